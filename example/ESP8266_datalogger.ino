@@ -2,6 +2,15 @@
 #include <SD.h>
 #include "SdList.h"
 #include "FtpServer.h"
+#include "HttpFileServer.h"
+#include "LogFile.h"
+#include "RingLog.h"
+#include "SensorBus.h"
+#include "Telemetry.h"
+#include "Rollup.h"
+#include "SamplePacer.h"
+#include "Scheduler.h"
+#include "MemStats.h"
 
 #include "MAX17043.h"
 
@@ -29,7 +38,7 @@ bool sleepStatus;
 //==== temperature sensor ===//
 #define ONE_WIRE_BUS 10
 OneWire oneWire(ONE_WIRE_BUS);
-DallasTemperature sensors(&oneWire);
+SensorBus probes(&oneWire);   // probes at several depths, searched once
 
 //==== range finder =====//
 const int pwPin = 5; 
@@ -38,8 +47,20 @@ long pulse, inches, cm;
 
 //======= SD card =======//
 const uint8_t chipSelect = 15;
+// 1: the log is a ring that keeps the newest records, for years without a
+//   visit. 0: it grows until its extent is full
+#ifndef RING_LOG
+#define RING_LOG 0
+#endif
+#if RING_LOG
+char fileName[] = "Bush.rng";
+RingLog logFile;   // sent as CSV lines by RETR, see SITE RING
+#else
 char fileName[] = "Bush.csv";
-File file;
+LogFile logFile;   // preallocated on first use, appended without reading the FAT
+#endif
+String logHeader;  // first lines of a new log
+const uint32_t minFreeKB = 1024;  // stop logging when less is left on the card
   //===== NTP stuff =====//
   unsigned int localPort = 8888;      // local port to listen for UDP packets
   const char timeServer[] = "3.nz.pool.ntp.org";  // NTP server 
@@ -49,6 +70,26 @@ File file;
   // Update these with values suitable for your network.
   IPAddress server(10, 13, 0, 136);
   PubSubClient client(server);
+
+// Samples queued in RTC memory and published in batches while WiFi is up
+Telemetry telemetry;
+class MqttSink : public TelemetrySink
+{
+public:
+  MqttSink(const char* t) : topic(t) {}
+  bool publish(const uint8_t* payload, uint16_t len)
+  {
+    return client.connected() &&
+           client.publish(MQTT::Publish(topic, payload, len).set_qos(1));
+  }
+private:
+  const char* topic;
+};
+MqttSink mqttSink("datalogger/telemetry");
+
+// Hourly and daily min/max/mean, in ROLLHOUR.CSV and ROLLDAY.CSV
+Rollup rollup;
+MqttSink rollupSink("datalogger/rollup");
     
   //rtc timer variables
   unsigned long rtc_start_time = millis(); //used for the count down timer
@@ -56,12 +97,25 @@ File file;
 
   
 volatile int watchdogCount = 0;
-const int sleepSeconds = 10;
+const int sleepSeconds = 10;   // cadence of the samples in the FTP window
+
+// Deep sleep between two samples, from the rate of change of the water
+SamplePacer pacer;
+
+// While the FTP server is up, sampling goes on at the cadence of the wakes:
+//   the sample task comes first, then MQTT, and the FTP and HTTP servers
+//   get the rest
+Scheduler sched;
+int8_t sampleTaskId = -1;
+#define PRIO_SAMPLE 0
+#define PRIO_MQTT   1
+#define PRIO_FTP    2
 
 MAX17043 batteryMonitor;
 
 SdList sdl;
 FtpServer ftpSrv;
+HttpFileServer httpSrv;   // GET of the logs with Range, for scripted collectors
  String webString = "";   // String to display
 
  /*------------ RTC----------- */
@@ -82,6 +136,14 @@ String returnDateTime(const RtcDateTime& dt)
   return datestring;
 }
 
+// Time stamp of the files written on the SD card, shown by MLSD and MDTM
+void sdDateTime(uint16_t* date, uint16_t* time)
+{
+  RtcDateTime now = Rtc.GetDateTime();
+  *date = FAT_DATE(now.Year(), now.Month(), now.Day());
+  *time = FAT_TIME(now.Hour(), now.Minute(), now.Second());
+}
+
 // Callback function
 void callback(const MQTT::Publish& pub) {
   if(pub.payload_string().equals("rtc set"))
@@ -111,7 +173,12 @@ void configModeCallback (WiFiManager *myWiFiManager) {
   //if you used auto generated SSID, print it
   Serial.println(myWiFiManager->getConfigPortalSSID());
 }
-void FTP_WiFiConfig(){
+// Bring up what the FTP window needs, once per wake: nothing of it is
+//   touched on the wakes that only take a sample
+bool networkUp = false;
+void startNetwork(){
+  if (networkUp) return;
+  networkUp = true;
    batteryMonitor.reset();
   batteryMonitor.quickStart();
   delay(100);
@@ -168,65 +235,128 @@ void FTP_WiFiConfig(){
     Rtc.SetSquareWavePin(DS3231SquareWavePin_ModeNone);
     client.set_callback(callback); 
   
-  if (client.connect("arduinoClient")) { 
+  // Persistent session: the broker keeps the subscription and QoS 1 messages
+  if (client.connect(MQTT::Connect("arduinoClient").unset_clean_session())) { 
     client.publish("outTopic","rtc boot up"); 
     client.subscribe("inTopic"); 
   }  
   setRTC();
   
   ftpSrv.init();
-  const unsigned long ftp_time_out = 1*60*3*100000; //3*60*3*100000 = 4.30 min timeout for the knob turn in thousandths of a second (60*1000 = 10 mins)
-  unsigned long ftp_start_time = 0; //used for the count down timer
-  while(ftp_start_time<=ftp_time_out){
-    ftpSrv.service();ftp_start_time++; 
+#if RING_LOG
+  ftpSrv.setRing(&logFile);  // RETR in order, SITE RING
+#else
+  ftpSrv.setLog(&logFile);   // SITE SNAPSHOT
+#endif
+  httpSrv.init();
+  sampleTaskId = sched.add(sampleTask, sleepSeconds * 1000UL, PRIO_SAMPLE);
+  sched.add(mqttTask, 100, PRIO_MQTT);
+  sched.add(ftpTask, 0, PRIO_FTP);
+  sched.add(httpTask, 0, PRIO_FTP);   // takes turns with the FTP server
+}
+
+// FTP window: serve clients and keep sampling, for 4.30 min
+void FTP_WiFiConfig(){
+  startNetwork();
+  if (!client.connected() &&
+      client.connect(MQTT::Connect("arduinoClient").unset_clean_session())) {
+    client.subscribe("inTopic");
+  }
+  rollup.setSink(&rollupSink);
+  const unsigned long ftp_time_out = 270000UL; // 4.30 min timeout for the knob turn in thousandths of a second
+  unsigned long ftp_start_time = millis(); //used for the count down timer
+  while(millis() - ftp_start_time <= ftp_time_out){
+    sched.run();
   }  
+  rollup.setSink(NULL);
    
 }
+// Tasks of the FTP window
+void sampleTask() {
+  if (sample()) {   // let FTP clients see the new lines
+    logFile.sync();
+    rollup.sync();
+  }
+}
+void mqttTask() {
+  client.loop();
+  if (client.connected()) telemetry.flush(&mqttSink);
+}
+void ftpTask() {
+  ftpSrv.service();
+}
+void httpTask() {
+  httpSrv.service();
+}
+
 void setup()
 { 
+ MemStats::begin();   // stack depths are counted from here, see SITE MEM
  stopWiFi();
  Serial.begin(9600);
- pinMode(TRIGGER_SLEEP_PIN, INPUT);
   //--------RTC SETUP ------------
+  // Rtc.Begin() starts the I2C bus on its default pins, that are the trigger
+  //   and the range finder pins here: set them after it
   Rtc.Begin();
 #if defined(ESP8266)
   Wire.begin(0, 2); //SDA,SCL
 #endif
+  pinMode(TRIGGER_SLEEP_PIN, INPUT);
+  pinMode(pwPin, INPUT);
+  SdFile::dateTimeCallback(sdDateTime);
 
-  sensors.begin();
+  probes.begin();
+  telemetry.begin();
+  rollup.begin();
+  pacer.begin();
 
-   pinMode(15, OUTPUT);
-   if (!SD.begin(chipSelect)){
+   // Single mount of the card, shared by the log and the servers
+   if (!sdl.begin(chipSelect)){
         Serial.println("Card failed, or not present");
         return;
    }
-   if(sdl.begin(15) == 0){
-     Serial.println(("SD init fail"));
-   }  
-
-   // Create a file and header
-   if(! SD.exists(fileName)){
-     file = SD.open(fileName, FILE_WRITE);
-     if(file){
-      file.println(", , ,"); 
-      file.println("Water Height (cm), Water Temperature (C), Date, Time");
-      file.close();
-      return; }
+
+   // Open the log, a new one starts with the header (also after SITE
+   //   SNAPSHOT). The place of the log is kept in RTC memory: no directory
+   //   read on a sampling wake
+   logHeader = ", , ,\r\nWater Height (cm), Water Temperature (C), Date, Time";
+   for (uint8_t i = 2; i <= probes.count(); i++) {
+     logHeader += ", Water Temperature "; logHeader += i; logHeader += " (C)";
+   }
+   logHeader += ", Interval (s)";
+#if !RING_LOG
+   logHeader += ", Record, CRC";
+   logFile.journal(true);   // a line torn by a loss of power is cleared at boot
+#endif
+   logFile.dateTimeCallback(sdDateTime);
+   logFile.header(logHeader.c_str());
+   if(!logFile.begin(fileName)){
+     Serial.println(F("log open failed"));
+   }
+   else if(logFile.isNew()){
+      return;
    }
   while(digitalRead(TRIGGER_SLEEP_PIN) ==  LOW) {
-    if(! SD.exists(fileName)){
-    file = SD.open(fileName, FILE_WRITE);
-    if(file){file.println(", , ,"); 
-      file.println("Water Height (cm), Water Temperature (C), Date, Time");
-      file.close();}
-      FTP_WiFiConfig();
-   }else{ FTP_WiFiConfig();}
+    logFile.sync();   // let FTP clients see the whole log
+    rollup.sync();
+    FTP_WiFiConfig();
+    logFile.begin(fileName);   // the log may have been deleted by a client
   }
 }
 
 void loop()
 {
-    Serial.println("Wake up");
+  Serial.println("Wake up");
+  sample();
+  stopWiFiAndSleep();
+}
+
+// Read the sensors and append a line to the log
+//
+// return:
+//    false if the card is full or the line can't be written
+bool sample()
+{
     if (!Rtc.IsDateTimeValid()) 
     {Serial.println("RTC lost confidence in the DateTime!");}
    
@@ -246,32 +376,47 @@ void loop()
   cm = (pulse/147) * 2.54;
     
     //===== DS18B20====//
-    float temperature = (sensors.getTempCByIndex(0));
-    sensors.requestTemperatures(); // Send the command to get temperatures
+    float temps[SENSOR_MAX];
+    probes.read(temps);   // conversion started at the previous wake
+    probes.start();       // one conversion for all probes, read at the next wake
+    float temperature = probes.count() > 0 ? temps[0] : DEVICE_DISCONNECTED_C;
   
    String dataString = String(cm) + ", " + String(temperature) + ", " + String(datestring) + "," + String(timestring);
+   for (uint8_t i = 1; i < probes.count(); i++) {
+     dataString += ", "; dataString += String(temps[i]);
+   }
+   // seconds since the previous sample, and the sleep to the next one
+   dataString += ", "; dataString += String(pacer.update(now.TotalSeconds(), cm, temperature));
+   MemStats::sample(MEM_AT_SAMPLE);   // with the Strings of the line on the heap
   
-    file = SD.open(fileName, FILE_WRITE);
-  if (!file) {
-    Serial.println(F("open failed"));
-    return;
+#if !RING_LOG
+  // Keep the end of the card free: the logger stops, FTP still works. A
+  // preallocated log takes clusters once its extent is full
+  if ((!logFile.isContiguous() || logFile.room() < LOG_LINE_MAX) &&
+      sdl.freeKB() < minFreeKB) {
+    Serial.println(F("card full"));
+    return false;
   }
+#endif
   Serial.println(dataString);
-  file.println(dataString);
-  file.close();
-
-  stopWiFiAndSleep();
+  telemetry.push(now.TotalSeconds(), cm, temperature);
+  rollup.add(now.TotalSeconds(), cm, temperature);
+  if (!logFile.println(dataString.c_str())) {
+    Serial.println(F("log write failed"));
+    return false;
+  }
+  return true;
 }
 void stopWiFi() {
     WiFi.mode(WIFI_OFF); 
     WiFi.forceSleepBegin();
     delay(1);
 }
-void stopWiFiAndSleep() {// Sleep for 10 seconds
+void stopWiFiAndSleep() {// Sleep until the next sample, see SamplePacer
     WiFi.mode(WIFI_OFF);
     WiFi.forceSleepBegin();
     delay(1); 
-    ESP.deepSleep(10*1000000, WAKE_RF_DEFAULT); 
+    ESP.deepSleep(pacer.seconds()*1000000ULL, WAKE_RF_DEFAULT); 
     delay(100);
 }
 
@@ -320,7 +465,7 @@ void setRTC()
   }
 }
 
-unsigned long sendNTPpacket(const char*)
+void sendNTPpacket(const char*)
 {
   memset(packetBuffer, 0, NTP_PACKET_SIZE);
   // Initialize values needed to form NTP request
@@ -0,0 +1,612 @@
+#!/usr/bin/env python3
+#
+# Check the servers of the datalogger on the host
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Builds the wake-cycle simulator with ports that need no rights, runs it
+# with --serve on a new card image, and checks what FTP clients see:
+#   a session recorded by SITE TRACE, then replayed by ftp_replay.py,
+#   without and with --allow-writes;
+#   digests of HASH and XMD5 after the file is written, deleted, renamed,
+#   and that the cache of the digests is out of reach;
+#   the HTTP server with http_check.py, and the FTP directory it leaves;
+#   MODE Z downloads, inflated with zlib (ftp_zbench.py and listings);
+#   a client that drops its session in the middle of RETR and STOR;
+#   the content of SITE TAR archives, with a command sent during one;
+#   when the index of a directory is built, and that its files can't be
+#   reached by a name (the root directory of the image is read here);
+#   the free space counted, against a scan of the FAT.
+# Then runs two days of wakes with power cuts while the log is written
+#   (--tear), and checks the journal on the image, and the cost of its
+#   recovery. Then builds the sketch with a ring log of a few blocks,
+#   turned over by wakes, and checks RETR and SITE RING of the ring. Then
+#   builds and runs the checks of the library without the sketch:
+#   telemetry_test.cpp, log_test.cpp, rollup_test.cpp.
+#
+# usage, from the root of the repository:
+#   extras/WakeSim/host_test.py
+#   extras/WakeSim/host_test.py --keep-dir /tmp/wake   (build and image kept)
+
+import argparse
+import binascii
+import csv
+import ftplib
+import hashlib
+import http.client
+import io
+import os
+import random
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tarfile
+import tempfile
+import time
+import zlib
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", ".."))
+FTP_PORT = 2121
+PASV_PORT = 2122
+HTTP_PORT = 8080
+USER = "Ukrit"
+PASSWORD = "Khonglao"
+RING_RECORD_SIZE = 64   # as in RingLog.h
+
+failures = 0
+
+
+def check(what, cond):
+    global failures
+    print("%-50s %s" % (what, "ok" if cond else "FAILED"))
+    if not cond:
+        failures += 1
+
+
+def build(workdir, main="wake_sim", defines=(), name=None):
+    """Build the simulator, or another main of extras/WakeSim, in workdir,
+    with more -D defines, return the path of the program"""
+    exe = os.path.join(workdir, name or main)
+    sources = [os.path.join(ROOT, "extras/WakeSim", main + ".cpp")]
+    for d in ("extras/WakeSim/mock", "src"):
+        sources += sorted(os.path.join(ROOT, d, f) for f in os.listdir(os.path.join(ROOT, d))
+                          if f.endswith(".cpp"))
+    cmd = ["g++", "-std=gnu++11", "-O2", "-w",
+           "-DFTP_CTRL_PORT=%d" % FTP_PORT, "-DFTP_DATA_PORT_PASV=%d" % PASV_PORT,
+           "-DHTTP_PORT=%d" % HTTP_PORT] + ["-D" + d for d in defines] + [
+           "-I" + os.path.join(ROOT, "extras/WakeSim/mock"), "-I" + os.path.join(ROOT, "src"),
+           "-o", exe] + sources
+    subprocess.run(cmd, check=True)
+    return exe
+
+
+def serve(exe, workdir, image="card.img", log="BUSH.CSV", keep=False):
+    """Start the simulator on a new card image, or on the one there with
+    keep, wait for the FTP server
+
+    The first wake creates the log and sleeps: its server may accept a
+    client and go away. Wait for a wake that lists the log."""
+    image = os.path.join(workdir, image)
+    if os.path.exists(image) and not keep:
+        os.remove(image)
+    proc = subprocess.Popen([exe, "--serve", "--image", image] + (["--keep"] if keep else []),
+                            cwd=workdir, stdout=subprocess.DEVNULL)
+    for _ in range(100):
+        try:
+            ftp = login()
+            names = ftp.nlst()
+            ftp.quit()
+            if log in names:
+                return proc
+        except (OSError, EOFError, ftplib.Error):
+            pass
+        time.sleep(0.2)
+    proc.kill()
+    sys.exit("the simulator does not serve FTP")
+
+
+def login():
+    ftp = ftplib.FTP()
+    ftp.connect("127.0.0.1", FTP_PORT, timeout=20)
+    ftp.login(USER, PASSWORD)
+    return ftp
+
+
+def retrieve(ftp, name):
+    b = io.BytesIO()
+    ftp.retrbinary("RETR " + name, b.write)
+    return b.getvalue()
+
+
+def test_replay(workdir):
+    """Record a session that changes the card, replay it both ways"""
+    ftp = login()
+    ftp.sendcmd("SITE TRACE ON")
+    ftp.quit()
+    ftp = login()
+    ftp.nlst()
+    retrieve(ftp, "BUSH.CSV")
+    ftp.storbinary("STOR REPLAY.TXT", io.BytesIO(b"x" * 3000))
+    ftp.sendcmd("SIZE REPLAY.TXT")
+    ftp.delete("REPLAY.TXT")
+    ftp.quit()
+    ftp = login()
+    ftp.sendcmd("SITE TRACE OFF")
+    trace = retrieve(ftp, "FTPTRACE.TXT")
+    ftp.storbinary("STOR KEEP.TXT", io.BytesIO(b"k" * 100))
+    ftp.quit()
+    path = os.path.join(workdir, "FTPTRACE.TXT")
+    with open(path, "wb") as f:
+        f.write(trace)
+    check("trace holds the session", b"C " in trace and b"STOR REPLAY.TXT" in trace)
+
+    # Without --allow-writes: STOR and DELE are skipped, the card is the same
+    replay = [sys.executable, os.path.join(ROOT, "extras/ftp_replay.py"), path,
+              "127.0.0.1", "--port", str(FTP_PORT), "--user", USER,
+              "--password", PASSWORD, "--speed", "0"]
+    r = subprocess.run(replay, capture_output=True, text=True)
+    check("replay runs", r.returncode == 0)
+    check("replay skips STOR and DELE", "skipped" in r.stdout and "STOR" in r.stdout
+          and "DELE" in r.stdout)
+    ftp = login()
+    names = ftp.nlst()
+    check("replay leaves the card as it was", "KEEP.TXT" in names and "REPLAY.TXT" not in names)
+    ftp.quit()
+
+    # With --allow-writes: the file is stored again, then deleted again
+    r = subprocess.run(replay + ["--allow-writes", "-v"], capture_output=True, text=True)
+    check("replay --allow-writes runs", r.returncode == 0)
+    check("replay --allow-writes stores and deletes",
+          "skipped" not in r.stdout and "226" in r.stdout and "250 Deleted" in r.stdout)
+
+
+def test_hash():
+    """The digests of a name follow its content, never a cached state"""
+    def xmd5(ftp, name, *rng):
+        return ftp.sendcmd(" ".join(("XMD5", name) + tuple(str(r) for r in rng))).split()[1]
+
+    def md5(data):
+        return hashlib.md5(data).hexdigest()
+
+    # Same first bytes: only the cache key tells the files apart
+    head = b"time,height\r\n" * 50
+    a1, a2, a3, c = (head + b"1" * 5000, head + b"2" * 5000, head + b"3" * 7000,
+                     head + b"c" * 4000)
+    ftp = login()
+    ftp.storbinary("STOR HASH.TXT", io.BytesIO(a1))
+    check("XMD5 of a range", xmd5(ftp, "HASH.TXT", 0, 2000) == md5(a1[:2000]))
+    check("XMD5 of a file", xmd5(ftp, "HASH.TXT") == md5(a1))
+    check("HASH of a file", ftp.sendcmd("HASH HASH.TXT").split()[3] == md5(a1))
+
+    ftp.storbinary("STOR HASH.TXT", io.BytesIO(a2))
+    check("XMD5 after STOR over the file", xmd5(ftp, "HASH.TXT") == md5(a2))
+
+    ftp.delete("HASH.TXT")
+    ftp.storbinary("STOR HASH.TXT", io.BytesIO(a3))
+    check("XMD5 after DELE and STOR", xmd5(ftp, "HASH.TXT", 0, 2000) == md5(a3[:2000])
+          and xmd5(ftp, "HASH.TXT") == md5(a3))
+
+    ftp.rename("HASH.TXT", "MOVED.TXT")
+    ftp.storbinary("STOR HASH.TXT", io.BytesIO(c))
+    check("XMD5 after RNTO", xmd5(ftp, "HASH.TXT") == md5(c)
+          and xmd5(ftp, "MOVED.TXT") == md5(a3))
+    ftp.delete("HASH.TXT")
+    ftp.delete("MOVED.TXT")
+
+    # The cache of the digests is the server's own
+    listed = ftp.nlst() + [line.split(";")[-1].strip() for line in mlsd_lines(ftp)]
+    refused = True
+    for cmd in ("RETR HASHES.DAT", "SIZE HASHES.DAT", "DELE hashes.dat", "RNFR HASHES.DAT"):
+        try:
+            refused = refused and ftp.sendcmd(cmd).startswith("5")
+        except ftplib.error_perm:
+            pass
+    try:
+        ftp.storbinary("STOR HASHES.DAT", io.BytesIO(b"x"))
+        refused = False
+    except ftplib.error_temp:
+        pass
+    check("cache of the digests hidden", "HASHES.DAT" not in listed and refused)
+    ftp.quit()
+
+
+def mlsd_lines(ftp):
+    lines = []
+    ftp.retrlines("MLSD", lines.append)
+    return lines
+
+
+def test_http():
+    """http_check.py on the log; a GET leaves the FTP session where it is"""
+    r = subprocess.run([sys.executable, os.path.join(ROOT, "extras/http_check.py"),
+                        "127.0.0.1", "/BUSH.CSV", "--port", str(HTTP_PORT)],
+                       capture_output=True, text=True)
+    print(r.stdout, end="")
+    check("http_check.py", r.returncode == 0)
+
+    # The server opens files from a handle of its own: a FTP session in
+    # the middle of a transfer does not see its directory move
+    ftp = login()
+    ftp.voidcmd("TYPE I")
+    data = ftp.transfercmd("RETR BUSH.CSV")
+    conn = http.client.HTTPConnection("127.0.0.1", HTTP_PORT, timeout=10)
+    conn.request("GET", "/BUSH.CSV")
+    r = conn.getresponse()
+    body = r.read()
+    conn.close()
+    ftp_body = b""
+    while True:
+        b = data.recv(4096)
+        if not b:
+            break
+        ftp_body += b
+    data.close()
+    ftp.voidresp()
+    check("GET of the log during a RETR", r.status == 200 and body.startswith(ftp_body[:100]))
+    check("FTP session after a GET", ftp.pwd() == "/" and "BUSH.CSV" in ftp.nlst())
+    ftp.quit()
+
+
+def test_deflate():
+    """MODE Z: what the server sends inflates to the file, at each level"""
+    rnd = random.Random(41)
+    lines = ["%d, %.2f, 10/19/2026,%02d:%02d:%02d, %d\r\n"
+             % (i, 20 + rnd.random() * 5, i // 3600 % 24, i // 60 % 60, i % 60, rnd.randint(0, 3))
+             for i in range(3000)]
+    data = "".join(lines).encode() + bytes(rnd.getrandbits(8) for _ in range(20000))
+    ftp = login()
+    ftp.storbinary("STOR ZTEST.CSV", io.BytesIO(data))
+    ftp.quit()
+    r = subprocess.run([sys.executable, os.path.join(ROOT, "extras/ftp_zbench.py"), "127.0.0.1",
+                        "ZTEST.CSV", "--port", str(FTP_PORT), "--user", USER,
+                        "--password", PASSWORD, "--levels", "1", "6", "9"],
+                       capture_output=True, text=True)
+    print(r.stdout, end="")
+    check("ftp_zbench.py: RETR in MODE Z at levels 1, 6, 9", r.returncode == 0)
+    check("SITE ZBENCH", "level 9:" in r.stdout)
+
+    ftp = login()
+    plain = []
+    ftp.retrlines("NLST", plain.append)
+    ftp.voidcmd("TYPE I")
+    ftp.voidcmd("MODE Z")
+    raw = io.BytesIO()
+    ftp.retrbinary("NLST", raw.write)
+    ftp.voidcmd("MODE S")
+    try:
+        names = zlib.decompress(raw.getvalue()).decode().split("\r\n")[:-1]
+    except zlib.error:
+        names = None
+    check("NLST in MODE Z", names == plain)
+    ftp.delete("ZTEST.CSV")
+    ftp.quit()
+
+
+def pasv_data(ftp, cmd):
+    """Send a transfer command on a data connection of a small window,
+    that the server can't fill at once"""
+    host, port = ftplib.parse227(ftp.sendcmd("PASV"))
+    data = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    data.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+    data.connect((host, port))
+    ftp.putcmd(cmd)
+    check("%s accepted" % cmd, ftp.getline().startswith("150"))
+    return data
+
+
+def test_drop():
+    """A client that goes away in the middle of a transfer: the file is
+    closed with the session"""
+    big = b"r" * 400000
+    ftp = login()
+    ftp.storbinary("STOR DROP.TXT", io.BytesIO(big))
+    ftp.voidcmd("TYPE I")
+    data = pasv_data(ftp, "RETR DROP.TXT")
+    data.recv(4096)
+    ftp.close()                 # no QUIT
+    time.sleep(0.5)
+    data.close()
+    time.sleep(0.5)
+    ftp = login()
+    check("RETR after a client dropped during a RETR",
+          retrieve(ftp, "BUSH.CSV") != b"" and retrieve(ftp, "DROP.TXT") == big)
+
+    ftp.voidcmd("TYPE I")
+    data = pasv_data(ftp, "STOR DROPPED.TXT")
+    data.sendall(b"s" * 20000)
+    time.sleep(0.5)
+    ftp.close()                 # no QUIT
+    time.sleep(0.5)
+    data.close()
+    time.sleep(0.5)
+    ftp = login()
+    ftp.voidcmd("TYPE I")
+    check("STOR kept when the client dropped during it", ftp.size("DROPPED.TXT") == 20000)
+    ftp.delete("DROP.TXT")
+    ftp.delete("DROPPED.TXT")
+    ftp.quit()
+
+
+def test_tar():
+    """SITE TAR sends the files in an archive, whole, even when commands
+    come while it is sent"""
+    # Small files: headers and padding are a large part of the archive
+    files = {"T%02d.CSV" % i: bytes([65 + i % 26]) * (100 + 37 * i) for i in range(40)}
+    ftp = login()
+    for name, body in files.items():
+        ftp.storbinary("STOR " + name, io.BytesIO(body))
+
+    def archive(during=0):
+        ftp.voidcmd("TYPE I")
+        data = pasv_data(ftp, "SITE TAR T*.CSV")
+        for _ in range(during):     # read one character at a time by the server
+            ftp.putcmd("XMD5 T05.CSV 0 100")
+        raw = b""
+        while True:
+            b = data.recv(4096)
+            if not b:
+                break
+            raw += b
+        data.close()
+        replies = [ftp.getmultiline() for _ in range(during + 1)]
+        with tarfile.open(fileobj=io.BytesIO(raw), mode="r:") as tar:
+            got = {m.name: tar.extractfile(m).read() for m in tar.getmembers()}
+        return raw, got, replies
+
+    clean, got, replies = archive()
+    check("SITE TAR: the files, in an archive", got == files and replies[0].startswith("226"))
+    raw, got, replies = archive(100)
+    during = [r for r in replies if r.startswith("450")]
+    check("SITE TAR: digests asked meanwhile are refused",
+          len(during) > 0 and all(r.startswith("450") for r in replies[:len(during)]) and
+          replies[len(during)].startswith("226"))
+    check("SITE TAR: the archive stays the same", raw == clean)
+    for name in files:
+        ftp.delete(name)
+    ftp.quit()
+
+
+def test_free():
+    """The free space kept up to date is the one a scan of the FAT finds,
+    after each command that gives back or takes clusters"""
+    ftp = login()
+
+    def same(what):
+        tracked = ftp.sendcmd("SITE FREE")
+        scanned = ftp.sendcmd("SITE FREE SCAN")
+        check("SITE FREE after %s" % what, tracked == scanned)
+        if tracked != scanned:
+            print("  %s, scan: %s" % (tracked, scanned))
+
+    ftp.sendcmd("SITE FREE SCAN")
+    ftp.storbinary("STOR FREE.TXT", io.BytesIO(b"f" * 300000))
+    same("STOR of a new file")
+    ftp.storbinary("STOR FREE.TXT", io.BytesIO(b"g" * 1000))
+    same("STOR over a file")
+    ftp.rename("FREE.TXT", "FREE2.TXT")
+    same("RNTO")
+    ftp.delete("FREE2.TXT")
+    same("DELE")
+    ftp.sendcmd("SITE SNAPSHOT FREE.CSV")
+    same("SITE SNAPSHOT")
+    ftp.storbinary("STOR BUSH.CSV", io.BytesIO(b"h" * 1000))
+    same("STOR over the preallocated log")
+    ftp.delete("FREE.CSV")
+    same("DELE of a snapshot")
+    ftp.quit()
+
+
+def root_entries(image):
+    """Entries of the root directory of the FAT16 image, as the card has
+    them: name, first cluster, size"""
+    with open(image, "rb") as f:
+        boot = f.read(512)
+        bps, spc, reserved, fats, entries = struct.unpack_from("<HBHBH", boot, 11)
+        fat_size = struct.unpack_from("<H", boot, 22)[0]
+        f.seek((reserved + fats * fat_size) * bps)
+        root = f.read(entries * 32)
+    found = []
+    for i in range(0, len(root), 32):
+        e = root[i:i + 32]
+        if e[0] == 0:
+            break
+        if e[0] == 0xE5 or e[11] & 0x08:
+            continue
+        base, ext = e[:8].decode().rstrip(), e[8:11].decode().rstrip()
+        found.append((base + ("." + ext if ext else ""),
+                      struct.unpack_from("<H", e, 26)[0], struct.unpack_from("<I", e, 28)[0]))
+    return found
+
+
+def root_names(image):
+    """Names of the root directory of the FAT16 image"""
+    return [e[0] for e in root_entries(image)]
+
+
+def root_file(image, name):
+    """Content of a file of the root directory, following its FAT chain"""
+    cluster, size = next((c, n) for e, c, n in root_entries(image) if e == name)
+    with open(image, "rb") as f:
+        boot = f.read(512)
+        bps, spc, reserved, fats, entries = struct.unpack_from("<HBHBH", boot, 11)
+        fat_size = struct.unpack_from("<H", boot, 22)[0]
+        f.seek(reserved * bps)
+        fat = f.read(fat_size * bps)
+        data = (reserved + fats * fat_size) * bps + entries * 32
+        content = b""
+        while len(content) < size and 2 <= cluster < 0xFFF8:
+            f.seek(data + (cluster - 2) * spc * bps)
+            content += f.read(spc * bps)
+            cluster = struct.unpack_from("<H", fat, cluster * 2)[0]
+    return content[:size]
+
+
+def test_index(workdir):
+    """The index is built by SITE INDEX or for a large directory only, and
+    is out of reach of the commands that take a name"""
+    image = os.path.join(workdir, "card.img")
+    ftp = login()
+    ftp.nlst()
+    ftp.retrlines("LIST", lambda line: None)
+    ftp.retrlines("MLSD", lambda line: None)
+    check("no index for listings of a small directory", "DIRINDEX.IDX" not in root_names(image))
+
+    names = ["F%03d.TXT" % i for i in range(70)]
+    for n in reversed(names):
+        ftp.storbinary("STOR " + n, io.BytesIO(n.encode()))
+    listed = ftp.nlst()
+    check("index built for a listing of 70 files", "DIRINDEX.IDX" in root_names(image))
+    check("listing in the order of the names", [n for n in listed if n in names] == names
+          and "DIRINDEX.IDX" not in listed)
+
+    refused = []
+    for cmd in ("RETR DIRINDEX.IDX", "SIZE DIRINDEX.IDX", "MDTM DIRINDEX.IDX",
+                "DELE DIRINDEX.IDX", "RNFR DIRINDEX.IDX", "XMD5 DIRINDEX.IDX",
+                "MLST DIRINDEX.IDX", "SIZE dirindex.tmp", "MKD DIRINDEX.TMP"):
+        try:
+            reply = ftp.sendcmd(cmd)
+        except ftplib.error_perm as e:
+            reply = str(e)
+        if not reply.startswith("5"):
+            refused.append(cmd)
+    try:
+        ftp.storbinary("STOR DIRINDEX.IDX", io.BytesIO(b"x"))
+        refused.append("STOR")
+    except ftplib.error_temp:
+        pass
+    ftp.sendcmd("RNFR F000.TXT")
+    try:
+        ftp.sendcmd("RNTO DIRINDEX.IDX")
+        refused.append("RNTO")
+    except ftplib.error_perm:
+        pass
+    check("names of the index can't be reached", refused == [])
+    check("index still there", "DIRINDEX.IDX" in root_names(image))
+
+    for n in names:
+        ftp.delete(n)
+    check("index kept up to date", "F000.TXT" not in ftp.nlst())
+    ftp.sendcmd("SITE INDEX")
+    check("SITE INDEX builds an index", "DIRINDEX.IDX" in root_names(image))
+    ftp.quit()
+
+
+def test_tear(exe, workdir):
+    """Power cut while a block of the log is written, at every 7th wake:
+    the journal stays whole, and finding its end costs the same on the
+    last days as on the first"""
+    image = os.path.join(workdir, "tear.img")
+    wakes = os.path.join(workdir, "tear.csv")
+    subprocess.run([exe, "--days", "2", "--tear", "7", "--image", image, "--csv", wakes],
+                   cwd=workdir, stdout=subprocess.DEVNULL, check=True)
+    lines = root_file(image, "BUSH.CSV").split(b"\r\n")[2:-1]
+    seqs, crcs = [], True
+    for line in lines:
+        text, seq, crc = line.rsplit(b", ", 2)
+        seqs.append(int(seq))
+        crcs = crcs and binascii.crc_hqx(line[:-4], 0xFFFF) == int(crc, 16)
+    check("journal: sequence numbers follow", len(seqs) > 1000 and
+          seqs == list(range(1, len(seqs) + 1)))
+    check("journal: CRC of every line", crcs)
+
+    # The wakes cut are not in the CSV: reads of the wake after each
+    with open(wakes) as f:
+        rows = list(csv.DictReader(f))
+    done = set(int(r["wake"]) for r in rows)
+    after = [int(r["reads"]) for r in rows if int(r["wake"]) > 0 and int(r["wake"]) - 1 not in done]
+    quarter = len(after) // 4
+    check("reads after a loss of power stay flat", quarter > 10 and
+          max(after[-quarter:]) <= max(after[:quarter]) + 16)
+    if quarter > 0:
+        print("  blocks read after a loss: %d on the first half day, %d on the last" %
+              (max(after[:quarter]), max(after[-quarter:])))
+
+
+def ring_records(image, name):
+    """Texts of the records of a ring log of the image, by sequence number,
+    read from the card (the header of the ring may be behind)"""
+    data = root_file(image, name)
+    capacity = struct.unpack_from("<I", data, 12)[0]
+    records = {}
+    for i in range(512, 512 + capacity * RING_RECORD_SIZE, RING_RECORD_SIZE):
+        seq, n = struct.unpack_from("<IB", data, i)
+        if seq > 0:
+            records[seq] = data[i + 5:i + 5 + n]
+    last = max(records)
+    return capacity, [records[s] for s in range(last - capacity + 1, last + 1)], last - capacity + 1
+
+
+def test_ring(workdir):
+    """Build the sketch with a ring log of a few blocks, run wakes until it
+    turned several times, then serve the card: RETR sends the records
+    oldest first, and after SITE RING <seq> from that record on"""
+    exe = build(workdir, defines=("RING_LOG=1", "RING_PREALLOC_SIZE=4096"), name="wake_ring")
+    image = os.path.join(workdir, "ring.img")
+    subprocess.run([exe, "--days", "0.5", "--image", image],
+                   cwd=workdir, stdout=subprocess.DEVNULL, check=True)
+    proc = serve(exe, workdir, "ring.img", "BUSH.RNG", keep=True)
+    try:
+        ftp = login()
+        # A sample may be taken meanwhile: read again until the card is the same
+        for _ in range(5):
+            capacity, records, first = ring_records(image, "BUSH.RNG")
+            lines = retrieve(ftp, "BUSH.RNG").split(b"\r\n")[2:-1]
+            skip = first + capacity // 3
+            ftp.sendcmd("SITE RING %d" % skip)
+            since = retrieve(ftp, "BUSH.RNG").split(b"\r\n")[:-1]
+            if ring_records(image, "BUSH.RNG")[1] == records:
+                break
+        check("ring: turned on the card", first > capacity and len(records) == capacity)
+        check("ring: RETR sends the records oldest first", lines == records)
+        check("ring: SITE RING <seq> skips to that record", since == records[skip - first:])
+        ftp.quit()
+    finally:
+        proc.terminate()
+        proc.wait()
+
+
+def test_units(workdir):
+    """Checks of the library on the mocked card, each a program of its own"""
+    for main in ("telemetry_test", "log_test", "rollup_test"):
+        r = subprocess.run([build(workdir, main)], cwd=workdir, capture_output=True, text=True)
+        print(r.stdout, end="")
+        check(main, r.returncode == 0)
+
+
+def main():
+    p = argparse.ArgumentParser()
+    p.add_argument("--keep-dir", help="directory of the build and the card image, kept")
+    args = p.parse_args()
+
+    workdir = args.keep_dir or tempfile.mkdtemp(prefix="wake_host_")
+    os.makedirs(workdir, exist_ok=True)
+    exe = build(workdir)
+    proc = serve(exe, workdir)
+    try:
+        test_replay(workdir)
+        test_hash()
+        test_http()
+        test_deflate()
+        test_drop()
+        test_tar()
+        test_index(workdir)
+        test_free()             # last: writes over the log
+    finally:
+        proc.terminate()
+        proc.wait()
+    test_tear(exe, workdir)
+    test_ring(workdir)
+    test_units(workdir)
+    if not args.keep_dir:
+        shutil.rmtree(workdir)
+    print("%d failure(s)" % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
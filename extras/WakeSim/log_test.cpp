@@ -0,0 +1,211 @@
+/*
+ * Check of the log file when its extent can't be made or is full
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                         LOG FILE ON THE HOST                               **
+ **                                                                            **
+ *******************************************************************************/
+
+// Runs LogFile of src/ on the mocked card and RTC memory, without the
+//   sketch. A new LogFile object that calls begin() is a new wake.
+//
+//   - no extent: the card has no run of clusters for the extent, the log
+//     is appended through SdFile
+//   - full: a journal grows past the end of its small extent, then the
+//     RTC memory is lost; no line is lost, the sequence goes on
+//
+// Build and run, from the root of the repository (host_test.py does it):
+//
+//   g++ -std=gnu++11 -O2 -Iextras/WakeSim/mock -Isrc -o log_test
+//       extras/WakeSim/log_test.cpp extras/WakeSim/mock/*.cpp src/*.cpp
+//   ./log_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <string>
+#include "LogFile.h"
+#include "SdList.h"
+#include "SimState.h"
+#include "CardImage.h"
+
+#define TEST_IMAGE "log_test.img"
+
+SimState * sim;
+SdList sdl;
+
+void simDeepSleep( uint64_t us )
+{
+  exit( 0 );
+}
+
+static uint16_t failures = 0;
+
+static void check( const char * what, bool cond )
+{
+  printf( "%-50s %s\n", what, cond ? "ok" : "FAILED" );
+  if( ! cond )
+    failures ++;
+}
+
+// A new card and an empty RTC memory
+
+static void reset( const char * name )
+{
+  sdl.remove( name );
+  memset( sim->rtcMem, 0, sizeof( sim->rtcMem ));
+}
+
+// Content of a file of the root directory
+
+static std::string content( const char * name )
+{
+  SdFile f;
+  std::string s;
+  char buf[ 512 ];
+  int16_t n;
+
+  if( ! sdl.openRootFile( & f, name, O_READ ))
+    return s;
+  while(( n = f.read( buf, sizeof( buf ))) > 0 )
+    s.append( buf, n );
+  f.close();
+  return s;
+}
+
+// CRC of the lines of a journal, as LogFile makes it
+
+static uint16_t crc16( const char * p, size_t n )
+{
+  uint16_t crc = 0xFFFF;
+
+  while( n -- )
+  {
+    crc ^= (uint8_t) * p ++ << 8;
+    for( uint8_t i = 0; i < 8; i ++ )
+      crc = crc & 0x8000 ? ( crc << 1 ) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// Number of lines of a journal after its header, or -1 if one of them is
+//   not the next of "line <n>, <n>, <CRC>"
+
+static int journalLines( const std::string & s, const char * header )
+{
+  size_t pos = strlen( header ) + 2;
+  int n = 0;
+
+  if( s.compare( 0, pos, std::string( header ) + "\r\n" ))
+    return -1;
+  while( pos < s.size())
+  {
+    size_t end = s.find( "\r\n", pos );
+    char expected[ 40 ];
+    if( end == std::string::npos )
+      return -1;
+    n ++;
+    int len = snprintf( expected, sizeof( expected ), "line %d, %d, ", n, n );
+    snprintf( expected + len, sizeof( expected ) - len, "%04X", crc16( expected, len ));
+    if( s.compare( pos, end - pos, expected ))
+      return -1;
+    pos = end + 2;
+  }
+  return n;
+}
+
+static bool println( LogFile * log, int n )
+{
+  char line[ 20 ];
+  snprintf( line, sizeof( line ), "line %d", n );
+  return log->println( line );
+}
+
+static void testNoExtent()
+{
+  const char * header = "no extent";
+  LogFile log;
+  bool ok = true;
+
+  reset( "NOEXT.CSV" );
+  log.journal( true );
+  log.header( header );
+  check( "no extent: the log is made", log.begin( "NOEXT.CSV", 2 * sim->blocks * 512UL ) &&
+         ! log.isContiguous());
+  for( int i = 1; i <= 50; i ++ )
+    ok = println( & log, i ) && ok;
+  check( "no extent: lines appended", ok && journalLines( content( "NOEXT.CSV" ), header ) == 50 );
+  sdl.remove( "NOEXT.CSV" );
+}
+
+static void testFull()
+{
+  const char * header = "full";
+  bool ok = true;
+  int n = 0;
+
+  reset( "FULL.CSV" );
+  {
+    LogFile log;
+    log.journal( true );
+    log.header( header );
+    check( "full: a small extent is made", log.begin( "FULL.CSV", 4096 ) && log.isContiguous());
+    while( n < 300 )
+      ok = println( & log, ++ n ) && ok;
+    check( "full: lines appended past the extent", ok && ! log.isContiguous() &&
+           log.size() > 4096 );
+  }
+  memset( sim->rtcMem, 0xA5, sizeof( sim->rtcMem ));   // loss of power
+  {
+    LogFile log;
+    log.journal( true );
+    log.header( header );
+    ok = log.begin( "FULL.CSV", 4096 ) && ! log.isNew();
+    while( n < 320 )
+      ok = println( & log, ++ n ) && ok;
+  }
+  check( "full: the journal goes on after a loss of power", ok &&
+         journalLines( content( "FULL.CSV" ), header ) == 320 );
+  sdl.remove( "FULL.CSV" );
+}
+
+int main()
+{
+  uint32_t blocks;
+
+  sim = (SimState *) mmap( NULL, sizeof( SimState ), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+  memset( sim, 0, sizeof( SimState ));
+  sim->image = simOpenImage( TEST_IMAGE, 32, true, & blocks );
+  if( sim->image == NULL )
+    return 1;
+  sim->blocks = blocks;
+  sim->blockWrites = (uint32_t *) calloc( blocks, sizeof( uint32_t ));
+  if( ! sdl.begin( 15 ))
+  {
+    printf( "can't mount the card\n" );
+    return 1;
+  }
+
+  testNoExtent();
+  testFull();
+
+  remove( TEST_IMAGE );
+  printf( "%u failure(s)\n", failures );
+  return failures > 0;
+}
@@ -0,0 +1,151 @@
+#include "Arduino.h"
+#include "SimState.h"
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRIGGER_PIN  4        // TRIGGER_SLEEP_PIN of the sketch
+#define FTP_WINDOW   270000   // ms the sketch serves FTP once triggered
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// Time of the wake, on the virtual clock. When servers listen (see
+//   sim->network) the clock follows the one of the host: clients see
+//   the time outs of the sketch as they are
+
+static void realTime()
+{
+  static uint64_t startUs = 0;
+  struct timespec ts;
+
+  if( ! sim->network )
+    return;
+  clock_gettime( CLOCK_MONOTONIC, & ts );
+  uint64_t us = (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  if( startUs == 0 )
+    startUs = us - ( sim->clockUs - sim->wakeUs );
+  sim->clockUs = sim->wakeUs + us - startUs;
+}
+
+unsigned long millis()
+{
+  realTime();
+  return ( sim->clockUs - sim->wakeUs ) / 1000;
+}
+
+unsigned long micros()
+{
+  realTime();
+  return sim->clockUs - sim->wakeUs;
+}
+
+void delay( unsigned long ms )
+{
+  if( sim->network )
+    usleep( ms * 1000 );
+  sim->clockUs += (uint64_t) ms * 1000;
+  realTime();
+}
+
+void yield()
+{
+  if( sim->network )
+    usleep( SIM_YIELD_US / 10 );    // a short sleep, the host is not spun
+  sim->clockUs += SIM_YIELD_US;
+  realTime();
+}
+
+// The trigger pin is low at a wake chosen for FTP, until a window is over.
+//   When servers listen, it stays low: the sketch serves until it is killed
+
+int digitalRead( uint8_t pin )
+{
+  if( pin == TRIGGER_PIN )
+    return sim->ftpWake && ( sim->network || millis() < FTP_WINDOW ) ? LOW : HIGH;
+  return HIGH;
+}
+
+void pinMode( uint8_t pin, uint8_t mode )
+{
+}
+
+// Echo of the range finder: height of the water (see simHeight()),
+//   147 us per inch
+
+unsigned long pulseIn( uint8_t pin, uint8_t state, unsigned long timeout )
+{
+  double t = sim->clockUs / 1e6;
+  double cm = simHeight( t );
+  unsigned long us = cm / 2.54 * 147;
+  simRecordSample( t, cm );
+  sim->clockUs += 2 * us;         // wait for the pulse, then its length
+  return us;
+}
+
+void EspClass::deepSleep( uint64_t us, int mode )
+{
+  simDeepSleep( us );
+}
+
+String::String( double f, unsigned char decimals )
+{
+  char str[ 32 ];
+  snprintf( str, sizeof( str ), "%.*f", decimals, f );
+  s = str;
+}
+
+size_t Print::write( const uint8_t * buffer, size_t size )
+{
+  size_t n = 0;
+  while( size -- && write( * buffer ++ ))
+    n ++;
+  return n;
+}
+
+size_t Print::print( long n, int base )
+{
+  if( base != 10 )
+    return print( (unsigned long) n, base );
+  char str[ 24 ];
+  snprintf( str, sizeof( str ), "%ld", n );
+  return write( str );
+}
+
+size_t Print::print( unsigned long n, int base )
+{
+  char str[ 68 ];
+  char * p = str + sizeof( str ) - 1;
+  * p = 0;
+  do
+  {
+    * -- p = "0123456789ABCDEF"[ n % base ];
+    n /= base;
+  }
+  while( n > 0 );
+  return write( p );
+}
+
+size_t Print::print( double f, int decimals )
+{
+  char str[ 48 ];
+  snprintf( str, sizeof( str ), "%.*f", decimals, f );
+  return write( str );
+}
+
+size_t Print::printf( const char * format, ... )
+{
+  char str[ 256 ];
+  va_list args;
+  va_start( args, format );
+  vsnprintf( str, sizeof( str ), format, args );
+  va_end( args );
+  return write( str );
+}
+
+size_t HardwareSerial::write( uint8_t c )
+{
+  if( sim->serial )
+    putchar( c );
+  return 1;
+}
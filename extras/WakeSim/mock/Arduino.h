@@ -0,0 +1,160 @@
+/*
+ * Arduino core for the wake-cycle simulator: what the sketch and the
+ *   library use of it, on a host
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW  0
+#define INPUT  0
+#define OUTPUT 1
+
+#define PSTR(s) (s)
+#define PGM_P const char *
+#define F(s) (s)
+#define snprintf_P snprintf
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay( unsigned long ms );
+void yield();
+int  digitalRead( uint8_t pin );
+void pinMode( uint8_t pin, uint8_t mode );
+unsigned long pulseIn( uint8_t pin, uint8_t state, unsigned long timeout = 1000000L );
+
+class String
+{
+public:
+  String( const char * s = "" ) : s( s ) {}
+  String( const std::string & str ) : s( str ) {}
+  String( char c ) : s( 1, c ) {}
+  String( unsigned char n ) : s( std::to_string( n )) {}
+  String( int n ) : s( std::to_string( n )) {}
+  String( unsigned int n ) : s( std::to_string( n )) {}
+  String( long n ) : s( std::to_string( n )) {}
+  String( unsigned long n ) : s( std::to_string( n )) {}
+  String( double f, unsigned char decimals = 2 );
+
+  const char * c_str() const { return s.c_str(); }
+  unsigned length() const { return s.length(); }
+  bool equals( const char * str ) const { return s == str; }
+  bool equals( const String & str ) const { return s == str.s; }
+
+  String & operator +=( const String & str ) { s += str.s; return * this; }
+  String & operator +=( const char * str ) { s += str; return * this; }
+  String & operator +=( char c ) { s += c; return * this; }
+  String & operator +=( unsigned char n ) { s += std::to_string( n ); return * this; }
+  String & operator +=( int n ) { s += std::to_string( n ); return * this; }
+  String & operator +=( unsigned int n ) { s += std::to_string( n ); return * this; }
+  String & operator +=( long n ) { s += std::to_string( n ); return * this; }
+  String & operator +=( unsigned long n ) { s += std::to_string( n ); return * this; }
+
+  friend String operator +( const String & a, const String & b ) { return String( a.s + b.s ); }
+  friend String operator +( const String & a, const char * b ) { return String( a.s + b ); }
+
+private:
+  std::string s;
+};
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write( uint8_t c ) = 0;
+  virtual size_t write( const uint8_t * buffer, size_t size );
+  size_t write( const char * str ) { return write( (const uint8_t *) str, strlen( str )); }
+
+  size_t print( const char * str ) { return write( str ); }
+  size_t print( const String & str ) { return write( str.c_str()); }
+  size_t print( char c ) { return write( (uint8_t) c ); }
+  size_t print( unsigned char n, int base = 10 ) { return print( (unsigned long) n, base ); }
+  size_t print( int n, int base = 10 ) { return print( (long) n, base ); }
+  size_t print( unsigned int n, int base = 10 ) { return print( (unsigned long) n, base ); }
+  size_t print( long n, int base = 10 );
+  size_t print( unsigned long n, int base = 10 );
+  size_t print( double f, int decimals = 2 );
+  size_t printf( const char * format, ... );
+
+  size_t println() { return write( "\r\n" ); }
+  template< typename T > size_t println( T value ) { return print( value ) + println(); }
+  template< typename T > size_t println( T value, int b ) { return print( value, b ) + println(); }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+  void   begin( unsigned long baud ) {}
+  size_t write( uint8_t c );
+  using  Print::write;
+  int    available() { return 0; }
+  int    read() { return -1; }
+  int    peek() { return -1; }
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress
+{
+public:
+  IPAddress() { memset( bytes, 0, 4 ); }
+  IPAddress( uint8_t a, uint8_t b, uint8_t c, uint8_t d ) { bytes[ 0 ] = a; bytes[ 1 ] = b; bytes[ 2 ] = c; bytes[ 3 ] = d; }
+  uint8_t operator []( int i ) const { return bytes[ i ]; }
+  uint8_t & operator []( int i ) { return bytes[ i ]; }
+  operator uint32_t() const { uint32_t a; memcpy( & a, bytes, 4 ); return a; }
+
+private:
+  uint8_t bytes[ 4 ];
+};
+
+class EspClass
+{
+public:
+  uint32_t getFreeHeap() { return 40000; }
+  uint32_t getMaxFreeBlockSize() { return 30000; }
+  uint8_t  getHeapFragmentation() { return 0; }
+  uint32_t getCycleCount() { return micros() * 80; }
+  void     deepSleep( uint64_t us, int mode = 0 );
+};
+
+extern EspClass ESP;
+
+#define WAKE_RF_DEFAULT  0
+#define WAKE_RF_DISABLED 4
+
+#endif // ARDUINO_H
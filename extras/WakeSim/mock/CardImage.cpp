@@ -0,0 +1,117 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "CardImage.h"
+
+static uint8_t * image;
+static off_t imageSize;
+
+static void put16( uint8_t * p, uint16_t v ) { p[ 0 ] = v; p[ 1 ] = v >> 8; }
+static void put32( uint8_t * p, uint32_t v ) { put16( p, v ); put16( p + 2, v >> 16 ); }
+
+// FAT16 without partition table, 512 root entries, the smallest clusters
+//   that keep the count of clusters under 65525
+
+static bool mkfs( uint8_t * image, uint32_t blocks )
+{
+  uint8_t spc;
+  uint32_t fatBlocks, clusters;
+
+  for( spc = 1; spc <= 64; spc <<= 1 )
+  {
+    fatBlocks = 1;
+    for( uint8_t i = 0; i < 4; i ++ )
+    {
+      clusters = ( blocks - 1 - 2 * fatBlocks - 32 ) / spc;
+      fatBlocks = (( clusters + 2 ) * 2 + 511 ) / 512;
+    }
+    if( clusters < 65525 )
+      break;
+  }
+  if( spc > 64 || clusters < 4085 )
+    return NULL;
+  memset( image, 0, 512UL * ( 1 + 2 * fatBlocks + 32 ));
+  uint8_t * b = image;
+  b[ 0 ] = 0XEB; b[ 1 ] = 0X3C; b[ 2 ] = 0X90;
+  memcpy( b + 3, "WAKESIM ", 8 );
+  put16( b + 11, 512 );
+  b[ 13 ] = spc;
+  put16( b + 14, 1 );                // reserved blocks
+  b[ 16 ] = 2;                       // FATs
+  put16( b + 17, 512 );              // root entries
+  put16( b + 19, blocks < 65536 ? blocks : 0 );
+  b[ 21 ] = 0XF8;
+  put16( b + 22, fatBlocks );
+  put16( b + 24, 63 );
+  put16( b + 26, 255 );
+  put32( b + 32, blocks < 65536 ? 0 : blocks );
+  b[ 36 ] = 0X80;
+  b[ 38 ] = 0X29;
+  put32( b + 39, 0X20260101 );
+  memcpy( b + 43, "WAKESIM    FAT16   ", 19 );
+  b[ 510 ] = 0X55; b[ 511 ] = 0XAA;
+  for( uint8_t f = 0; f < 2; f ++ )
+  {
+    uint8_t * fat = image + 512UL * ( 1 + f * fatBlocks );
+    put16( fat, 0XFFF8 );
+    put16( fat + 2, 0XFFFF );
+  }
+  return true;
+}
+
+uint8_t * simOpenImage( const char * name, uint32_t sizeMB, bool format, uint32_t * pBlocks )
+{
+  int fd = open( name, O_RDWR | O_CREAT, 0644 );
+  struct stat st;
+
+  if( fd < 0 || fstat( fd, & st ) < 0 )
+  {
+    perror( name );
+    return NULL;
+  }
+  if( st.st_size == 0 || format )
+  {
+    // a new image, sparse and zeroed
+    st.st_size = (off_t) sizeMB << 20;
+    format = true;
+    if( ftruncate( fd, 0 ) < 0 || ftruncate( fd, st.st_size ) < 0 )
+    {
+      perror( name );
+      return NULL;
+    }
+  }
+  imageSize = st.st_size;
+  * pBlocks = st.st_size / 512;
+  image = (uint8_t *) mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  close( fd );
+  if( image == MAP_FAILED )
+  {
+    perror( name );
+    return NULL;
+  }
+  if( format && ! mkfs( image, * pBlocks ))
+  {
+    fprintf( stderr, "%s: size not fit for FAT16\n", name );
+    return NULL;
+  }
+  return image;
+}
+
+void simSyncImage()
+{
+  msync( image, imageSize, MS_SYNC );
+}
+
+const char * simRegion( const uint8_t * b, uint32_t block )
+{
+  uint32_t fatStart = b[ 14 ] | b[ 15 ] << 8;
+  uint32_t rootStart = fatStart + b[ 16 ] * ( b[ 22 ] | b[ 23 ] << 8 );
+  uint32_t dataStart = rootStart + ( 32 * ( b[ 17 ] | b[ 18 ] << 8 ) + 511 ) / 512;
+
+  return block < fatStart ? "boot" : block < rootStart ? "FAT" :
+         block < dataStart ? "root dir" : "data";
+}
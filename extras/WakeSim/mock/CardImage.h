@@ -0,0 +1,36 @@
+/*
+ * Card image of the wake-cycle simulator
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CARD_IMAGE_H
+#define CARD_IMAGE_H
+
+#include <stdint.h>
+
+// Without SdFat.h, that defines O_READ, O_CREAT... its own way
+
+// Map an image file, made anew and formatted FAT16 if it is empty or
+//   format is true
+//
+// return:
+//    the image in memory, NULL on error. Its size in blocks in * pBlocks
+uint8_t * simOpenImage( const char * name, uint32_t sizeMB, bool format, uint32_t * pBlocks );
+void simSyncImage();
+
+// Region of a block of the card: "boot", "FAT", "root dir" or "data"
+const char * simRegion( const uint8_t * image, uint32_t block );
+
+#endif // CARD_IMAGE_H
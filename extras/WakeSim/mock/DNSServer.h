@@ -0,0 +1 @@
+// DNS server of the ESP8266 core: used by WiFiManager only
@@ -0,0 +1,38 @@
+/*
+ * DS18B20 of the wake-cycle simulator: water temperature of the virtual day
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DALLAS_TEMPERATURE_H
+#define DALLAS_TEMPERATURE_H
+
+#include "OneWire.h"
+
+#define DEVICE_DISCONNECTED_C -127
+
+typedef uint8_t DeviceAddress[ 8 ];
+
+class DallasTemperature
+{
+public:
+  DallasTemperature( OneWire * pOneWire ) {}
+  void    begin() {}
+  void    setWaitForConversion( bool wait ) {}
+  void    requestTemperatures() { delay( 2 ); }   // one command on the bus
+  float   getTempC( const uint8_t * deviceAddress );
+  int16_t millisToWaitForConversion( uint8_t bitResolution ) { return 750; }
+};
+
+#endif // DALLAS_TEMPERATURE_H
@@ -0,0 +1,281 @@
+#include "RtcDS3231.h"
+#include "OneWire.h"
+#include "DallasTemperature.h"
+#include "ESP8266WiFi.h"
+#include "WiFiUdp.h"
+#include "Wire.h"
+#include "user_interface.h"
+#include "md5.h"
+#include "SimState.h"
+
+ESP8266WiFiClass WiFi;
+TwoWire Wire;
+struct rst_info resetInfo = { REASON_DEEP_SLEEP_AWAKE };
+
+#define SECONDS_PER_DAY 86400L
+#define NTP_TO_2000     ( 2208988800UL + 946684800UL )
+
+// True local time, in seconds since 2000
+
+static uint32_t simLocalTime()
+{
+  return sim->startTime + sim->clockUs / 1000000;
+}
+
+uint32_t simRtcTime()
+{
+  return simLocalTime() + sim->rtcDrift;
+}
+
+//------------------------------------------------------------------------------
+// DS3231
+
+static const uint8_t daysInMonth[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+static bool leapYear( uint8_t yearFrom2000 )
+{
+  return yearFrom2000 % 4 == 0;
+}
+
+RtcDateTime::RtcDateTime( uint32_t secondsFrom2000 )
+{
+  setSeconds( secondsFrom2000 );
+}
+
+// Build time of the program, as in "Oct 19 2026" and "12:34:56"
+
+RtcDateTime::RtcDateTime( const char * date, const char * time )
+{
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char m[ 4 ] = { date[ 0 ], date[ 1 ], date[ 2 ], 0 };
+
+  yearFrom2000 = atoi( date + 7 ) - 2000;
+  month = ( strstr( months, m ) - months ) / 3 + 1;
+  dayOfMonth = atoi( date + 4 );
+  hour = atoi( time );
+  minute = atoi( time + 3 );
+  second = atoi( time + 6 );
+}
+
+void RtcDateTime::setSeconds( uint32_t seconds )
+{
+  uint32_t days = seconds / SECONDS_PER_DAY;
+
+  second = seconds % 60;
+  minute = seconds / 60 % 60;
+  hour = seconds / 3600 % 24;
+  for( yearFrom2000 = 0; days >= ( leapYear( yearFrom2000 ) ? 366U : 365U ); yearFrom2000 ++ )
+    days -= leapYear( yearFrom2000 ) ? 366 : 365;
+  for( month = 1; ; month ++ )
+  {
+    uint8_t n = daysInMonth[ month - 1 ] + ( month == 2 && leapYear( yearFrom2000 ));
+    if( days < n )
+      break;
+    days -= n;
+  }
+  dayOfMonth = days + 1;
+}
+
+uint32_t RtcDateTime::TotalSeconds() const
+{
+  uint32_t days = dayOfMonth - 1;
+
+  for( uint8_t y = 0; y < yearFrom2000; y ++ )
+    days += leapYear( y ) ? 366 : 365;
+  for( uint8_t m = 1; m < month; m ++ )
+    days += daysInMonth[ m - 1 ] + ( m == 2 && leapYear( yearFrom2000 ));
+  return (( days * 24 + hour ) * 60 + minute ) * 60 + second;
+}
+
+RtcDateTime RtcDS3231::GetDateTime()
+{
+  delay( 1 );                      // a read over I2C
+  return RtcDateTime( simRtcTime());
+}
+
+void RtcDS3231::SetDateTime( const RtcDateTime & dt )
+{
+  sim->rtcDrift = (int32_t) ( dt.TotalSeconds() - simLocalTime());
+}
+
+//------------------------------------------------------------------------------
+// Probes: DS18B20 numbered from 1, in the order of the search
+
+uint8_t OneWire::search( uint8_t * newAddr )
+{
+  if( next >= sim->probes )
+    return false;
+  delay( 13 );                     // 64 time slots of the search
+  uint8_t rom[ 8 ] = { 0X28, ++ next, 0X5A, 0X1C, 0X0B, 0, 0, 0 };
+  rom[ 7 ] = crc8( rom, 7 );
+  memcpy( newAddr, rom, 8 );
+  return true;
+}
+
+// Dallas CRC, x^8 + x^5 + x^4 + 1
+
+uint8_t OneWire::crc8( const uint8_t * addr, uint8_t len )
+{
+  uint8_t crc = 0;
+
+  while( len -- )
+  {
+    uint8_t b = * addr ++;
+    for( uint8_t i = 0; i < 8; i ++ )
+    {
+      uint8_t mix = ( crc ^ b ) & 1;
+      crc >>= 1;
+      if( mix )
+        crc ^= 0X8C;
+      b >>= 1;
+    }
+  }
+  return crc;
+}
+
+// Water temperature: from the trace of the water, else warmest at 15:00.
+//   Half a degree colder for each probe deeper, in steps of 1/16 degree
+
+float DallasTemperature::getTempC( const uint8_t * deviceAddress )
+{
+  if( deviceAddress[ 1 ] == 0 || deviceAddress[ 1 ] > sim->probes )
+    return DEVICE_DISCONNECTED_C;
+  delay( 1 );                      // the scratchpad of the probe
+  double hours = ( simLocalTime() % SECONDS_PER_DAY ) / 3600.0;
+  double t = simHasTrace() ? simTraceTemp( sim->clockUs / 1e6 )
+                           : 18 + 3 * sin( 2 * M_PI * ( hours - 9 ) / 24 );
+  t -= 0.5 * ( deviceAddress[ 1 ] - 1 );
+  return floor( t * 16 + 0.5 ) / 16;
+}
+
+//------------------------------------------------------------------------------
+// NTP: transmit time of the answer, in seconds since 1900, UTC
+
+int WiFiUDP::read( uint8_t * buf, size_t size )
+{
+  if( ! requested || size < 48 )
+    return 0;
+  uint32_t t = simLocalTime() - SIM_TZ_SECONDS + NTP_TO_2000;
+  memset( buf, 0, 48 );
+  buf[ 0 ] = 0X24;                 // version 4, server
+  buf[ 1 ] = 1;                    // stratum
+  for( uint8_t at = 16; at <= 40; at += 8 )
+    for( uint8_t i = 0; i < 4; i ++ )
+      buf[ at + i ] = t >> ( 24 - 8 * i );
+  requested = false;
+  return 48;
+}
+
+//------------------------------------------------------------------------------
+// RTC user memory: blocks of 4 bytes, the user part from block 64
+
+extern "C" bool system_rtc_mem_read( uint8_t src_addr, void * des_addr, uint16_t load_size )
+{
+  if( src_addr < 64 || ( src_addr - 64 ) * 4U + load_size > sizeof( sim->rtcMem ))
+    return false;
+  memcpy( des_addr, sim->rtcMem + ( src_addr - 64 ) * 4, load_size );
+  return true;
+}
+
+extern "C" bool system_rtc_mem_write( uint8_t des_addr, const void * src_addr, uint16_t save_size )
+{
+  if( des_addr < 64 || ( des_addr - 64 ) * 4U + save_size > sizeof( sim->rtcMem ))
+    return false;
+  memcpy( sim->rtcMem + ( des_addr - 64 ) * 4, src_addr, save_size );
+  sim->rtcWrites += save_size;
+  return true;
+}
+
+extern "C" void esp_yield()
+{
+  yield();
+}
+
+//------------------------------------------------------------------------------
+// MD5 of RFC 1321, as in the ROM of the ESP8266: HASH and XMD5 are
+//   checked against the digests of the host
+
+static const uint32_t md5K[ 64 ] =
+{
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+  0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+  0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+  0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+  0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+  0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const uint8_t md5R[ 16 ] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+static void md5Block( uint32_t state[ 4 ], const uint8_t * p )
+{
+  uint32_t w[ 16 ];
+  uint32_t a = state[ 0 ], b = state[ 1 ], c = state[ 2 ], d = state[ 3 ];
+
+  for( int i = 0; i < 16; i ++ )
+    w[ i ] = p[ 4 * i ] | p[ 4 * i + 1 ] << 8 | p[ 4 * i + 2 ] << 16 | (uint32_t) p[ 4 * i + 3 ] << 24;
+  for( int i = 0; i < 64; i ++ )
+  {
+    uint32_t f;
+    int g;
+    if( i < 16 )
+      f = ( b & c ) | ( ~ b & d ), g = i;
+    else if( i < 32 )
+      f = ( d & b ) | ( ~ d & c ), g = ( 5 * i + 1 ) & 15;
+    else if( i < 48 )
+      f = b ^ c ^ d, g = ( 3 * i + 5 ) & 15;
+    else
+      f = c ^ ( b | ~ d ), g = ( 7 * i ) & 15;
+    uint32_t t = a + f + md5K[ i ] + w[ g ];
+    int r = md5R[ ( i >> 4 ) * 4 + ( i & 3 ) ];
+    a = d; d = c; c = b;
+    b += t << r | t >> ( 32 - r );
+  }
+  state[ 0 ] += a; state[ 1 ] += b; state[ 2 ] += c; state[ 3 ] += d;
+}
+
+extern "C" void MD5Init( md5_context_t * context )
+{
+  memset( context, 0, sizeof( * context ));
+  context->state[ 0 ] = 0x67452301;
+  context->state[ 1 ] = 0xefcdab89;
+  context->state[ 2 ] = 0x98badcfe;
+  context->state[ 3 ] = 0x10325476;
+}
+
+// count[ 0 ] and count[ 1 ] hold the length in bits, low and high words
+
+extern "C" void MD5Update( md5_context_t * context, const uint8_t * buf, const uint16_t len )
+{
+  uint32_t used = ( context->count[ 0 ] >> 3 ) & 63;
+
+  if(( context->count[ 0 ] += (uint32_t) len << 3 ) < ( (uint32_t) len << 3 ))
+    context->count[ 1 ] ++;
+  for( uint16_t i = 0; i < len; i ++ )
+  {
+    context->buffer[ used ++ ] = buf[ i ];
+    if( used == 64 )
+    {
+      md5Block( context->state, context->buffer );
+      used = 0;
+    }
+  }
+}
+
+extern "C" void MD5Final( uint8_t hash[ 16 ], md5_context_t * context )
+{
+  uint8_t  bits[ 8 ];
+  uint8_t  pad = 0x80, zero = 0;
+
+  for( int i = 0; i < 8; i ++ )
+    bits[ i ] = context->count[ i >> 2 ] >> ( 8 * ( i & 3 ));
+  MD5Update( context, & pad, 1 );
+  while((( context->count[ 0 ] >> 3 ) & 63 ) != 56 )
+    MD5Update( context, & zero, 1 );
+  MD5Update( context, bits, 8 );
+  for( int i = 0; i < 16; i ++ )
+    hash[ i ] = context->state[ i >> 2 ] >> ( 8 * ( i & 3 ));
+  memset( context, 0, sizeof( * context ));
+}
@@ -0,0 +1 @@
+// Web server of the ESP8266 core: used by WiFiManager only
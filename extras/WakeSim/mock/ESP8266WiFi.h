@@ -0,0 +1,40 @@
+/*
+ * WiFi of the ESP8266 core, for the simulator: the radio stays off
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESP8266_WIFI_H
+#define ESP8266_WIFI_H
+
+#include "WiFiClient.h"
+
+#define WIFI_OFF 0
+#define WIFI_STA 1
+#define WL_CONNECTED 3
+
+class ESP8266WiFiClass
+{
+public:
+  void      mode( int m ) {}
+  void      forceSleepBegin() { delay( 1 ); }
+  void      forceSleepWake() { delay( 1 ); }
+  int       status() { return WL_CONNECTED; }
+  IPAddress localIP();
+  IPAddress softAPIP() { return IPAddress( 192, 168, 4, 1 ); }
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif // ESP8266_WIFI_H
@@ -0,0 +1 @@
+// mDNS of the ESP8266 core: not used by the sketch
@@ -0,0 +1,32 @@
+/*
+ * MAX17043 fuel gauge, for the wake-cycle simulator
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAX17043_H
+#define MAX17043_H
+
+#include "Arduino.h"
+
+class MAX17043
+{
+public:
+  void  reset() {}
+  void  quickStart() {}
+  float getVCell() { return 3.9; }
+  float getSoC() { return 80; }
+};
+
+#endif // MAX17043_H
@@ -0,0 +1,2 @@
+// MD5Builder of the ESP8266 core: the server only uses md5.h
+#include "md5.h"
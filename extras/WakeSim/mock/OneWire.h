@@ -0,0 +1,35 @@
+/*
+ * 1-Wire bus of the wake-cycle simulator: sim->probes DS18B20
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ONE_WIRE_H
+#define ONE_WIRE_H
+
+#include "Arduino.h"
+
+class OneWire
+{
+public:
+  OneWire( uint8_t pin ) { next = 0; }
+  void    reset_search() { next = 0; }
+  uint8_t search( uint8_t * newAddr );
+  static uint8_t crc8( const uint8_t * addr, uint8_t len );
+
+private:
+  uint8_t next;
+};
+
+#endif // ONE_WIRE_H
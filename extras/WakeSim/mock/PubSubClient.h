@@ -0,0 +1,60 @@
+/*
+ * PubSubClient (MQTT, imroy API) for the wake-cycle simulator: no broker
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PUB_SUB_CLIENT_H
+#define PUB_SUB_CLIENT_H
+
+#include "Arduino.h"
+
+namespace MQTT
+{
+  class Connect
+  {
+  public:
+    Connect( const char * clientId ) {}
+    Connect & unset_clean_session() { return * this; }
+  };
+
+  class Publish
+  {
+  public:
+    Publish( const char * topic, const uint8_t * payload, uint32_t length ) : topic_( topic ) {}
+    Publish( const char * topic, const String & payload ) : topic_( topic ), payload_( payload ) {}
+    Publish & set_qos( uint8_t qos ) { return * this; }
+    String topic() const { return topic_; }
+    String payload_string() const { return payload_; }
+
+  private:
+    String topic_;
+    String payload_;
+  };
+}
+
+class PubSubClient
+{
+public:
+  PubSubClient( IPAddress server ) {}
+  void set_callback( void (*callback)( const MQTT::Publish & )) {}
+  bool connect( const MQTT::Connect & conn ) { delay( 100 ); return false; }   // a timeout
+  bool connected() { return false; }
+  bool loop() { return false; }
+  bool publish( const MQTT::Publish & pub ) { return false; }
+  bool publish( const char * topic, const String & payload ) { return false; }
+  bool subscribe( const char * topic ) { return false; }
+};
+
+#endif // PUB_SUB_CLIENT_H
@@ -0,0 +1,67 @@
+/*
+ * DS3231 of the wake-cycle simulator: local time of the virtual clock
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTC_DS3231_H
+#define RTC_DS3231_H
+
+#include "Arduino.h"
+
+// Date and time in seconds since 2000-01-01, as in the Rtc library
+
+class RtcDateTime
+{
+public:
+  RtcDateTime( uint32_t secondsFrom2000 = 0 );
+  RtcDateTime( const char * date, const char * time );   // __DATE__, __TIME__
+
+  uint16_t Year() const { return yearFrom2000 + 2000; }
+  uint8_t  Month() const { return month; }
+  uint8_t  Day() const { return dayOfMonth; }
+  uint8_t  Hour() const { return hour; }
+  uint8_t  Minute() const { return minute; }
+  uint8_t  Second() const { return second; }
+  uint32_t TotalSeconds() const;
+
+  bool operator <( const RtcDateTime & other ) const { return TotalSeconds() < other.TotalSeconds(); }
+  bool operator >( const RtcDateTime & other ) const { return TotalSeconds() > other.TotalSeconds(); }
+  bool operator ==( const RtcDateTime & other ) const { return TotalSeconds() == other.TotalSeconds(); }
+
+private:
+  void setSeconds( uint32_t seconds );
+
+  uint8_t yearFrom2000, month, dayOfMonth, hour, minute, second;
+};
+
+enum DS3231SquareWavePinMode
+{
+  DS3231SquareWavePin_ModeNone,
+  DS3231SquareWavePin_ModeAlarmOne,
+  DS3231SquareWavePin_ModeClock
+};
+
+class RtcDS3231
+{
+public:
+  void Begin() {}
+  bool IsDateTimeValid() { return true; }
+  RtcDateTime GetDateTime();
+  void SetDateTime( const RtcDateTime & dt );
+  void Enable32kHzPin( bool enable ) {}
+  void SetSquareWavePin( DS3231SquareWavePinMode mode ) {}
+};
+
+#endif // RTC_DS3231_H
@@ -0,0 +1,43 @@
+/*
+ * SD library for the wake-cycle simulator, see utility/SdFat.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SD_H
+#define SD_H
+
+#include "utility/SdFat.h"
+
+#define FILE_READ  O_READ
+#define FILE_WRITE ( O_READ | O_WRITE | O_CREAT )
+
+class SDClass
+{
+public:
+  bool begin( uint8_t csPin = 4 );
+  bool exists( const char * path );
+  bool remove( const char * path );
+  bool mkdir( const char * path );
+  bool rmdir( const char * path );
+
+protected:
+  Sd2Card card;
+  SdVolume volume;
+  SdFile root;
+};
+
+extern SDClass SD;
+
+#endif // SD_H
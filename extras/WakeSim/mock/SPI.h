@@ -0,0 +1 @@
+// SPI of the Arduino core: the card of the simulator is an image file
@@ -0,0 +1,767 @@
+#include <unistd.h>
+#include "SD.h"
+#include "SdBlockDev.h"
+#include "SimState.h"
+
+SDClass SD;
+
+Sd2Card  * SdVolume::sdCard_ = NULL;
+uint8_t  SdVolume::cache_[ 512 ];
+uint32_t SdVolume::cacheBlockNumber_ = 0XFFFFFFFF;
+bool     SdVolume::cacheDirty_ = false;
+uint32_t SdVolume::cacheMirrorBlock_ = 0;
+void (*SdFile::dateTime_)( uint16_t * date, uint16_t * time ) = NULL;
+
+//------------------------------------------------------------------------------
+// Card
+
+uint8_t Sd2Card::init( uint8_t sckRateID, uint8_t chipSelectPin )
+{
+  return sim->image != NULL;
+}
+
+uint32_t Sd2Card::cardSize()
+{
+  return sim->blocks;
+}
+
+uint8_t Sd2Card::readBlock( uint32_t block, uint8_t * dst )
+{
+  if( block >= sim->blocks )
+    return false;
+  memcpy( dst, sim->image + 512UL * block, 512 );
+  sim->reads ++;
+  sim->clockUs += sim->readUs;
+  SdBlockDev::count( block, false, sim->readUs );
+  return true;
+}
+
+uint8_t Sd2Card::writeBlock( uint32_t block, const uint8_t * src )
+{
+  if( block >= sim->blocks )
+    return false;
+  if( sim->writes + 1 == sim->failWrite )
+  {
+    sim->failWrite = 0;       // a single failure: the card answers again
+    return false;
+  }
+  if( sim->writes + 1 == sim->tearWrite )
+  {
+    // Loss of power: the card kept the start of the block
+    memcpy( sim->image + 512UL * block, src, sim->tearBytes );
+    sim->writes ++;
+    sim->torn = true;
+    fflush( stdout );
+    _exit( 0 );
+  }
+  memcpy( sim->image + 512UL * block, src, 512 );
+  sim->writes ++;
+  sim->blockWrites[ block ] ++;
+  sim->clockUs += sim->writeUs;
+  SdBlockDev::count( block, true, sim->writeUs );
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Volume
+
+static uint16_t le16( const uint8_t * p ) { return p[ 0 ] | p[ 1 ] << 8; }
+static uint32_t le32( const uint8_t * p ) { return le16( p ) | (uint32_t) le16( p + 2 ) << 16; }
+
+// Mount the volume from its boot sector: FAT16, no partition table
+
+uint8_t SdVolume::init( Sd2Card * dev )
+{
+  sdCard_ = dev;
+  cacheBlockNumber_ = 0XFFFFFFFF;
+  cacheDirty_ = false;
+  if( ! cacheRawBlock( 0, false ) || le16( cache_ + 11 ) != 512 ||
+      cache_[ 510 ] != 0X55 || cache_[ 511 ] != 0XAA )
+    return false;
+  blocksPerCluster_ = cache_[ 13 ];
+  for( clusterSizeShift_ = 0; ( 1 << clusterSizeShift_ ) < blocksPerCluster_; clusterSizeShift_ ++ )
+    ;
+  fatCount_ = cache_[ 16 ];
+  fatStartBlock_ = le16( cache_ + 14 );
+  blocksPerFat_ = le16( cache_ + 22 );
+  rootDirEntryCount_ = le16( cache_ + 17 );
+  rootDirStart_ = fatStartBlock_ + fatCount_ * blocksPerFat_;
+  dataStartBlock_ = rootDirStart_ + (( 32UL * rootDirEntryCount_ + 511 ) / 512 );
+  uint32_t totalBlocks = le16( cache_ + 19 ) != 0 ? le16( cache_ + 19 ) : le32( cache_ + 32 );
+  clusterCount_ = ( totalBlocks - dataStartBlock_ ) >> clusterSizeShift_;
+  fatType_ = clusterCount_ < 4085 ? 12 : clusterCount_ < 65525 ? 16 : 32;
+  allocSearchStart_ = 2;
+  return fatType_ == 16 && blocksPerFat_ != 0;
+}
+
+// Write the cache back if it was changed, with the copy of a FAT block
+//   in the second FAT
+
+uint8_t SdVolume::cacheFlush()
+{
+  if( cacheDirty_ )
+  {
+    if( ! sdCard_->writeBlock( cacheBlockNumber_, cache_ ))
+      return false;
+    if( cacheMirrorBlock_ != 0 && ! sdCard_->writeBlock( cacheMirrorBlock_, cache_ ))
+      return false;
+    cacheMirrorBlock_ = 0;
+    cacheDirty_ = false;
+  }
+  return true;
+}
+
+uint8_t SdVolume::cacheRawBlock( uint32_t block, bool forWrite )
+{
+  if( cacheBlockNumber_ != block )
+  {
+    if( ! cacheFlush() || ! sdCard_->readBlock( block, cache_ ))
+      return false;
+    cacheBlockNumber_ = block;
+  }
+  if( forWrite )
+    cacheDirty_ = true;
+  return true;
+}
+
+uint8_t * SdVolume::cacheClear()
+{
+  if( ! cacheFlush())
+    return NULL;
+  cacheBlockNumber_ = 0XFFFFFFFF;
+  return cache_;
+}
+
+uint8_t SdVolume::fatGet( uint32_t cluster, uint32_t * value )
+{
+  if( cluster > clusterCount_ + 1 || ! cacheRawBlock( fatStartBlock_ + ( cluster >> 8 ), false ))
+    return false;
+  * value = le16( cache_ + 2 * ( cluster & 0XFF ));
+  return true;
+}
+
+uint8_t SdVolume::fatPut( uint32_t cluster, uint32_t value )
+{
+  uint32_t block = fatStartBlock_ + ( cluster >> 8 );
+  if( cluster < 2 || cluster > clusterCount_ + 1 || ! cacheRawBlock( block, true ))
+    return false;
+  cache_[ 2 * ( cluster & 0XFF ) ] = value;
+  cache_[ 2 * ( cluster & 0XFF ) + 1 ] = value >> 8;
+  if( fatCount_ > 1 )
+    cacheMirrorBlock_ = block + blocksPerFat_;
+  return true;
+}
+
+uint8_t SdVolume::freeChain( uint32_t cluster )
+{
+  uint32_t next;
+  allocSearchStart_ = 2;
+  do
+  {
+    if( ! fatGet( cluster, & next ) || ! fatPut( cluster, 0 ))
+      return false;
+    cluster = next;
+  }
+  while( ! isEOC( cluster ));
+  return true;
+}
+
+uint8_t SdVolume::chainSize( uint32_t cluster, uint32_t * size )
+{
+  uint32_t s = 0;
+  do
+  {
+    if( ! fatGet( cluster, & cluster ))
+      return false;
+    s += 512UL << clusterSizeShift_;
+  }
+  while( ! isEOC( cluster ));
+  * size = s;
+  return true;
+}
+
+// Allocate a run of free clusters, after curCluster if it is not 0
+
+uint8_t SdVolume::allocContiguous( uint32_t count, uint32_t * curCluster )
+{
+  uint32_t bgnCluster;
+  bool setStart;
+
+  if( * curCluster != 0 )
+  {
+    bgnCluster = * curCluster + 1;
+    setStart = false;
+  }
+  else
+  {
+    bgnCluster = allocSearchStart_;
+    setStart = count == 1;
+  }
+  uint32_t endCluster = bgnCluster;
+  uint32_t fatEnd = clusterCount_ + 1;
+  for( uint32_t n = 0; ; n ++, endCluster ++ )
+  {
+    uint32_t f;
+    if( n >= clusterCount_ )
+      return false;
+    if( endCluster > fatEnd )
+      bgnCluster = endCluster = 2;
+    if( ! fatGet( endCluster, & f ))
+      return false;
+    if( f != 0 )
+      bgnCluster = endCluster + 1;
+    else if( endCluster - bgnCluster + 1 == count )
+      break;
+  }
+  if( ! fatPut( endCluster, 0XFFFF ))
+    return false;
+  for( ; endCluster > bgnCluster; endCluster -- )
+    if( ! fatPut( endCluster - 1, endCluster ))
+      return false;
+  if( * curCluster != 0 && ! fatPut( * curCluster, bgnCluster ))
+    return false;
+  * curCluster = bgnCluster;
+  if( setStart )
+    allocSearchStart_ = bgnCluster + 1;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Files
+
+static uint8_t make83Name( const char * str, uint8_t * name )
+{
+  uint8_t c, i = 0, last = 7;
+
+  memset( name, ' ', 11 );
+  while(( c = * str ++ ) != 0 )
+  {
+    if( c == '.' )
+    {
+      if( last == 10 )
+        return false;
+      last = 10;
+      i = 8;
+    }
+    else if( i > last || c <= ' ' || c > '~' || strchr( "|<>^+=?/[];,*\"\\", c ) != NULL )
+      return false;
+    else
+      name[ i ++ ] = toupper( c );
+  }
+  return name[ 0 ] != ' ';
+}
+
+void SdFile::dirName( const dir_t & dir, char * name )
+{
+  uint8_t j = 0;
+  for( uint8_t i = 0; i < 11; i ++ )
+  {
+    if( dir.name[ i ] == ' ' )
+      continue;
+    if( i == 8 )
+      name[ j ++ ] = '.';
+    name[ j ++ ] = dir.name[ i ];
+  }
+  name[ j ] = 0;
+}
+
+uint8_t SdFile::openRoot( SdVolume * vol )
+{
+  if( isOpen() || vol->fatType() != 16 )
+    return false;
+  type_ = FAT_FILE_TYPE_ROOT16;
+  firstCluster_ = 0;
+  fileSize_ = 32 * vol->rootDirEntryCount();
+  vol_ = vol;
+  flags_ = O_READ;
+  curCluster_ = 0;
+  curPosition_ = 0;
+  dirBlock_ = 0;
+  dirIndex_ = 0;
+  return true;
+}
+
+dir_t * SdFile::cacheDirEntry( bool forWrite )
+{
+  if( ! SdVolume::cacheRawBlock( dirBlock_, forWrite ))
+    return NULL;
+  return ((dir_t *) SdVolume::cacheBuffer()) + dirIndex_;
+}
+
+// Read the next entry of a directory into the cache
+
+dir_t * SdFile::readDirCache()
+{
+  if( ! isDir())
+    return NULL;
+  uint8_t i = ( curPosition_ >> 5 ) & 0XF;
+  if( read() < 0 )
+    return NULL;
+  curPosition_ += 31;
+  return ((dir_t *) SdVolume::cacheBuffer()) + i;
+}
+
+uint8_t SdFile::openCachedEntry( uint8_t dirIndex, uint8_t oflag )
+{
+  dir_t * p = ((dir_t *) SdVolume::cacheBuffer()) + dirIndex;
+
+  if(( p->attributes & ( DIR_ATT_READ_ONLY | DIR_ATT_DIRECTORY )) && ( oflag & ( O_WRITE | O_TRUNC )))
+    return false;
+  dirIndex_ = dirIndex;
+  dirBlock_ = SdVolume::cacheBlockNumber_;
+  firstCluster_ = (uint32_t) p->firstClusterHigh << 16 | p->firstClusterLow;
+  if( DIR_IS_FILE( p ))
+  {
+    fileSize_ = p->fileSize;
+    type_ = FAT_FILE_TYPE_NORMAL;
+  }
+  else if( DIR_IS_SUBDIR( p ))
+  {
+    if( ! vol_->chainSize( firstCluster_, & fileSize_ ))
+      return false;
+    type_ = FAT_FILE_TYPE_SUBDIR;
+  }
+  else
+    return false;
+  flags_ = oflag & ( O_ACCMODE | O_SYNC | O_APPEND );
+  curCluster_ = 0;
+  curPosition_ = 0;
+  return oflag & O_TRUNC ? truncate( 0 ) : true;
+}
+
+// Open a file by name, creating it in a free entry if asked
+
+uint8_t SdFile::open( SdFile * dirFile, const char * fileName, uint8_t oflag )
+{
+  uint8_t dname[ 11 ];
+  dir_t * p;
+  bool emptyFound = false;
+
+  if( isOpen() || ! make83Name( fileName, dname ))
+    return false;
+  vol_ = dirFile->vol_;
+  dirFile->rewind();
+  while( dirFile->curPosition_ < dirFile->fileSize_ )
+  {
+    uint8_t index = 0XF & ( dirFile->curPosition_ >> 5 );
+    p = dirFile->readDirCache();
+    if( p == NULL )
+      return false;
+    if( p->name[ 0 ] == DIR_NAME_FREE || p->name[ 0 ] == DIR_NAME_DELETED )
+    {
+      if( ! emptyFound )
+      {
+        emptyFound = true;
+        dirIndex_ = index;
+        dirBlock_ = SdVolume::cacheBlockNumber_;
+      }
+      if( p->name[ 0 ] == DIR_NAME_FREE )
+        break;
+    }
+    else if( ! memcmp( dname, p->name, 11 ))
+    {
+      if(( oflag & ( O_CREAT | O_EXCL )) == ( O_CREAT | O_EXCL ))
+        return false;
+      return openCachedEntry( index, oflag );
+    }
+  }
+  if(( oflag & ( O_CREAT | O_WRITE )) != ( O_CREAT | O_WRITE ) || ! emptyFound )
+    return false;
+  p = cacheDirEntry( true );
+  if( p == NULL )
+    return false;
+  memset( p, 0, sizeof( dir_t ));
+  memcpy( p->name, dname, 11 );
+  uint16_t date = FAT_DATE( 2000, 1, 1 ), time = 0;   // dir_t is packed: no pointer to its fields
+  if( dateTime_ != NULL )
+    dateTime_( & date, & time );
+  p->creationDate = date;
+  p->creationTime = time;
+  p->lastAccessDate = p->creationDate;
+  p->lastWriteDate = p->creationDate;
+  p->lastWriteTime = p->creationTime;
+  if( ! SdVolume::cacheFlush())
+    return false;
+  return openCachedEntry( dirIndex_, oflag );
+}
+
+// Open the entry of a directory at an index
+
+uint8_t SdFile::open( SdFile * dirFile, uint16_t index, uint8_t oflag )
+{
+  if( isOpen() || ( oflag & O_EXCL ))
+    return false;
+  vol_ = dirFile->vol_;
+  if( ! dirFile->seekSet( 32UL * index ))
+    return false;
+  dir_t * p = dirFile->readDirCache();
+  if( p == NULL || p->name[ 0 ] == DIR_NAME_FREE ||
+      p->name[ 0 ] == DIR_NAME_DELETED || p->name[ 0 ] == '.' )
+    return false;
+  return openCachedEntry( index & 0XF, oflag );
+}
+
+uint8_t SdFile::createContiguous( SdFile * dirFile, const char * fileName, uint32_t size )
+{
+  if( size == 0 || ! open( dirFile, fileName, O_CREAT | O_EXCL | O_RDWR ))
+    return false;
+  uint32_t count = (( size - 1 ) >> ( vol_->clusterSizeShift() + 9 )) + 1;
+  if( ! vol_->allocContiguous( count, & firstCluster_ ))
+  {
+    remove();
+    return false;
+  }
+  fileSize_ = size;
+  flags_ |= F_FILE_DIR_DIRTY;
+  return sync();
+}
+
+uint8_t SdFile::sync()
+{
+  if( ! isOpen())
+    return false;
+  if( flags_ & F_FILE_DIR_DIRTY )
+  {
+    dir_t * d = cacheDirEntry( true );
+    if( d == NULL )
+      return false;
+    if( ! isDir())
+      d->fileSize = fileSize_;
+    d->firstClusterLow = firstCluster_ & 0XFFFF;
+    d->firstClusterHigh = firstCluster_ >> 16;
+    if( dateTime_ != NULL )
+    {
+      uint16_t date, time;
+      dateTime_( & date, & time );
+      d->lastWriteDate = date;
+      d->lastWriteTime = time;
+      d->lastAccessDate = date;
+    }
+    flags_ &= ~ F_FILE_DIR_DIRTY;
+  }
+  return SdVolume::cacheFlush();
+}
+
+uint8_t SdFile::close()
+{
+  if( ! sync())
+    return false;
+  type_ = FAT_FILE_TYPE_CLOSED;
+  return true;
+}
+
+int16_t SdFile::read()
+{
+  uint8_t b;
+  return read( & b, 1 ) == 1 ? b : -1;
+}
+
+int16_t SdFile::read( void * buf, uint16_t nbyte )
+{
+  uint8_t * dst = (uint8_t *) buf;
+
+  if( ! isOpen() || ! ( flags_ & O_READ ))
+    return -1;
+  if( nbyte > fileSize_ - curPosition_ )
+    nbyte = fileSize_ - curPosition_;
+  uint16_t toRead = nbyte;
+  while( toRead > 0 )
+  {
+    uint32_t block;
+    uint16_t offset = curPosition_ & 0X1FF;
+    uint8_t blockOfCluster = vol_->blockOfCluster( curPosition_ );
+    if( type_ == FAT_FILE_TYPE_ROOT16 )
+      block = vol_->rootDirStart() + ( curPosition_ >> 9 );
+    else
+    {
+      if( offset == 0 && blockOfCluster == 0 )
+      {
+        if( curPosition_ == 0 )
+          curCluster_ = firstCluster_;
+        else if( ! vol_->fatGet( curCluster_, & curCluster_ ))
+          return -1;
+      }
+      block = vol_->clusterStartBlock( curCluster_ ) + blockOfCluster;
+    }
+    uint16_t n = toRead < 512 - offset ? toRead : 512 - offset;
+    if( n == 512 && block != SdVolume::cacheBlockNumber_ )
+    {
+      if( ! SdVolume::sdCard()->readBlock( block, dst ))
+        return -1;
+    }
+    else
+    {
+      if( ! SdVolume::cacheRawBlock( block, false ))
+        return -1;
+      memcpy( dst, SdVolume::cacheBuffer() + offset, n );
+    }
+    dst += n;
+    curPosition_ += n;
+    toRead -= n;
+  }
+  return nbyte;
+}
+
+int8_t SdFile::readDir( dir_t * dir )
+{
+  int16_t n;
+  if( ! isDir() || ( curPosition_ & 0X1F ))
+    return -1;
+  while(( n = read( dir, sizeof( dir_t ))) == sizeof( dir_t ))
+  {
+    if( dir->name[ 0 ] == DIR_NAME_FREE )
+      break;
+    if( dir->name[ 0 ] == DIR_NAME_DELETED || dir->name[ 0 ] == '.' )
+      continue;
+    if( DIR_IS_FILE_OR_SUBDIR( dir ))
+      return n;
+  }
+  return n < 0 ? -1 : 0;
+}
+
+uint8_t SdFile::addCluster()
+{
+  if( ! vol_->allocContiguous( 1, & curCluster_ ))
+    return false;
+  if( firstCluster_ == 0 )
+  {
+    firstCluster_ = curCluster_;
+    flags_ |= F_FILE_DIR_DIRTY;
+  }
+  return true;
+}
+
+// Write through the cache, or straight to the card for a whole block
+
+size_t SdFile::write( const void * buf, uint16_t nbyte )
+{
+  const uint8_t * src = (const uint8_t *) buf;
+  uint16_t nToWrite = nbyte;
+
+  if( ! isFile() || ! ( flags_ & O_WRITE ))
+    return 0;
+  if(( flags_ & O_APPEND ) && curPosition_ != fileSize_ && ! seekEnd())
+    return 0;
+  while( nToWrite > 0 )
+  {
+    uint8_t blockOfCluster = vol_->blockOfCluster( curPosition_ );
+    uint16_t blockOffset = curPosition_ & 0X1FF;
+    if( blockOfCluster == 0 && blockOffset == 0 )
+    {
+      if( curCluster_ == 0 )
+      {
+        if( firstCluster_ == 0 )
+        {
+          if( ! addCluster())
+            return 0;
+        }
+        else
+          curCluster_ = firstCluster_;
+      }
+      else
+      {
+        uint32_t next;
+        if( ! vol_->fatGet( curCluster_, & next ))
+          return 0;
+        if( vol_->isEOC( next ))
+        {
+          if( ! addCluster())
+            return 0;
+        }
+        else
+          curCluster_ = next;
+      }
+    }
+    uint16_t n = 512 - blockOffset < nToWrite ? 512 - blockOffset : nToWrite;
+    uint32_t block = vol_->clusterStartBlock( curCluster_ ) + blockOfCluster;
+    if( n == 512 )
+    {
+      if( SdVolume::cacheBlockNumber_ == block )
+        SdVolume::cacheBlockNumber_ = 0XFFFFFFFF;
+      if( ! SdVolume::sdCard()->writeBlock( block, src ))
+        return 0;
+    }
+    else
+    {
+      if( blockOffset == 0 && curPosition_ >= fileSize_ )
+      {
+        // a new block: no need to read it
+        if( ! SdVolume::cacheFlush())
+          return 0;
+        SdVolume::cacheBlockNumber_ = block;
+        SdVolume::cacheSetDirty();
+      }
+      else if( ! SdVolume::cacheRawBlock( block, true ))
+        return 0;
+      memcpy( SdVolume::cacheBuffer() + blockOffset, src, n );
+    }
+    src += n;
+    nToWrite -= n;
+    curPosition_ += n;
+  }
+  if( curPosition_ > fileSize_ )
+  {
+    fileSize_ = curPosition_;
+    flags_ |= F_FILE_DIR_DIRTY;
+  }
+  else if( dateTime_ != NULL && nbyte > 0 )
+    flags_ |= F_FILE_DIR_DIRTY;
+  if(( flags_ & O_SYNC ) && ! sync())
+    return 0;
+  return nbyte;
+}
+
+// Move to a position, following the chain of clusters
+
+uint8_t SdFile::seekSet( uint32_t pos )
+{
+  if( ! isOpen() || pos > fileSize_ )
+    return false;
+  if( type_ == FAT_FILE_TYPE_ROOT16 )
+  {
+    curPosition_ = pos;
+    return true;
+  }
+  if( pos == 0 )
+  {
+    curCluster_ = 0;
+    curPosition_ = 0;
+    return true;
+  }
+  uint8_t shift = vol_->clusterSizeShift() + 9;
+  uint32_t nCur = ( curPosition_ - 1 ) >> shift;
+  uint32_t nNew = ( pos - 1 ) >> shift;
+  if( nNew < nCur || curPosition_ == 0 )
+    curCluster_ = firstCluster_;
+  else
+    nNew -= nCur;
+  while( nNew -- )
+    if( ! vol_->fatGet( curCluster_, & curCluster_ ))
+      return false;
+  curPosition_ = pos;
+  return true;
+}
+
+// Cut the file, giving back the clusters past the new end
+
+uint8_t SdFile::truncate( uint32_t length )
+{
+  if( ! isFile() || ! ( flags_ & O_WRITE ) || length > fileSize_ )
+    return false;
+  if( fileSize_ == 0 )
+    return true;
+  uint32_t newPos = curPosition_ > length ? length : curPosition_;
+  if( ! seekSet( length ))
+    return false;
+  if( length == 0 )
+  {
+    if( firstCluster_ != 0 && ! vol_->freeChain( firstCluster_ ))
+      return false;
+    firstCluster_ = 0;
+  }
+  else
+  {
+    uint32_t toFree;
+    if( ! vol_->fatGet( curCluster_, & toFree ))
+      return false;
+    if( ! vol_->isEOC( toFree ))
+    {
+      if( ! vol_->freeChain( toFree ) || ! vol_->fatPut( curCluster_, 0XFFFF ))
+        return false;
+    }
+  }
+  fileSize_ = length;
+  flags_ |= F_FILE_DIR_DIRTY;
+  if( ! sync())
+    return false;
+  return seekSet( newPos );
+}
+
+uint8_t SdFile::remove()
+{
+  if( ! truncate( 0 ))
+    return false;
+  dir_t * d = cacheDirEntry( true );
+  if( d == NULL )
+    return false;
+  d->name[ 0 ] = DIR_NAME_DELETED;
+  type_ = FAT_FILE_TYPE_CLOSED;
+  return SdVolume::cacheFlush();
+}
+
+uint8_t SdFile::remove( SdFile * dirFile, const char * fileName )
+{
+  SdFile file;
+  return file.open( dirFile, fileName, O_WRITE ) && file.remove();
+}
+
+uint8_t SdFile::contiguousRange( uint32_t * bgnBlock, uint32_t * endBlock )
+{
+  if( firstCluster_ == 0 )
+    return false;
+  for( uint32_t c = firstCluster_; ; c ++ )
+  {
+    uint32_t next;
+    if( ! vol_->fatGet( c, & next ))
+      return false;
+    if( next != c + 1 )
+    {
+      if( ! vol_->isEOC( next ))
+        return false;
+      * bgnBlock = vol_->clusterStartBlock( firstCluster_ );
+      * endBlock = vol_->clusterStartBlock( c ) + vol_->blocksPerCluster() - 1;
+      return true;
+    }
+  }
+}
+
+uint8_t SdFile::dirEntry( dir_t * dir )
+{
+  if( ! sync())
+    return false;
+  dir_t * p = cacheDirEntry( false );
+  if( p == NULL )
+    return false;
+  memcpy( dir, p, sizeof( dir_t ));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// SD: names of the current directory (the root of SDClass) only
+
+bool SDClass::begin( uint8_t csPin )
+{
+  root.close();
+  return card.init( 0, csPin ) && volume.init( card ) && root.openRoot( volume );
+}
+
+static const char * leafName( const char * path )
+{
+  return * path == '/' ? path + 1 : path;
+}
+
+bool SDClass::exists( const char * path )
+{
+  SdFile f;
+  if( ! strcmp( path, "/" ))
+    return true;
+  if( ! f.open( & root, leafName( path ), O_READ ))
+    return false;
+  f.close();
+  return true;
+}
+
+bool SDClass::remove( const char * path )
+{
+  return SdFile::remove( & root, leafName( path ));
+}
+
+bool SDClass::mkdir( const char * path )
+{
+  return false;
+}
+
+bool SDClass::rmdir( const char * path )
+{
+  return false;
+}
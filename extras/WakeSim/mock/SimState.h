@@ -0,0 +1,106 @@
+/*
+ * State of the wake-cycle simulator shared by the stand-ins of the hardware
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                        SHARED STATE OF THE SIMULATOR                       **
+ **                                                                            **
+ *******************************************************************************/
+
+// Each wake runs in a process of its own, forked from the simulator: the
+//   RAM of the sketch starts as after a reset. What survives a deep sleep
+//   on the board lives here, in memory shared with the simulator: the RTC
+//   user memory, the DS3231, the card (a mapped image file) and the
+//   counters of the work done.
+//
+// Time is virtual. It only moves when the sketch waits (delay(), pulseIn(),
+//   a conversion of the probes), when the card is accessed (a cost per
+//   block) and when the sketch yields (SIM_YIELD_US).
+
+#ifndef SIM_STATE_H
+#define SIM_STATE_H
+
+#include <stdint.h>
+#include "SdBlockDev.h"
+
+#define SIM_YIELD_US     1000     // time given to the system by yield()
+#define SIM_TZ_SECONDS   ( 13 * 3600L )   // local time of the sketch - UTC
+
+struct SimSample
+{
+  double   seconds;         // virtual time of the sample
+  double   height;          // cm, of the water (not of the range finder)
+};
+
+struct SimState
+{
+  // Clock
+  uint64_t clockUs;         // virtual time since the start of the simulation
+  uint64_t wakeUs;          // clockUs at the start of the wake
+  uint32_t startTime;       // local time at clockUs 0, seconds since 2000
+  int32_t  rtcDrift;        // DS3231 - true time, changed by SetDateTime()
+
+  // Options
+  uint32_t readUs;          // cost of a block read from the card
+  uint32_t writeUs;         //   of a block written
+  uint8_t  probes;          // DS18B20 probes on the bus
+  bool     serial;          // echo the Serial output
+  bool     ftpWake;         // the trigger pin is low at this wake
+  bool     network;         // servers listen on 127.0.0.1, see wake_sim --serve
+
+  // RTC user memory of the ESP8266, blocks 64 to 191
+  uint8_t  rtcMem[ 512 ];
+  uint64_t rtcWrites;       // bytes written
+
+  // Card: image file mapped in memory
+  uint8_t  * image;
+  uint32_t blocks;
+  uint64_t reads, writes;   // blocks
+  uint32_t * blockWrites;   // writes of each block
+  IoCount  io[ IO_OPS ];    // by operation, see SdBlockDev.h
+  uint64_t tearWrite;       // the power is cut at this block write (sim->writes), 0 never
+  uint16_t tearBytes;       //   when this many bytes of the block are written
+  uint64_t failWrite;       // this block write fails, the card is left as it was, 0 never
+
+  // Heights measured, see simRecordSample()
+  SimSample * samples;
+  uint32_t nSamples, maxSamples;
+
+  // End of the wake
+  bool     slept;           // ESP.deepSleep() was called
+  uint64_t sleepUs;         //   for that long
+  uint32_t logSize;         // size of the log of the sketch
+  uint64_t hostNs;          // host time taken by the wake
+  bool     torn;            // the power was cut while a block was written
+};
+
+extern SimState * sim;
+
+// Local time of the DS3231, in seconds since 2000-01-01
+uint32_t simRtcTime();
+
+// Water, see Water.cpp
+bool   simLoadTrace( const char * name );
+bool   simHasTrace();
+double simHeight( double seconds );
+double simTraceTemp( double seconds );
+void   simRecordSample( double seconds, double height );
+
+// Called by ESP.deepSleep(): end of the wake
+void simDeepSleep( uint64_t us ) __attribute__(( noreturn ));
+
+#endif // SIM_STATE_H
@@ -0,0 +1 @@
+// Ticker of the ESP8266 core: not used by the sketch
@@ -0,0 +1,105 @@
+#include "SimState.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// Water recorded, replayed instead of the tide
+
+struct TracePoint
+{
+  double seconds;           // from the start of the record
+  double height;            // cm
+  double temp;              // C
+};
+
+static std::vector< TracePoint > trace;   // loaded before the wakes are forked
+
+// Load a record of the water: lines "seconds,height_cm,temp_c", other
+//   lines (a header) are skipped. It is played again from its start when
+//   its end is reached.
+//
+// return:
+//    false if the file can't be read or has less than 2 points
+
+bool simLoadTrace( const char * name )
+{
+  FILE * f = fopen( name, "r" );
+  char line[ 256 ];
+  TracePoint p;
+
+  if( f == NULL )
+  {
+    perror( name );
+    return false;
+  }
+  while( fgets( line, sizeof( line ), f ) != NULL )
+    if( sscanf( line, "%lf,%lf,%lf", & p.seconds, & p.height, & p.temp ) == 3 &&
+        ( trace.empty() || p.seconds > trace.back().seconds ))
+      trace.push_back( p );
+  fclose( f );
+  if( trace.size() < 2 )
+  {
+    fprintf( stderr, "%s: no record of the water\n", name );
+    trace.clear();
+    return false;
+  }
+  return true;
+}
+
+bool simHasTrace()
+{
+  return ! trace.empty();
+}
+
+// Point of the trace at a time, by linear interpolation
+
+static TracePoint tracePoint( double seconds )
+{
+  double span = trace.back().seconds - trace.front().seconds;
+  double t = trace.front().seconds + fmod( seconds, span );
+  size_t lo = 0, hi = trace.size() - 1;
+  TracePoint p;
+
+  while( hi - lo > 1 )
+  {
+    size_t mid = ( lo + hi ) / 2;
+    if( trace[ mid ].seconds <= t )
+      lo = mid;
+    else
+      hi = mid;
+  }
+  double k = ( t - trace[ lo ].seconds ) / ( trace[ hi ].seconds - trace[ lo ].seconds );
+  p.seconds = seconds;
+  p.height = trace[ lo ].height + k * ( trace[ hi ].height - trace[ lo ].height );
+  p.temp = trace[ lo ].temp + k * ( trace[ hi ].temp - trace[ lo ].temp );
+  return p;
+}
+
+// Height of the water: the trace, else a tide of 12 h 25 min
+
+double simHeight( double seconds )
+{
+  if( ! trace.empty())
+    return tracePoint( seconds ).height;
+  return 120 + 30 * sin( 2 * M_PI * seconds / 44712 );
+}
+
+// Temperature at the first probe, from the trace
+
+double simTraceTemp( double seconds )
+{
+  return tracePoint( seconds ).temp;
+}
+
+// Keep a height measured by the sketch, for the error of the series
+
+void simRecordSample( double seconds, double height )
+{
+  if( sim->samples != NULL && sim->nSamples < sim->maxSamples )
+  {
+    sim->samples[ sim->nSamples ].seconds = seconds;
+    sim->samples[ sim->nSamples ].height = height;
+    sim->nSamples ++;
+  }
+}
@@ -0,0 +1,192 @@
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include "ESP8266WiFi.h"
+#include "SimState.h"
+
+// Address of the board: the host when servers listen
+
+IPAddress ESP8266WiFiClass::localIP()
+{
+  return sim->network ? IPAddress( 127, 0, 0, 1 ) : IPAddress( 192, 168, 4, 2 );
+}
+
+static void nonBlocking( int fd )
+{
+  int on = 1;
+  ioctl( fd, FIONBIO, & on );
+}
+
+//------------------------------------------------------------------------------
+// Client
+
+WiFiClient::WiFiClient( int fd )
+{
+  nonBlocking( fd );
+  sock = std::make_shared< Socket >( fd );
+}
+
+WiFiClient::Socket::~Socket()
+{
+  if( fd >= 0 )
+    close( fd );
+}
+
+// Connected while the peer did not close, or while bytes are left to read
+
+uint8_t WiFiClient::connected()
+{
+  char c;
+
+  if( ! sock || sock->fd < 0 )
+    return false;
+  int n = recv( sock->fd, & c, 1, MSG_PEEK | MSG_DONTWAIT );
+  return n > 0 || ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ));
+}
+
+int WiFiClient::connect( IPAddress ip, uint16_t port )
+{
+  struct sockaddr_in a;
+  int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+  if( fd < 0 )
+    return false;
+  memset( & a, 0, sizeof( a ));
+  a.sin_family = AF_INET;
+  a.sin_port = htons( port );
+  a.sin_addr.s_addr = (uint32_t) ip;
+  if( ::connect( fd, (struct sockaddr *) & a, sizeof( a )) < 0 )
+  {
+    close( fd );
+    return false;
+  }
+  * this = WiFiClient( fd );
+  return true;
+}
+
+void WiFiClient::stop()
+{
+  if( sock && sock->fd >= 0 )
+  {
+    close( sock->fd );
+    sock->fd = -1;
+  }
+  sock.reset();
+}
+
+size_t WiFiClient::write( const uint8_t * buf, size_t size )
+{
+  size_t done = 0;
+
+  while( sock && sock->fd >= 0 && done < size )
+  {
+    ssize_t n = send( sock->fd, buf + done, size - done, MSG_NOSIGNAL );
+    if( n > 0 )
+      done += n;
+    else if( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ))
+    {
+      struct pollfd p = { sock->fd, POLLOUT, 0 };
+      if( poll( & p, 1, 5000 ) <= 0 )
+        break;
+    }
+    else
+      break;
+  }
+  return done;
+}
+
+int WiFiClient::available()
+{
+  int n = 0;
+
+  if( ! sock || sock->fd < 0 || ioctl( sock->fd, FIONREAD, & n ) < 0 )
+    return 0;
+  return n;
+}
+
+int WiFiClient::read()
+{
+  uint8_t c;
+  return read( & c, 1 ) == 1 ? c : -1;
+}
+
+int WiFiClient::read( uint8_t * buf, size_t size )
+{
+  if( ! sock || sock->fd < 0 )
+    return -1;
+  ssize_t n = recv( sock->fd, buf, size, MSG_DONTWAIT );
+  return n > 0 ? n : -1;
+}
+
+int WiFiClient::peek()
+{
+  uint8_t c;
+
+  if( ! sock || sock->fd < 0 || recv( sock->fd, & c, 1, MSG_PEEK | MSG_DONTWAIT ) != 1 )
+    return -1;
+  return c;
+}
+
+void WiFiClient::setNoDelay( bool noDelay )
+{
+  int on = noDelay;
+  if( sock && sock->fd >= 0 )
+    setsockopt( sock->fd, IPPROTO_TCP, TCP_NODELAY, & on, sizeof( on ));
+}
+
+IPAddress WiFiClient::remoteIP()
+{
+  struct sockaddr_in a;
+  socklen_t len = sizeof( a );
+  IPAddress ip;
+
+  if( sock && sock->fd >= 0 && getpeername( sock->fd, (struct sockaddr *) & a, & len ) == 0 )
+    memcpy( & ip[ 0 ], & a.sin_addr.s_addr, 4 );
+  return ip;
+}
+
+//------------------------------------------------------------------------------
+// Server
+
+void WiFiServer::begin()
+{
+  struct sockaddr_in a;
+  int on = 1;
+
+  if( fd >= 0 || ! sim->network )
+    return;
+  fd = socket( AF_INET, SOCK_STREAM, 0 );
+  if( fd < 0 )
+    return;
+  setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, & on, sizeof( on ));
+  memset( & a, 0, sizeof( a ));
+  a.sin_family = AF_INET;
+  a.sin_port = htons( port );
+  a.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+  if( bind( fd, (struct sockaddr *) & a, sizeof( a )) < 0 || listen( fd, 4 ) < 0 )
+  {
+    perror( "listen" );
+    close( fd );
+    fd = -1;
+    return;
+  }
+  nonBlocking( fd );
+}
+
+void WiFiServer::stop()
+{
+  if( fd >= 0 )
+    close( fd );
+  fd = -1;
+}
+
+WiFiClient WiFiServer::available()
+{
+  int c = fd >= 0 ? accept( fd, NULL, NULL ) : -1;
+  return c >= 0 ? WiFiClient( c ) : WiFiClient();
+}
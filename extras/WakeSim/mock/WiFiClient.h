@@ -0,0 +1,78 @@
+/*
+ * TCP of the ESP8266 core, for the simulator: sockets of the host
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// A server listens on 127.0.0.1 if sim->network is set (wake_sim --serve).
+//   Else (the wake-cycle simulator) nothing listens: no client ever
+//   connects.
+//
+// Sockets are non-blocking, except write(): it waits until all is sent,
+//   as the core does. Copies of a client share its socket, closed with
+//   the last copy or by stop().
+
+#ifndef WIFI_CLIENT_H
+#define WIFI_CLIENT_H
+
+#include <memory>
+#include "Arduino.h"
+
+class WiFiClient : public Stream
+{
+public:
+  WiFiClient() {}
+  WiFiClient( int fd );
+
+  uint8_t connected();
+  int     connect( IPAddress ip, uint16_t port );
+  int     connect( const char * host, uint16_t port ) { return false; }
+  void    stop();
+  size_t  write( uint8_t c ) { return write( & c, 1 ); }
+  size_t  write( const uint8_t * buf, size_t size );
+  using   Print::write;
+  int     available();
+  int     availableForWrite() { return sock ? 1460 : 0; }
+  int     read();
+  int     read( uint8_t * buf, size_t size );
+  int     peek();
+  void    flush() {}
+  void    setNoDelay( bool noDelay );
+  IPAddress remoteIP();
+  operator bool() { return sock && sock->fd >= 0; }
+
+private:
+  struct Socket
+  {
+    int fd;
+    Socket( int f ) : fd( f ) {}
+    ~Socket();
+  };
+  std::shared_ptr< Socket > sock;
+};
+
+class WiFiServer
+{
+public:
+  WiFiServer( uint16_t p ) : port( p ), fd( -1 ) {}
+  void       begin();
+  void       stop();
+  WiFiClient available();
+
+private:
+  uint16_t port;
+  int      fd;
+};
+
+#endif // WIFI_CLIENT_H
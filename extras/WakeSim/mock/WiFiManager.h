@@ -0,0 +1,34 @@
+/*
+ * WiFiManager for the wake-cycle simulator: always connected
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include "ESP8266WiFi.h"
+
+class WiFiManager
+{
+public:
+  void   setAPCallback( void (*func)( WiFiManager * )) {}
+  void   setMinimumSignalQuality( int quality = 8 ) {}
+  void   setConfigPortalTimeout( unsigned long seconds ) {}
+  void   resetSettings() {}
+  bool   autoConnect( const char * apName, const char * apPassword ) { delay( 2000 ); return true; }
+  String getConfigPortalSSID() { return "ESP8266"; }
+};
+
+#endif // WIFI_MANAGER_H
@@ -0,0 +1,41 @@
+/*
+ * UDP of the ESP8266 core, for the wake-cycle simulator: an NTP server
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WIFI_UDP_H
+#define WIFI_UDP_H
+
+#include "Arduino.h"
+
+// Answers the request written with beginPacket() and endPacket() with the
+//   true time of the virtual clock
+
+class WiFiUDP
+{
+public:
+  WiFiUDP() { requested = false; }
+  uint8_t begin( uint16_t port ) { return true; }
+  int     beginPacket( const char * host, uint16_t port ) { requested = false; return true; }
+  size_t  write( const uint8_t * buf, size_t size ) { requested = size == 48; return size; }
+  int     endPacket() { return true; }
+  int     parsePacket() { return requested ? 48 : 0; }
+  int     read( uint8_t * buf, size_t size );
+
+private:
+  bool requested;
+};
+
+#endif // WIFI_UDP_H
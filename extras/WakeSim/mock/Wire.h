@@ -0,0 +1,30 @@
+/*
+ * Wire of the Arduino core: I2C of the DS3231, see RtcDS3231.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WIRE_H
+#define WIRE_H
+
+class TwoWire
+{
+public:
+  void begin() {}
+  void begin( int sda, int scl ) {}
+};
+
+extern TwoWire Wire;
+
+#endif // WIRE_H
@@ -0,0 +1 @@
+// eboot of the ESP8266: not simulated
@@ -0,0 +1 @@
+// Flash of the ESP8266: not simulated
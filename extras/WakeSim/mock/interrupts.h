@@ -0,0 +1 @@
+// Interrupt locks of the ESP8266: not needed on the host
@@ -0,0 +1,40 @@
+/*
+ * MD5 of the ESP8266 core, for the wake-cycle simulator
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MD5_H
+#define MD5_H
+
+#include <stdint.h>
+
+typedef struct
+{
+  uint32_t state[ 4 ];
+  uint32_t count[ 2 ];
+  uint8_t  buffer[ 64 ];
+} md5_context_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void MD5Init( md5_context_t * context );
+void MD5Update( md5_context_t * context, const uint8_t * buf, const uint16_t len );
+void MD5Final( uint8_t hash[ 16 ], md5_context_t * context );
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MD5_H
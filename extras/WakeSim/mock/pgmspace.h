@@ -0,0 +1,2 @@
+// Program memory of the ESP8266: plain memory on the host, see Arduino.h
+#include "Arduino.h"
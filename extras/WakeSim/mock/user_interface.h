@@ -0,0 +1,45 @@
+/*
+ * RTC user memory and reset of the ESP8266, for the wake-cycle simulator
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef USER_INTERFACE_H
+#define USER_INTERFACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct rst_info
+{
+  uint32_t reason;
+  uint32_t exccause;
+  uint32_t epc1, epc2, epc3;
+  uint32_t excvaddr;
+  uint32_t depc;
+};
+
+#define REASON_DEEP_SLEEP_AWAKE 5
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+bool system_rtc_mem_read( uint8_t src_addr, void * des_addr, uint16_t load_size );
+bool system_rtc_mem_write( uint8_t des_addr, const void * src_addr, uint16_t save_size );
+void esp_yield();
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USER_INTERFACE_H
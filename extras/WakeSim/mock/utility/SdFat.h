@@ -0,0 +1,228 @@
+/*
+ * SdFat of the Arduino SD library for the wake-cycle simulator
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                      FAT16 VOLUME OVER AN IMAGE FILE                       **
+ **                                                                            **
+ *******************************************************************************/
+
+// The part of SdFat (the version in the Arduino SD library) used by the
+//   datalogger, over a FAT16 volume without partition table in the image of
+//   the simulator. The card is read and written the way SdFat does it: one
+//   block of cache shared by all the files, FAT entries changed in the
+//   cache and written to both FATs when the cache is flushed, directory
+//   entry written by sync(), whole blocks written around the cache.
+//
+// Files of the root directory only: subdirectories can be read, not made.
+
+#ifndef SD_FAT_H
+#define SD_FAT_H
+
+#include "Arduino.h"
+
+#define O_READ   0X01
+#define O_RDONLY O_READ
+#define O_WRITE  0X02
+#define O_WRONLY O_WRITE
+#define O_RDWR   ( O_READ | O_WRITE )
+#define O_ACCMODE ( O_READ | O_WRITE )
+#define O_APPEND 0X04
+#define O_SYNC   0X08
+#define O_CREAT  0X10
+#define O_EXCL   0X20
+#define O_TRUNC  0X40
+
+#define DIR_NAME_0XE5     0X05
+#define DIR_NAME_DELETED  0XE5
+#define DIR_NAME_FREE     0X00
+#define DIR_ATT_READ_ONLY 0X01
+#define DIR_ATT_VOLUME_ID 0X08
+#define DIR_ATT_DIRECTORY 0X10
+#define DIR_ATT_FILE_TYPE_MASK ( DIR_ATT_VOLUME_ID | DIR_ATT_DIRECTORY )
+
+typedef struct directoryEntry
+{
+  uint8_t  name[ 11 ];
+  uint8_t  attributes;
+  uint8_t  reservedNT;
+  uint8_t  creationTimeTenths;
+  uint16_t creationTime;
+  uint16_t creationDate;
+  uint16_t lastAccessDate;
+  uint16_t firstClusterHigh;
+  uint16_t lastWriteTime;
+  uint16_t lastWriteDate;
+  uint16_t firstClusterLow;
+  uint32_t fileSize;
+} __attribute__(( packed )) dir_t;
+
+static inline uint8_t DIR_IS_FILE( const dir_t * dir ) { return ( dir->attributes & DIR_ATT_FILE_TYPE_MASK ) == 0; }
+static inline uint8_t DIR_IS_SUBDIR( const dir_t * dir ) { return ( dir->attributes & DIR_ATT_FILE_TYPE_MASK ) == DIR_ATT_DIRECTORY; }
+static inline uint8_t DIR_IS_FILE_OR_SUBDIR( const dir_t * dir ) { return ( dir->attributes & DIR_ATT_VOLUME_ID ) == 0; }
+
+static inline uint16_t FAT_DATE( uint16_t year, uint8_t month, uint8_t day ) { return ( year - 1980 ) << 9 | month << 5 | day; }
+static inline uint16_t FAT_TIME( uint8_t hour, uint8_t minute, uint8_t second ) { return hour << 11 | minute << 5 | second >> 1; }
+static inline uint16_t FAT_YEAR( uint16_t fatDate ) { return 1980 + ( fatDate >> 9 ); }
+static inline uint8_t  FAT_MONTH( uint16_t fatDate ) { return ( fatDate >> 5 ) & 0XF; }
+static inline uint8_t  FAT_DAY( uint16_t fatDate ) { return fatDate & 0X1F; }
+static inline uint8_t  FAT_HOUR( uint16_t fatTime ) { return fatTime >> 11; }
+static inline uint8_t  FAT_MINUTE( uint16_t fatTime ) { return ( fatTime >> 5 ) & 0X3F; }
+static inline uint8_t  FAT_SECOND( uint16_t fatTime ) { return 2 * ( fatTime & 0X1F ); }
+
+// Card: blocks of the image of the simulator, each access counted
+
+class Sd2Card
+{
+public:
+  uint8_t  init( uint8_t sckRateID = 0, uint8_t chipSelectPin = 0 );
+  uint32_t cardSize();
+  uint8_t  readBlock( uint32_t block, uint8_t * dst );
+  uint8_t  writeBlock( uint32_t block, const uint8_t * src );
+};
+
+class SdVolume
+{
+public:
+  uint8_t  init( Sd2Card * dev );
+  uint8_t  init( Sd2Card & dev ) { return init( & dev ); }
+
+  uint8_t  blocksPerCluster() const { return blocksPerCluster_; }
+  uint32_t blocksPerFat() const { return blocksPerFat_; }
+  uint32_t clusterCount() const { return clusterCount_; }
+  uint8_t  clusterSizeShift() const { return clusterSizeShift_; }
+  uint32_t dataStartBlock() const { return dataStartBlock_; }
+  uint8_t  fatCount() const { return fatCount_; }
+  uint32_t fatStartBlock() const { return fatStartBlock_; }
+  uint8_t  fatType() const { return fatType_; }
+  uint32_t rootDirEntryCount() const { return rootDirEntryCount_; }
+  uint32_t rootDirStart() const { return rootDirStart_; }
+
+  static uint8_t * cacheClear();
+  static Sd2Card * sdCard() { return sdCard_; }
+
+  // Private in SdFat, where SdFile is a friend
+  uint32_t clusterStartBlock( uint32_t cluster ) const
+             { return dataStartBlock_ + (( cluster - 2 ) << clusterSizeShift_ ); }
+  uint8_t  blockOfCluster( uint32_t position ) const
+             { return ( position >> 9 ) & ( blocksPerCluster_ - 1 ); }
+  bool     isEOC( uint32_t cluster ) const { return cluster >= 0XFFF8; }
+  uint8_t  fatGet( uint32_t cluster, uint32_t * value );
+  uint8_t  fatPut( uint32_t cluster, uint32_t value );
+  uint8_t  freeChain( uint32_t cluster );
+  uint8_t  chainSize( uint32_t cluster, uint32_t * size );
+  uint8_t  allocContiguous( uint32_t count, uint32_t * curCluster );
+
+  static uint8_t  cacheFlush();
+  static uint8_t  cacheRawBlock( uint32_t block, bool forWrite );
+  static void     cacheSetDirty() { cacheDirty_ = true; }
+  static uint8_t  * cacheBuffer() { return cache_; }
+  static uint32_t cacheBlockNumber_;
+
+private:
+  static Sd2Card  * sdCard_;
+  static uint8_t  cache_[ 512 ];
+  static bool     cacheDirty_;
+  static uint32_t cacheMirrorBlock_;  // second FAT, written with the cache
+
+  uint32_t allocSearchStart_;
+  uint8_t  blocksPerCluster_;
+  uint32_t blocksPerFat_;
+  uint32_t clusterCount_;
+  uint8_t  clusterSizeShift_;
+  uint32_t dataStartBlock_;
+  uint8_t  fatCount_;
+  uint32_t fatStartBlock_;
+  uint8_t  fatType_;
+  uint16_t rootDirEntryCount_;
+  uint32_t rootDirStart_;
+};
+
+class SdFile : public Print
+{
+public:
+  SdFile() { type_ = 0; }
+
+  uint8_t  openRoot( SdVolume * vol );
+  uint8_t  openRoot( SdVolume & vol ) { return openRoot( & vol ); }
+  uint8_t  open( SdFile * dirFile, const char * fileName, uint8_t oflag );
+  uint8_t  open( SdFile & dirFile, const char * fileName, uint8_t oflag ) { return open( & dirFile, fileName, oflag ); }
+  uint8_t  open( SdFile * dirFile, uint16_t index, uint8_t oflag );
+  uint8_t  createContiguous( SdFile * dirFile, const char * fileName, uint32_t size );
+  uint8_t  close();
+  uint8_t  sync();
+
+  int16_t  read();
+  int16_t  read( void * buf, uint16_t nbyte );
+  int8_t   readDir( dir_t * dir );
+  size_t   write( uint8_t b ) { return write( & b, 1 ); }
+  size_t   write( const void * buf, uint16_t nbyte );
+  size_t   write( const char * str ) { return write( str, strlen( str )); }
+
+  uint8_t  seekSet( uint32_t pos );
+  uint8_t  seekCur( uint32_t pos ) { return seekSet( curPosition_ + pos ); }
+  uint8_t  seekEnd() { return seekSet( fileSize_ ); }
+  void     rewind() { curPosition_ = curCluster_ = 0; }
+  uint8_t  truncate( uint32_t length );
+  uint8_t  remove();
+  static uint8_t remove( SdFile * dirFile, const char * fileName );
+  uint8_t  contiguousRange( uint32_t * bgnBlock, uint32_t * endBlock );
+  uint8_t  dirEntry( dir_t * dir );
+  static void dirName( const dir_t & dir, char * name );
+  static void dateTimeCallback( void (*dateTime)( uint16_t * date, uint16_t * time ))
+                { dateTime_ = dateTime; }
+
+  uint32_t curCluster() const { return curCluster_; }
+  uint32_t curPosition() const { return curPosition_; }
+  uint32_t dirBlock() const { return dirBlock_; }
+  uint8_t  dirIndex() const { return dirIndex_; }
+  uint32_t fileSize() const { return fileSize_; }
+  uint32_t firstCluster() const { return firstCluster_; }
+  uint8_t  isDir() const { return type_ >= FAT_FILE_TYPE_ROOT16; }
+  uint8_t  isFile() const { return type_ == FAT_FILE_TYPE_NORMAL; }
+  uint8_t  isOpen() const { return type_ != FAT_FILE_TYPE_CLOSED; }
+  uint8_t  isRoot() const { return type_ == FAT_FILE_TYPE_ROOT16; }
+  uint8_t  type() const { return type_; }
+  SdVolume * volume() const { return vol_; }
+
+  static const uint8_t FAT_FILE_TYPE_CLOSED = 0;
+  static const uint8_t FAT_FILE_TYPE_NORMAL = 1;
+  static const uint8_t FAT_FILE_TYPE_ROOT16 = 2;
+  static const uint8_t FAT_FILE_TYPE_SUBDIR = 4;
+
+private:
+  static const uint8_t F_FILE_DIR_DIRTY = 0X80;
+
+  uint8_t  addCluster();
+  dir_t    * cacheDirEntry( bool forWrite );
+  dir_t    * readDirCache();
+  uint8_t  openCachedEntry( uint8_t dirIndex, uint8_t oflag );
+
+  static void (*dateTime_)( uint16_t * date, uint16_t * time );
+
+  uint8_t  flags_;
+  uint8_t  type_;
+  uint32_t curCluster_;
+  uint32_t curPosition_;
+  uint32_t dirBlock_;
+  uint8_t  dirIndex_;
+  uint32_t fileSize_;
+  uint32_t firstCluster_;
+  SdVolume * vol_;
+};
+
+#endif // SD_FAT_H
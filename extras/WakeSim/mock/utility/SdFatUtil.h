@@ -0,0 +1 @@
+// SdFatUtil of the Arduino SD library: nothing of it is used
@@ -0,0 +1,215 @@
+/*
+ * Check of the rollups, with a sink that records what it is given
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                           ROLLUPS ON THE HOST                              **
+ **                                                                            **
+ *******************************************************************************/
+
+// Runs Rollup of src/ on the mocked card and RTC memory, without the
+//   sketch. A new Rollup object that calls begin() is a new wake.
+//
+//   - boundaries: samples over the end of a minute, an hour and a day; the
+//     buckets closed, in order, with their aggregates, and a minute
+//     without temperature
+//   - files: the lines of each tier in its file, after the header
+//   - loss: the RTC memory is lost; the minute file goes on after the
+//     lines written since its last checkpoint
+//
+// Build and run, from the root of the repository (host_test.py does it):
+//
+//   g++ -std=gnu++11 -O2 -Iextras/WakeSim/mock -Isrc -o rollup_test
+//       extras/WakeSim/rollup_test.cpp extras/WakeSim/mock/*.cpp src/*.cpp
+//   ./rollup_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <string>
+#include <vector>
+#include "Rollup.h"
+#include "SdList.h"
+#include "SimState.h"
+#include "CardImage.h"
+
+#define TEST_IMAGE "rollup_test.img"
+#define T0         581212680UL      // 2018-06-01 23:58, in seconds since 2000
+#define NO_TEMP    -127.0           // probe not read
+
+SimState * sim;
+SdList sdl;
+
+void simDeepSleep( uint64_t us )
+{
+  exit( 0 );
+}
+
+// Stand-in of the MQTT client: keeps the lines
+
+class RecordSink : public TelemetrySink
+{
+public:
+  bool publish( const uint8_t * payload, uint16_t len )
+  {
+    lines.push_back( std::string( (const char *) payload, len ));
+    return true;
+  }
+
+  std::vector< std::string > lines;
+};
+
+static uint16_t failures = 0;
+
+static void check( const char * what, bool cond )
+{
+  printf( "%-50s %s\n", what, cond ? "ok" : "FAILED" );
+  if( ! cond )
+    failures ++;
+}
+
+static const char * const files[] = { "ROLLMIN.CSV", "ROLLHOUR.CSV", "ROLLDAY.CSV" };
+static const char * const header =
+  "Start, Samples, Height min (cm), Height max (cm), Height mean (cm), "
+  "Temperature min (C), Temperature max (C), Temperature mean (C)\r\n";
+
+// A new card and an empty RTC memory
+
+static void reset()
+{
+  for( uint8_t i = 0; i < 3; i ++ )
+    sdl.remove( files[ i ]);
+  memset( sim->rtcMem, 0, sizeof( sim->rtcMem ));
+}
+
+// Content of a file of the root directory
+
+static std::string content( const char * name )
+{
+  SdFile f;
+  std::string s;
+  char buf[ 512 ];
+  int16_t n;
+
+  if( ! sdl.openRootFile( & f, name, O_READ ))
+    return s;
+  while(( n = f.read( buf, sizeof( buf ))) > 0 )
+    s.append( buf, n );
+  f.close();
+  return s;
+}
+
+// A wake that takes a sample
+
+static void wake( RecordSink * sink, uint32_t time, float heightCm, float tempC )
+{
+  Rollup r;
+  r.begin();
+  r.setSink( sink );
+  r.add( time, heightCm, tempC );
+}
+
+// What the file of a tier should hold, from the lines published
+
+static std::string expected( const RecordSink & sink, const char * tier )
+{
+  std::string s = header;
+  size_t n = strlen( tier ) + 2;
+
+  for( size_t i = 0; i < sink.lines.size(); i ++ )
+    if( ! sink.lines[ i ].compare( 0, n, std::string( tier ) + ", " ))
+      s += sink.lines[ i ].substr( n ) + "\r\n";
+  return s;
+}
+
+static void testBoundaries()
+{
+  RecordSink sink;
+  const char * closed[] = {
+    "minute, 2018-06-01 23:58, 3, 10.0, 30.0, 20.0, 20.00, 22.00, 21.00",
+    "minute, 2018-06-01 23:59, 3, 40.0, 60.0, 50.0, 20.00, 22.00, 21.00",
+    "hour, 2018-06-01 23:00, 6, 10.0, 60.0, 35.0, 20.00, 22.00, 21.00",
+    "day, 2018-06-01 00:00, 6, 10.0, 60.0, 35.0, 20.00, 22.00, 21.00",
+    "minute, 2018-06-02 00:00, 1, 70.0, 70.0, 70.0, , , " };
+  bool same = true;
+
+  reset();
+  wake( & sink, T0, 10, 20 );
+  wake( & sink, T0 + 20, 20, 21 );
+  wake( & sink, T0 + 40, 30, 22 );
+  check( "boundaries: nothing closed within a minute", sink.lines.empty());
+  wake( & sink, T0 + 60, 40, 20 );
+  wake( & sink, T0 + 80, 50, NO_TEMP );
+  wake( & sink, T0 + 100, 60, 22 );
+  wake( & sink, T0 + 120, 70, NO_TEMP );   // the next day
+  wake( & sink, T0 + 180, 80, NO_TEMP );
+  for( uint8_t i = 0; i < 5; i ++ )
+    same = same && i < sink.lines.size() && sink.lines[ i ] == closed[ i ];
+  check( "boundaries: buckets closed in order, aggregates", same && sink.lines.size() == 5 );
+  if( ! same )
+    for( size_t i = 0; i < sink.lines.size(); i ++ )
+      printf( "  %s\n", sink.lines[ i ].c_str());
+
+  Rollup r;
+  r.begin();
+  check( "files: minute lines seen after sync()", r.sync() &&
+         content( files[ 0 ]) == expected( sink, "minute" ));
+  check( "files: hour lines", content( files[ 1 ]) == expected( sink, "hour" ));
+  check( "files: day lines", content( files[ 2 ]) == expected( sink, "day" ));
+}
+
+static void testLoss()
+{
+  RecordSink sink;
+
+  reset();
+  for( uint32_t i = 0; i <= 10; i ++ )
+    wake( & sink, T0 + 600 + 60 * i, i, 20 );
+  memset( sim->rtcMem, 0xA5, sizeof( sim->rtcMem ));   // loss of power
+  for( uint32_t i = 20; i <= 25; i ++ )
+    wake( & sink, T0 + 600 + 60 * i, i, 20 );
+  Rollup r;
+  r.begin();
+  check( "loss: minute lines kept, and the next after them", r.sync() &&
+         sink.lines.size() == 15 && content( files[ 0 ]) == expected( sink, "minute" ));
+}
+
+int main()
+{
+  uint32_t blocks;
+
+  sim = (SimState *) mmap( NULL, sizeof( SimState ), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+  memset( sim, 0, sizeof( SimState ));
+  sim->image = simOpenImage( TEST_IMAGE, 64, true, & blocks );
+  if( sim->image == NULL )
+    return 1;
+  sim->blocks = blocks;
+  sim->blockWrites = (uint32_t *) calloc( blocks, sizeof( uint32_t ));
+  if( ! sdl.begin( 15 ))
+  {
+    printf( "can't mount the card\n" );
+    return 1;
+  }
+
+  testBoundaries();
+  testLoss();
+
+  remove( TEST_IMAGE );
+  printf( "%u failure(s)\n", failures );
+  return failures > 0;
+}
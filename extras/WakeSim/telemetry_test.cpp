@@ -0,0 +1,249 @@
+/*
+ * Check of the telemetry queue, with a sink that records what it is given
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                       TELEMETRY QUEUE ON THE HOST                          **
+ **                                                                            **
+ *******************************************************************************/
+
+// Runs Telemetry of src/ on the mocked card and RTC memory, without the
+//   sketch. A new Telemetry object that calls begin() is a new wake.
+//
+//   - framing: each payload is a batch as described in Telemetry.h
+//   - resume: a publish fails in the middle of the spill file; the next
+//     flush, at the next wake, goes on from the batch that failed
+//   - spill: a block write of the card fails while the RTC queue is moved
+//     to the card, at each write of the spill in turn; no sample is
+//     published twice, none accepted by push() is lost
+//
+// Build and run, from the root of the repository (host_test.py does it):
+//
+//   g++ -std=gnu++11 -O2 -Iextras/WakeSim/mock -Isrc -o telemetry_test
+//       extras/WakeSim/telemetry_test.cpp extras/WakeSim/mock/*.cpp src/*.cpp
+//   ./telemetry_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <vector>
+#include "Telemetry.h"
+#include "SdList.h"
+#include "SimState.h"
+#include "CardImage.h"
+
+#define TEST_IMAGE "telemetry_test.img"
+
+SimState * sim;
+SdList sdl;
+
+void simDeepSleep( uint64_t us )
+{
+  exit( 0 );
+}
+
+// Stand-in of the MQTT client: keeps the payloads, refuses the publish
+//   given by failAt (1 is the first), or all of them if down
+
+class RecordSink : public TelemetrySink
+{
+public:
+  RecordSink() : down( false ), failAt( 0 ), calls( 0 ) {}
+
+  bool publish( const uint8_t * payload, uint16_t len )
+  {
+    calls ++;
+    if( down || calls == failAt )
+      return false;
+    payloads.push_back( std::vector< uint8_t >( payload, payload + len ));
+    return true;
+  }
+
+  // Times of the samples received, and false if a payload is not a batch
+  bool samples( std::vector< uint32_t > * times )
+  {
+    for( size_t i = 0; i < payloads.size(); i ++ )
+    {
+      const std::vector< uint8_t > & p = payloads[ i ];
+      if( p.size() < 4 || p[ 0 ] != 'T' || p[ 1 ] != TELEMETRY_VERSION ||
+          p[ 3 ] != sizeof( TelemetrySample ) || p[ 2 ] == 0 || p[ 2 ] > TELEMETRY_BATCH ||
+          p.size() != 4 + p[ 2 ] * sizeof( TelemetrySample ))
+        return false;
+      for( uint8_t j = 0; j < p[ 2 ]; j ++ )
+      {
+        TelemetrySample s;
+        memcpy( & s, & p[ 4 + j * sizeof( s )], sizeof( s ));
+        if( s.height != (int16_t)( s.time % 100 * 10 ) || s.temp != 2000 )
+          return false;
+        times->push_back( s.time );
+      }
+    }
+    return true;
+  }
+
+  bool     down;
+  uint16_t failAt;
+  uint16_t calls;
+  std::vector< std::vector< uint8_t > > payloads;
+};
+
+static uint16_t failures = 0;
+
+static void check( const char * what, bool cond )
+{
+  printf( "%-50s %s\n", what, cond ? "ok" : "FAILED" );
+  if( ! cond )
+    failures ++;
+}
+
+// A new card and an empty RTC memory
+
+static void reset()
+{
+  sdl.remove( TELEMETRY_SPILL );
+  memset( sim->rtcMem, 0, sizeof( sim->rtcMem ));
+}
+
+// The sample of 'time' has a height of time % 100 cm and 20 C
+
+static bool push( Telemetry * t, uint32_t time )
+{
+  return t->push( time, time % 100, 20.0 );
+}
+
+static bool sameTimes( const std::vector< uint32_t > & got, const std::vector< uint32_t > & sent )
+{
+  return got == sent;
+}
+
+static void testFraming()
+{
+  RecordSink sink;
+  std::vector< uint32_t > sent, got;
+  Telemetry t;
+
+  reset();
+  t.begin();
+  for( uint32_t i = 1; i <= 30; i ++ )
+    if( push( & t, 1000 + i ))
+      sent.push_back( 1000 + i );
+  check( "framing: 30 samples queued", sent.size() == 30 && t.pending() == 30 );
+  check( "framing: all published", t.flush( & sink ) == 30 && t.pending() == 0 );
+  check( "framing: batches as in Telemetry.h, in order", sink.samples( & got ) &&
+         sameTimes( got, sent ));
+  check( "framing: nothing left to publish", t.flush( & sink ) == 0 && sink.calls == 2 );
+}
+
+static void testResume()
+{
+  RecordSink sink;
+  std::vector< uint32_t > sent, got;
+
+  reset();
+  {
+    Telemetry t;
+    t.begin();
+    for( uint32_t i = 1; i <= 80; i ++ )
+      if( push( & t, 2000 + i ))
+        sent.push_back( 2000 + i );
+    sink.failAt = 2;          // the second batch of the spill file fails
+    check( "resume: first batch published", t.flush( & sink ) == TELEMETRY_BATCH );
+    check( "resume: the others wait", t.pending() == 80 - TELEMETRY_BATCH );
+  }
+  {
+    Telemetry t;              // next wake
+    t.begin();
+    check( "resume: the queue survives the wake", t.pending() == 80 - TELEMETRY_BATCH );
+    check( "resume: the rest published", t.flush( & sink ) == 80 - TELEMETRY_BATCH &&
+           t.pending() == 0 );
+  }
+  check( "resume: no sample twice, none lost", sink.samples( & got ) && sameTimes( got, sent ));
+}
+
+// A write of the card fails during the spill, at write 'k' of the push
+//   that moves the RTC queue
+
+static bool spillFails( uint16_t k, bool * pFailed )
+{
+  RecordSink sink;
+  std::vector< uint32_t > sent, got;
+
+  reset();
+  * pFailed = false;
+  {
+    Telemetry t;
+    t.begin();
+    for( uint32_t i = 1; i <= 3 * TELEMETRY_RTC_SAMPLES + 2; i ++ )
+    {
+      if( i == 2 * TELEMETRY_RTC_SAMPLES + 1 )
+        sim->failWrite = sim->writes + k;
+      if( push( & t, 3000 + i ))
+        sent.push_back( 3000 + i );
+      else
+        * pFailed = true;
+    }
+    sim->failWrite = 0;
+  }
+  Telemetry t;                // next wake
+  t.begin();
+  t.flush( & sink );
+  return sink.samples( & got ) && sameTimes( got, sent ) && t.pending() == 0;
+}
+
+static void testSpill()
+{
+  bool ok = true, failed, anyFailed = false;
+
+  for( uint16_t k = 1; k <= 8; k ++ )
+  {
+    if( ! spillFails( k, & failed ))
+    {
+      printf( "  write %u of the spill failed: duplicates or losses\n", k );
+      ok = false;
+    }
+    anyFailed |= failed;
+  }
+  check( "spill: a failed write is seen by push()", anyFailed );
+  check( "spill: no sample twice, none lost", ok );
+}
+
+int main()
+{
+  uint32_t blocks;
+
+  sim = (SimState *) mmap( NULL, sizeof( SimState ), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+  memset( sim, 0, sizeof( SimState ));
+  sim->image = simOpenImage( TEST_IMAGE, 32, true, & blocks );
+  if( sim->image == NULL )
+    return 1;
+  sim->blocks = blocks;
+  sim->blockWrites = (uint32_t *) calloc( blocks, sizeof( uint32_t ));
+  if( ! sdl.begin( 15 ))
+  {
+    printf( "can't mount the card\n" );
+    return 1;
+  }
+
+  testFraming();
+  testResume();
+  testSpill();
+
+  remove( TEST_IMAGE );
+  printf( "%u failure(s)\n", failures );
+  return failures > 0;
+}
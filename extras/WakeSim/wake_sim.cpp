@@ -0,0 +1,446 @@
+/*
+ * Wake-cycle simulator of the datalogger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                       WAKE-CYCLE SIMULATOR ON THE HOST                     **
+ **                                                                            **
+ *******************************************************************************/
+
+// Runs setup() and loop() of example/ESP8266_datalogger.ino, with the
+//   library of src/, wake after wake: a year of 10 s wakes in minutes, a
+//   day in seconds. The sensors, the DS3231, the RTC memory and the card
+//   are mocked (see mock/), the card by a FAT16 image file that can be
+//   read with mtools after the run. The clock is virtual.
+//
+// Build, from the root of the repository:
+//
+//   g++ -std=gnu++11 -O2 -Iextras/WakeSim/mock -Isrc -o wake_sim
+//       extras/WakeSim/wake_sim.cpp extras/WakeSim/mock/*.cpp src/*.cpp
+//
+// Run:
+//
+//   ./wake_sim --days 1
+//   ./wake_sim --wakes 1000 --image card.img --csv wakes.csv
+//   ./wake_sim --days 30 --trace water.csv
+//   ./wake_sim --days 1 --tear 7
+//   ./wake_sim --serve --image card.img --keep
+//
+// Report: card blocks read and written per wake, write amplification of
+//   the log, blocks most written, time of a wake (virtual and on the host)
+//   and bytes written to RTC memory.
+//
+// Servers: with --serve the trigger pin is low at each wake, and stays
+//   low: the sketch serves FTP and HTTP, and samples, until the simulator
+//   is killed. The servers listen on 127.0.0.1 and the clock is the one of
+//   the host. Build with ports that need no rights:
+//
+//   g++ -std=gnu++11 -O2 -DFTP_CTRL_PORT=2121 -DFTP_DATA_PORT_PASV=2122
+//       -DHTTP_PORT=8080 -Iextras/WakeSim/mock -Isrc -o wake_sim ...
+//
+//   Scripts of extras/ then run against it, see extras/WakeSim/host_test.py.
+//
+// Loss of power: --power-loss clears the RTC memory between two wakes,
+//   --tear cuts the power in the middle of a block written by the wake: the
+//   card keeps a part of the block, the RTC memory is lost, and the next
+//   wake starts from what is on the card.
+//
+// Sampling: the interval between two samples is set by SamplePacer. The
+//   height is a tide, or a record of the water given by --trace. The report
+//   gives the samples taken, the energy they cost, and how far the height
+//   drawn from the samples is from the true one. To compare with a fixed
+//   interval, build again with -DPACER_MAX_SECONDS=10.
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "SimState.h"
+#include "CardImage.h"
+
+static SimState bootState;          // until main() maps the shared one
+SimState * sim = & bootState;
+
+// Functions of the sketch, declared by the Arduino IDE
+
+class RtcDateTime;
+class WiFiManager;
+namespace MQTT { class Publish; }
+void printDateTime( const RtcDateTime & dt );
+String returnDateTime( const RtcDateTime & dt );
+void sdDateTime( uint16_t * date, uint16_t * time );
+void callback( const MQTT::Publish & pub );
+void configModeCallback( WiFiManager * myWiFiManager );
+void startNetwork();
+void FTP_WiFiConfig();
+void sampleTask();
+void mqttTask();
+void ftpTask();
+void httpTask();
+bool sample();
+void stopWiFi();
+void stopWiFiAndSleep();
+String getTime();
+void setRTC();
+void sendNTPpacket( const char * );
+
+#include "../../example/ESP8266_datalogger.ino"
+
+#define SIM_READ_US      500      // SPI at 20 MHz, with the wait for the card
+#define SIM_WRITE_US     1500     //   and its busy time after a write
+#define SIM_IMAGE_MB     256
+#define SIM_HOT_BLOCKS   8        // blocks most written, in the report
+#define SIM_AWAKE_MA     40       // ESP8266 with WiFi off, and the card
+#define SIM_WIFI_MA      80       //   with WiFi on, in an FTP window
+#define SIM_ASLEEP_UA    100      // deep sleep: ESP8266, DS3231, card idle
+#define SIM_BOOT_MS      250      // boot before setup(), not on the clock
+#define SIM_TRUTH_STEP   10       // seconds between two points of the true height
+#define SIM_MAX_SAMPLES  ( 1UL << 22 )
+#define SIM_TEAR_WRITES  4        // the power is cut at one of the first block writes of a wake
+
+static uint64_t hostNow()
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, & ts );
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t wakeHostNs;
+
+// End of a wake: what the board keeps is in *sim, the rest is lost
+
+void simDeepSleep( uint64_t us )
+{
+  sim->slept = true;
+  sim->sleepUs = us;
+  sim->logSize = logFile.size();
+  sim->hostNs = hostNow() - wakeHostNs;
+  for( uint8_t i = 0; i < IO_OPS; i ++ )
+  {
+    const IoCount * c = & SdBlockDev::counts()[ i ];
+    sim->io[ i ].ops += c->ops;
+    for( uint8_t r = 0; r < IO_REGIONS; r ++ )
+    {
+      sim->io[ i ].reads[ r ] += c->reads[ r ];
+      sim->io[ i ].writes[ r ] += c->writes[ r ];
+    }
+    sim->io[ i ].micros += c->micros;
+  }
+  fflush( stdout );
+  _exit( 0 );
+}
+
+//------------------------------------------------------------------------------
+
+// Standard output, with the line ends of the host
+
+class StdoutPrint : public Print
+{
+public:
+  size_t write( uint8_t c ) { if( c != '\r' ) putchar( c ); return 1; }
+};
+
+struct Stat
+{
+  uint64_t min, max, sum;
+  uint32_t n;
+
+  Stat() { min = UINT64_MAX; max = sum = n = 0; }
+  void add( uint64_t v ) { min = v < min ? v : min; max = v > max ? v : max; sum += v; n ++; }
+  void print( const char * name, double scale = 1 )
+  {
+    printf( "  %-20s %12.1f %12.1f %12.1f\n", name, n ? min / scale : 0,
+            n ? sum / scale / n : 0, max / scale );
+  }
+};
+
+static void usage()
+{
+  fprintf( stderr,
+    "usage: wake_sim [options]\n"
+    "  --days N         simulate N days of wakes (default 1)\n"
+    "  --wakes N        simulate N wakes\n"
+    "  --image FILE     card image (default card.img)\n"
+    "  --size MB        size of a new image (default %d)\n"
+    "  --keep           keep the card of the previous run, else formatted\n"
+    "  --read-us N      cost of a block read (default %d)\n"
+    "  --write-us N     cost of a block write (default %d)\n"
+    "  --probes N       DS18B20 on the bus (default 1)\n"
+    "  --ftp-every N    trigger pin low at every Nth wake: 4.30 min of FTP window\n"
+    "  --power-loss N   RTC memory lost at every Nth wake\n"
+    "  --tear N         power cut while a block is written, at every Nth wake\n"
+    "  --serve          serve FTP and HTTP on 127.0.0.1 until killed\n"
+    "  --trace FILE     water recorded: lines seconds,height_cm,temp_c\n"
+    "  --awake-ma N     current of a wake (default %d, %d with WiFi)\n"
+    "  --asleep-ua N    current in deep sleep (default %d)\n"
+    "  --csv FILE       work of each wake\n"
+    "  --serial         echo the Serial output\n",
+    SIM_IMAGE_MB, SIM_READ_US, SIM_WRITE_US, SIM_AWAKE_MA, SIM_WIFI_MA, SIM_ASLEEP_UA );
+  exit( 2 );
+}
+
+int main( int argc, char ** argv )
+{
+  const char * imageName = "card.img";
+  const char * csvName = NULL;
+  double days = 1;
+  uint32_t wakes = 0, sizeMB = SIM_IMAGE_MB, ftpEvery = 0, powerLoss = 0, tear = 0;
+  double awakeMa = SIM_AWAKE_MA, asleepUa = SIM_ASLEEP_UA;
+  bool format = true;
+  bool serve = false;
+
+  sim = (SimState *) mmap( NULL, sizeof( SimState ), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+  memset( sim, 0, sizeof( SimState ));
+  sim->readUs = SIM_READ_US;
+  sim->writeUs = SIM_WRITE_US;
+  sim->probes = 1;
+  for( int i = 1; i < argc; i ++ )
+  {
+    const char * a = argv[ i ];
+    const char * v = i + 1 < argc ? argv[ i + 1 ] : NULL;
+    if( ! strcmp( a, "--keep" ))
+      format = false;
+    else if( ! strcmp( a, "--serial" ))
+      sim->serial = true;
+    else if( ! strcmp( a, "--serve" ))
+      serve = true;
+    else if( v == NULL )
+      usage();
+    else if( ! strcmp( a, "--days" ))
+      days = atof( v ), i ++;
+    else if( ! strcmp( a, "--wakes" ))
+      wakes = atol( v ), i ++;
+    else if( ! strcmp( a, "--image" ))
+      imageName = v, i ++;
+    else if( ! strcmp( a, "--size" ))
+      sizeMB = atol( v ), i ++;
+    else if( ! strcmp( a, "--read-us" ))
+      sim->readUs = atol( v ), i ++;
+    else if( ! strcmp( a, "--write-us" ))
+      sim->writeUs = atol( v ), i ++;
+    else if( ! strcmp( a, "--probes" ))
+      sim->probes = atoi( v ), i ++;
+    else if( ! strcmp( a, "--ftp-every" ))
+      ftpEvery = atol( v ), i ++;
+    else if( ! strcmp( a, "--power-loss" ))
+      powerLoss = atol( v ), i ++;
+    else if( ! strcmp( a, "--tear" ))
+      tear = atol( v ), i ++;
+    else if( ! strcmp( a, "--trace" ))
+    {
+      if( ! simLoadTrace( v ))
+        return 1;
+      i ++;
+    }
+    else if( ! strcmp( a, "--awake-ma" ))
+      awakeMa = atof( v ), i ++;
+    else if( ! strcmp( a, "--asleep-ua" ))
+      asleepUa = atof( v ), i ++;
+    else if( ! strcmp( a, "--csv" ))
+      csvName = v, i ++;
+    else
+      usage();
+  }
+  sim->maxSamples = SIM_MAX_SAMPLES;
+  sim->samples = (SimSample *) mmap( NULL, sim->maxSamples * sizeof( SimSample ),
+                                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+  if( sim->samples == MAP_FAILED )
+  {
+    perror( "mmap" );
+    return 1;
+  }
+
+  // Card
+  sim->image = simOpenImage( imageName, sizeMB, format, & sim->blocks );
+  if( sim->image == NULL )
+    return 1;
+  sim->blockWrites = (uint32_t *) mmap( NULL, sim->blocks * sizeof( uint32_t ), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+  if( sim->blockWrites == MAP_FAILED )
+  {
+    perror( "mmap" );
+    return 1;
+  }
+  memset( sim->blockWrites, 0, sim->blocks * sizeof( uint32_t ));
+
+  // Clock: the DS3231 holds the build time of the simulator at the first
+  //   wake, the RTC memory is garbage after power up
+  sim->startTime = RtcDateTime( __DATE__, __TIME__ ).TotalSeconds();
+  srand( 1 );
+  for( uint16_t i = 0; i < sizeof( sim->rtcMem ); i ++ )
+    sim->rtcMem[ i ] = rand();
+
+  // Every wake is an FTP window, that lasts: the first wake of a new log
+  //   only writes its header
+  if( serve )
+  {
+    sim->network = true;
+    wakes = 0xFFFFFFFF;
+    printf( "serving FTP on port %u, HTTP on port %u\n", FTP_CTRL_PORT, HTTP_PORT );
+  }
+
+  FILE * csv = csvName != NULL ? fopen( csvName, "w" ) : NULL;
+  if( csv != NULL )
+    fprintf( csv, "wake,ftp,reads,writes,wake_ms,host_us,rtc_bytes,log_size\n" );
+
+  uint64_t endUs = wakes > 0 ? UINT64_MAX : (uint64_t) ( days * 86400e6 );
+  uint64_t logBytes = 0;
+  uint32_t lastLog = 0, nWakes = 0, nFtp = 0, nTorn = 0;
+  Stat reads, writes, wakeMs, hostUs, rtcBytes, sleepS;
+  double awakeS = 0, asleepS = 0, mAs = 0;
+
+  for( uint32_t w = 0; wakes > 0 ? w < wakes : sim->clockUs < endUs; w ++ )
+  {
+    if(( powerLoss > 0 && w > 0 && w % powerLoss == 0 ) || sim->torn )
+      for( uint16_t i = 0; i < sizeof( sim->rtcMem ); i ++ )
+        sim->rtcMem[ i ] = rand();
+    sim->torn = false;
+    sim->tearWrite = 0;
+    if( tear > 0 && w > 0 && w % tear == 0 )
+    {
+      sim->tearWrite = sim->writes + 1 + rand() % SIM_TEAR_WRITES;
+      sim->tearBytes = rand() % 512;
+    }
+    sim->ftpWake = serve || ( ftpEvery > 0 && w > 0 && w % ftpEvery == 0 );
+    sim->wakeUs = sim->clockUs;
+    sim->slept = false;
+    uint64_t r0 = sim->reads, w0 = sim->writes, b0 = sim->rtcWrites;
+
+    fflush( stdout );
+    pid_t pid = fork();
+    if( pid == 0 )
+    {
+      if( serve )
+        prctl( PR_SET_PDEATHSIG, SIGTERM );   // killed with the simulator
+      wakeHostNs = hostNow();
+      setup();
+      for( ;; )
+        loop();
+    }
+    int status;
+    if( pid < 0 || waitpid( pid, & status, 0 ) < 0 || ( ! sim->slept && ! sim->torn ))
+    {
+      fprintf( stderr, "wake %u: the sketch ended without deep sleep\n", w );
+      return 1;
+    }
+    if( sim->torn )
+    {
+      nTorn ++;                 // the board starts again, after a while
+      sim->clockUs += SIM_BOOT_MS * 1000ULL;
+      continue;
+    }
+
+    uint64_t nr = sim->reads - r0, nw = sim->writes - w0, nb = sim->rtcWrites - b0;
+    uint64_t us = sim->clockUs - sim->wakeUs;
+    if( sim->logSize > lastLog )
+      logBytes += sim->logSize - lastLog;
+    lastLog = sim->logSize;
+    nWakes ++;
+    nFtp += sim->ftpWake;
+    awakeS += us / 1e6 + SIM_BOOT_MS / 1e3;
+    asleepS += sim->sleepUs / 1e6;
+    mAs += ( us / 1e6 + SIM_BOOT_MS / 1e3 ) * ( sim->ftpWake ? SIM_WIFI_MA : awakeMa ) +
+           sim->sleepUs / 1e6 * asleepUa / 1000;
+    if( ! sim->ftpWake )      // an FTP window would hide the sampling wakes
+    {
+      reads.add( nr );
+      writes.add( nw );
+      wakeMs.add( us );
+      hostUs.add( sim->hostNs );
+      rtcBytes.add( nb );
+      sleepS.add( sim->sleepUs );
+    }
+    if( csv != NULL )
+      fprintf( csv, "%u,%d,%llu,%llu,%.1f,%.1f,%llu,%u\n", w, sim->ftpWake,
+               (unsigned long long) nr, (unsigned long long) nw, us / 1e3,
+               sim->hostNs / 1e3, (unsigned long long) nb, sim->logSize );
+    sim->clockUs += sim->sleepUs;
+  }
+  if( csv != NULL )
+    fclose( csv );
+  simSyncImage();
+
+  // Report
+  uint32_t distinct = 0;
+  std::vector< uint32_t > hot;
+  for( uint32_t b = 0; b < sim->blocks; b ++ )
+    if( sim->blockWrites[ b ] > 0 )
+    {
+      distinct ++;
+      hot.push_back( b );
+    }
+  std::sort( hot.begin(), hot.end(), []( uint32_t a, uint32_t b )
+             { return sim->blockWrites[ a ] > sim->blockWrites[ b ]; });
+
+  printf( "\n%u wakes (%u with FTP window) over %.2f days, image %s\n",
+          nWakes, nFtp, sim->clockUs / 86400e6, imageName );
+  printf( "log: %u bytes, %llu appended\n", lastLog, (unsigned long long) logBytes );
+  if( tear > 0 )
+    printf( "power cut while a block was written: %u wakes\n", nTorn );
+  printf( "card: %llu blocks read, %llu written, %u distinct blocks written\n",
+          (unsigned long long) sim->reads, (unsigned long long) sim->writes, distinct );
+  if( logBytes > 0 )
+    printf( "write amplification: %.2f (bytes written to the card / bytes appended)\n",
+            512.0 * sim->writes / logBytes );
+  printf( "blocks most written:\n" );
+  for( uint32_t i = 0; i < hot.size() && i < SIM_HOT_BLOCKS; i ++ )
+    printf( "  %8u %-8s %10u\n", hot[ i ], simRegion( sim->image, hot[ i ] ), sim->blockWrites[ hot[ i ]] );
+  printf( "by operation, blocks read/written (SITE IO):\n" );
+  StdoutPrint out;
+  SdBlockDev::print( out, "  ", sim->io );
+  printf( "per sampling wake:      %12s %12s %12s\n", "min", "mean", "max" );
+  reads.print( "blocks read" );
+  writes.print( "blocks written" );
+  wakeMs.print( "wake time (ms)", 1e3 );
+  hostUs.print( "host time (us)", 1e3 );
+  rtcBytes.print( "RTC bytes written" );
+  sleepS.print( "sleep (s)", 1e6 );
+
+  // Energy, and the height drawn from the samples against the true one
+  double simDays = ( awakeS + asleepS ) / 86400;
+  printf( "sampling: %u samples, %.1f a day, interval %d to %d s\n", sim->nSamples,
+          simDays > 0 ? sim->nSamples / simDays : 0, PACER_MIN_SECONDS, PACER_MAX_SECONDS );
+  printf( "energy: %.2f mAh a day, awake %.0f s a day (boot included)\n",
+          simDays > 0 ? mAs / 3600 / simDays : 0, simDays > 0 ? awakeS / simDays : 0 );
+  if( sim->nSamples >= 2 )
+  {
+    double maxErr = 0, sumSq = 0;
+    uint32_t n = 0, over = 0, i = 0;
+    const SimSample * p = sim->samples;
+    for( double t = p[ 0 ].seconds; t <= p[ sim->nSamples - 1 ].seconds; t += SIM_TRUTH_STEP )
+    {
+      while( i + 2 < sim->nSamples && p[ i + 1 ].seconds <= t )
+        i ++;
+      double k = ( t - p[ i ].seconds ) / ( p[ i + 1 ].seconds - p[ i ].seconds );
+      double err = fabs( p[ i ].height + k * ( p[ i + 1 ].height - p[ i ].height ) - simHeight( t ));
+      maxErr = err > maxErr ? err : maxErr;
+      sumSq += err * err;
+      over += err > PACER_HEIGHT_STEP;
+      n ++;
+    }
+    printf( "height from the samples: max error %.2f cm, rms %.2f cm, %u s off by more than %.1f cm\n",
+            maxErr, sqrt( sumSq / n ), over * SIM_TRUTH_STEP, (double) PACER_HEIGHT_STEP );
+  }
+  return 0;
+}
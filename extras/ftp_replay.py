@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+#
+# Replay FTP sessions recorded by the server with SITE TRACE ON
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# The trace file (FTPTRACE.TXT, fetched from the card) holds the control
+# channel of each session, with the time of each command. This script
+# sends the same commands to a server, with their original timing, and
+# reports the latency of each command and the total time of each session.
+#
+# Data connections are opened as the client did (PASV). PORT is replayed as
+# PASV. Listings and downloads are read and thrown away, uploads send as
+# many zero bytes as were recorded.
+#
+# Commands that change the card (STOR, DELE, RNFR/RNTO, MKD, RMD, SITE
+# SNAPSHOT...) are skipped unless --allow-writes is given: replayed on the
+# logger in the field, they would delete or overwrite the data collected.
+# Run them against the simulator of the board instead, that serves a card
+# image (extras/WakeSim/wake_sim.cpp --serve, see extras/WakeSim/host_test.py).
+#
+# The memory used by each command on the device (M events of the trace) is
+# summed up too, and --mem prints the peaks of the server after the replay
+# (SITE MEM), so that two versions of the firmware can be compared.
+#
+# usage:
+#   ftp_replay.py FTPTRACE.TXT 192.168.1.20 --user Ukrit --password xxx
+#   ftp_replay.py FTPTRACE.TXT 192.168.1.20 --speed 0   (no pauses)
+#   ftp_replay.py FTPTRACE.TXT 192.168.1.20 --user Ukrit --password xxx --mem
+#   ftp_replay.py FTPTRACE.TXT 127.0.0.1 --port 2121 --allow-writes
+
+import argparse
+import re
+import socket
+import sys
+import time
+
+DATA_COMMANDS = ("LIST", "NLST", "MLSD", "RETR", "STOR")
+WRITE_COMMANDS = ("STOR", "STOU", "APPE", "DELE", "RNFR", "RNTO", "MKD", "XMKD",
+                  "RMD", "XRMD")
+READ_SITE = ("FREE", "IO", "MEM", "PAGE", "RING", "TAR", "ZBENCH")
+
+
+def writes_card(text):
+    """True for a command that changes the card"""
+    words = text.split()
+    cmd = words[0].upper() if words else ""
+    if cmd == "SITE":
+        return len(words) < 2 or words[1].upper() not in READ_SITE
+    return cmd in WRITE_COMMANDS
+
+
+def read_sessions(path):
+    """Return a list of sessions, each a list of
+    (ms, command, upload bytes, memory sample or None)"""
+    sessions = []
+    cur = None
+    last = None
+    with open(path, errors="replace") as f:
+        for raw in f:
+            raw = raw.rstrip("\r\n")
+            if len(raw) < 3:
+                continue
+            kind, _, rest = raw.partition(" ")
+            ms, _, text = rest.partition(" ")
+            if kind == "S":
+                cur = []
+                sessions.append(cur)
+            elif kind == "C" and cur is not None:
+                last = [int(ms), text, 0, None]
+                cur.append(last)
+            elif kind == "X" and last is not None:
+                last[2] = int(text.split()[0])
+            elif kind == "M" and last is not None:
+                last[3] = [int(x) for x in text.split()]
+            elif kind == "E":
+                cur = None
+    return sessions
+
+
+class Control:
+    def __init__(self, host, port, timeout):
+        self.sock = socket.create_connection((host, port), timeout)
+        self.buf = b""
+
+    def line(self):
+        while b"\n" not in self.buf:
+            chunk = self.sock.recv(1024)
+            if not chunk:
+                raise EOFError("control connection closed")
+            self.buf += chunk
+        line, _, self.buf = self.buf.partition(b"\n")
+        return line.decode(errors="replace").rstrip("\r")
+
+    def reply(self):
+        """Read a complete reply, return its code and last line"""
+        line = self.line()
+        code = line[:3]
+        if len(line) > 3 and line[3] == "-":
+            while not (line.startswith(code) and line[3:4] == " "):
+                line = self.line()
+        return int(code), line
+
+    def send(self, text):
+        self.sock.sendall(text.encode() + b"\r\n")
+
+
+def pasv_address(line):
+    m = re.search(r"(\d+),(\d+),(\d+),(\d+),(\d+),(\d+)", line)
+    if not m:
+        return None
+    n = [int(x) for x in m.groups()]
+    return "%d.%d.%d.%d" % tuple(n[:4]), n[4] * 256 + n[5]
+
+
+def replay(session, args, stats, skipped):
+    ctl = Control(args.host, args.port, args.timeout)
+    ctl.reply()  # greeting
+    start = time.monotonic()
+    data_addr = None
+    for ms, text, upload, _ in session:
+        if args.speed > 0:
+            wait = start + ms / 1000.0 / args.speed - time.monotonic()
+            if wait > 0:
+                time.sleep(wait)
+        cmd = text.split(" ", 1)[0].upper()
+        if not args.allow_writes and writes_card(text):
+            skipped.setdefault(cmd, 0)
+            skipped[cmd] += 1
+            if cmd in DATA_COMMANDS:
+                data_addr = None  # the PASV before it is lost
+            continue
+        if cmd == "USER" and args.user:
+            text = "USER " + args.user
+        elif cmd == "PASS":
+            text = "PASS " + (args.password or "")
+        elif cmd == "PORT":
+            cmd, text = "PASV", "PASV"
+        t0 = time.monotonic()
+        data = None
+        if cmd in DATA_COMMANDS and data_addr:
+            data = socket.create_connection(data_addr, args.timeout)
+        ctl.send(text)
+        code, line = ctl.reply()
+        if code < 200 and data is not None:
+            if cmd == "STOR":
+                data.sendall(b"\0" * upload)
+                data.close()
+            else:
+                while data.recv(4096):
+                    pass
+            code, line = ctl.reply()
+        if data is not None:
+            data.close()
+            data_addr = None
+        ms_cmd = (time.monotonic() - t0) * 1000.0
+        if cmd == "PASV" and code == 227:
+            data_addr = pasv_address(line)
+        stats.setdefault(cmd, []).append(ms_cmd)
+        if args.verbose:
+            print("%8.1f ms  %-30s %s" % (ms_cmd, text[:30], line))
+        if cmd == "QUIT":
+            break
+    ctl.sock.close()
+    return time.monotonic() - start
+
+
+def memory_table(sessions):
+    """Print the worst memory sample recorded for each command"""
+    worst = {}
+    for session in sessions:
+        for _, text, _, mem in session:
+            if mem is None or len(mem) < 5:
+                continue
+            cmd = text.split(" ", 1)[0].upper()
+            w = worst.get(cmd)
+            if w is None:
+                worst[cmd] = list(mem)
+            else:
+                # stack, heap free, largest block, fragmentation, allocations
+                worst[cmd] = [max(w[0], mem[0]), min(w[1], mem[1]),
+                              min(w[2], mem[2]), max(w[3], mem[3]), max(w[4], mem[4])]
+    if not worst:
+        return
+    print()
+    print("recorded on the device:")
+    print("%-6s %8s %8s %8s %5s %7s" % ("cmd", "stack", "heap", "block", "frag", "allocs"))
+    for cmd in sorted(worst):
+        print("%-6s %8d %8d %8d %4d%% %7d" % ((cmd,) + tuple(worst[cmd])))
+
+
+def site_mem(args):
+    """Log in and print the reply to SITE MEM"""
+    ctl = Control(args.host, args.port, args.timeout)
+    ctl.reply()
+    ctl.send("USER " + (args.user or ""))
+    ctl.reply()
+    ctl.send("PASS " + (args.password or ""))
+    code, line = ctl.reply()
+    if code != 230:
+        print("SITE MEM: " + line)
+        return
+    ctl.send("SITE MEM")
+    line = ctl.line()
+    print()
+    while True:
+        print(line)
+        if not line.startswith("211-"):
+            break
+        line = ctl.line()
+    ctl.send("QUIT")
+    ctl.sock.close()
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__)
+    p.add_argument("trace")
+    p.add_argument("host")
+    p.add_argument("--port", type=int, default=21)
+    p.add_argument("--user")
+    p.add_argument("--password")
+    p.add_argument("--speed", type=float, default=1.0,
+                   help="time scale of the pauses, 0 for none")
+    p.add_argument("--timeout", type=float, default=30.0)
+    p.add_argument("--allow-writes", action="store_true",
+                   help="replay the commands that change the card too")
+    p.add_argument("--mem", action="store_true",
+                   help="print SITE MEM of the server after the replay")
+    p.add_argument("-v", "--verbose", action="store_true")
+    args = p.parse_args()
+
+    sessions = read_sessions(args.trace)
+    if not sessions:
+        sys.exit("no session in " + args.trace)
+    stats = {}
+    skipped = {}
+    total = 0.0
+    for i, s in enumerate(sessions):
+        t = replay(s, args, stats, skipped)
+        total += t
+        print("session %d: %d commands, %.3f s" % (i + 1, len(s), t))
+    print()
+    print("%-6s %6s %10s %10s %10s" % ("cmd", "count", "min ms", "mean ms", "max ms"))
+    for cmd in sorted(stats):
+        v = stats[cmd]
+        print("%-6s %6d %10.1f %10.1f %10.1f" % (cmd, len(v), min(v), sum(v) / len(v), max(v)))
+    print("total: %.3f s for %d sessions" % (total, len(sessions)))
+    if skipped:
+        print("skipped, they change the card (see --allow-writes): " +
+              ", ".join("%s %d" % (c, n) for c, n in sorted(skipped.items())))
+    memory_table(sessions)
+    if args.mem:
+        site_mem(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+#
+# Compare the download of a file in MODE S and in MODE Z
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# The file is downloaded once in MODE S, then in MODE Z at each level
+# given. For each download the script reports the bytes on air, the time
+# and the rate of useful bytes, and checks that the inflated data is the
+# same as in MODE S. SITE ZBENCH is then asked for the time the server
+# takes to compress, without the link. The exit status is 1 if a download
+# does not inflate to the data of MODE S.
+#
+# usage:
+#   ftp_zbench.py 192.168.1.20 BUSH.CSV --user Ukrit --password xxx
+#   ftp_zbench.py 192.168.1.20 BUSH.CSV --levels 1 6 9
+
+import argparse
+import re
+import socket
+import sys
+import time
+import zlib
+
+
+class Control:
+    def __init__(self, host, port, timeout):
+        self.sock = socket.create_connection((host, port), timeout)
+        self.buf = b""
+
+    def line(self):
+        while b"\n" not in self.buf:
+            chunk = self.sock.recv(1024)
+            if not chunk:
+                raise EOFError("control connection closed")
+            self.buf += chunk
+        line, _, self.buf = self.buf.partition(b"\n")
+        return line.decode(errors="replace").rstrip("\r")
+
+    def reply(self):
+        """Read a complete reply, return its code and its lines"""
+        lines = [self.line()]
+        code = lines[0][:3]
+        if lines[0][3:4] == "-":
+            while not (lines[-1].startswith(code) and lines[-1][3:4] == " "):
+                lines.append(self.line())
+        return int(code), lines
+
+    def command(self, text):
+        """Send a command, return its code and the lines of the reply"""
+        self.sock.sendall(text.encode() + b"\r\n")
+        return self.reply()
+
+
+def retrieve(ctl, host, name, timeout):
+    """Download a file, return its raw bytes and the time taken"""
+    code, lines = ctl.command("PASV")
+    if code != 227:
+        sys.exit("PASV: " + lines[-1])
+    n = [int(x) for x in re.search(r"(\d+),(\d+),(\d+),(\d+),(\d+),(\d+)", lines[-1]).groups()]
+    t0 = time.monotonic()
+    data = socket.create_connection((host, n[4] * 256 + n[5]), timeout)
+    code, lines = ctl.command("RETR " + name)
+    if code >= 300:
+        sys.exit("RETR: " + lines[-1])
+    raw = bytearray()
+    while True:
+        chunk = data.recv(8192)
+        if not chunk:
+            break
+        raw += chunk
+    data.close()
+    ctl.reply()
+    return bytes(raw), time.monotonic() - t0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__)
+    p.add_argument("host")
+    p.add_argument("file")
+    p.add_argument("--port", type=int, default=21)
+    p.add_argument("--user", default="")
+    p.add_argument("--password", default="")
+    p.add_argument("--levels", type=int, nargs="+", default=[1, 6, 9])
+    p.add_argument("--timeout", type=float, default=60.0)
+    args = p.parse_args()
+
+    ctl = Control(args.host, args.port, args.timeout)
+    ctl.reply()  # greeting
+    ctl.command("USER " + args.user)
+    code, lines = ctl.command("PASS " + args.password)
+    if code != 230:
+        sys.exit("login: " + lines[-1])
+    ctl.command("TYPE I")
+
+    differs = 0
+    print("%-8s %10s %10s %8s %10s" % ("mode", "on air", "ratio", "s", "KB/s"))
+    ctl.command("MODE S")
+    plain, t = retrieve(ctl, args.host, args.file, args.timeout)
+    print("%-8s %10d %10.2f %8.2f %10.1f" % ("S", len(plain), 1.0, t, len(plain) / t / 1000))
+    code, lines = ctl.command("MODE Z")
+    if code != 200:
+        sys.exit("MODE Z: " + lines[-1])
+    for level in args.levels:
+        ctl.command("OPTS MODE Z LEVEL %d" % level)
+        raw, t = retrieve(ctl, args.host, args.file, args.timeout)
+        try:
+            ok = zlib.decompress(raw) == plain
+        except zlib.error:
+            ok = False
+        differs += not ok
+        print("%-8s %10d %10.2f %8.2f %10.1f%s" % ("Z%d" % level, len(raw), len(plain) / max(len(raw), 1),
+              t, len(plain) / t / 1000, "" if ok else "  DATA DIFFERS"))
+    ctl.command("MODE S")
+    code, lines = ctl.command("SITE ZBENCH " + args.file)
+    print()
+    for line in lines:
+        print(line[4:])
+    ctl.command("QUIT")
+    sys.exit(1 if differs else 0)
+
+
+if __name__ == "__main__":
+    main()
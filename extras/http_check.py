@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+#
+# Check the HTTP file server of the datalogger
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Sends, on a single kept-alive connection, the requests a collector makes
+# and checks the answers against a full download of the file:
+#   whole file, byte ranges, suffix range, range past the end (416),
+#   If-None-Match and If-Modified-Since (304), If-Range, HEAD, missing file,
+#   files of the servers and other directories (403).
+#
+# usage:
+#   http_check.py 192.168.1.20 /BUSH.CSV [--port 80]
+
+import argparse
+import http.client
+import sys
+
+failures = 0
+
+
+def check(what, cond):
+    global failures
+    print("%-40s %s" % (what, "ok" if cond else "FAILED"))
+    if not cond:
+        failures += 1
+
+
+def get(conn, method, path, headers=None):
+    conn.request(method, path, headers=headers or {})
+    r = conn.getresponse()
+    return r, r.read()
+
+
+def main():
+    p = argparse.ArgumentParser()
+    p.add_argument("host")
+    p.add_argument("path")
+    p.add_argument("--port", type=int, default=80)
+    args = p.parse_args()
+
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=10)
+    r, full = get(conn, "GET", args.path)
+    check("GET whole file", r.status == 200 and len(full) == int(r.getheader("Content-Length")))
+    etag = r.getheader("ETag")
+    modified = r.getheader("Last-Modified")
+    check("ETag and Last-Modified", etag is not None and modified is not None)
+    size = len(full)
+    sock = conn.sock
+
+    if size > 10:
+        r, body = get(conn, "GET", args.path, {"Range": "bytes=2-9"})
+        check("Range bytes=2-9", r.status == 206 and body == full[2:10] and
+              r.getheader("Content-Range") == "bytes 2-9/%d" % size)
+        r, body = get(conn, "GET", args.path, {"Range": "bytes=%d-" % (size - 5)})
+        check("Range bytes=n- (tail)", r.status == 206 and body == full[-5:])
+        r, body = get(conn, "GET", args.path, {"Range": "bytes=-7"})
+        check("Range bytes=-7 (suffix)", r.status == 206 and body == full[-7:])
+    r, body = get(conn, "GET", args.path, {"Range": "bytes=%d-" % (size + 10)})
+    check("Range past the end", r.status == 416)
+    r, body = get(conn, "GET", args.path, {"If-None-Match": etag})
+    check("If-None-Match", r.status == 304 and body == b"")
+    r, body = get(conn, "GET", args.path, {"If-Modified-Since": modified})
+    check("If-Modified-Since", r.status == 304)
+    r, body = get(conn, "GET", args.path, {"Range": "bytes=0-0", "If-Range": '"other"'})
+    check("If-Range with another ETag", r.status == 200 and len(body) == size)
+    r, body = get(conn, "HEAD", args.path)
+    check("HEAD", r.status == 200 and body == b"" and int(r.getheader("Content-Length")) == size)
+    r, body = get(conn, "GET", "/NOFILE.CSV")
+    check("missing file", r.status == 404)
+    for path in ("/DIRINDEX.IDX", "/HASHES.DAT", "/FTPTRACE.TXT", "/LOGS/BUSH.CSV", "/"):
+        r, body = get(conn, "GET", path)
+        check("GET %s forbidden" % path, r.status == 403)
+    check("single connection", conn.sock is sock)
+    conn.close()
+
+    print("%d failures" % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
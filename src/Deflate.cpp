@@ -0,0 +1,718 @@
+#include "Deflate.h"
+
+#define WIN_SIZE      ( 2 * DEFLATE_WINDOW )   // window and bytes to come
+#define WIN_MASK      ( DEFLATE_WINDOW - 1 )
+#define HASH_SIZE     ( 1 << DEFLATE_HASH_BITS )
+#define MIN_MATCH     3
+#define MAX_MATCH     258
+#define MIN_LOOKAHEAD ( MAX_MATCH + MIN_MATCH + 1 )
+#define MAX_SYMBOL    8       // bytes a symbol can add to the output
+#define LIT_CODES     288     // literals, end of block, lengths, 2 not used
+#define DIST_CODES    30
+#define END_BLOCK     256
+#define MAX_BITS      15      // longest code
+#define CL_BITS       7       //   of the lengths of codes
+
+// Stages of a block sent by sendBlock()
+#define SEND_NONE     0
+#define SEND_HEADER   1
+#define SEND_CL       2       // lengths of the codes of lengths
+#define SEND_LENGTHS  3       // lengths of the codes
+#define SEND_SYMBOLS  4
+
+// Lengths and distances of matches: first value of each code, and number
+//   of extra bits (RFC 1951, 3.2.5)
+
+static const uint16_t lenBase[ 29 ] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lenExtra[ 29 ] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[ 30 ] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[ 30 ] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Order of the lengths of codes of lengths (RFC 1951, 3.2.7)
+
+static const uint8_t clOrder[ 19 ] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Search effort of each level: positions tried, length good enough
+
+static const uint16_t levelChain[ 10 ] = { 0, 4, 8, 16, 16, 32, 64, 128, 256, 1024 };
+static const uint16_t levelNice[ 10 ]  = { 0, 16, 32, 32, 64, 128, 128, 258, 258, 258 };
+
+// Huffman codes are sent from their most significant bit
+
+static uint16_t reverse( uint16_t code, uint8_t n )
+{
+  uint16_t r = 0;
+  while( n -- )
+  {
+    r = ( r << 1 ) | ( code & 1 );
+    code >>= 1;
+  }
+  return r;
+}
+
+// Code of a length or a distance
+
+static uint8_t lengthIndex( uint16_t len )
+{
+  uint8_t i = 28;
+  while( lenBase[ i ] > len )
+    i --;
+  return i;
+}
+
+static uint8_t distIndex( uint16_t dist )
+{
+  uint8_t i = 29;
+  while( distBase[ i ] > dist )
+    i --;
+  return i;
+}
+
+// Length of the fixed code of a literal or a length
+
+static uint8_t fixedLength( uint16_t sym )
+{
+  return sym < 144 ? 8 : sym < 256 ? 9 : sym < 280 ? 7 : 8;
+}
+
+// Codes from their lengths, in the canonical order (RFC 1951, 3.2.2),
+//   reversed to be sent
+
+static void makeCodes( const uint8_t * len, uint16_t n, uint16_t * code )
+{
+  uint16_t count[ MAX_BITS + 1 ], next[ MAX_BITS + 1 ];
+  uint16_t c = 0;
+
+  memset( count, 0, sizeof( count ));
+  for( uint16_t i = 0; i < n; i ++ )
+    count[ len[ i ]] ++;
+  count[ 0 ] = 0;
+  for( uint8_t b = 1; b <= MAX_BITS; b ++ )
+  {
+    c = ( c + count[ b - 1 ]) << 1;
+    next[ b ] = c;
+  }
+  for( uint16_t i = 0; i < n; i ++ )
+    if( len[ i ] > 0 )
+      code[ i ] = reverse( next[ len[ i ]] ++, len[ i ] );
+}
+
+Deflate::Deflate()
+{
+  win = NULL;
+}
+
+// Take the memory and write the zlib header
+//
+// return:
+//    false if there is not enough memory
+
+bool Deflate::begin( uint8_t level )
+{
+  end();
+  if( level < 1 || level > 9 )
+    level = DEFLATE_LEVEL;
+  win = (uint8_t *) malloc( WIN_SIZE + 2 * HASH_SIZE + 2 * DEFLATE_WINDOW + 3 * DEFLATE_BLOCK +
+                            7 * LIT_CODES + 3 * DIST_CODES + DEFLATE_OUT_SIZE );
+  if( win == NULL )
+    return false;
+  head = (uint16_t *) ( win + WIN_SIZE );
+  prev = head + HASH_SIZE;
+  symDist = prev + DEFLATE_WINDOW;
+  litCode = symDist + DEFLATE_BLOCK;
+  distCode = litCode + LIT_CODES;
+  scratch = distCode + DIST_CODES;
+  out = (uint8_t *) ( scratch + 2 * LIT_CODES );
+  symLit = out + DEFLATE_OUT_SIZE;
+  litLen = symLit + DEFLATE_BLOCK;
+  memset( head, 0, 2 * HASH_SIZE + 2 * DEFLATE_WINDOW );   // 0 is the end of a chain
+  memset( litCode, 0, 2 * ( LIT_CODES + DIST_CODES ));     // frequencies of the block
+  nSym = 0;
+  stage = SEND_NONE;
+  pos = 0;
+  fill = 0;
+  outLen = 0;
+  outPos = 0;
+  chain = levelChain[ level ];
+  nice = levelNice[ level ];
+  lazy = level >= 4;
+  matchAvailable = false;
+  prevLen = 0;
+  prevDist = 0;
+  flushing = false;
+  done = false;
+  bitBuf = 0;
+  bitCount = 0;
+  adlerA = 1;
+  adlerB = 0;
+  nIn = 0;
+  nOut = 0;
+
+  // CMF: deflate with the size of the window, FLG: level, and a check of both
+  uint8_t cmf = 0x08 | (( DEFLATE_WINDOW_BITS - 8 ) << 4 );
+  uint8_t flg = ( level == 1 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3 ) << 6;
+  flg += 31 - ( cmf * 256 + flg ) % 31;
+  putBits( cmf, 8 );
+  putBits( flg, 8 );
+  return true;
+}
+
+// Give back the memory
+
+void Deflate::end()
+{
+  if( win != NULL )
+    free( win );
+  win = NULL;
+}
+
+size_t Deflate::write( uint8_t c )
+{
+  return write( & c, 1 );
+}
+
+// Take bytes to compress
+//
+// return:
+//    number of bytes taken, fewer than size (maybe 0) when the compressed
+//    bytes must be taken first
+
+size_t Deflate::write( const uint8_t * data, size_t size )
+{
+  if( win == NULL || flushing )
+    return 0;
+  compress( false );
+  if( pos >= WIN_SIZE - MIN_LOOKAHEAD )
+    slide();
+  size_t n = (size_t) ( WIN_SIZE - fill ) < size ? WIN_SIZE - fill : size;
+  for( size_t i = 0; i < n; i ++ )
+  {
+    adlerA += data[ i ];
+    adlerB += adlerA;
+  }
+  adlerA %= 65521;
+  adlerB %= 65521;
+  memcpy( win + fill, data, n );
+  fill += n;
+  nIn += n;
+  compress( false );
+  return n;
+}
+
+// Compress what is left and end the stream
+//
+// return:
+//    true once the end of the stream is in the output
+
+bool Deflate::finish()
+{
+  if( win == NULL )
+    return true;
+  flushing = true;
+  if( done )
+    return true;
+  compress( true );
+  if( pos < fill || matchAvailable || nSym > 0 || stage != SEND_NONE ||
+      outLen + MAX_SYMBOL > DEFLATE_OUT_SIZE )
+    return false;
+  putBits( 1, 1 );                    // last block, empty, with the fixed codes
+  putBits( 1, 2 );
+  putBits( 0, 7 );
+  if( bitCount > 0 )
+    putBits( 0, 8 - bitCount );
+  putBits( adlerB >> 8, 8 );          // check sum, most significant byte first
+  putBits( adlerB & 0xFF, 8 );
+  putBits( adlerA >> 8, 8 );
+  putBits( adlerA & 0xFF, 8 );
+  done = true;
+  return true;
+}
+
+// Mark compressed bytes as taken
+
+void Deflate::consume( uint16_t n )
+{
+  outPos += n < pending() ? n : pending();
+  if( outPos == outLen )
+  {
+    outPos = 0;
+    outLen = 0;
+  }
+}
+
+// Code the bytes of the window into blocks, sent as long as there is room
+//   in the output
+//
+// parameters:
+//   flush : code all the bytes and send the block, else keep MIN_LOOKAHEAD
+//           bytes to match
+
+void Deflate::compress( bool flush )
+{
+  if( outPos > 0 )
+  {
+    memmove( out, out + outPos, outLen - outPos );
+    outLen -= outPos;
+    outPos = 0;
+  }
+  for( ;; )
+  {
+    if( stage != SEND_NONE )
+    {
+      if( ! sendBlock())
+        break;                        // the output is full
+      continue;
+    }
+    if( nSym == DEFLATE_BLOCK )
+    {
+      startBlock();
+      continue;
+    }
+    uint16_t avail = fill - pos;
+    if( avail == 0 || ( avail < MIN_LOOKAHEAD && ! flush ))
+    {
+      if( avail == 0 && flush && matchAvailable )
+      {
+        tallyLiteral( win[ pos - 1 ] );
+        matchAvailable = false;
+        continue;
+      }
+      if( avail == 0 && flush && nSym > 0 )
+      {
+        startBlock();
+        continue;
+      }
+      break;
+    }
+    uint16_t cand = 0, len = 0, dist = 0;
+    if( avail >= MIN_MATCH )
+    {
+      uint16_t h = hashAt( pos );
+      cand = head[ h ];
+      prev[ pos & WIN_MASK ] = cand;
+      head[ h ] = pos;
+    }
+    if( cand > 0 && ( ! lazy || prevLen < nice ))
+      len = longestMatch( pos, cand, & dist );
+
+    if( ! lazy )
+    {
+      if( len >= MIN_MATCH )
+      {
+        tallyMatch( len, dist );
+        for( uint16_t i = 1; i < len; i ++ )
+          insert( pos + i );
+        pos += len;
+      }
+      else
+        tallyLiteral( win[ pos ++ ] );
+    }
+    // Lazy: the match at the byte before is coded only if the one at this
+    //   byte is not longer
+    else if( prevLen >= MIN_MATCH && len <= prevLen )
+    {
+      tallyMatch( prevLen, prevDist );
+      for( uint16_t i = 1; i < prevLen - 1; i ++ )
+        insert( pos + i );
+      pos += prevLen - 1;
+      matchAvailable = false;
+      prevLen = 0;
+    }
+    else
+    {
+      if( matchAvailable )
+        tallyLiteral( win[ pos - 1 ] );
+      matchAvailable = true;
+      prevLen = len;
+      prevDist = dist;
+      pos ++;
+    }
+  }
+}
+
+// Move the window down by DEFLATE_WINDOW bytes, to make room for new bytes
+
+void Deflate::slide()
+{
+  memmove( win, win + DEFLATE_WINDOW, fill - DEFLATE_WINDOW );
+  pos -= DEFLATE_WINDOW;
+  fill -= DEFLATE_WINDOW;
+  for( uint16_t i = 0; i < HASH_SIZE; i ++ )
+    head[ i ] = head[ i ] > DEFLATE_WINDOW ? head[ i ] - DEFLATE_WINDOW : 0;
+  for( uint16_t i = 0; i < DEFLATE_WINDOW; i ++ )
+    prev[ i ] = prev[ i ] > DEFLATE_WINDOW ? prev[ i ] - DEFLATE_WINDOW : 0;
+}
+
+// Add a position to the chain of its hash, if 3 bytes are known there
+
+void Deflate::insert( uint16_t p )
+{
+  if( p + MIN_MATCH > fill )
+    return;
+  uint16_t h = hashAt( p );
+  prev[ p & WIN_MASK ] = head[ h ];
+  head[ h ] = p;
+}
+
+uint16_t Deflate::hashAt( uint16_t p )
+{
+  uint32_t v = (uint32_t) win[ p ] << 16 | (uint32_t) win[ p + 1 ] << 8 | win[ p + 2 ];
+  return (uint32_t) ( v * 2654435761UL ) >> ( 32 - DEFLATE_HASH_BITS );
+}
+
+// Find the longest match of the bytes at p, following the chain from cand
+//
+// return:
+//    length of the match, 0 if none of at least MIN_MATCH bytes (or, when
+//    lazy, none longer than the match at the byte before)
+
+uint16_t Deflate::longestMatch( uint16_t p, uint16_t cand, uint16_t * pDist )
+{
+  uint16_t maxLen = fill - p < MAX_MATCH ? fill - p : MAX_MATCH;
+  uint16_t limit = p > DEFLATE_WINDOW ? p - DEFLATE_WINDOW : 0;
+  uint16_t best = lazy && prevLen > MIN_MATCH - 1 ? prevLen : MIN_MATCH - 1;
+  uint16_t n = chain;
+  const uint8_t * s = win + p;
+
+  * pDist = 0;
+  if( best >= maxLen )
+    return 0;
+  while( cand > limit && n -- > 0 )
+  {
+    const uint8_t * m = win + cand;
+    if( m[ best ] == s[ best ] && m[ 0 ] == s[ 0 ] && m[ 1 ] == s[ 1 ] )
+    {
+      uint16_t l = 2;
+      while( l < maxLen && m[ l ] == s[ l ] )
+        l ++;
+      if( l > best )
+      {
+        best = l;
+        * pDist = p - cand;
+        if( l >= nice || l >= maxLen )
+          break;
+      }
+    }
+    cand = prev[ cand & WIN_MASK ];
+  }
+  return * pDist > 0 ? best : 0;
+}
+
+// Add bits to the output, least significant first
+
+void Deflate::putBits( uint32_t value, uint8_t n )
+{
+  bitBuf |= value << bitCount;
+  bitCount += n;
+  while( bitCount >= 8 )
+  {
+    out[ outLen ++ ] = bitBuf;
+    bitBuf >>= 8;
+    bitCount -= 8;
+    nOut ++;
+  }
+}
+
+// Keep a literal or a match in the block, and count its codes
+
+void Deflate::tallyLiteral( uint8_t c )
+{
+  symLit[ nSym ] = c;
+  symDist[ nSym ++ ] = 0;
+  litCode[ c ] ++;
+}
+
+void Deflate::tallyMatch( uint16_t len, uint16_t dist )
+{
+  symLit[ nSym ] = len - MIN_MATCH;
+  symDist[ nSym ++ ] = dist;
+  litCode[ 257 + lengthIndex( len ) ] ++;
+  distCode[ distIndex( dist ) ] ++;
+}
+
+// Make the codes of the block from the counts of its symbols
+//
+// The codes made for the block are sent in its header. The fixed codes
+//   are taken instead when the block is not longer with them.
+
+void Deflate::startBlock()
+{
+  uint16_t * freqLit = litCode;
+  uint16_t * freqDist = distCode;
+  uint8_t  * distLen = litLen + LIT_CODES;
+  uint16_t clFreq[ 19 ];
+  uint32_t dynBits = 3 + 5 + 5 + 4, fixBits = 3;
+  uint8_t  sym;
+
+  freqLit[ END_BLOCK ] = 1;
+  buildLengths( freqLit, LIT_CODES, litLen, MAX_BITS );
+  buildLengths( freqDist, DIST_CODES, distLen, MAX_BITS );
+  for( nLit = LIT_CODES; nLit > 257 && litLen[ nLit - 1 ] == 0; nLit -- )
+    ;
+  for( nDist = DIST_CODES; nDist > 1 && distLen[ nDist - 1 ] == 0; nDist -- )
+    ;
+
+  // The lengths are sent as runs, with a code of their own
+  memset( clFreq, 0, sizeof( clFreq ));
+  for( uint16_t i = 0; i < nLit + nDist; )
+  {
+    i += lengthRun( i, & sym );
+    clFreq[ sym ] ++;
+  }
+  for( uint8_t i = 0; i < 19; i ++ )
+    dynBits += clFreq[ i ] * ( i == 16 ? 2 : i == 17 ? 3 : i == 18 ? 7 : 0 );
+  buildLengths( clFreq, 19, clLen, CL_BITS );
+  for( nCl = 19; nCl > 4 && clLen[ clOrder[ nCl - 1 ]] == 0; nCl -- )
+    ;
+
+  // Size of the block both ways, but the extra bits of lengths and distances
+  dynBits += 3 * nCl;
+  for( uint8_t i = 0; i < 19; i ++ )
+    dynBits += clFreq[ i ] * clLen[ i ];
+  for( uint16_t i = 0; i < LIT_CODES; i ++ )
+  {
+    dynBits += freqLit[ i ] * litLen[ i ];
+    fixBits += freqLit[ i ] * fixedLength( i );
+  }
+  for( uint8_t i = 0; i < DIST_CODES; i ++ )
+  {
+    dynBits += freqDist[ i ] * distLen[ i ];
+    fixBits += freqDist[ i ] * 5;
+  }
+  fixed = fixBits <= dynBits;
+  if( fixed )
+  {
+    for( uint16_t i = 0; i < LIT_CODES; i ++ )
+      litLen[ i ] = fixedLength( i );
+    memset( distLen, 5, DIST_CODES );
+  }
+  makeCodes( litLen, LIT_CODES, litCode );
+  makeCodes( distLen, DIST_CODES, distCode );
+  makeCodes( clLen, 19, clCode );
+  stage = SEND_HEADER;
+  sent = 0;
+}
+
+// Send the next part of the block: its header, a length of a code, or a
+//   symbol
+//
+// return:
+//    false if there is no room in the output
+
+bool Deflate::sendBlock()
+{
+  uint8_t sym;
+
+  if( outLen + MAX_SYMBOL > DEFLATE_OUT_SIZE )
+    return false;
+  if( stage == SEND_HEADER )
+  {
+    putBits( 0, 1 );                  // not the last block
+    putBits( fixed ? 1 : 2, 2 );
+    stage = fixed ? SEND_SYMBOLS : SEND_CL;
+    if( ! fixed )
+    {
+      putBits( nLit - 257, 5 );
+      putBits( nDist - 1, 5 );
+      putBits( nCl - 4, 4 );
+    }
+  }
+  else if( stage == SEND_CL )
+  {
+    putBits( clLen[ clOrder[ sent ++ ]], 3 );
+    if( sent == nCl )
+    {
+      stage = SEND_LENGTHS;
+      sent = 0;
+    }
+  }
+  else if( stage == SEND_LENGTHS )
+  {
+    uint16_t n = lengthRun( sent, & sym );
+    putBits( clCode[ sym ], clLen[ sym ] );
+    if( sym == 16 )
+      putBits( n - 3, 2 );
+    else if( sym == 17 )
+      putBits( n - 3, 3 );
+    else if( sym == 18 )
+      putBits( n - 11, 7 );
+    sent += n;
+    if( sent == nLit + nDist )
+    {
+      stage = SEND_SYMBOLS;
+      sent = 0;
+    }
+  }
+  else if( sent < nSym )
+  {
+    uint16_t dist = symDist[ sent ];
+    uint8_t c = symLit[ sent ++ ];
+    if( dist == 0 )
+      putBits( litCode[ c ], litLen[ c ] );
+    else
+    {
+      uint8_t i = lengthIndex( c + MIN_MATCH );
+      putBits( litCode[ 257 + i ], litLen[ 257 + i ] );
+      putBits( c + MIN_MATCH - lenBase[ i ], lenExtra[ i ] );
+      i = distIndex( dist );
+      putBits( distCode[ i ], litLen[ LIT_CODES + i ] );
+      putBits( dist - distBase[ i ], distExtra[ i ] );
+    }
+  }
+  else
+  {
+    putBits( litCode[ END_BLOCK ], litLen[ END_BLOCK ] );
+    memset( litCode, 0, 2 * ( LIT_CODES + DIST_CODES ));   // frequencies of the next block
+    nSym = 0;
+    stage = SEND_NONE;
+  }
+  return true;
+}
+
+// Lengths of the Huffman codes of symbols, from their frequencies
+//
+// The lengths are found in place (A. Moffat, J. Katajainen, 1995) on the
+//   symbols sorted by frequency, then those longer than maxBits are
+//   shortened, as zlib does. At least two symbols get a code: a code of
+//   a single one would not be complete.
+//
+// parameters:
+//   freq    : frequencies of the n symbols
+//   len     : where to store the lengths, 0 for a symbol not used
+//   maxBits : longest length
+
+void Deflate::buildLengths( uint16_t * freq, uint16_t n, uint8_t * len, uint8_t maxBits )
+{
+  uint16_t * sym = scratch;                 // symbols used, less frequent first
+  uint16_t * a = scratch + LIT_CODES;       // their frequencies, then lengths
+  uint16_t count[ MAX_BITS + 1 ];
+  uint16_t m = 0;
+
+  memset( len, 0, n );
+  for( uint16_t i = 0; i < n; i ++ )
+    if( freq[ i ] > 0 )
+      sym[ m ++ ] = i;
+  for( uint16_t i = 0; m < 2; i ++ )
+    if( freq[ i ] == 0 )
+      sym[ m ++ ] = i;
+  for( uint16_t i = 1; i < m; i ++ )
+  {
+    uint16_t s = sym[ i ], j = i;
+    for( ; j > 0 && freq[ sym[ j - 1 ]] > freq[ s ]; j -- )
+      sym[ j ] = sym[ j - 1 ];
+    sym[ j ] = s;
+  }
+  for( uint16_t i = 0; i < m; i ++ )
+    a[ i ] = freq[ sym[ i ]];
+
+  // Weights of the nodes, then their parents, from left to right
+  uint16_t root = 0, leaf = 2, next;
+  a[ 0 ] += a[ 1 ];
+  for( next = 1; next < m - 1; next ++ )
+  {
+    if( leaf >= m || a[ root ] < a[ leaf ] )
+    {
+      a[ next ] = a[ root ];
+      a[ root ++ ] = next;
+    }
+    else
+      a[ next ] = a[ leaf ++ ];
+    if( leaf >= m || ( root < next && a[ root ] < a[ leaf ] ))
+    {
+      a[ next ] += a[ root ];
+      a[ root ++ ] = next;
+    }
+    else
+      a[ next ] += a[ leaf ++ ];
+  }
+  // Depths of the nodes, then of the leaves, from right to left
+  a[ m - 2 ] = 0;
+  for( int16_t i = m - 3; i >= 0; i -- )
+    a[ i ] = a[ a[ i ]] + 1;
+  int16_t avail = 1, used = 0, depth = 0, r = m - 2, k = m - 1;
+  while( avail > 0 )
+  {
+    for( ; r >= 0 && a[ r ] == depth; r -- )
+      used ++;
+    for( ; avail > used; avail -- )
+      a[ k -- ] = depth;
+    avail = 2 * used;
+    depth ++;
+    used = 0;
+  }
+
+  // Count the lengths; if some were cut to maxBits the code is too long
+  //   by their share of the Kraft sum: move a leaf down beside each of
+  //   them, one unit of 1 / 2^maxBits at a time
+  uint32_t kraft = 0;
+  memset( count, 0, sizeof( count ));
+  for( uint16_t i = 0; i < m; i ++ )
+  {
+    if( a[ i ] > maxBits )
+      a[ i ] = maxBits;
+    count[ a[ i ]] ++;
+    kraft += 1UL << ( maxBits - a[ i ]);
+  }
+  for( ; kraft > ( 1UL << maxBits ); kraft -- )
+  {
+    uint8_t b = maxBits - 1;
+    while( count[ b ] == 0 )
+      b --;
+    count[ b ] --;                  // a leaf goes down,
+    count[ b + 1 ] += 2;            //   with a cut one as its brother
+    count[ maxBits ] --;
+  }
+  // The longest codes to the less frequent symbols
+  uint16_t i = 0;
+  for( uint8_t b = maxBits; b > 0; b -- )
+    for( uint16_t c = count[ b ]; c > 0; c -- )
+      len[ sym[ i ++ ]] = b;
+}
+
+// Runs of the lengths of the codes, as they are sent (RFC 1951, 3.2.7):
+//   16 repeats the length before 3 to 6 times, 17 and 18 give 3 to 10 and
+//   11 to 138 zeros
+//
+// parameters:
+//   i    : first length of the run, the lengths of distances follow those
+//          of literals and lengths
+//   pSym : where to store the code of the run
+//
+// return:
+//    number of lengths of the run
+
+uint16_t Deflate::lengthRun( uint16_t i, uint8_t * pSym )
+{
+  uint8_t l = lengthAt( i );
+  uint16_t max = l == 0 ? 138 : 6;
+  uint16_t n = 1;
+
+  while( i + n < nLit + nDist && n < max && lengthAt( i + n ) == l )
+    n ++;
+  if( l == 0 && n >= 11 )
+    * pSym = 18;
+  else if( l == 0 && n >= 3 )
+    * pSym = 17;
+  else if( l != 0 && n >= 3 && i > 0 && lengthAt( i - 1 ) == l )
+    * pSym = 16;
+  else
+  {
+    * pSym = l;
+    n = 1;
+  }
+  return n;
+}
+
+uint8_t Deflate::lengthAt( uint16_t i )
+{
+  return i < nLit ? litLen[ i ] : litLen[ LIT_CODES + i - nLit ];
+}
@@ -0,0 +1,554 @@
+#include "DirIndex.h"
+#include "SdList.h"
+#include "SdBlockDev.h"
+
+extern SdList sdl;
+
+#define REC sizeof( IndexEntry )
+
+// Records of a sorted run read by merge(), a few at a time
+struct RunReader
+{
+  uint32_t pos;           // next record to read from the file
+  uint32_t end;           // end of the run
+  uint8_t  n, i;          // records in e, next one to use
+  IndexEntry e[ 8 ];
+};
+
+static bool fillReader( SdFile * pFile, RunReader * r )
+{
+  if( r->i < r->n || r->pos >= r->end )
+    return true;
+  r->n = r->end - r->pos < 8 ? r->end - r->pos : 8;
+  r->i = 0;
+  if( ! pFile->seekSet(( r->pos + 1 ) * REC ) ||
+      pFile->read( r->e, r->n * REC ) != (int16_t) ( r->n * REC ))
+    return false;
+  r->pos += r->n;
+  return true;
+}
+
+// True for the entries of the files of the index itself
+static bool isIndexEntry( const dir_t * d )
+{
+  return ! memcmp( d->name, "DIRINDEXIDX", 11 ) || ! memcmp( d->name, "DIRINDEXTMP", 11 );
+}
+
+DirIndex::DirIndex()
+{
+  pos = 0;
+  end = 0;
+  pattern = NULL;
+  prefix[ 0 ] = 0;
+  prefixLen = 0;
+  nChunk = 0;
+  iChunk = 0;
+  cachedBlock = 0xFFFFFFFF;
+}
+
+// Get ready to list a directory in the order of the names
+//
+// parameters:
+//   pDir : the directory
+//   pattern : only names that match it are listed (see match()), or NULL
+//   after : the listing starts after this name, or NULL
+//
+// return:
+//    false if the directory has no valid index
+
+bool DirIndex::open( SdFile * pDir, const char * pat, const char * after )
+{
+  IndexHead head;
+
+  close();
+  if( ! openIndex( pDir, & idx, & head, O_READ ))
+    return false;
+  pattern = pat;
+  prefixLen = 0;
+  while( pat != NULL && pat[ prefixLen ] != 0 && pat[ prefixLen ] != '*' &&
+         pat[ prefixLen ] != '?' && prefixLen < sizeof( prefix ) - 1 )
+  {
+    prefix[ prefixLen ] = toupper( pat[ prefixLen ] );
+    prefixLen ++;
+  }
+  prefix[ prefixLen ] = 0;
+  end = head.count;
+  pos = lowerBound( & idx, end, prefix, false );
+  if( after != NULL && after[ 0 ] != 0 )
+  {
+    uint32_t p = lowerBound( & idx, end, after, true );
+    if( p > pos )
+      pos = p;
+  }
+  nChunk = 0;
+  iChunk = 0;
+  cachedBlock = 0xFFFFFFFF;
+  return true;
+}
+
+// Read the next entry of the listing
+//
+// Facts are read from the directory entry. An entry that does not have the
+//   name of the record anymore is skipped.
+//   The cache of the volume is used to read directory blocks: no other
+//   access to the card must be made between two calls.
+//
+// return:
+//    false at the end of the listing
+
+bool DirIndex::next( char * name, bool * pIsF, uint32_t * pSize,
+                     uint16_t * pDate, uint16_t * pTime )
+{
+  while( idx.isOpen())
+  {
+    if( iChunk >= nChunk )
+    {
+      if( pos >= end )
+        break;
+      nChunk = end - pos < DIR_INDEX_CHUNK ? end - pos : DIR_INDEX_CHUNK;
+      iChunk = 0;
+      if( ! readEntries( & idx, pos, chunk, nChunk ))
+        break;
+      pos += nChunk;
+      cachedBlock = 0xFFFFFFFF;       // the cache now holds a block of the index
+    }
+    IndexEntry * e = & chunk[ iChunk ++ ];
+    if( strncmp( e->name, prefix, prefixLen ) != 0 )
+      break;                          // past the names that can match
+    if( pattern != NULL && ! match( pattern, e->name ))
+      continue;
+
+    uint8_t * blk = SdVolume::cacheClear();   // flush and borrow the cache of the volume
+    if( blk == NULL || e->index >= 512 / sizeof( dir_t ))
+      break;
+    if( e->block != cachedBlock )
+    {
+      if( ! SdBlockDev::read( e->block, blk, IO_DIR ))
+        break;
+      cachedBlock = e->block;
+    }
+    dir_t * d = ((dir_t *) blk ) + e->index;
+    if( d->name[ 0 ] == DIR_NAME_FREE || d->name[ 0 ] == DIR_NAME_DELETED ||
+        ! DIR_IS_FILE_OR_SUBDIR( d ))
+      continue;
+    SdFile::dirName( * d, name );
+    if( strcmp( name, e->name ))
+      continue;
+    if( pIsF != NULL )
+      * pIsF = DIR_IS_FILE( d );
+    if( pSize != NULL )
+      * pSize = d->fileSize;
+    if( pDate != NULL )
+      * pDate = d->lastWriteDate;
+    if( pTime != NULL )
+      * pTime = d->lastWriteTime;
+    return true;
+  }
+  close();
+  return false;
+}
+
+void DirIndex::close()
+{
+  if( idx.isOpen())
+    idx.close();
+  cachedBlock = 0xFFFFFFFF;
+}
+
+// Build the index of a directory
+//
+// The entries are read in runs of DIR_INDEX_RUN records, sorted in memory,
+//   then the runs are merged two by two, going from a file to the other.
+//   The files are chosen so that the last pass writes DIR_INDEX_FILE.
+//
+// return:
+//    false if the index can't be written
+
+bool DirIndex::build( SdFile * pDir )
+{
+  SdFile fIdx, fTmp;
+  IndexHead head;
+  dir_t d;
+  uint32_t count = 0;
+  uint32_t oldIdx = 0, oldTmp = 0;
+  uint8_t passes = 0;
+
+  if( ! createFile( pDir, & fIdx, DIR_INDEX_FILE, & oldIdx ))
+    return false;
+
+  pDir->rewind();
+  while( pDir->readDir( & d ) > 0 )
+    if( ! isIndexEntry( & d ))
+      count ++;
+  for( uint32_t w = DIR_INDEX_RUN; w < count; w *= 2 )
+    passes ++;
+  if( passes > 0 && ! createFile( pDir, & fTmp, DIR_INDEX_TMP, & oldTmp ))
+  {
+    fIdx.remove();
+    sdl.sizeChanged( oldIdx, 0 );
+    return false;
+  }
+
+  // Records are written after the head, that must be there first
+  memset( & head, 0, sizeof( head ));
+  bool ok = fIdx.write( & head, sizeof( head )) == sizeof( head ) &&
+            ( passes == 0 || fTmp.write( & head, sizeof( head )) == sizeof( head ));
+
+  SdFile * src = passes & 1 ? & fTmp : & fIdx;
+  SdFile * dst = passes & 1 ? & fIdx : & fTmp;
+  ok = ok && ( count = makeRuns( pDir, src, count )) != 0xFFFFFFFF;
+  for( uint32_t w = DIR_INDEX_RUN; ok && w < count; w *= 2 )
+  {
+    ok = merge( src, dst, count, w );
+    SdFile * t = src;
+    src = dst;
+    dst = t;
+  }
+  ok = ok && src == & fIdx;           // false if entries went away meanwhile
+
+  head.magic = DIR_INDEX_MAGIC;
+  head.count = count;
+  head.dirCluster = pDir->firstCluster();
+  ok = ok && fIdx.seekSet( 0 ) && fIdx.write( & head, sizeof( head )) == sizeof( head ) &&
+       fIdx.truncate(( count + 1 ) * REC ) && fIdx.sync();
+  if( ok )
+  {
+    sdl.sizeChanged( oldIdx, fIdx.fileSize());
+    fIdx.close();
+  }
+  else
+  {
+    fIdx.remove();
+    sdl.sizeChanged( oldIdx, 0 );
+  }
+  // The clusters of the second file were free before the build
+  if( fTmp.isOpen())
+  {
+    fTmp.remove();
+    if( oldTmp > 0 )
+      sdl.sizeChanged( oldTmp, 0 );
+  }
+  pDir->rewind();
+  return ok;
+}
+
+// Has a directory DIR_INDEX_MIN entries at least, so that a listing builds
+//   its index? Stops reading at the end of the entries, or at DIR_INDEX_MIN
+
+bool DirIndex::worthBuilding( SdFile * pDir )
+{
+  dir_t d;
+  uint32_t count = 0;
+
+  pDir->rewind();
+  while( count < DIR_INDEX_MIN && pDir->readDir( & d ) > 0 )
+    if( ! isIndexEntry( & d ))
+      count ++;
+  pDir->rewind();
+  return count >= DIR_INDEX_MIN;
+}
+
+// Add to the index the entry of a file just created, if the directory
+//   has an index
+
+void DirIndex::insert( SdFile * pDir, SdFile * pFile )
+{
+  SdFile f;
+  IndexHead head;
+  IndexEntry e, cur;
+  dir_t d;
+
+  if( ! pFile->dirEntry( & d ) || ! openIndex( pDir, & f, & head, O_RDWR ))
+    return;
+  memset( & e, 0, sizeof( e ));
+  SdFile::dirName( d, e.name );
+  e.isDir = DIR_IS_SUBDIR( & d );
+  e.index = pFile->dirIndex();
+  e.block = pFile->dirBlock();
+
+  uint32_t i = lowerBound( & f, head.count, e.name, false );
+  bool ok;
+  if( i < head.count && readEntries( & f, i, & cur, 1 ) && ! strcmp( cur.name, e.name ))
+    ok = writeEntries( & f, i, & e, 1 );       // entry made again
+  else
+  {
+    // Move the records that follow by one, from the end
+    IndexEntry buf[ 4 ];
+    uint32_t oldSize = f.fileSize();
+    uint32_t j = head.count;
+    ok = true;
+    while( ok && j > i )
+    {
+      uint8_t n = j - i < 4 ? j - i : 4;
+      j -= n;
+      ok = readEntries( & f, j, buf, n ) && writeEntries( & f, j + 1, buf, n );
+    }
+    head.count ++;
+    ok = ok && writeEntries( & f, i, & e, 1 ) &&
+         f.seekSet( 0 ) && f.write( & head, sizeof( head )) == sizeof( head );
+    sdl.sizeChanged( oldSize, f.fileSize());
+  }
+  f.close();
+  if( ! ok )
+    erase( pDir );
+}
+
+// Remove a name from the index, if the directory has an index
+//
+// parameters:
+//   name : name as read from the directory entry (see SdFile::dirName())
+
+void DirIndex::remove( SdFile * pDir, const char * name )
+{
+  SdFile f;
+  IndexHead head;
+  IndexEntry buf[ 4 ];
+
+  if( ! openIndex( pDir, & f, & head, O_RDWR ))
+    return;
+  uint32_t i = lowerBound( & f, head.count, name, false );
+  bool ok = true;
+  if( i < head.count && readEntries( & f, i, buf, 1 ) && ! strcmp( buf[ 0 ].name, name ))
+  {
+    // Move the records that follow by one, from the beginning
+    uint32_t oldSize = f.fileSize();
+    for( uint32_t j = i + 1; ok && j < head.count; )
+    {
+      uint8_t n = head.count - j < 4 ? head.count - j : 4;
+      ok = readEntries( & f, j, buf, n ) && writeEntries( & f, j - 1, buf, n );
+      j += n;
+    }
+    head.count --;
+    ok = ok && f.seekSet( 0 ) && f.write( & head, sizeof( head )) == sizeof( head ) &&
+         f.truncate(( head.count + 1 ) * REC );
+    sdl.sizeChanged( oldSize, f.fileSize());
+  }
+  f.close();
+  if( ! ok )
+    erase( pDir );
+}
+
+// Remove the index of a directory, to be built again when listed
+
+void DirIndex::erase( SdFile * pDir )
+{
+  SdFile f;
+
+  if( f.open( pDir, DIR_INDEX_FILE, O_WRITE ))
+  {
+    uint32_t size = f.fileSize();
+    if( f.remove())
+      sdl.sizeChanged( size, 0 );
+    else
+      f.close();
+  }
+}
+
+// Match a name against a pattern, ignoring case
+//
+// In the pattern, '*' stands for any number of characters, '?' for one.
+
+bool DirIndex::match( const char * p, const char * s )
+{
+  const char * star = NULL;
+  const char * back = NULL;
+
+  while( * s != 0 )
+  {
+    if( * p == '*' )
+    {
+      star = p ++;
+      back = s;
+    }
+    else if( * p != 0 && ( * p == '?' || toupper( * p ) == toupper( * s )))
+    {
+      p ++;
+      s ++;
+    }
+    else if( star != NULL )
+    {
+      p = star + 1;
+      s = ++ back;
+    }
+    else
+      return false;
+  }
+  while( * p == '*' )
+    p ++;
+  return * p == 0;
+}
+
+// True for the names of the files of the index, not listed
+
+bool DirIndex::isIndexName( const char * name )
+{
+  return ! strcasecmp( name, DIR_INDEX_FILE ) || ! strcasecmp( name, DIR_INDEX_TMP );
+}
+
+// Open the index of a directory and check its head
+
+bool DirIndex::openIndex( SdFile * pDir, SdFile * pIdx, IndexHead * head, uint8_t oflag )
+{
+  if( ! pIdx->open( pDir, DIR_INDEX_FILE, oflag ))
+    return false;
+  if( pIdx->read( head, sizeof( IndexHead )) == sizeof( IndexHead ) &&
+      head->magic == DIR_INDEX_MAGIC && head->dirCluster == pDir->firstCluster() &&
+      pIdx->fileSize() == ( head->count + 1 ) * REC )
+    return true;
+  pIdx->close();
+  return false;
+}
+
+// Open a file of the index empty, creating it if needed
+//
+// parameters:
+//   pOldSize : where to store the size the file had, for SdList::sizeChanged()
+
+bool DirIndex::createFile( SdFile * pDir, SdFile * pFile, const char * name, uint32_t * pOldSize )
+{
+  * pOldSize = 0;
+  if( pFile->open( pDir, name, O_RDWR ))
+  {
+    * pOldSize = pFile->fileSize();
+    return pFile->truncate( 0 );
+  }
+  return pFile->open( pDir, name, O_RDWR | O_CREAT );
+}
+
+// Index of the first record whose name is not less than key, or greater
+//   than key if after is true
+
+uint32_t DirIndex::lowerBound( SdFile * pIdx, uint32_t count, const char * key, bool after )
+{
+  char k[ 13 ];
+  IndexEntry e;
+  uint32_t lo = 0, hi = count;
+  uint8_t i;
+
+  for( i = 0; key[ i ] != 0 && i < sizeof( k ) - 1; i ++ )
+    k[ i ] = toupper( key[ i ] );
+  k[ i ] = 0;
+  while( lo < hi )
+  {
+    uint32_t mid = ( lo + hi ) / 2;
+    if( ! readEntries( pIdx, mid, & e, 1 ))
+      return count;
+    int c = strcmp( e.name, k );
+    if( c < 0 || ( after && c == 0 ))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Read or write n records from record i (the head is not counted)
+
+bool DirIndex::readEntries( SdFile * pIdx, uint32_t i, IndexEntry * e, uint8_t n )
+{
+  return pIdx->seekSet(( i + 1 ) * REC ) &&
+         pIdx->read( e, n * REC ) == (int16_t) ( n * REC );
+}
+
+bool DirIndex::writeEntries( SdFile * pIdx, uint32_t i, const IndexEntry * e, uint8_t n )
+{
+  return pIdx->seekSet(( i + 1 ) * REC ) &&
+         pIdx->write( e, n * REC ) == n * REC;
+}
+
+// Write the entries of a directory in sorted runs of DIR_INDEX_RUN records
+//
+// return:
+//    number of records written, 0xFFFFFFFF if the file can't be written
+
+uint32_t DirIndex::makeRuns( SdFile * pDir, SdFile * pRuns, uint32_t count )
+{
+  IndexEntry run[ DIR_INDEX_RUN ];
+  SdVolume * vol = pDir->volume();
+  bool root16 = pDir->isRoot() && vol->fatType() != 32;
+  uint32_t total = 0;
+  dir_t d;
+
+  pDir->rewind();
+  while( total < count )
+  {
+    uint8_t n = 0;
+    while( n < DIR_INDEX_RUN && total + n < count && pDir->readDir( & d ) > 0 )
+    {
+      if( isIndexEntry( & d ))
+        continue;
+      // Place of the entry just read, found from the position in the directory
+      IndexEntry * e = & run[ n ++ ];
+      uint32_t p = pDir->curPosition() - sizeof( dir_t );
+      memset( e, 0, REC );
+      SdFile::dirName( d, e->name );
+      e->isDir = DIR_IS_SUBDIR( & d );
+      e->index = ( p >> 5 ) & 15;
+      if( root16 )
+        e->block = vol->rootDirStart() + ( p >> 9 );
+      else
+        e->block = vol->dataStartBlock() + ( pDir->curCluster() - 2 ) * vol->blocksPerCluster() +
+                   (( p >> 9 ) & ( vol->blocksPerCluster() - 1 ));
+    }
+    if( n == 0 )
+      break;                          // fewer entries than counted
+    // Insertion sort of the run
+    for( uint8_t i = 1; i < n; i ++ )
+    {
+      IndexEntry t = run[ i ];
+      uint8_t j = i;
+      while( j > 0 && strcmp( run[ j - 1 ].name, t.name ) > 0 )
+      {
+        run[ j ] = run[ j - 1 ];
+        j --;
+      }
+      run[ j ] = t;
+    }
+    if( ! writeEntries( pRuns, total, run, n ))
+      return 0xFFFFFFFF;
+    total += n;
+    yield();
+  }
+  return total;
+}
+
+// Merge the runs of width records of pSrc two by two in pDst
+
+bool DirIndex::merge( SdFile * pSrc, SdFile * pDst, uint32_t count, uint32_t width )
+{
+  RunReader a, b;
+  IndexEntry out[ 8 ];
+  uint32_t written = 0;
+  uint8_t n = 0;
+
+  for( uint32_t lo = 0; lo < count; lo += 2 * width )
+  {
+    a.pos = lo;
+    a.end = count - lo > width ? lo + width : count;
+    b.pos = a.end;
+    b.end = count - a.end > width ? a.end + width : count;
+    a.n = a.i = b.n = b.i = 0;
+    while( true )
+    {
+      if( ! fillReader( pSrc, & a ) || ! fillReader( pSrc, & b ))
+        return false;
+      bool hasA = a.i < a.n;
+      bool hasB = b.i < b.n;
+      if( ! hasA && ! hasB )
+        break;
+      if( hasA && ( ! hasB || strcmp( a.e[ a.i ].name, b.e[ b.i ].name ) <= 0 ))
+        out[ n ++ ] = a.e[ a.i ++ ];
+      else
+        out[ n ++ ] = b.e[ b.i ++ ];
+      if( n == 8 )
+      {
+        if( ! writeEntries( pDst, written, out, n ))
+          return false;
+        written += n;
+        n = 0;
+      }
+    }
+    yield();
+  }
+  return n == 0 || writeEntries( pDst, written, out, n );
+}
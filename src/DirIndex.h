@@ -0,0 +1,124 @@
+/*
+ * Sorted index of the entries of a directory
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                       SORTED INDEX OF A DIRECTORY                          **
+ **                                                                            **
+ *******************************************************************************/
+
+// The entries of a directory are kept sorted by name in a file of the
+//   directory itself (DIR_INDEX_FILE). Each record holds the name and the
+//   place of the directory entry on the card, so that the facts of a file
+//   (size, date) are read from its entry, always up to date.
+//
+// A listing starts with a binary search of the first name that can match
+//   the pattern, or of the name to resume after, and stops at the first
+//   name that can't match anymore: its cost depends on the number of names
+//   returned, not on the size of the directory.
+//
+// The index is built by SITE INDEX, or the first time a directory of at
+//   least DIR_INDEX_MIN entries is listed (an external merge sort, through
+//   a second file): a small directory is listed by reading its entries, and
+//   a read-only session writes nothing. Then SdList keeps the index up to
+//   date when it creates or removes an entry. Entries changed by other means
+//   (the card written by a computer) are found out while listing and
+//   skipped; SITE INDEX builds the index again.
+//
+// insert() and remove() move the records that follow the name by one: they
+//   read and write O(n) records, about n / 25 blocks for n entries. Cheap
+//   for the hundreds of files of a logger, not for a directory that gets
+//   thousands of files created and removed.
+//
+// The files of the index can't be listed, nor reached by a name given to
+//   the FTP server (RETR, STOR, DELE, SIZE, RNFR...).
+
+#ifndef DIR_INDEX_H
+#define DIR_INDEX_H
+
+#include "Arduino.h"
+#include "utility/SdFat.h"
+
+#define DIR_INDEX_FILE  "DIRINDEX.IDX"
+#define DIR_INDEX_TMP   "DIRINDEX.TMP"   // second file of the merge sort
+#define DIR_INDEX_MAGIC 0x31584944       // "DIX1"
+#ifndef DIR_INDEX_MIN
+#define DIR_INDEX_MIN   64    // entries a directory needs for a listing to build its index
+#endif
+#define DIR_INDEX_RUN   16    // records sorted in memory to build an index
+#define DIR_INDEX_CHUNK 6     // records read at once while listing
+
+// Record of the index, one per entry of the directory
+
+struct IndexEntry
+{
+  char     name[ 13 ];    // 8.3 name, as shown in listings
+  uint8_t  isDir;
+  uint8_t  index;         // index of the directory entry in its block
+  uint8_t  reserved;
+  uint32_t block;         // block of the directory entry
+};
+
+// First record of the index file
+
+struct IndexHead
+{
+  uint32_t magic;
+  uint32_t count;         // number of entries
+  uint32_t dirCluster;    // first cluster of the directory, 0 for a FAT16 root
+  uint32_t reserved[ 2 ];
+};
+
+class DirIndex
+{
+public:
+  DirIndex();
+
+  bool    open( SdFile * pDir, const char * pattern = NULL, const char * after = NULL );
+  bool    next( char * name, bool * pIsF = NULL, uint32_t * pSize = NULL,
+                uint16_t * pDate = NULL, uint16_t * pTime = NULL );
+  void    close();
+
+  static bool build( SdFile * pDir );
+  static bool worthBuilding( SdFile * pDir );
+  static void insert( SdFile * pDir, SdFile * pFile );
+  static void remove( SdFile * pDir, const char * name );
+  static void erase( SdFile * pDir );
+  static bool match( const char * pattern, const char * name );
+  static bool isIndexName( const char * name );
+
+private:
+  static bool     openIndex( SdFile * pDir, SdFile * pIdx, IndexHead * head, uint8_t oflag );
+  static bool     createFile( SdFile * pDir, SdFile * pFile, const char * name, uint32_t * pOldSize );
+  static uint32_t lowerBound( SdFile * pIdx, uint32_t count, const char * key, bool after );
+  static bool     readEntries( SdFile * pIdx, uint32_t i, IndexEntry * e, uint8_t n );
+  static bool     writeEntries( SdFile * pIdx, uint32_t i, const IndexEntry * e, uint8_t n );
+  static uint32_t makeRuns( SdFile * pDir, SdFile * pRuns, uint32_t count );
+  static bool     merge( SdFile * pSrc, SdFile * pDst, uint32_t count, uint32_t width );
+
+  SdFile   idx;
+  uint32_t pos;                 // next record to read
+  uint32_t end;                 // number of records
+  const char * pattern;         // names returned must match it
+  char     prefix[ 13 ];        // all those names begin with it
+  uint8_t  prefixLen;
+  IndexEntry chunk[ DIR_INDEX_CHUNK ];
+  uint8_t  nChunk, iChunk;
+  uint32_t cachedBlock;         // directory block in the cache of the volume
+};
+
+#endif // DIR_INDEX_H
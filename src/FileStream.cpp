@@ -0,0 +1,47 @@
+#include "FileStream.h"
+
+FileStream::FileStream()
+{
+  file = NULL;
+  startPos = 0;
+  pos = 0;
+  endPos = 0;
+}
+
+// Get ready to send bytes start to end - 1 of a file
+//
+// return:
+//    false if the range is not in the file
+
+bool FileStream::begin( SdFile * pFile, uint32_t start, uint32_t end )
+{
+  file = NULL;
+  if( end > pFile->fileSize() || start > end || ! pFile->seekSet( start ))
+    return false;
+  file = pFile;
+  startPos = start;
+  pos = start;
+  endPos = end;
+  return true;
+}
+
+// Send the next buffer of the range
+//
+// return:
+//    number of bytes sent, 0 if the client can't take any now or at the end
+//    of the range (see done()), -1 if the file can't be read
+
+int16_t FileStream::send( Print & out, uint8_t * buf, uint16_t bufSize )
+{
+  if( done())
+    return 0;
+  uint16_t n = endPos - pos < bufSize ? endPos - pos : bufSize;
+  int16_t nb = file->read( buf, n );
+  if( nb <= 0 )
+    return -1;
+  size_t nw = out.write( (const uint8_t *) buf, nb );
+  pos += nw;
+  if( nw < (size_t) nb && ! file->seekSet( pos ))
+    return -1;
+  return nw;
+}
@@ -0,0 +1,55 @@
+/*
+ * Streaming of a file of the SD card to a network client
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                      FILE STREAMING TO A NETWORK CLIENT                    **
+ **                                                                            **
+ *******************************************************************************/
+
+// A range of bytes of an open file is sent one buffer at a time, so that
+//   the server that streams it can go on serving between two buffers.
+//   Used by RETR of the FTP server and by the HTTP file server.
+//
+// When the client takes fewer bytes than read, the file goes back to the
+//   first byte not sent: nothing is lost when the socket buffer is full.
+
+#ifndef FILE_STREAM_H
+#define FILE_STREAM_H
+
+#include "Arduino.h"
+#include <WiFiClient.h>
+#include "utility/SdFat.h"
+
+class FileStream
+{
+public:
+  FileStream();
+
+  bool     begin( SdFile * pFile, uint32_t start, uint32_t end );
+  int16_t  send( Print & out, uint8_t * buf, uint16_t bufSize );
+  bool     done() { return file == NULL || pos >= endPos; }
+  uint32_t sent() { return pos - startPos; }
+
+private:
+  SdFile * file;
+  uint32_t startPos;      // first byte of the range
+  uint32_t pos;           // next byte to send
+  uint32_t endPos;        // byte after the range
+};
+
+#endif // FILE_STREAM_H
@@ -0,0 +1,74 @@
+#include "FtpArena.h"
+
+FtpArena::FtpArena()
+{
+  base = NULL;
+  size = 0;
+  bottom = 0;
+  top = 0;
+  peakUsed = 0;
+}
+
+// Take the whole arena from the heap
+//
+// return:
+//    false if there is not enough memory
+
+bool FtpArena::begin( size_t sz )
+{
+  end();
+  sz = align( sz );
+  base = (uint8_t *) malloc( sz );
+  if( base == NULL )
+    return false;
+  size = sz;
+  bottom = 0;
+  top = sz;
+  peakUsed = 0;
+  return true;
+}
+
+// Give the arena back to the heap
+
+void FtpArena::end()
+{
+  if( base != NULL )
+    free( base );
+  base = NULL;
+  size = 0;
+  bottom = 0;
+  top = 0;
+}
+
+// Take memory for the whole session
+//
+// return:
+//    NULL if the arena is exhausted
+
+void * FtpArena::hold( size_t n )
+{
+  n = align( n );
+  if( base == NULL || top - bottom < n )
+    return NULL;
+  top -= n;
+  if( bottom + size - top > peakUsed )
+    peakUsed = bottom + size - top;
+  return base + top;
+}
+
+// Take memory for a temporary, freed by the next release()
+//
+// return:
+//    NULL if the arena is exhausted
+
+void * FtpArena::alloc( size_t n )
+{
+  n = align( n );
+  if( base == NULL || top - bottom < n )
+    return NULL;
+  void * p = base + bottom;
+  bottom += n;
+  if( bottom + size - top > peakUsed )
+    peakUsed = bottom + size - top;
+  return p;
+}
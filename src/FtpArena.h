@@ -0,0 +1,65 @@
+/*
+ * Session memory arena for the FTP server
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                    SESSION MEMORY ARENA FOR FTP SERVER                     **
+ **                                                                            **
+ *******************************************************************************/
+
+// All the working memory of an ftp session is taken from the heap in one
+//   block when a client connects and given back when it disconnects.
+//
+// The block is used from both ends:
+//   hold()  takes memory from the top, for buffers that live as long as
+//           the session (transfer buffer, command line, directories)
+//   alloc() takes memory from the bottom, for temporaries of a command.
+//           mark() / release() free all temporaries taken since the mark.
+
+#ifndef FTP_ARENA_H
+#define FTP_ARENA_H
+
+#include "Arduino.h"
+
+class FtpArena
+{
+public:
+  FtpArena();
+
+  bool    begin( size_t size );
+  void    end();
+  bool    active() { return base != NULL; }
+
+  void *  hold( size_t size );
+  void *  alloc( size_t size );
+  size_t  mark() { return bottom; }
+  void    release( size_t m ) { if( m < bottom ) bottom = m; }
+
+  size_t  capacity() { return size; }
+  size_t  peak() { return peakUsed; }
+
+private:
+  static size_t align( size_t n ) { return ( n + 3 ) & ~ (size_t) 3; }
+
+  uint8_t * base;
+  size_t size;
+  size_t bottom;          // first free byte from the bottom
+  size_t top;             // first byte held from the top
+  size_t peakUsed;        // peak of bottom + held bytes in this session
+};
+
+#endif // FTP_ARENA_H
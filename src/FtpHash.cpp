@@ -0,0 +1,242 @@
+#include "FtpHash.h"
+#include "SdList.h"
+
+extern SdList sdl;
+
+#define HASH_HEAD_SIZE 512   // bytes covered by headCrc
+
+// First fields of a slot, enough to search the cache file
+struct HashSlotHead
+{
+  uint32_t cluster;
+  uint32_t created;
+  uint32_t length;
+  uint32_t headCrc;
+  uint32_t crc;
+  uint32_t stamp;
+};
+
+// Search the cache file for the slot of a file
+//
+// parameters:
+//   cluster : first cluster of the file
+//   created : date and time of creation of its entry
+//   pLength : where to store the length hashed in the slot found
+//   pVictim : where to store the slot to use if the file is not found
+//
+// return:
+//    index of the slot of the file, -1 if not found
+
+static int8_t scanSlots( SdFile * pCache, uint32_t cluster, uint32_t created, uint32_t * pLength,
+                         int8_t * pVictim, uint32_t * pStamp )
+{
+  HashSlotHead h;
+  uint32_t oldest = 0xFFFFFFFF;
+  int8_t found = -1;
+
+  * pVictim = -1;
+  * pStamp = 0;
+  for( int8_t i = 0; i < HASH_CACHE_SLOTS; i ++ )
+  {
+    if( ! pCache->seekSet( (uint32_t) i * sizeof( HashState )) ||
+        pCache->read( & h, sizeof( h )) != sizeof( h ))
+    {
+      // slot never written: the best victim
+      if( * pVictim < 0 || oldest > 0 )
+      {
+        * pVictim = i;
+        oldest = 0;
+      }
+      break;
+    }
+    if( h.stamp > * pStamp )
+      * pStamp = h.stamp;
+    if( cluster != 0 && h.cluster == cluster && h.created == created )
+    {
+      found = i;
+      * pLength = h.length;
+    }
+    if( h.cluster == 0 )
+      h.stamp = 0;
+    if( h.stamp < oldest )
+    {
+      oldest = h.stamp;
+      * pVictim = i;
+    }
+  }
+  return found;
+}
+
+// Compute MD5 and CRC-32 of bytes start to end - 1 of a file
+//
+// parameters:
+//   pFile : file opened for reading
+//   buf, bufSize : buffer for the reads
+//   st : working storage for the running state
+//   md5, crc : where to store the digests
+//
+// return:
+//    false if the range or the file can't be read
+
+bool FtpHash::digest( SdFile * pFile, uint32_t start, uint32_t end,
+                      uint8_t * buf, uint16_t bufSize, HashState * st,
+                      uint8_t md5[ 16 ], uint32_t * crc )
+{
+  uint32_t size = pFile->fileSize();
+  uint32_t cluster = pFile->firstCluster();
+  uint32_t created = entryCreated( pFile );
+  bool cached = false;
+
+  if( end > size )
+    end = size;
+  if( start > end )
+    return false;
+
+  // Resume from the running state of the beginning of the file
+  if( start == 0 && cluster != 0 )
+  {
+    SdFile cache;
+    if( sdl.openRootFile( & cache, HASH_CACHE_FILE, O_READ ))
+    {
+      uint32_t length, stamp, head;
+      int8_t victim;
+      int8_t slot = scanSlots( & cache, cluster, created, & length, & victim, & stamp );
+      if( slot >= 0 && length <= end &&
+          cache.seekSet( (uint32_t) slot * sizeof( HashState )) &&
+          cache.read( st, sizeof( HashState )) == sizeof( HashState ) &&
+          headCrc( pFile, length, buf, bufSize, & head ) && head == st->headCrc )
+        cached = true;
+      cache.close();
+    }
+  }
+  if( ! cached )
+  {
+    st->cluster = cluster;
+    st->created = created;
+    st->length = start;
+    st->crc = 0xFFFFFFFF;
+    MD5Init( & st->md5 );
+  }
+
+  if( ! pFile->seekSet( st->length ))
+    return false;
+  while( st->length < end )
+  {
+    uint16_t n = end - st->length < bufSize ? end - st->length : bufSize;
+    int16_t nb = pFile->read( buf, n );
+    if( nb <= 0 )
+      return false;
+    MD5Update( & st->md5, buf, nb );
+    st->crc = crc32( st->crc, buf, nb );
+    st->length += nb;
+    yield();
+  }
+
+  // Keep the running state of the beginning of the file
+  if( start == 0 && cluster != 0 && st->length > 0 &&
+      headCrc( pFile, st->length, buf, bufSize, & st->headCrc ))
+    saveState( st );
+
+  md5_context_t ctx = st->md5;   // MD5Final() destroys the context
+  MD5Final( md5, & ctx );
+  * crc = ~ st->crc;
+  return true;
+}
+
+// Forget the running states of a file that is deleted, overwritten or
+//   renamed: all the slots of its first cluster
+
+void FtpHash::forget( uint32_t cluster )
+{
+  SdFile cache;
+  uint32_t c;
+
+  if( cluster == 0 || ! sdl.openRootFile( & cache, HASH_CACHE_FILE, O_RDWR ))
+    return;
+  for( uint8_t i = 0; i < HASH_CACHE_SLOTS; i ++ )
+  {
+    if( ! cache.seekSet( (uint32_t) i * sizeof( HashState )) ||
+        cache.read( & c, sizeof( c )) != sizeof( c ))
+      break;
+    if( c == cluster && cache.seekSet( (uint32_t) i * sizeof( HashState )))
+    {
+      uint32_t zero = 0;
+      cache.write( & zero, sizeof( zero ));
+    }
+  }
+  cache.close();
+}
+
+// Date and time of creation of the entry of a file, 0 if unknown
+
+uint32_t FtpHash::entryCreated( SdFile * pFile )
+{
+  dir_t d;
+
+  if( ! pFile->dirEntry( & d ))
+    return 0;
+  return (uint32_t) d.creationDate << 16 | d.creationTime;
+}
+
+// CRC-32 of the first bytes of a file, up to HASH_HEAD_SIZE or length if less
+
+bool FtpHash::headCrc( SdFile * pFile, uint32_t length, uint8_t * buf, uint16_t bufSize, uint32_t * crc )
+{
+  uint32_t cur = pFile->curPosition();
+  uint16_t n = HASH_HEAD_SIZE;
+  if( n > bufSize )
+    n = bufSize;
+  if( n > length )
+    n = length;
+  if( ! pFile->seekSet( 0 ) || pFile->read( buf, n ) != n )
+    return false;
+  * crc = crc32( 0xFFFFFFFF, buf, n );
+  return pFile->seekSet( cur );
+}
+
+// Store a running state in the slot of its file, or in the oldest slot
+
+void FtpHash::saveState( HashState * st )
+{
+  SdFile cache;
+  uint32_t length, stamp;
+  int8_t victim;
+
+  if( ! sdl.openRootFile( & cache, HASH_CACHE_FILE, O_RDWR | O_CREAT ))
+    return;
+  int8_t slot = scanSlots( & cache, st->cluster, st->created, & length, & victim, & stamp );
+  if( slot < 0 )
+    slot = victim;
+  else if( length > st->length )
+    slot = -1;                   // keep the longer state
+  if( slot >= 0 && cache.seekSet( (uint32_t) slot * sizeof( HashState )))
+  {
+    st->stamp = stamp + 1;
+    cache.write( st, sizeof( HashState ));
+  }
+  cache.close();
+}
+
+// Update a CRC-32 with some bytes
+//
+// Start with crc = 0xFFFFFFFF and complement the result at the end.
+//   Uses a table of 16 entries to save RAM.
+
+uint32_t FtpHash::crc32( uint32_t crc, const uint8_t * data, uint16_t len )
+{
+  static const uint32_t table[ 16 ] =
+  {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+
+  while( len -- )
+  {
+    crc ^= * data ++;
+    crc = ( crc >> 4 ) ^ table[ crc & 0x0F ];
+    crc = ( crc >> 4 ) ^ table[ crc & 0x0F ];
+  }
+  return crc;
+}
@@ -0,0 +1,80 @@
+/*
+ * Cached file digests for the FTP server (HASH, XMD5, XCRC)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                     CACHED FILE DIGESTS FOR FTP SERVER                     **
+ **                                                                            **
+ *******************************************************************************/
+
+// MD5 and CRC-32 are computed together in a single pass over the file.
+//
+// Log files only grow, so the running state of both digests after the
+//   last byte hashed is kept in a small file at the root of the card.
+//   Hashing the file again only reads the bytes appended since then.
+//   A state is taken again only for the same first cluster, the same date
+//   and time of creation of the entry, and the same first block. Besides,
+//   the FTP server forgets the state of a file stored, deleted or renamed:
+//   a file made again in the same place never gets the digest of the old
+//   one. The cache file is not listed, and the FTP server refuses its name.
+//
+// The running MD5 context is taken from md5.h (the ROM functions wrapped
+//   by MD5Builder), as MD5Builder does not give access to its context.
+
+#ifndef FTP_HASH_H
+#define FTP_HASH_H
+
+#include "Arduino.h"
+#include "MD5Builder.h"
+#include "utility/SdFat.h"
+
+#define HASH_CACHE_FILE  "HASHES.DAT"  // where running states are kept
+#define HASH_CACHE_SLOTS 8             // number of files remembered
+
+#define HASH_MD5   1
+#define HASH_CRC32 2
+
+// Running state of the digests of the beginning of a file
+
+struct HashState
+{
+  uint32_t cluster;       // first cluster of the file, identifies it on the card
+  uint32_t created;       //   with the date and time of creation of its entry
+  uint32_t length;        // number of bytes hashed from the beginning
+  uint32_t headCrc;       // CRC-32 of the first block, to detect a rewritten file
+  uint32_t crc;           // running CRC-32, not finalized
+  uint32_t stamp;         // age of the slot, for replacement
+  md5_context_t md5;      // running MD5
+};
+
+class FtpHash
+{
+public:
+  bool    digest( SdFile * pFile, uint32_t start, uint32_t end,
+                  uint8_t * buf, uint16_t bufSize, HashState * st,
+                  uint8_t md5[ 16 ], uint32_t * crc );
+  void    forget( uint32_t cluster );
+
+  static uint32_t crc32( uint32_t crc, const uint8_t * data, uint16_t len );
+
+private:
+  bool    headCrc( SdFile * pFile, uint32_t length, uint8_t * buf, uint16_t bufSize, uint32_t * crc );
+  void    saveState( HashState * st );
+  uint32_t entryCreated( SdFile * pFile );
+};
+
+#endif // FTP_HASH_H
@@ -34,7 +34,7 @@
  * Commands implemented:
  *   USER, PASS
  *   CDUP, CWD, QUIT
- *   MODE, STRU, TYPE
+ *   MODE (S, Z), STRU, TYPE
  *   PASV, PORT
  *   ABOR
  *   DELE
@@ -43,8 +43,10 @@
  *   RETR, STOR
  *   MKD,  RMD
  *   RNTO, RNFR
- *   FEAT, SIZE
- *   SITE FREE
+ *   FEAT, SIZE, MDTM, MLST
+ *   HASH, XCRC, XMD5, OPTS HASH, OPTS MODE Z
+ *   SITE FREE, SITE TRACE, SITE PAGE, SITE INDEX, SITE TAR, SITE MEM, SITE ZBENCH,
+ *   SITE SNAPSHOT, SITE IO, SITE RING
  *
  * Tested with those clients:
  *   under Windows:
@@ -71,6 +73,8 @@
 
 #include "FtpServer.h"
 #include "SdList.h"
+#include "MemStats.h"
+#include "SdBlockDev.h"
 #include <ESP8266WiFi.h>
 #include <WiFiClient.h>
 #include <ESP8266WebServer.h>
@@ -93,11 +97,33 @@ WiFiServer ftpServer( FTP_CTRL_PORT );
 WiFiServer dataServer( FTP_DATA_PORT_PASV );
 extern SdList sdl;
 
+// Operation of a command, for the counts of SITE IO
+
+static uint8_t ioOp( const char * command )
+{
+  static const struct { char name[ 5 ]; uint8_t op; } ops[] =
+  {
+    { "CWD",  IO_OP_CWD },  { "CDUP", IO_OP_CWD },
+    { "LIST", IO_OP_LIST }, { "NLST", IO_OP_LIST }, { "MLSD", IO_OP_LIST }, { "MLST", IO_OP_LIST },
+    { "RETR", IO_OP_RETR }, { "STOR", IO_OP_STOR },
+    { "DELE", IO_OP_FILE }, { "RNFR", IO_OP_FILE }, { "RNTO", IO_OP_FILE }, { "MKD",  IO_OP_FILE },
+    { "RMD",  IO_OP_FILE }, { "SIZE", IO_OP_FILE }, { "MDTM", IO_OP_FILE }, { "HASH", IO_OP_FILE },
+    { "XCRC", IO_OP_FILE }, { "XMD5", IO_OP_FILE }
+  };
+
+  for( uint8_t i = 0; i < sizeof( ops ) / sizeof( ops[ 0 ] ); i ++ )
+    if( ! strcmp( command, ops[ i ].name ))
+      return ops[ i ].op;
+  return IO_OP_OTHER;
+}
+
 void FtpServer::init()
 {
   // Tells the ftp server to begin listening for incoming connection
   ftpServer.begin();
   dataServer.begin();
+  traceOn = false;
+  transferStatus = 0;     // then closed with the session, see service()
   iniVariables();
 }
 
@@ -109,17 +135,18 @@ void FtpServer::iniVariables()
   // Default Data connection is Active
   dataPassiveConn = false;
 
-  // Set the root directory
-  strcpy( cwdName, "/" );
-
-  cwdRNFR[ 0 ] = 0;
   cmdStatus = 0;
-  transferStatus = 0;
+  hashAlgo = HASH_MD5;
+  modeZ = false;
+  zLevel = DEFLATE_LEVEL;
+  ringRetr = false;
+  ringFrom = 0;
   millisTimeOut = ( uint32_t ) FTP_TIME_OUT * 60 * 1000;
 }
 
 void FtpServer::service()
 {
+  MemStats::sample( MEM_AT_SERVICE );
   if( cmdStatus == 0 )
   {
     if( client.connected())
@@ -129,6 +156,15 @@ void FtpServer::service()
       #endif
       client.stop();
     }
+    // A transfer can't outlive the session: its buffer is in the arena
+    if( transferStatus > 0 )
+    {
+      closeFile();
+      data.stop();
+      transferStatus = 0;
+    }
+    traceClose();
+    arena.end();
     #ifdef FTP_DEBUG
       	 Serial.print("Ftp server waiting for connection on port ");
       	 Serial.print(FTP_CTRL_PORT);
@@ -139,9 +175,8 @@ void FtpServer::service()
   else if( cmdStatus == 1 )  // Ftp server idle
   {
 	  client = ftpServer.available();
-    if( client > 0 )   // A client connected
+    if( client > 0 && clientConnected())   // A client connected
     {
-    	clientConnected();
 		millisEndConnection = millis() + 10 * 1000 ; // wait client id during 10 s.
 		cmdStatus = 2;
     }
@@ -155,15 +190,18 @@ void FtpServer::service()
 	}
 	else if( readChar() > 0 )         // got response
 	{
+		uint32_t microsCmd = micros();
+		uint32_t allocsCmd = MemStats::allocs();
+		if( cmdStatus == 3 && ! strcmp( command, "PASS" ))
+			trace( 'C', "PASS ****" );
+		else
+			trace( 'C', cmdLine );
+
 		if( cmdStatus == 2 )            // Ftp server waiting for user registration
 		{
 			if( strcmp(command,"FEAT") == 0 )
-			{
-			  client.print("530 Please login with USER and PASS.\r\n");
-			  return;
-			}
-
-			if( userIdentity() )
+			  sendFeatures();
+			else if( userIdentity() )
 				cmdStatus = 3;
 			else
 				cmdStatus = 0;
@@ -180,11 +218,27 @@ void FtpServer::service()
 		}
 		else if( cmdStatus == 4 )       // Ftp server waiting for user command
 		{
-			if( ! processCommand())
+			size_t scratch = arena.mark();
+			IoScope io( ioOp( command ));
+			boolean ok = processCommand();
+			MemStats::sample( MEM_AT_REPLY );
+			arena.release( scratch );     // free the temporaries of the command
+			if( ! ok )
 				cmdStatus = 0;
 			else
 				millisEndConnection = millis() + millisTimeOut;
 		}
+		if( traceFile.isOpen())
+		{
+			char us[ 12 ];
+			sprintf( us, "%lu", (unsigned long) ( micros() - microsCmd ));
+			trace( 'D', us );
+			char mem[ 48 ];
+			sprintf( mem, "%lu %lu %lu %u %lu", (unsigned long) MemStats::stackPeak(),
+			         (unsigned long) MemStats::heapFree(), (unsigned long) MemStats::heapBlock(),
+			         MemStats::heapFrag(), (unsigned long) ( MemStats::allocs() - allocsCmd ));
+			trace( 'M', mem );
+		}
 	}
   }
   if( transferStatus == 1 )           // Retrieve data
@@ -197,6 +251,11 @@ void FtpServer::service()
     if( ! doStore())
       transferStatus = 0;
   }
+  else if( transferStatus == 3 )      // Archive of files
+  {
+    if( ! doTar())
+      transferStatus = 0;
+  }
   else if( cmdStatus > 1 && ! ((int32_t) ( millisEndConnection - millis() ) > 0 ))
   {
     client.print("530 Timeout\r\n");
@@ -204,17 +263,44 @@ void FtpServer::service()
   }
 }
 
-void FtpServer::clientConnected()
+// Take the memory of the session and greet the client
+//
+// return:
+//    false if there is not enough memory for the session
+
+boolean FtpServer::clientConnected()
 {
   #ifdef FTP_DEBUG
     Serial.println("Client connected!");
   #endif
+  if( ! arena.begin( FTP_ARENA_SIZE ))
+  {
+    #ifdef FTP_DEBUG
+      Serial.println("Not enough memory for session");
+    #endif
+    client.print("421 Not enough memory, try later\r\n");
+    client.stop();
+    return false;
+  }
+  millisSession = millis();
+  buf = (uint8_t *) arena.hold( FTP_BUF_SIZE );
+  cmdLine = (char *) arena.hold( FTP_CMD_SIZE );
+  cwdName = (char *) arena.hold( FTP_CWD_SIZE );
+  cwdRNFR = (char *) arena.hold( FTP_CWD_SIZE );
+  strcpy( cwdName, "/" );
+  cwdRNFR[ 0 ] = 0;
+  listPage = 0;
+  listAfter[ 0 ] = 0;
+
     client.print("220--- Welcome to FTP for ESP8266 ---\r\n");
     client.print("220---   By Ukrit   ---\r\n");
     client.print("220 --   Version ");
     client.print(FTP_SERVER_VERSION);
     client.print("   --\r\n");
   iCL = 0;
+  if( traceOn )
+    traceOpen();
+  return true;
 }
 
 extern "C" void esp_yield();
@@ -267,6 +353,7 @@ boolean FtpServer::userPassword()
 
 boolean FtpServer::processCommand()
 {
+  MemStats::sample( MEM_AT_COMMAND );
   ///////////////////////////////////////
   //                                   //
   //      ACCESS CONTROL COMMANDS      //
@@ -279,7 +366,6 @@ boolean FtpServer::processCommand()
   if( ! strcmp( command, "CDUP" ))
   {
     char * pSep;
-    char tmp[ FTP_CWD_SIZE ];
     boolean ok = false;
 
     if( strlen( cwdName ) > 1 )
@@ -311,14 +397,16 @@ boolean FtpServer::processCommand()
   //
   else if( ! strcmp( command, "CWD" ))
   {
+    char * tmp = (char *) arena.alloc( FTP_CWD_SIZE );
     if( strcmp( parameters, "." ) == 0 )  // 'CWD .' is the same as PWD command
     {
       client.print("257 \""); client.print(cwdName); client.print(" is your current directory\r\n");
     }
+    else if( tmp == NULL )
+      client.print("451 Not enough memory\r\n");
     else
     {
       boolean ok = true;
-      char tmp[ FTP_CWD_SIZE ] = {0,};
 		if( strcmp( parameters, "/" ) == 0 || strlen( parameters ) == 0 )
 		{
 			strcpy( cwdName, "/" );            // go to root
@@ -334,12 +422,14 @@ boolean FtpServer::processCommand()
 //			}
 //			else
 //				strcpy( tmp, parameters );
-			strcpy( tmp, parameters );
+			ok = strlen( parameters ) < FTP_CWD_SIZE;
+			if( ok )
+				strcpy( tmp, parameters );
 
 //			if( tmp[ strlen( tmp ) - 1 ] != '/' )
 //				strcat( tmp, "/" );
 
-			ok = sdl.chdir( tmp );   // try to change to new dir
+			ok = ok && sdl.chdir( tmp );   // try to change to new dir
 
 			if( ok )
 			{
@@ -389,12 +479,23 @@ boolean FtpServer::processCommand()
   //
   //  MODE - Transfer Mode
   //
+  //  In MODE Z, the data of RETR, LIST, NLST, MLSD and SITE TAR is sent as
+  //    a zlib stream (see Deflate.h); STOR is only accepted in MODE S
+  //
   else if( ! strcmp( command, "MODE" ))
   {
     if( ! strcmp( parameters, "S" ))
+    {
+      modeZ = false;
       client.print("200 S Ok\r\n");
+    }
+    else if( ! strcmp( parameters, "Z" ))
+    {
+      modeZ = true;
+      client.print("200 Z Ok\r\n");
+    }
     else
-      client.print("504 Only S(tream) is suported\r\n");
+      client.print("504 Only S(tream) and Z are suported\r\n");
   }
   //
   //  PASV - Passive Connection management
@@ -404,9 +505,13 @@ boolean FtpServer::processCommand()
     data.stop();
     dataServer.begin();
     dataIp = WiFi.localIP();
-    //dataPort = FTP_DATA_PORT_PASV;
+    dataPort = FTP_DATA_PORT_PASV;    // the port dataServer listens on
    // data.connect( dataIp, dataPort );
-    data = dataServer.available();
+    // A connection made before this reply is left from a command that
+    //   failed before dataConnect() (a refused STOR): drop it, or the next
+    //   transfer would go to that closed socket
+    while(( data = dataServer.available()))
+      data.stop();
     #ifdef FTP_DEBUG
     	Serial.println("Connection management set to passive");
     	Serial.print("Data port set to");
@@ -503,7 +608,7 @@ boolean FtpServer::processCommand()
   {
     if( transferStatus > 0 )
     {
-      file.close();
+      closeFile();
       data.stop();
       client.print("426 Transfer aborted\r\n");
       //client << "426 Transfer aborted" << "\r\n";
@@ -522,17 +627,17 @@ boolean FtpServer::processCommand()
     	//client << "501 No file name\r\n";
     else
     {
-      char path[ FTP_CWD_SIZE ];
-      char name[ FTP_FIL_SIZE ];
-      makePathName( name, path, FTP_CWD_SIZE );
+      char * path;
+      char * name;
       // Serial << "Deleting [" << name << "] in [" << path << "]" << endl;
-      if( ! sdl.chdir( path ) || ! sdl.exists( name ))
+      if( ! allocPathName( & name, & path ) || ! sdl.chdir( path ) || ! sdl.exists( name ))
       {
         client.print("550 File "); client.print(parameters); client.print(" not found\r\n");
   	  //client << "550 File " << parameters << " not found\r\n";
       }
       else
       {
+        forgetHash( name );
         if( sdl.remove( name ))
         {
           client.print("250 Deleted "); client.print(parameters); client.print("\r\n");
@@ -547,46 +652,142 @@ boolean FtpServer::processCommand()
     }
   }
   //
-  //  LIST - List
+  //  LIST, NLST, MLSD - List
   //
-  else if( ! strcmp( command, "LIST" ))
+  //  Entries are listed in the order of the names, from the index of the
+  //    directory (see DirIndex.h), and all facts are taken from the
+  //    directory entries. The parameter is a directory, a file, or a pattern
+  //    with '*' and '?' (LIST 2018-06*). See SITE PAGE for long listings.
+  //
+  else if( ! strcmp( command, "LIST" ) || ! strcmp( command, "NLST" ) ||
+           ! strcmp( command, "MLSD" ))
   {
-    if( ! dataConnect())
+    char * pattern;
+
+    while( * parameters == '-' )      // options of ls sent by some clients
+    {
+      while( * parameters != 0 && * parameters != ' ' )
+        parameters ++;
+      while( * parameters == ' ' )
+        parameters ++;
+    }
+    boolean listable = enterListDir( & pattern );
+    char * name = (char *) arena.alloc( FTP_FIL_SIZE );
+    char * str = (char *) arena.alloc( 256 );
+    if( ! listable )
+    {
+      client.print("550 Can't list "); client.print(parameters); client.print("\r\n");
+    }
+    else if( name == NULL || str == NULL )
+      client.print("451 Not enough memory\r\n");
+    else if( modeZ && ! zip.begin( zLevel ))
+      client.print("451 Not enough memory for MODE Z\r\n");
+    else if( ! dataConnect())
+    {
+      zip.end();
       client.print("425 No data connection\r\n");
+    }
     else
     {
       client.print("150 Accepted data connection\r\n");
-      char fileName[ FTP_FIL_SIZE ];
+      uint16_t nm = 0;
       bool isFile;
       uint32_t fileSize;
-      uint16_t nm = 0;
-      File dir;
-      char str[256];
-
-      sdl.chdir( cwdName );
-      dir = sdl.open(cwdName);
+      uint16_t fileDate, fileTime;
+      boolean more = false;
+      DirIndex list;
 
-     while(true)
+      // Without an index, entries come in the order of the directory
+      boolean sorted = sdl.listOpen( & list, pattern, listAfter );
+      listAfter[ 0 ] = 0;
+      while( sorted ? list.next( name, & isFile, & fileSize, & fileDate, & fileTime )
+                    : sdl.nextFile( name, & isFile, & fileSize, & fileDate, & fileTime ))
       {
-    	 File entry = dir.openNextFile();
-    	 if( !entry )
-    		 break;
-
-		if( entry.isDirectory() )
-		{
-			sprintf(str,"drwxrwxrwx  1 %-10s %-10s %10lu Jan  1  1980 %s\r\n",FTP_USER,FTP_USER,entry.size(),entry.name() );
-		}
-		else
-		{
-			sprintf(str,"-rwxrwxrwx  1 %-10s %-10s %10lu Jan  1  1980 %s\r\n",FTP_USER,FTP_USER,entry.size(),entry.name() );
-		}
-		data.print(str);
-		nm ++;
-     }
+        if( hiddenName( name ) ||
+            ( ! sorted && pattern != NULL && ! DirIndex::match( pattern, name )))
+          continue;
+        if( sorted && listPage > 0 && nm >= listPage )
+        {
+          more = true;
+          break;
+        }
+        if( command[ 0 ] == 'M' )
+          makeFacts( str, name, isFile, fileSize, fileDate, fileTime );
+        else if( command[ 0 ] == 'L' )
+          makeListLine( str, name, isFile, fileSize, fileDate );
+        else
+          sprintf( str, "%s\r\n", name );
+        dataPrint( str );
+        nm ++;
+        strcpy( listAfter, name );
+      }
+      list.close();
+      dataEnd();
+      if( command[ 0 ] == 'M' )
+        client.print("226-options: -a -l\r\n");
+      if( more )
+      {
+        client.print("226-More entries: SITE PAGE "); client.print(listPage);
+        client.print(" "); client.print(listAfter); client.print("\r\n");
+      }
+      listAfter[ 0 ] = 0;
       client.print("226 "); client.print(nm); client.print(" matches total\r\n");
       data.stop();
     }
   }
+  //
+  //  MLST - Listing of one entry
+  //
+  else if( ! strcmp( command, "MLST" ))
+  {
+    char * path;
+    char * name;
+    char * str = (char *) arena.alloc( 256 );
+    bool isFile;
+    uint32_t fileSize;
+    uint16_t fileDate, fileTime;
+
+    if( strlen( parameters ) == 0 )
+      client.print("501 No file name\r\n");
+    else if( str == NULL || ! allocPathName( & name, & path ) || ! sdl.chdir( path ) ||
+             ! sdl.fileInfo( name, & isFile, & fileSize, & fileDate, & fileTime ))
+    {
+      client.print("550 No such file "); client.print(parameters); client.print("\r\n");
+    }
+    else
+    {
+      makeFacts( str, parameters, isFile, fileSize, fileDate, fileTime );
+      client.print("250-Listing "); client.print(parameters); client.print("\r\n");
+      client.print(" "); client.print(str);
+      client.print("250 End.\r\n");
+    }
+  }
+  //
+  //  MDTM - Modification time of a file
+  //
+  else if( ! strcmp( command, "MDTM" ))
+  {
+    char * path;
+    char * name;
+    bool isFile;
+    uint16_t fileDate, fileTime;
+
+    if( strlen( parameters ) == 0 )
+      client.print("501 No file name\r\n");
+    else if( ! allocPathName( & name, & path ) || ! sdl.chdir( path ) ||
+             ! sdl.fileInfo( name, & isFile, NULL, & fileDate, & fileTime ) || ! isFile )
+    {
+      client.print("550 No such file "); client.print(parameters); client.print("\r\n");
+    }
+    else
+    {
+      char * str = (char *) name;     // name is not needed anymore
+      sprintf( str, "213 %04u%02u%02u%02u%02u%02u\r\n",
+               FAT_YEAR( fileDate ), FAT_MONTH( fileDate ), FAT_DAY( fileDate ),
+               FAT_HOUR( fileTime ), FAT_MINUTE( fileTime ), FAT_SECOND( fileTime ));
+      client.print(str);
+    }
+  }
   
   //
   //  NOOP
@@ -607,14 +808,34 @@ boolean FtpServer::processCommand()
     	//client << "501 No file name\r\n";
     else
     {
-      char path[ FTP_CWD_SIZE ];
-      char name[ FTP_FIL_SIZE ];
-      makePathName( name, path, FTP_CWD_SIZE );
-      if( ! sdl.chdir( path ) || ! sdl.exists( name ))
+      char * path;
+      char * name;
+      if( ! allocPathName( & name, & path ) || ! sdl.chdir( path ) || ! sdl.exists( name ))
       {
     	  client.print("550 File "); client.print(parameters); client.print(" not found\r\n");
         //client << "550 File " << parameters << " not found\r\n";
       }
+      // The ring log is sent as lines, oldest first
+      else if( liveRing != NULL && ! strcmp( path, "/" ) && ! strcasecmp( name, liveRing->name()))
+      {
+        if( modeZ && ! zip.begin( zLevel ))
+          client.print("451 Not enough memory for MODE Z\r\n");
+        else if( ! dataConnect() || ! ringStream.begin( liveRing, ringFrom ))
+        {
+          zip.end();
+          client.print("425 No data connection\r\n");
+        }
+        else
+        {
+          client.print("150-Connected to port "); client.print(dataPort); client.print("\r\n");
+          client.print("150 "); client.print(ringStream.records()); client.print(" records to download\r\n");
+          millisBeginTrans = millis();
+          bytesTransfered = 0;
+          ringRetr = true;
+          transferStatus = 1;
+        }
+        ringFrom = 0;
+      }
       else
       {
         if( ! sdl.openFile( & file, name, O_READ ))
@@ -624,9 +845,18 @@ boolean FtpServer::processCommand()
         }
         else
         {
-          if( ! dataConnect())
+          if( modeZ && ! zip.begin( zLevel ))
+          {
+            client.print("451 Not enough memory for MODE Z\r\n");
+            file.close();
+          }
+          else if( ! dataConnect() || ! stream.begin( & file, 0, file.fileSize()))
+          {
+            zip.end();
         	  client.print("425 No data connection\r\n");
             //client << "425 No data connection\r\n";
+            file.close();
+          }
           else
           {
             #ifdef FTP_DEBUG
@@ -653,12 +883,18 @@ boolean FtpServer::processCommand()
     if( strlen( parameters ) == 0 )
       client.print("501 No file name\r\n");
     	//client << "501 No file name\r\n";
+    else if( modeZ )
+      client.print("504 STOR is not supported in MODE Z\r\n");
     else
     {
-      char path[ FTP_CWD_SIZE ];
-      char name[ FTP_FIL_SIZE ];
-      makePathName( name, path, FTP_CWD_SIZE );
-      if( ! sdl.chdir( path ) || ! sdl.openFile( & file, name, O_CREAT | O_TRUNC | O_RDWR ))
+      char * path;
+      char * name;
+      boolean ok = allocPathName( & name, & path ) && sdl.chdir( path );
+      if( ok )
+        forgetHash( name );    // the file is overwritten
+      if( ok )                 // gives back the clusters of the old file
+        ok = sdl.openFile( & file, name, O_CREAT | O_TRUNC | O_RDWR );
+      if( ! ok )
       {
         client.print("451 Can't open/create "); client.print(parameters); client.print("\r\n");
     	  //client << "451 Can't open/create " << parameters << "\r\n";
@@ -693,13 +929,12 @@ boolean FtpServer::processCommand()
       client.print("501 No directory name\r\n");
     else
     {
-      char path[ FTP_CWD_SIZE ];
-      char dir[ FTP_FIL_SIZE ];
-      makePathName( dir, path, FTP_CWD_SIZE );
+      char * path;
+      char * dir;
+      boolean ok = allocPathName( & dir, & path ) && sdl.chdir( path );
       #ifdef FTP_DEBUG
-      	  Serial.print("Creating directory "); Serial.println(dir); Serial.print(" in "); Serial.println(path);
+      	if( ok ) { Serial.print("Creating directory "); Serial.println(dir); Serial.print(" in "); Serial.println(path); }
       #endif
-      boolean ok = sdl.chdir( path );
 		if( ok )
 		{
 			if(  sdl.exists( dir ))
@@ -730,13 +965,9 @@ boolean FtpServer::processCommand()
       client.print("501 No directory name\r\n");
     else
     {
-      char path[ FTP_CWD_SIZE ];
-      char dir[ FTP_FIL_SIZE ];
-      makePathName( dir, path, FTP_CWD_SIZE );
-      #ifdef FTP_DEBUG
-      	  Serial.print("Deleting "); Serial.println(dir); Serial.print(" in "); Serial.println(path);
-      #endif
-      if( ! sdl.chdir( path ) || ! sdl.exists( dir ))
+      char * path;
+      char * dir;
+      if( ! allocPathName( & dir, & path ) || ! sdl.chdir( path ) || ! sdl.exists( dir ))
       {
     	  client.print("550 File "); client.print(parameters); client.print(" not found\r\n");
       }
@@ -751,6 +982,76 @@ boolean FtpServer::processCommand()
     }
   }
 
+  //
+  //  RNFR - Rename From
+  //
+  else if( ! strcmp( command, "RNFR" ))
+  {
+    cwdRNFR[ 0 ] = 0;
+    if( strlen( parameters ) == 0 )
+      client.print("501 No file name\r\n");
+    else
+    {
+      char * path;
+      char * name;
+      if( ! allocPathName( & name, & path ) || ! sdl.chdir( path ) || ! sdl.exists( name ) ||
+          strlen( path ) + strlen( name ) + 1 >= FTP_CWD_SIZE )
+      {
+        client.print("550 File "); client.print(parameters); client.print(" not found\r\n");
+      }
+      else
+      {
+        strcpy( cwdRNFR, path );
+        if( cwdRNFR[ strlen( cwdRNFR ) - 1 ] != '/' )
+          strcat( cwdRNFR, "/" );
+        strcat( cwdRNFR, name );
+        client.print("350 RNFR accepted - file exists, ready for destination\r\n");
+      }
+    }
+  }
+  //
+  //  RNTO - Rename To
+  //
+  //  Only the directory entry is changed, or moved to the directory given:
+  //    the data is not copied (see SdList::rename)
+  //
+  else if( ! strcmp( command, "RNTO" ))
+  {
+    char * path;
+    char * name;
+    char * fromPath = (char *) arena.alloc( FTP_CWD_SIZE );
+    SdFile fromDir;
+    if( cwdRNFR[ 0 ] == 0 )
+      client.print("503 Need RNFR before RNTO\r\n");
+    else if( strlen( parameters ) == 0 )
+      client.print("501 No file name\r\n");
+    else if( fromPath == NULL || ! allocPathName( & name, & path ))
+      client.print("501 Name too long\r\n");
+    else
+    {
+      char * fromName = strrchr( cwdRNFR, '/' ) + 1;
+      strcpy( fromPath, cwdRNFR );
+      fromPath[ fromName - cwdRNFR ] = 0;
+      if( ! sdl.chdir( fromPath ) || ! sdl.openCwd( & fromDir ) || ! sdl.chdir( path ))
+      {
+        client.print("550 \""); client.print(path); client.print("\" is not directory\r\n");
+      }
+      else if( sdl.exists( name ))
+      {
+        client.print("553 "); client.print(parameters); client.print(" already exists\r\n");
+      }
+      else
+      {
+        forgetHash( fromName, & fromDir );
+        if( sdl.rename( & fromDir, fromName, name ))
+          client.print("250 File successfully renamed or moved\r\n");
+        else
+          client.print("451 Rename/move failure\r\n");
+      }
+    }
+    cwdRNFR[ 0 ] = 0;
+  }
+
   ///////////////////////////////////////
   //                                   //
   //   EXTENSIONS COMMANDS (RFC 3659)  //
@@ -762,19 +1063,7 @@ boolean FtpServer::processCommand()
   //
   else if( strncmp( command, "FEAT",4) == 0 )
   {
-	  client.print("530 Please login with USER and PASS.\r\n");
-//	  client.print("211-Extensions suported:\r\n");
-//	  client.print(" MLSD\r\n");
-//	  client.print(" SIZE\r\n");
-//	  client.print(" SITE FREE\r\n");
-//    client << "211-Extensions suported:\r\n";
-//    client << " MLSD\r\n";
-//    client << " SIZE\r\n";
-//    client << " SITE FREE\r\n";
-    // client << " SITE NAME LONG\r\n";
-    // client << " SITE NAME 8.3\r\n";
-//	  client.print("211 End.\r\n");
-	  //client << "211 End.\r\n";
+    sendFeatures();
   }
   //
   //  SIZE - Size of the file
@@ -811,10 +1100,9 @@ boolean FtpServer::processCommand()
     // /*
     // The correct way
     {
-      char path[ FTP_CWD_SIZE ];
-      char name[ FTP_FIL_SIZE ];
-      makePathName( name, path, FTP_CWD_SIZE );
-      if( sdl.chdir( path ) && sdl.openFile( & file, name, O_READ ))
+      char * path;
+      char * name;
+      if( allocPathName( & name, & path ) && sdl.chdir( path ) && sdl.openFile( & file, name, O_READ ))
       {
         client.print("213 "); client.print(file.fileSize()); client.print("\r\n");
 //    	 client << "213 " << file.fileSize() << "\r\n";
@@ -829,6 +1117,424 @@ boolean FtpServer::processCommand()
     // */
   }
   //
+  //  HASH, XCRC, XMD5 - Digest of a file
+  //
+  //  XCRC and XMD5 accept an optional range: XMD5 file [start [end]]
+  //
+  //  Refused while SITE TAR sends an archive: the digest is made in buf.
+  //
+  else if( ! strcmp( command, "HASH" ) || ! strcmp( command, "XCRC" ) ||
+           ! strcmp( command, "XMD5" ))
+  {
+    uint32_t start = 0, end = 0xFFFFFFFF;
+    uint8_t algo = hashAlgo;
+    if( command[ 0 ] == 'X' )
+    {
+      algo = command[ 1 ] == 'C' ? HASH_CRC32 : HASH_MD5;
+      splitRange( & start, & end );
+    }
+    char * path;
+    char * name;
+    SdFile hf;
+    HashState * st = (HashState *) arena.alloc( sizeof( HashState ));
+    uint8_t md5[ 16 ];
+    uint32_t crc;
+
+    if( strlen( parameters ) == 0 )
+      client.print("501 No file name\r\n");
+    else if( transferStatus == 3 )
+      client.print("450 An archive is being sent, try after it\r\n");
+    else if( st == NULL || ! allocPathName( & name, & path ) || ! sdl.chdir( path ) ||
+             ! sdl.openFile( & hf, name, O_READ ))
+    {
+      client.print("550 No such file "); client.print(parameters); client.print("\r\n");
+    }
+    else
+    {
+      if( end > hf.fileSize())
+        end = hf.fileSize();
+      // buf holds nothing between two calls to doRetrieve() or doStore(),
+      //   but doTar() keeps there the header or padding it is sending
+      if( ! hash.digest( & hf, start, end, buf, FTP_BUF_SIZE, st, md5, & crc ))
+        client.print("501 Can't read range\r\n");
+      else
+      {
+        char * hex = (char *) st;     // the state is not needed anymore
+        if( algo == HASH_MD5 )
+          for( uint8_t i = 0; i < 16; i ++ )
+            sprintf( hex + 2 * i, "%02x", md5[ i ] );
+        else
+          sprintf( hex, "%08X", crc );
+        if( command[ 0 ] == 'X' )
+        {
+          client.print("250 "); client.print(hex); client.print("\r\n");
+        }
+        else
+        {
+          client.print("213 "); client.print(algo == HASH_MD5 ? "MD5 " : "CRC32 ");
+          client.print(start); client.print("-"); client.print(end > start ? end - 1 : start);
+          client.print(" "); client.print(hex); client.print(" "); client.print(parameters);
+          client.print("\r\n");
+        }
+      }
+      hf.close();
+    }
+  }
+  //
+  //  OPTS - Options
+  //
+  else if( ! strcmp( command, "OPTS" ))
+  {
+    //  OPTS MODE Z LEVEL <n> - Level of compression, 1 (fast) to 9 (small)
+    if( ! strncasecmp( parameters, "MODE Z", 6 ))
+    {
+      char * p = parameters + 6;
+      while( * p == ' ' )
+        p ++;
+      if( ! strncasecmp( p, "LEVEL ", 6 ) && atoi( p + 6 ) >= 1 && atoi( p + 6 ) <= 9 )
+      {
+        zLevel = atoi( p + 6 );
+        client.print("200 MODE Z LEVEL set to "); client.print(zLevel); client.print("\r\n");
+      }
+      else
+        client.print("501 Unknown option\r\n");
+    }
+    else if( strncasecmp( parameters, "HASH", 4 ) != 0 )
+      client.print("501 Option not understood\r\n");
+    else
+    {
+      char * alg = parameters + 4;
+      while( * alg == ' ' )
+        alg ++;
+      boolean ok = true;
+      if( ! strcasecmp( alg, "MD5" ))
+        hashAlgo = HASH_MD5;
+      else if( ! strcasecmp( alg, "CRC32" ))
+        hashAlgo = HASH_CRC32;
+      else
+        ok = * alg == 0;          // no algorithm: print the current one
+      if( ! ok )
+        client.print("501 Unknown algorithm\r\n");
+      else
+      {
+        client.print("200 "); client.print(hashAlgo == HASH_MD5 ? "MD5" : "CRC32"); client.print("\r\n");
+      }
+    }
+  }
+  //
+  //  SITE - Site specific commands
+  //
+  else if( ! strcmp( command, "SITE" ))
+  {
+    //
+    //  SITE FREE [SCAN] - Free space on the card
+    //
+    if( ! strncasecmp( parameters, "FREE", 4 ) &&
+        ( parameters[ 4 ] == 0 || parameters[ 4 ] == ' ' ))
+    {
+      if( ! strcasecmp( parameters + 4, " SCAN" ) && ! sdl.scanFree())
+        client.print("451 Can't read FAT\r\n");
+      else
+      {
+        client.print("211 "); client.print(sdl.free(), 1);
+        client.print(" MB free of "); client.print(sdl.capacity(), 1);
+        client.print(" MB capacity\r\n");
+      }
+    }
+    //
+    //  SITE TRACE [ON|OFF] - Record the sessions in FTP_TRACE_FILE
+    //
+    else if( ! strncasecmp( parameters, "TRACE", 5 ) &&
+             ( parameters[ 5 ] == 0 || parameters[ 5 ] == ' ' ))
+    {
+      if( ! strcasecmp( parameters + 5, " ON" ))
+      {
+        traceOn = true;
+        traceOpen();
+      }
+      else if( ! strcasecmp( parameters + 5, " OFF" ))
+      {
+        traceOn = false;
+        traceClose();
+      }
+      client.print("200 Trace is "); client.print(traceOn ? "ON" : "OFF");
+      if( traceFile.isOpen())
+      {
+        client.print(", "); client.print(traceFile.fileSize()); client.print(" bytes");
+      }
+      client.print("\r\n");
+    }
+    //
+    //  SITE PAGE <n> [<name>] - Listings return at most n entries (0 for
+    //    all), the next one starting after <name>. Pages need the index: a
+    //    directory of less than DIR_INDEX_MIN entries without one is listed
+    //    whole
+    //
+    else if( ! strncasecmp( parameters, "PAGE ", 5 ))
+    {
+      char * p = parameters + 5;
+      listPage = strtoul( p, & p, 10 );
+      while( * p == ' ' )
+        p ++;
+      strncpy( listAfter, p, sizeof( listAfter ) - 1 );
+      listAfter[ sizeof( listAfter ) - 1 ] = 0;
+      client.print("200 Pages of "); client.print(listPage); client.print(" entries\r\n");
+    }
+    //
+    //  SITE INDEX - Build the index of the current directory, or build it
+    //    again
+    //
+    else if( ! strcasecmp( parameters, "INDEX" ))
+    {
+      if( sdl.chdir( cwdName ) && sdl.reindex())
+        client.print("200 Index built\r\n");
+      else
+        client.print("451 Can't build index\r\n");
+    }
+    //
+    //  SITE MEM [RESET] - Peaks of stack and heap usage, see MemStats.h
+    //
+    else if( ! strncasecmp( parameters, "MEM", 3 ) &&
+             ( parameters[ 3 ] == 0 || parameters[ 3 ] == ' ' ))
+    {
+      client.print("211-Memory usage\r\n");
+      MemStats::print( client, "211-" );
+      client.print("211-session arena "); client.print(arena.peak());
+      client.print(" of "); client.print(arena.capacity()); client.print(" bytes\r\n");
+      if( ! strcasecmp( parameters + 3, " RESET" ))
+      {
+        MemStats::reset();
+        client.print("211 Samples cleared\r\n");
+      }
+      else
+        client.print("211 End.\r\n");
+    }
+    //
+    //  SITE IO [RESET] - Blocks read and written on the card by each kind
+    //    of operation, see SdBlockDev.h
+    //
+    else if( ! strncasecmp( parameters, "IO", 2 ) &&
+             ( parameters[ 2 ] == 0 || parameters[ 2 ] == ' ' ))
+    {
+      client.print("211-Card I/O, blocks read/written\r\n");
+      SdBlockDev::print( client, "211-" );
+      if( ! strcasecmp( parameters + 2, " RESET" ))
+      {
+        SdBlockDev::reset();
+        client.print("211 Counts cleared\r\n");
+      }
+      else
+        client.print("211 End.\r\n");
+    }
+    //
+    //  SITE RING [<seq>] - Records held by the ring log of the sketch. With
+    //    a sequence number, the next RETR of the ring sends the records
+    //    from there (those since the last download), without the header
+    //
+    else if( ! strncasecmp( parameters, "RING", 4 ) &&
+             ( parameters[ 4 ] == 0 || parameters[ 4 ] == ' ' ))
+    {
+      char * p = parameters + 4;
+      while( * p == ' ' )
+        p ++;
+      if( liveRing == NULL )
+        client.print("502 No ring log\r\n");
+      else if( * p == 0 )
+      {
+        client.print("211-Ring /"); client.print(liveRing->name());
+        client.print(", "); client.print(liveRing->capacity());
+        client.print(" records of "); client.print(RING_TEXT_SIZE); client.print(" chars\r\n");
+        client.print("211-Records "); client.print(liveRing->first());
+        client.print(" to "); client.print(liveRing->next() - 1); client.print("\r\n");
+        client.print("211 End.\r\n");
+      }
+      else if( strspn( p, "0123456789" ) != strlen( p ))
+        client.print("501 Bad sequence number\r\n");
+      else
+      {
+        ringFrom = strtoul( p, NULL, 10 );
+        if( ringFrom == 0 )
+          ringFrom = 1;
+        client.print("200 Next RETR of /"); client.print(liveRing->name());
+        client.print(" from record "); client.print(liveRing->since( ringFrom ));
+        client.print("\r\n");
+      }
+    }
+    //
+    //  SITE SNAPSHOT [<name>] - Rename the log of the sketch, in the root
+    //    directory, and start a new one. Without a name, the snapshot is
+    //    named from the date and time: MMDDhhmm, with the extension of the log
+    //
+    //  A client then downloads a file that does not grow anymore, without
+    //    a copy of it on the card.
+    //
+    else if( ! strncasecmp( parameters, "SNAPSHOT", 8 ) &&
+             ( parameters[ 8 ] == 0 || parameters[ 8 ] == ' ' ))
+    {
+      char * name = (char *) arena.alloc( 13 );
+      char * p = parameters + 8;
+      while( * p == ' ' )
+        p ++;
+      if( liveLog == NULL )
+        client.print("502 No log to snapshot\r\n");
+      else if( name == NULL )
+        client.print("451 Not enough memory\r\n");
+      else if( strlen( p ) > 12 )
+        client.print("501 Name too long\r\n");
+      else
+      {
+        strcpy( name, p );
+        if( ! liveLog->snapshot( name ))
+        {
+          client.print("451 Can't save the log");
+          if( name[ 0 ] != 0 )
+          {
+            client.print(" as "); client.print(name);
+          }
+          client.print("\r\n");
+        }
+        else if( liveLog->isOpen())
+        {
+          client.print("250 Log saved as /"); client.print(name); client.print("\r\n");
+        }
+        else
+        {
+          client.print("250-Log saved as /"); client.print(name); client.print("\r\n");
+          client.print("250 Warning: the new log can't be started, logging has stopped\r\n");
+        }
+      }
+    }
+    //
+    //  SITE ZBENCH <file> [<level>] - Time the compression of the first
+    //    FTP_ZBENCH_SIZE bytes of a file, at a level or at levels 1, 6 and 9
+    //
+    //  Sending in MODE Z takes the time to compress plus the time to send
+    //    the compressed bytes: it is faster as long as the link is slower
+    //    than the rate given for each level.
+    //
+    else if( ! strncasecmp( parameters, "ZBENCH ", 7 ))
+    {
+      static const uint8_t levels[] = { 1, 6, 9 };
+      uint8_t level = 0;
+      char * pSpace = strrchr( parameters, ' ' );
+      if( pSpace > parameters + 6 && isdigit( pSpace[ 1 ] ) && pSpace[ 2 ] == 0 )
+      {
+        level = pSpace[ 1 ] - '0';
+        * pSpace = 0;
+      }
+      parameters += 7;
+      char * path;
+      char * name;
+      SdFile f;
+      uint8_t * in = buf;     // free unless an archive is sent, see HASH
+      if( zip.active())
+        client.print("425 A transfer is in progress\r\n");
+      else if( transferStatus == 3 )
+        client.print("450 An archive is being sent, try after it\r\n");
+      else if( ! allocPathName( & name, & path ) || ! sdl.chdir( path ) ||
+               ! sdl.openFile( & f, name, O_READ ))
+      {
+        client.print("550 Can't open "); client.print(parameters); client.print("\r\n");
+      }
+      else
+      {
+        client.print("211-Compression of "); client.print(parameters); client.print("\r\n");
+        for( uint8_t i = 0; i < sizeof( levels ); i ++ )
+        {
+          uint8_t lv = level > 0 ? level : levels[ i ];
+          if( ! zip.begin( lv ))
+          {
+            client.print("211-Not enough memory\r\n");
+            break;
+          }
+          uint32_t us = 0;
+          int16_t nb;
+          f.seekSet( 0 );
+          while( zip.totalIn() < FTP_ZBENCH_SIZE && ( nb = f.read( in, FTP_TAR_BLOCK )) > 0 )
+          {
+            uint32_t t0 = micros();
+            for( int16_t off = 0; off < nb; zip.consume( zip.pending()))
+              off += zip.write( in + off, nb - off );
+            us += micros() - t0;
+            yield();
+          }
+          uint32_t t0 = micros();
+          while( ! zip.finish() || zip.pending() > 0 )
+            zip.consume( zip.pending());
+          us += micros() - t0;
+          uint32_t rate = us > 0 ? (uint64_t) zip.totalIn() * 1000 / us : 0;   // KB/s
+          client.print("211-level "); client.print(lv); client.print(": ");
+          client.print(zip.totalIn()); client.print(" -> "); client.print(zip.totalOut());
+          client.print(" bytes, "); client.print(us / 1000); client.print(" ms, ");
+          client.print(rate); client.print(" KB/s, faster below ");
+          client.print(zip.totalIn() > 0 ? rate - rate * zip.totalOut() / zip.totalIn() : 0);
+          client.print(" KB/s\r\n");
+          zip.end();
+          if( level > 0 )
+            break;
+        }
+        f.close();
+        client.print("211 End.\r\n");
+      }
+    }
+    //
+    //  SITE TAR [<dir>|<pattern>] - Send the files of a directory, or those
+    //    matching a pattern, in a single tar archive on the data connection
+    //
+    //  Headers are made from the directory entries while sending: the
+    //    archive is not written on the card.
+    //
+    else if( ! strncasecmp( parameters, "TAR", 3 ) &&
+             ( parameters[ 3 ] == 0 || parameters[ 3 ] == ' ' ))
+    {
+      char * pattern;
+      parameters += 3;
+      while( * parameters == ' ' )
+        parameters ++;
+      if( ! enterListDir( & pattern ) || ! sdl.openCwd( & tarDir ))
+      {
+        client.print("550 Can't archive "); client.print(parameters); client.print("\r\n");
+      }
+      else if( pattern != NULL && strlen( pattern ) >= sizeof( tarPattern ))
+      {
+        client.print("501 Pattern too long\r\n");
+        tarDir.close();
+      }
+      else if( modeZ && ! zip.begin( zLevel ))
+      {
+        client.print("451 Not enough memory for MODE Z\r\n");
+        tarDir.close();
+      }
+      else if( ! dataConnect())
+      {
+        client.print("425 No data connection\r\n");
+        zip.end();
+        tarDir.close();
+      }
+      else
+      {
+        DirIndex list;
+        strcpy( tarPattern, pattern != NULL ? pattern : "" );
+        tarAfter[ 0 ] = 0;
+        tarSorted = sdl.listOpen( & list, NULL, NULL );   // see SdList::listOpen()
+        list.close();
+        tarDir.rewind();
+        stream.begin( & file, 0, 0 );   // no file yet: nothing to stream
+        tarEnd = false;
+        tarOff = 0;
+        tarPending = 0;
+        client.print("150 Sending archive\r\n");
+        millisBeginTrans = millis();
+        bytesTransfered = 0;
+        transferStatus = 3;
+      }
+    }
+    else
+    {
+      client.print("504 Unknow SITE command "); client.print(parameters); client.print("\r\n");
+    }
+  }
+  //
   //  SYST
   //
   else if( ! strcmp( command, "SYST" ))
@@ -860,32 +1566,35 @@ int FtpServer::dataConnect()
 
 boolean FtpServer::doRetrieve()
 {
-  /*
-  int16_t nb = file.read( buf, FTP_BUF_SIZE );
+  IoScope io( IO_OP_RETR );
+  if( modeZ && zip.pending() > 0 )
+  {
+    if( sendZip())
+      return true;
+    closeTransfer();
+    return false;
+  }
+  int16_t nb = ringRetr ? ringStream.send( dataOut(), buf, FTP_BUF_SIZE )
+                        : stream.send( dataOut(), buf, FTP_BUF_SIZE );
   if( nb > 0 )
   {
-    data.write( buf, nb );
     bytesTransfered += nb;
     return true;
   }
-  closeTransfer();
-  return false;
-*/
-  
-  int16_t nb = file.read(buf, FTP_BUF_SIZE);
-  if( nb > 0 )
-  { 
-    data.write((uint8_t*) buf, nb );
-    bytesTransfered += nb;
+  if( nb == 0 && ! ( ringRetr ? ringStream.done() : stream.done()) && data.connected())
+    return true;                      // the client is slower than the card
+  if( nb == 0 && modeZ && ! zip.finished())
+  {
+    zip.finish();                     // end of the zlib stream, sent next
     return true;
   }
   closeTransfer();
   return false;
-  
 }
 
 boolean FtpServer::doStore()
 {
+  IoScope io( IO_OP_STOR );
   if( data.connected() )
   {
     int16_t nb = data.read( buf, FTP_BUF_SIZE );
@@ -896,13 +1605,242 @@ boolean FtpServer::doStore()
     }
     return true;
   }
+  hash.forget( file.firstCluster());   // it may hold the state of a file deleted
   closeTransfer();
   return false;
 }
 
+// Convert a FAT date and time to seconds since 1970
+
+static uint32_t fatToUnix( uint16_t date, uint16_t time )
+{
+  static const uint16_t days[] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+  uint16_t year = 1980 + ( date >> 9 );
+  uint8_t month = ( date >> 5 ) & 0x0F;
+  uint32_t d;
+
+  if( date == 0 || month < 1 || month > 12 )
+    return 0;
+  d = ( year - 1970 ) * 365UL + ( year - 1969 ) / 4 + days[ month - 1 ] + ( date & 0x1F ) - 1;
+  if( month > 2 && year % 4 == 0 )
+    d ++;
+  return d * 86400UL + ( time >> 11 ) * 3600UL + (( time >> 5 ) & 0x3F ) * 60 + ( time & 0x1F ) * 2;
+}
+
+// Make the ustar header of a file in a block of FTP_TAR_BLOCK bytes
+
+static void tarHeader( uint8_t * h, const char * name, uint32_t size,
+                       uint16_t date, uint16_t time )
+{
+  char * p = (char *) h;
+  uint16_t sum = 0;
+
+  memset( h, 0, FTP_TAR_BLOCK );
+  strcpy( p, name );                  // name
+  strcpy( p + 100, "0000644" );       // mode
+  strcpy( p + 108, "0000000" );       // uid
+  strcpy( p + 116, "0000000" );       // gid
+  sprintf( p + 124, "%011lo", (unsigned long) size );
+  sprintf( p + 136, "%011lo", (unsigned long) fatToUnix( date, time ));
+  memset( p + 148, ' ', 8 );          // checksum, counted as spaces
+  p[ 156 ] = '0';                     // regular file
+  memcpy( p + 257, "ustar\0" "00", 8 );
+  for( uint16_t i = 0; i < FTP_TAR_BLOCK; i ++ )
+    sum += h[ i ];
+  sprintf( p + 148, "%06o", sum );    // followed by NUL and space
+  p[ 155 ] = ' ';
+}
+
+// Send the next part of the archive of SITE TAR
+//
+//   Each file is sent as a header block, then the content of the file read
+//   as by RETR, then zeros up to the end of its last block. The archive ends
+//   with two blocks of zeros.
+//
+// return:
+//    false at the end of the archive, or if the transfer failed
+
+boolean FtpServer::doTar()
+{
+  IoScope io( IO_OP_RETR );
+  if( modeZ && zip.pending() > 0 )
+  {
+    if( sendZip())
+      return true;
+  }
+  else if( tarPending > 0 )           // a header, padding or the end
+  {
+    uint16_t nw = dataOut().write( (const uint8_t *) buf + tarOff, tarPending );
+    tarOff += nw;
+    tarPending -= nw;
+    bytesTransfered += nw;
+    if( nw > 0 || data.connected())
+      return true;
+  }
+  else if( ! stream.done())
+  {
+    int16_t nb = stream.send( dataOut(), buf, FTP_BUF_SIZE );
+    bytesTransfered += nb > 0 ? nb : 0;
+    if( nb > 0 || ( nb == 0 && data.connected()))
+      return true;
+  }
+  else if( file.isOpen())
+  {
+    uint16_t pad = ( FTP_TAR_BLOCK - stream.sent() % FTP_TAR_BLOCK ) % FTP_TAR_BLOCK;
+    file.close();
+    memset( buf, 0, pad );
+    tarOff = 0;
+    tarPending = pad;
+    return true;
+  }
+  else if( tarEnd )
+  {
+    if( modeZ && ! zip.finished())
+    {
+      zip.finish();
+      return true;
+    }
+    closeTransfer();
+    return false;
+  }
+  else
+  {
+    char name[ 13 ];
+    uint32_t size;
+    uint16_t date, time;
+
+    if( ! tarNext( name, & size, & date, & time ))
+    {
+      memset( buf, 0, 2 * FTP_TAR_BLOCK );
+      tarEnd = true;
+      tarOff = 0;
+      tarPending = 2 * FTP_TAR_BLOCK;
+      return true;
+    }
+    uint32_t dirPos = tarDir.curPosition();
+    boolean ok = file.open( & tarDir, name, O_READ );
+    tarDir.seekSet( dirPos );         // where nextFile() goes on
+    // The size in the header is the size at the opening: lines appended
+    //   to a log while it is sent are left for the next archive
+    if( ok && ! stream.begin( & file, 0, file.fileSize()))
+    {
+      file.close();
+      ok = false;
+    }
+    if( ok )                          // else removed meanwhile: skipped
+    {
+      tarHeader( buf, name, file.fileSize(), date, time );
+      tarOff = 0;
+      tarPending = FTP_TAR_BLOCK;
+    }
+    return true;
+  }
+  client.print("426 Connection closed; transfer aborted\r\n");
+  closeFile();
+  data.stop();
+  return false;
+}
+
+// Find the next file to archive in tarDir
+//
+//   From the index, the listing is opened again after the last file sent,
+//   so that reading the files does not disturb it.
+//
+// return:
+//    false if there are no more files
+
+boolean FtpServer::tarNext( char * name, uint32_t * pSize, uint16_t * pDate, uint16_t * pTime )
+{
+  bool isFile;
+  boolean found = false;
+  const char * pattern = tarPattern[ 0 ] != 0 ? tarPattern : NULL;
+
+  if( tarSorted )
+  {
+    DirIndex list;
+    if( list.open( & tarDir, pattern, tarAfter ))
+    {
+      while( ! found && list.next( name, & isFile, pSize, pDate, pTime ))
+        found = isFile && ! hiddenName( name );
+      list.close();
+    }
+  }
+  else
+  {
+    while( ! found && sdl.nextFile( & tarDir, name, & isFile, pSize, pDate, pTime ))
+      found = isFile && ! hiddenName( name ) &&
+              ( pattern == NULL || DirIndex::match( pattern, name ));
+  }
+  if( found )
+    strcpy( tarAfter, name );
+  return found;
+}
+
+// Where the data of a transfer is written: the compressor in MODE Z
+
+Print & FtpServer::dataOut()
+{
+  if( modeZ )
+    return zip;
+  return data;
+}
+
+// Send the bytes made by the compressor of MODE Z, as many as the data
+//   connection takes
+//
+// return:
+//    false if the data connection is closed
+
+boolean FtpServer::sendZip()
+{
+  zip.consume( data.write( zip.output(), zip.pending()));
+  return data.connected();
+}
+
+// Send a line of a listing on the data connection
+
+void FtpServer::dataPrint( const char * str )
+{
+  if( ! modeZ )
+  {
+    data.print( str );
+    return;
+  }
+  size_t n = strlen( str );
+  while( n > 0 && data.connected())
+  {
+    size_t nw = zip.write( (const uint8_t *) str, n );
+    str += nw;
+    n -= nw;
+    if( nw == 0 )
+      sendZip();
+  }
+}
+
+// End the data of a listing: in MODE Z, compress and send what is left
+
+void FtpServer::dataEnd()
+{
+  if( modeZ )
+    while( ( ! zip.finish() || zip.pending() > 0 ) && sendZip())
+      ;
+  zip.end();
+}
+
 void FtpServer::closeTransfer()
 {
   uint32_t deltaT = (int32_t) ( millis() - millisBeginTrans );
+  if( traceFile.isOpen())
+  {
+    char str[ 24 ];
+    sprintf( str, "%lu %lu", (unsigned long) bytesTransfered, (unsigned long) deltaT );
+    trace( 'X', str );
+  }
+  if( zip.active())
+  {
+    client.print("226-MODE Z: "); client.print(zip.totalOut());
+    client.print(" bytes sent for "); client.print(zip.totalIn()); client.print("\r\n");
+  }
   if( deltaT > 0 && bytesTransfered > 0 )
   {
     client.print("226-File successfully transferred\r\n");
@@ -916,10 +1854,24 @@ void FtpServer::closeTransfer()
 	    client.print("226 File successfully transferred\r\n");
 //    client << "226 File successfully transferred\r\n";
 
-  file.close();
+  closeFile();
   data.stop();
 }
 
+// Close the file of the transfer
+//
+//   The clusters taken by a stored file are counted in the free space
+
+void FtpServer::closeFile()
+{
+  if( transferStatus == 2 )
+    sdl.sizeChanged( 0, file.fileSize());
+  file.close();
+  tarDir.close();
+  zip.end();
+  ringRetr = false;
+}
+
 // Read a char from client connected to ftp server
 //
 //  update cmdLine and command buffers, iCL and parameters pointers
@@ -945,7 +1897,7 @@ int8_t FtpServer::readChar()
     if( c != '\r' )
       if( c != '\n' )
       {
-        if( iCL < FTP_CMD_SIZE )
+        if( iCL < FTP_CMD_SIZE - 1 )    // keep room for the terminating 0
           cmdLine[ iCL ++ ] = c;
         else
           rc = -2; //  Line too long
@@ -977,7 +1929,10 @@ int8_t FtpServer::readChar()
           else if( strlen( cmdLine ) > 4 )
             rc = -2; // Syntax error.
           else
+          {
             strcpy( command, cmdLine );
+            parameters = cmdLine + strlen( cmdLine );   // no parameters: ""
+          }
           iCL = 0;
         }
       }
@@ -1003,7 +1958,8 @@ int8_t FtpServer::readChar()
 //   maxpl : size of path' string
 //
 // return:
-//    true, if convertion is done
+//    true, if convertion is done and the name is not one of a file the
+//    server keeps for itself (see hiddenName())
 
 boolean FtpServer::makePathName( char * name, char * path, size_t maxpl )
 {
@@ -1041,5 +1997,218 @@ boolean FtpServer::makePathName( char * name, char * path, size_t maxpl )
     // Remove name from path
     * ( pName + 1 ) = 0;
   }
-  return true;
+  return ! hiddenName( name );
+}
+
+// Files the server keeps for itself, not for clients: the index of a
+//   directory and the cache of digests. They are not listed, and can't be
+//   reached by a name
+
+boolean FtpServer::hiddenName( const char * name )
+{
+  return DirIndex::isIndexName( name ) || ! strcasecmp( name, HASH_CACHE_FILE );
+}
+
+// Enter the directory given in parameters to a listing
+//
+//   The parameter is a directory, listed whole, a single file, or a pattern
+//   with '*' and '?'. Without parameter, the current directory is listed.
+//
+// parameters:
+//   pPattern : set to the pattern the names must match, NULL for all names
+//
+// return:
+//    false if there is no such directory, else it is the current
+//    directory of sdl
+
+boolean FtpServer::enterListDir( char ** pPattern )
+{
+  char * path = NULL;
+
+  * pPattern = NULL;
+  if( * parameters != 0 )
+  {
+    if( ! allocPathName( pPattern, & path ))
+      return false;
+    // No wildcard: a directory or a single file
+    size_t lp = strlen( path );
+    if( strpbrk( * pPattern, "*?" ) == NULL &&
+        lp + strlen( * pPattern ) + 1 < FTP_CWD_SIZE )
+    {
+      if( path[ lp - 1 ] != '/' )
+        strcat( path, "/" );
+      strcat( path, * pPattern );
+      if( sdl.chdir( path ))
+        * pPattern = NULL;
+      else
+        path[ lp ] = 0;
+    }
+  }
+  return sdl.chdir( path != NULL ? path : cwdName );
+}
+
+// Take path and name from the arena and make them from cwdName and parameters
+//
+// return:
+//    true, if the arena had room and convertion is done
+
+boolean FtpServer::allocPathName( char ** pName, char ** pPath )
+{
+  * pPath = (char *) arena.alloc( FTP_CWD_SIZE );
+  * pName = (char *) arena.alloc( FTP_FIL_SIZE );
+  if( * pPath == NULL || * pName == NULL )
+    return false;
+  return makePathName( * pName, * pPath, FTP_CWD_SIZE );
+}
+
+// Remove the optional range from the end of parameters
+//
+//   "name start end", "name start" and "name" are accepted.
+//   Quotes around the name are removed.
+//
+// return:
+//    true if a range was found
+
+boolean FtpServer::splitRange( uint32_t * pStart, uint32_t * pEnd )
+{
+  uint32_t num[ 2 ];
+  uint8_t nn = 0;
+  char * pSpace;
+
+  while( nn < 2 && ( pSpace = strrchr( parameters, ' ' )) != NULL &&
+         isdigit( pSpace[ 1 ] ) && strspn( pSpace + 1, "0123456789" ) == strlen( pSpace + 1 ))
+  {
+    num[ nn ++ ] = strtoul( pSpace + 1, NULL, 10 );
+    * pSpace = 0;
+  }
+  if( nn == 1 )
+    * pStart = num[ 0 ];
+  else if( nn == 2 )
+  {
+    * pStart = num[ 1 ];
+    * pEnd = num[ 0 ];
+  }
+  size_t l = strlen( parameters );
+  if( l >= 2 && parameters[ 0 ] == '"' && parameters[ l - 1 ] == '"' )
+  {
+    parameters[ l - 1 ] = 0;
+    parameters ++;
+  }
+  return nn > 0;
+}
+
+// Forget the running digests of a file of the current directory, or of
+//   pDir, before it is deleted, overwritten or renamed
+
+void FtpServer::forgetHash( const char * name, SdFile * pDir )
+{
+  SdFile hf;
+  if( pDir != NULL ? hf.open( pDir, name, O_READ ) : sdl.openFile( & hf, name, O_READ ))
+  {
+    hash.forget( hf.firstCluster());
+    hf.close();
+  }
+}
+
+// Send the reply to FEAT
+//
+//   Also sent before login, so that clients know early that MLSD gives
+//   every fact of a directory in one transfer.
+
+void FtpServer::sendFeatures()
+{
+  client.print("211-Extensions suported:\r\n");
+  client.print(" HASH MD5*;CRC32\r\n");
+  client.print(" MDTM\r\n");
+  client.print(" MLST type*;size*;modify*;\r\n");
+  client.print(" MODE Z\r\n");
+  client.print(" SIZE\r\n");
+  client.print(" SITE FREE\r\n");
+  client.print(" SITE RING\r\n");
+  client.print(" SITE SNAPSHOT\r\n");
+  client.print(" SITE TAR\r\n");
+  client.print(" XCRC\r\n");
+  client.print(" XMD5\r\n");
+  client.print("211 End.\r\n");
+}
+
+// Make a line of MLSD (RFC 3659) in str from the facts of an entry
+
+void FtpServer::makeFacts( char * str, const char * name, bool isFile, uint32_t size,
+                           uint16_t date, uint16_t time )
+{
+  char * p = str;
+  if( isFile )
+    p += sprintf( p, "type=file;size=%lu;", (unsigned long) size );
+  else
+    p += sprintf( p, "type=dir;" );
+  sprintf( p, "modify=%04u%02u%02u%02u%02u%02u; %s\r\n",
+           FAT_YEAR( date ), FAT_MONTH( date ), FAT_DAY( date ),
+           FAT_HOUR( time ), FAT_MINUTE( time ), FAT_SECOND( time ), name );
+}
+
+// Make a line of LIST in str, in the format of 'ls -l'
+
+void FtpServer::makeListLine( char * str, const char * name, bool isFile, uint32_t size,
+                              uint16_t date )
+{
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  uint8_t m = FAT_MONTH( date );
+  if( m < 1 || m > 12 )
+    m = 1;
+  sprintf( str, "%crwxrwxrwx  1 %-10s %-10s %10lu %.3s %2u  %4u %s\r\n",
+           isFile ? '-' : 'd', FTP_USER, FTP_USER, (unsigned long) size,
+           months + 3 * ( m - 1 ), FAT_DAY( date ), FAT_YEAR( date ), name );
+}
+
+// Start recording the session at the end of FTP_TRACE_FILE
+
+void FtpServer::traceOpen()
+{
+  if( traceFile.isOpen() ||
+      ! sdl.openRootFile( & traceFile, FTP_TRACE_FILE, O_WRITE | O_APPEND | O_CREAT ))
+    return;
+  traceSize = traceFile.fileSize();
+  IPAddress ip = client.remoteIP();
+  char str[ 16 ];
+  sprintf( str, "%u.%u.%u.%u", ip[ 0 ], ip[ 1 ], ip[ 2 ], ip[ 3 ] );
+  trace( 'S', str );
+}
+
+// Stop recording the session
+
+void FtpServer::traceClose()
+{
+  if( ! traceFile.isOpen())
+    return;
+  trace( 'E', "" );
+  sdl.sizeChanged( traceSize, traceFile.fileSize());
+  traceFile.close();
+}
+
+// Record an event of the session, for extras/ftp_replay.py
+//
+//   S <ms> <client ip>       start of the session
+//   C <ms> <command line>    command received, password masked
+//   D <ms> <us>              command processed, with the time it took
+//   M <ms> <stack> <heap> <block> <frag> <allocs>
+//                            memory after the command, see MemStats.h
+//   X <ms> <bytes> <ms>      end of a data transfer, with its duration
+//   E <ms>                   end of the session
+//
+//   <ms> is the time since the beginning of the session
+
+void FtpServer::trace( char type, const char * text )
+{
+  if( ! traceFile.isOpen())
+    return;
+  size_t m = arena.mark();
+  char * line = (char *) arena.alloc( FTP_CMD_SIZE + 16 );
+  if( line != NULL )
+  {
+    snprintf( line, FTP_CMD_SIZE + 16, "%c %lu %s\r\n", type,
+              (unsigned long) ( millis() - millisSession ), text );
+    traceFile.write( line );
+  }
+  arena.release( m );
 }
@@ -28,6 +28,12 @@
 
 #include <WiFiClient.h>
 #include "utility/SdFat.h"
+#include "FtpArena.h"
+#include "FtpHash.h"
+#include "FileStream.h"
+#include "Deflate.h"
+#include "LogFile.h"
+#include "RingLog.h"
 
 // Uncomment to print debugging info to console attached to Arduino
 //#define FTP_DEBUG
@@ -37,25 +43,38 @@
 #define FTP_USER "Ukrit"
 #define FTP_PASS "Khonglao"
 
+#ifndef FTP_CTRL_PORT
 #define FTP_CTRL_PORT  21
+#endif
 #define FTP_DATA_PORT_DFLT 20    // Default data port in active mode
+#ifndef FTP_DATA_PORT_PASV
 #define FTP_DATA_PORT_PASV 55600 // Data port in passive mode
+#endif
 
 #define FTP_TIME_OUT  5           // Disconnect client after 5 minutes of inactivity
 #define FTP_CMD_SIZE 256 // max size of a command
 #define FTP_CWD_SIZE 256 // max size of a directory name
 #define FTP_FIL_SIZE 128     // max size of a file name
 #define FTP_BUF_SIZE 1024   // size of file buffer for read/write
+#define FTP_TRACE_FILE "FTPTRACE.TXT"   // sessions recorded by SITE TRACE ON
+#define FTP_TMP_SIZE 768    // size of temporaries a command takes from the arena
+#define FTP_TAR_BLOCK 512   // tar archives are made of blocks of 512 bytes
+#define FTP_ZBENCH_SIZE 65536   // bytes of a file compressed by SITE ZBENCH
+
+// Memory taken from the heap while a client is connected
+#define FTP_ARENA_SIZE ( FTP_BUF_SIZE + FTP_CMD_SIZE + 2 * FTP_CWD_SIZE + FTP_TMP_SIZE )
 
 class FtpServer
 {
 public:
   void    init();
   void    service();
+  void    setLog( LogFile * pLog ) { liveLog = pLog; }   // see SITE SNAPSHOT
+  void    setRing( RingLog * pRing ) { liveRing = pRing; }   // see SITE RING
 
 private:
   void    iniVariables();
-  void    clientConnected();
+  boolean clientConnected();
   void    disconnectClient();
   boolean userIdentity();
   boolean userPassword();
@@ -63,20 +82,63 @@ private:
   int     dataConnect();
   boolean doRetrieve();
   boolean doStore();
+  boolean doTar();
+  boolean tarNext( char * name, uint32_t * pSize, uint16_t * pDate, uint16_t * pTime );
   void    closeTransfer();
+  Print & dataOut();
+  boolean sendZip();
+  void    dataPrint( const char * str );
+  void    dataEnd();
+  void    closeFile();
   boolean makePathName( char * name, char * path, size_t maxpl );
+  static boolean hiddenName( const char * name );
+  boolean allocPathName( char ** pName, char ** pPath );
+  boolean enterListDir( char ** pPattern );
+  boolean splitRange( uint32_t * pStart, uint32_t * pEnd );
+  void    forgetHash( const char * name, SdFile * pDir = NULL );
+  void    sendFeatures();
+  void    makeFacts( char * str, const char * name, bool isFile, uint32_t size,
+                     uint16_t date, uint16_t time );
+  void    makeListLine( char * str, const char * name, bool isFile, uint32_t size,
+                        uint16_t date );
+  void    traceOpen();
+  void    traceClose();
+  void    trace( char type, const char * text );
   int8_t  readChar();
 
   IPAddress dataIp;               // IP address of client for data
   WiFiClient client;
   WiFiClient data;
   SdFile file;
+  FileStream stream;              // sends the file of RETR
+  Deflate zip;                    // compressor of the data connection in MODE Z
+  boolean modeZ;                  // MODE Z: data connections are compressed
+  uint8_t zLevel;                 //   level of compression, see OPTS MODE Z
+  LogFile * liveLog;              // log of the sketch, see SITE SNAPSHOT
+  RingLog * liveRing;             // ring log of the sketch, sent as lines by RETR
+  RingStream ringStream;          //   sends it
+  boolean ringRetr;               //   RETR sends the ring, not a file
+  uint32_t ringFrom;              //   first record sent by the next RETR, see SITE RING
+  FtpHash hash;                   // digests of files, see FtpHash.h
+  uint8_t hashAlgo;               // algorithm used by HASH command
+  SdFile traceFile;               // record of the session, see SITE TRACE
+  uint32_t traceSize;             //   its size when opened
+  boolean traceOn;                // record the next sessions
+  uint16_t listPage;              // entries per listing, see SITE PAGE
+  char listAfter[ 13 ];           // name the next listing starts after
+  SdFile tarDir;                  // directory archived by SITE TAR
+  char tarPattern[ 13 ];          //   names of the files archived, "" for all
+  char tarAfter[ 13 ];            //   last file archived
+  boolean tarSorted;              //   files taken from the index of tarDir
+  boolean tarEnd;                 //   end of archive is in buf
+  uint16_t tarOff, tarPending;    // bytes of buf still to send
   boolean dataPassiveConn;
   uint16_t dataPort;
-  uint8_t buf[ FTP_BUF_SIZE ];    // data buffer for transfers
-  char cmdLine[ FTP_CMD_SIZE ];   // where to store incoming char from client
-  char cwdName[ FTP_CWD_SIZE ];   // name of current directory
-  char cwdRNFR[ FTP_CWD_SIZE ];   // name of origin directory for Rename command
+  FtpArena arena;                 // memory of the session, see FtpArena.h
+  uint8_t * buf;                  // data buffer for transfers
+  char * cmdLine;                 // where to store incoming char from client
+  char * cwdName;                 // name of current directory
+  char * cwdRNFR;                 // path of the file to rename, see RNFR
   char command[ 5 ];              // command sent by client
   char * parameters;              // point to begin of parameters sent by client
   uint16_t iCL;                   // pointer to cmdLine next incoming char
@@ -85,6 +147,7 @@ private:
   uint32_t millisTimeOut,         // disconnect after 5 min of inactivity
            millisEndConnection,   //
            millisBeginTrans,      // store time of beginning of a transaction
+           millisSession,         // time of beginning of the session
            bytesTransfered;       //
 };
 
@@ -0,0 +1,457 @@
+#include "HttpFileServer.h"
+#include "SdList.h"
+#include "SdBlockDev.h"
+#include <ESP8266WiFi.h>
+
+extern SdList sdl;
+
+// Methods
+#define HTTP_GET   1
+#define HTTP_HEAD  2
+#define HTTP_OTHER 3
+
+WiFiServer httpServer( HTTP_PORT );
+
+static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+static const char weekDays[] = "SunMonTueWedThuFriSat";
+
+// Day of the week of a date, 0 for Sunday
+
+static uint8_t weekDay( uint16_t y, uint8_t m, uint8_t d )
+{
+  static const uint8_t t[] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+  if( m < 3 )
+    y --;
+  return ( y + y / 4 - y / 100 + y / 400 + t[ m - 1 ] + d ) % 7;
+}
+
+// Write a FAT date and time as an HTTP date: Sun, 06 Nov 1994 08:49:37 GMT
+
+static void httpDate( char * str, uint16_t date, uint16_t time )
+{
+  uint8_t m = FAT_MONTH( date );
+  if( m < 1 || m > 12 )
+    m = 1;
+  sprintf( str, "%.3s, %02u %.3s %04u %02u:%02u:%02u GMT",
+           weekDays + 3 * weekDay( FAT_YEAR( date ), m, FAT_DAY( date )),
+           FAT_DAY( date ), months + 3 * ( m - 1 ), FAT_YEAR( date ),
+           FAT_HOUR( time ), FAT_MINUTE( time ), FAT_SECOND( time ));
+}
+
+// Read an HTTP date
+//
+// return:
+//    FAT date << 16 | FAT time, 0 if the date can't be read
+
+static uint32_t parseHttpDate( const char * str )
+{
+  char mon[ 4 ];
+  unsigned d, y, h, mi, s;
+
+  if( sscanf( str, "%*3s, %u %3s %u %u:%u:%u", & d, mon, & y, & h, & mi, & s ) != 6 || y < 1980 )
+    return 0;
+  for( uint8_t m = 0; m < 12; m ++ )
+    if( ! strncasecmp( mon, months + 3 * m, 3 ))
+      return (uint32_t) FAT_DATE( y, m + 1, d ) << 16 | FAT_TIME( h, mi, s );
+  return 0;
+}
+
+HttpFileServer::HttpFileServer()
+{
+  state = 0;
+  buf = NULL;
+  line = NULL;
+  target = NULL;
+  etag = NULL;
+  tagIn = NULL;
+}
+
+void HttpFileServer::init()
+{
+  httpServer.begin();
+  state = 0;
+}
+
+void HttpFileServer::service()
+{
+  if( state == 0 )
+  {
+    client = httpServer.available();
+    if( client && clientConnected())
+      state = 1;
+    return;
+  }
+  if( ! client.connected())
+  {
+    closeClient();
+    return;
+  }
+  if( state == 1 )                    // reading the request
+  {
+    while( state == 1 && client.available() > 0 )
+      if( readLine())
+      {
+        if( line[ 0 ] == 0 )
+        {
+          if( method != 0 )           // blank lines before a request are ignored
+            answer();
+        }
+        else if( method == 0 )
+          parseRequestLine();
+        else
+          parseHeader();
+      }
+    if( state == 1 && ! ((int32_t) ( millisEnd - millis()) > 0 ))
+      closeClient();
+  }
+  else if( state == 2 )               // sending the body
+  {
+    IoScope io( IO_OP_RETR );
+    int16_t nb = stream.send( client, buf, HTTP_BUF_SIZE );
+    if( nb < 0 )
+      closeClient();
+    else if( stream.done())
+    {
+      file.close();
+      endRequest();
+    }
+  }
+}
+
+// Take the memory of the connection
+//
+// return:
+//    false if there is not enough memory
+
+bool HttpFileServer::clientConnected()
+{
+  if( ! arena.begin( HTTP_ARENA_SIZE ))
+  {
+    client.print("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    client.stop();
+    return false;
+  }
+  buf = (uint8_t *) arena.hold( HTTP_BUF_SIZE );
+  line = (char *) arena.hold( HTTP_LINE_SIZE );
+  target = (char *) arena.hold( HTTP_LINE_SIZE );
+  etag = (char *) arena.hold( HTTP_TAG_SIZE );
+  tagIn = (char *) arena.hold( HTTP_TAG_SIZE );
+  newRequest();
+  return true;
+}
+
+void HttpFileServer::closeClient()
+{
+  if( file.isOpen())
+    file.close();
+  client.stop();
+  arena.end();
+  state = 0;
+}
+
+// Wait for the next request of the connection
+
+void HttpFileServer::newRequest()
+{
+  method = 0;
+  http11 = false;
+  keepAlive = false;
+  hasRange = false;
+  rangeSuffix = false;
+  tagIsRange = false;
+  modifiedSince = 0;
+  iLine = 0;
+  target[ 0 ] = 0;
+  tagIn[ 0 ] = 0;
+  millisEnd = millis() + HTTP_TIME_OUT;
+}
+
+// After the answer, keep the connection for the next request, or close it
+
+void HttpFileServer::endRequest()
+{
+  if( keepAlive )
+  {
+    newRequest();
+    state = 1;
+  }
+  else
+    closeClient();
+}
+
+// Read a char of the request
+//
+// return:
+//    true when a whole line is in line[]
+
+bool HttpFileServer::readLine()
+{
+  char c = client.read();
+  if( c == '\r' )
+    return false;
+  if( c == '\n' )
+  {
+    line[ iLine ] = 0;
+    iLine = 0;
+    return true;
+  }
+  if( iLine < HTTP_LINE_SIZE - 1 )    // keep room for the terminating 0
+    line[ iLine ++ ] = c;
+  return false;
+}
+
+// Method, target and version: GET /BUSH.CSV HTTP/1.1
+//
+// The query is dropped and %XX are decoded.
+
+void HttpFileServer::parseRequestLine()
+{
+  char * t = strchr( line, ' ' );
+
+  method = HTTP_OTHER;
+  if( t == NULL )
+    return;
+  * t ++ = 0;
+  if( ! strcmp( line, "GET" ))
+    method = HTTP_GET;
+  else if( ! strcmp( line, "HEAD" ))
+    method = HTTP_HEAD;
+  char * v = strchr( t, ' ' );
+  if( v != NULL )
+  {
+    * v ++ = 0;
+    http11 = ! strcmp( v, "HTTP/1.1" );
+  }
+  keepAlive = http11;
+
+  char * o = target;
+  for( ; * t != 0 && * t != '?' && o < target + HTTP_LINE_SIZE - 1; t ++ )
+    if( * t == '%' && isxdigit( t[ 1 ] ) && isxdigit( t[ 2 ] ))
+    {
+      char h[ 3 ] = { t[ 1 ], t[ 2 ], 0 };
+      * o ++ = strtol( h, NULL, 16 );
+      t += 2;
+    }
+    else
+      * o ++ = * t;
+  * o = 0;
+}
+
+// Keep the headers that change the answer
+
+void HttpFileServer::parseHeader()
+{
+  char * v = strchr( line, ':' );
+
+  if( v == NULL )
+    return;
+  * v ++ = 0;
+  while( * v == ' ' )
+    v ++;
+  if( ! strcasecmp( line, "Connection" ))
+  {
+    if( ! strncasecmp( v, "close", 5 ))
+      keepAlive = false;
+    else if( ! strncasecmp( v, "keep-alive", 10 ))
+      keepAlive = true;
+  }
+  else if( ! strcasecmp( line, "Range" ))
+  {
+    // A single range only, else the whole file is sent
+    if( strncasecmp( v, "bytes=", 6 ) || strchr( v, ',' ) != NULL )
+      return;
+    v += 6;
+    char * e;
+    if( * v == '-' )
+    {
+      rangeSuffix = true;
+      rangeLast = strtoul( v + 1, & e, 10 );
+      hasRange = e > v + 1;
+    }
+    else if( isdigit( * v ))
+    {
+      rangeFirst = strtoul( v, & e, 10 );
+      rangeLast = 0xFFFFFFFF;
+      if( * e ++ != '-' )
+        return;
+      if( isdigit( * e ))
+        rangeLast = strtoul( e, NULL, 10 );
+      hasRange = rangeLast >= rangeFirst;
+    }
+  }
+  else if( ! strcasecmp( line, "If-None-Match" ) ||
+           ( ! strcasecmp( line, "If-Range" ) && tagIn[ 0 ] == 0 ))
+  {
+    tagIsRange = line[ 3 ] == 'R' || line[ 3 ] == 'r';
+    strncpy( tagIn, v, HTTP_TAG_SIZE - 1 );
+    tagIn[ HTTP_TAG_SIZE - 1 ] = 0;
+  }
+  else if( ! strcasecmp( line, "If-Modified-Since" ))
+    modifiedSince = parseHttpDate( v );
+}
+
+// Answer the request read: headers, then the body is sent by service()
+
+void HttpFileServer::answer()
+{
+  uint32_t first = 0, last = 0, size;
+  dir_t d;
+  char * extra = line;                // the request is read, line is free
+
+  if( method == HTTP_OTHER )
+  {
+    sendHead( 405, "Method Not Allowed", 0, "Allow: GET, HEAD\r\n" );
+    endRequest();
+    return;
+  }
+  if( ! allowed())
+  {
+    sendHead( 403, "Forbidden", 0, NULL );
+    endRequest();
+    return;
+  }
+  if( ! openTarget() || ! file.dirEntry( & d ))
+  {
+    if( file.isOpen())
+      file.close();
+    sendHead( 404, "Not Found", 0, NULL );
+    endRequest();
+    return;
+  }
+  size = file.fileSize();
+  sprintf( etag, "\"%lx-%lx-%04x%04x\"", (unsigned long) file.firstCluster(),
+           (unsigned long) size, d.lastWriteDate, d.lastWriteTime );
+
+  // If-None-Match has precedence over If-Modified-Since
+  bool fresh;
+  if( tagIn[ 0 ] != 0 && ! tagIsRange )
+    fresh = ! strcmp( tagIn, "*" ) || strstr( tagIn, etag ) != NULL;
+  else
+    fresh = modifiedSince != 0 &&
+            ((uint32_t) d.lastWriteDate << 16 | d.lastWriteTime ) <= modifiedSince;
+  if( fresh )
+  {
+    sendHead( 304, "Not Modified", 0, NULL );
+    file.close();
+    endRequest();
+    return;
+  }
+
+  // If-Range: the range is for the version of the file the client has
+  if( hasRange && tagIsRange && strcmp( tagIn, etag ))
+    hasRange = false;
+  if( hasRange && ! resolveRange( size, & first, & last ))
+  {
+    sprintf( extra, "Content-Range: bytes */%lu\r\n", (unsigned long) size );
+    file.close();
+    sendHead( 416, "Range Not Satisfiable", 0, extra );
+    endRequest();
+    return;
+  }
+  if( hasRange )
+  {
+    sprintf( extra, "Content-Range: bytes %lu-%lu/%lu\r\n",
+             (unsigned long) first, (unsigned long) last, (unsigned long) size );
+    sendHead( 206, "Partial Content", last - first + 1, extra );
+    last ++;
+  }
+  else
+  {
+    sendHead( 200, "OK", size, NULL );
+    last = size;
+  }
+  if( method == HTTP_HEAD || first == last || ! stream.begin( & file, first, last ))
+  {
+    file.close();
+    endRequest();
+  }
+  else
+    state = 2;
+}
+
+// Is the target a name of the root directory that may be served?
+
+bool HttpFileServer::allowed()
+{
+  if( target[ 0 ] != '/' )
+    return false;
+  const char * name = target + 1;
+  const char * ext = strrchr( name, '.' );
+  return strchr( name, '/' ) == NULL && ext != NULL && ext > name &&
+         ! strcasecmp( ext, HTTP_EXT );
+}
+
+// Open the file of the request
+//
+// return:
+//    false if it is not a file of the card
+
+bool HttpFileServer::openTarget()
+{
+  if( ! sdl.readRootFile( & file, target + 1 ))
+    return false;
+  if( file.isFile())
+    return true;
+  file.close();
+  return false;
+}
+
+// First and last bytes of the range asked for
+//
+// return:
+//    false if the range is not satisfiable
+
+bool HttpFileServer::resolveRange( uint32_t size, uint32_t * pFirst, uint32_t * pLast )
+{
+  if( size == 0 )
+    return false;
+  if( rangeSuffix )
+  {
+    if( rangeLast == 0 )
+      return false;
+    * pFirst = rangeLast >= size ? 0 : size - rangeLast;
+    * pLast = size - 1;
+    return true;
+  }
+  if( rangeFirst >= size )
+    return false;
+  * pFirst = rangeFirst;
+  * pLast = rangeLast < size ? rangeLast : size - 1;
+  return true;
+}
+
+// Send the status line and the headers, in a single write
+//
+// The headers of the file are added when it is open.
+
+void HttpFileServer::sendHead( uint16_t code, const char * reason, uint32_t length,
+                               const char * extra )
+{
+  char * p = (char *) buf;
+
+  p += sprintf( p, "HTTP/1.1 %u %s\r\n", code, reason );
+  if( file.isOpen())
+  {
+    dir_t d;
+    const char * type = "application/octet-stream";
+    const char * ext = strrchr( target, '.' );
+    if( ext != NULL && ! strcasecmp( ext, ".CSV" ))
+      type = "text/csv";
+    else if( ext != NULL && ! strcasecmp( ext, ".TXT" ))
+      type = "text/plain";
+    p += sprintf( p, "Content-Type: %s\r\nAccept-Ranges: bytes\r\nETag: %s\r\n", type, etag );
+    if( file.dirEntry( & d ))
+    {
+      p += sprintf( p, "Last-Modified: " );
+      httpDate( p, d.lastWriteDate, d.lastWriteTime );
+      p += strlen( p );
+      p += sprintf( p, "\r\n" );
+    }
+  }
+  if( code != 304 )
+    p += sprintf( p, "Content-Length: %lu\r\n", (unsigned long) length );
+  if( extra != NULL )
+    p += sprintf( p, "%s", extra );
+  p += sprintf( p, "Connection: %s\r\n\r\n", keepAlive ? "keep-alive" : "close" );
+  client.write( (const uint8_t *) buf, p - (char *) buf );
+}
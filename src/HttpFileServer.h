@@ -0,0 +1,112 @@
+/*
+ * HTTP/1.1 server of the files of the SD card
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                        HTTP FILE SERVER FOR DATALOGGER                     **
+ **                                                                            **
+ *******************************************************************************/
+
+// GET and HEAD of a log of the card by its name: GET /BUSH.CSV
+//
+// A collector gets the tail of a log in a single round trip, on a single
+//   connection kept open between requests:
+//   Range: bytes=1000-   bytes=1000-1999   bytes=-500   (one range)
+//   If-None-Match, If-Modified-Since : 304 when the file has not changed
+//   If-Range : the range is only used if the file has not changed
+//
+// Only the logs are served: files of the root directory whose name ends
+//   with HTTP_EXT, that is the log, its snapshots and the rollups. The
+//   files of the servers (DIRINDEX.IDX, HASHES.DAT, FTPTRACE.TXT...) and
+//   the other directories answer 403: HTTP has no login, FTP has. A file
+//   is opened from a handle of its own, the current directory of the FTP
+//   server does not move.
+//
+// The ETag is made of the first cluster, the size and the time of last
+//   modification of the file, so it changes at each line appended.
+//   Dates are the time stamps of the card, that is the time of the RTC.
+//
+// Like FtpServer, service() does a little work at each call: a single
+//   client is served at a time, the body is sent a buffer at a time (see
+//   FileStream.h). Memory is taken from the heap while a client is connected.
+
+#ifndef HTTP_FILE_SERVER_H
+#define HTTP_FILE_SERVER_H
+
+#include "Arduino.h"
+#include <WiFiClient.h>
+#include "utility/SdFat.h"
+#include "FtpArena.h"
+#include "FileStream.h"
+
+#ifndef HTTP_PORT
+#define HTTP_PORT      80
+#endif
+#ifndef HTTP_EXT
+#define HTTP_EXT       ".CSV"  // extension of the files served
+#endif
+#define HTTP_LINE_SIZE 256     // max size of the request line and of a header
+#define HTTP_BUF_SIZE  1024    // size of file buffer
+#define HTTP_TAG_SIZE  40      // max size of an ETag
+#define HTTP_TIME_OUT  5000    // ms a kept-alive connection waits for a request
+#define HTTP_ARENA_SIZE ( HTTP_BUF_SIZE + 2 * HTTP_LINE_SIZE + 2 * HTTP_TAG_SIZE )
+
+class HttpFileServer
+{
+public:
+  HttpFileServer();
+
+  void    init();
+  void    service();
+
+private:
+  bool    clientConnected();
+  void    closeClient();
+  void    newRequest();
+  bool    readLine();
+  void    parseRequestLine();
+  void    parseHeader();
+  void    answer();
+  bool    allowed();
+  bool    openTarget();
+  bool    resolveRange( uint32_t size, uint32_t * pFirst, uint32_t * pLast );
+  void    sendHead( uint16_t code, const char * reason, uint32_t length, const char * extra );
+  void    endRequest();
+
+  WiFiClient client;
+  SdFile file;
+  FileStream stream;
+  FtpArena arena;                 // memory of the connection, see FtpArena.h
+  uint8_t * buf;                  // file buffer, also used to build headers
+  char * line;                    // line of the request being read
+  char * target;                  // path of the file requested
+  char * etag;                    // ETag of the file requested
+  char * tagIn;                   // If-None-Match or If-Range
+  uint16_t iLine;
+  int8_t  state;                  // 0 no client, 1 reading request, 2 sending body
+  uint8_t method;                 // see HTTP_GET ... in HttpFileServer.cpp
+  bool    http11;
+  bool    keepAlive;
+  bool    tagIsRange;             // tagIn comes from If-Range
+  bool    hasRange;
+  bool    rangeSuffix;            // bytes=-n
+  uint32_t rangeFirst, rangeLast;
+  uint32_t modifiedSince;         // FAT date << 16 | time, 0 if none
+  uint32_t millisEnd;             // close the connection if no request by then
+};
+
+#endif // HTTP_FILE_SERVER_H
@@ -0,0 +1,497 @@
+#include "LogFile.h"
+#include "SdList.h"
+#include "RtcMem.h"
+#include "SdBlockDev.h"
+
+extern SdList sdl;
+
+// Bytes that can be found in a log of text. Any other marks the end of the log.
+
+static bool isLogChar( uint8_t c )
+{
+  return ( c >= 0x20 && c < 0x7F ) || c == '\r' || c == '\n' || c == '\t';
+}
+
+// CRC-16/CCITT of the bytes of a line
+
+static uint16_t crc16( const char * p, uint16_t n )
+{
+  uint16_t crc = 0xFFFF;
+
+  while( n -- )
+  {
+    crc ^= (uint8_t) * p ++ << 8;
+    for( uint8_t i = 0; i < 8; i ++ )
+      crc = crc & 0x8000 ? ( crc << 1 ) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// Sequence number of a line of a journal, ended by CR LF
+//
+// return:
+//    false if the line has no sequence number, or a wrong CRC
+
+static bool journalSeq( const char * line, uint16_t n, uint32_t * pSeq )
+{
+  char hex[ 5 ];
+  uint16_t i;
+
+  // ", <seq>, <CRC>\r\n"
+  if( n < 12 || line[ n - 2 ] != '\r' || line[ n - 8 ] != ',' || line[ n - 7 ] != ' ' )
+    return false;
+  memcpy( hex, line + n - 6, 4 );
+  hex[ 4 ] = 0;
+  if( strspn( hex, "0123456789ABCDEF" ) != 4 || strtoul( hex, NULL, 16 ) != crc16( line, n - 6 ))
+    return false;
+  for( i = n - 8; i > 0 && isdigit( line[ i - 1 ] ); i -- )
+    ;
+  if( i < 2 || i == n - 8 || line[ i - 1 ] != ' ' || line[ i - 2 ] != ',' )
+    return false;
+  * pSeq = strtoul( line + i, NULL, 10 );
+  return true;
+}
+
+// Sequence number that follows the last line of a buffer that ends with it
+//
+// return:
+//    0 if this line is not a line of a journal
+
+static uint32_t lastSeq( const char * line, uint16_t n )
+{
+  uint16_t i = n - 1;
+  uint32_t s;
+
+  while( i > 0 && line[ i - 1 ] != '\n' )
+    i --;
+  return journalSeq( line + i, n - i, & s ) ? s + 1 : 0;
+}
+
+LogFile::LogFile( uint8_t slot )
+{
+  rtcSlot = slot;
+  memset( & cur, 0, sizeof( cur ));
+  valid = false;
+  created = false;
+  fileName[ 0 ] = 0;
+  pHeader = NULL;
+  pDateTime = NULL;
+  journaled = false;
+  seq = 1;
+}
+
+// Get ready to append to a file of the root directory
+//
+// parameters:
+//   name : 8.3 name of the file
+//   prealloc : size of the extent if the file is created
+//
+// When the cursor in RTC memory is valid, neither the directory nor the FAT
+//   are read. An empty log is given the header.
+//
+// return:
+//    false if the file can't be opened or created
+
+bool LogFile::begin( const char * name, uint32_t prealloc )
+{
+  IoScope io( IO_OP_LOG );
+  valid = false;
+  created = false;
+  if( strlen( name ) >= sizeof( fileName ))
+    return false;
+  if( name != fileName )
+    strcpy( fileName, name );
+  if( rtcLoad( rtcSlot, & cur, sizeof( cur )) &&
+      cur.name == nameHash( name ) && cur.generation == sdl.generation() &&
+      ( ! journaled || rtcLoad( RTC_SLOT_JOURNAL, & seq, sizeof( seq ))))
+  {
+    valid = true;
+    return true;
+  }
+  seq = 1;
+  if( ! open( name, prealloc ))
+    return false;
+  valid = true;
+  if( journaled )
+    rtcSave( RTC_SLOT_JOURNAL, & seq, sizeof( seq ));
+  if( cur.position == 0 && pHeader != NULL )
+  {
+    created = true;
+    return printText( pHeader ) && sync();     // the header has no sequence number
+  }
+  return rtcSave( rtcSlot, & cur, sizeof( cur ));
+}
+
+// Make the cursor from the file, creating it if needed
+
+bool LogFile::open( const char * name, uint32_t prealloc )
+{
+  SdFile f;
+
+  memset( & cur, 0, sizeof( cur ));
+  cur.name = nameHash( name );
+  cur.generation = sdl.generation();
+
+  if( sdl.openRootFile( & f, name, O_READ ))
+  {
+    if( ! f.isFile())
+    {
+      f.close();
+      return false;
+    }
+    cur.position = f.fileSize();
+    cur.dirBlock = f.dirBlock();
+    cur.dirIndex = f.dirIndex();
+    // A preallocated file has more than a cluster allocated past its end
+    cur.contiguous = f.contiguousRange( & cur.bgnBlock, & cur.endBlock ) &&
+                     ( cur.endBlock - cur.bgnBlock + 1 ) * 512 - cur.position >=
+                     512UL * f.volume()->blocksPerCluster();
+    if( ! cur.contiguous && journaled && ( seq = fileSeq( & f )) == 0 )
+      seq = 1;
+    f.close();
+    return ! cur.contiguous || recover();
+  }
+
+  // No run of free clusters for the extent: the file is made by the first
+  //   append, and grows the usual way
+  if( ! sdl.createContiguous( & f, name, prealloc ))
+    return true;
+  cur.dirBlock = f.dirBlock();
+  cur.dirIndex = f.dirIndex();
+  cur.contiguous = f.contiguousRange( & cur.bgnBlock, & cur.endBlock );
+  f.close();
+
+  // The extent holds old data: clear its first block, so that the log
+  //   ends there, and show an empty file to the clients
+  uint8_t * blk = SdVolume::cacheClear();
+  memset( blk, 0, 512 );
+  return cur.contiguous &&
+         SdBlockDev::write( cur.bgnBlock, blk ) &&
+         sdl.setFileSize( cur.dirBlock, cur.dirIndex, 0 );
+}
+
+// Find the end of the log from the size of the directory entry
+
+bool LogFile::recover()
+{
+  uint32_t extent = ( cur.endBlock - cur.bgnBlock + 1 ) * 512;
+  uint32_t checkpoint = cur.position;
+  uint8_t * blk = SdVolume::cacheClear();
+  bool found = false;
+
+  while( cur.position < extent && ! found )
+  {
+    if( ! SdBlockDev::read( cur.bgnBlock + cur.position / 512, blk ))
+      return false;
+    for( uint16_t off = cur.position % 512; off < 512 && ! found; off ++ )
+    {
+      found = ! isLogChar( blk[ off ] );
+      if( ! found )
+        cur.position ++;
+    }
+    yield();
+  }
+  if( journaled && ! trimJournal( checkpoint ))
+    return false;
+  // Checkpoint the end found, or every loss of power would scan again the
+  //   lines written since the last one
+  if( cur.position > checkpoint )
+  {
+    uint16_t date = 0, time = 0;
+    if( pDateTime != NULL )
+      pDateTime( & date, & time );
+    if( ! sdl.setFileSize( cur.dirBlock, cur.dirIndex, cur.position, date, time ))
+      return false;
+  }
+  cur.pending = 0;
+  return true;
+}
+
+// End the log after the last good line of the journal
+//
+// The lines from the checkpoint are taken while they have the next
+//   sequence number and a right CRC. What follows, a line torn by a loss
+//   of power, is cleared: it would be taken for the start of the next one.
+//
+// parameters:
+//   checkpoint : size in the directory entry. The lines before are good
+
+bool LogFile::trimJournal( uint32_t checkpoint )
+{
+  char line[ LOG_LINE_MAX ];
+  uint16_t n = 0;
+  uint32_t expected = seqBefore( checkpoint );   // 0 if not known
+  uint32_t end = checkpoint;                      // end of the last good line
+  uint8_t * blk = SdVolume::cacheClear();
+
+  for( uint32_t pos = checkpoint; pos < cur.position && n < sizeof( line ); pos ++ )
+  {
+    if(( pos == checkpoint || pos % 512 == 0 ) &&
+        ! SdBlockDev::read( cur.bgnBlock + pos / 512, blk ))
+      return false;
+    line[ n ++ ] = blk[ pos % 512 ];
+    if( line[ n - 1 ] == '\n' )
+    {
+      uint32_t s;
+      if( ! journalSeq( line, n, & s ) || ( expected != 0 && s != expected ))
+        break;
+      expected = s + 1;
+      end = pos + 1;
+      n = 0;
+    }
+  }
+  seq = expected != 0 ? expected : 1;
+
+  // Clear from the end of the last good line to the end of the text found
+  for( uint32_t pos = end; pos < cur.position; pos = ( pos / 512 + 1 ) * 512 )
+  {
+    if( ! SdBlockDev::read( cur.bgnBlock + pos / 512, blk ))
+      return false;
+    memset( blk + pos % 512, 0, 512 - pos % 512 );
+    if( ! SdBlockDev::write( cur.bgnBlock + pos / 512, blk ))
+      return false;
+  }
+  cur.position = end;
+  return true;
+}
+
+// Sequence number that follows the line ending at pos
+//
+// return:
+//    0 if there is no line of a journal there (the header, or an empty log)
+
+uint32_t LogFile::seqBefore( uint32_t pos )
+{
+  char line[ LOG_LINE_MAX ];
+  uint32_t from = pos > sizeof( line ) ? pos - sizeof( line ) : 0;
+  uint8_t * blk = SdVolume::cacheClear();
+  uint16_t n = 0;
+
+  if( pos == 0 )
+    return 0;
+  for( uint32_t p = from; p < pos; p ++ )
+  {
+    if(( p == from || p % 512 == 0 ) && ! SdBlockDev::read( cur.bgnBlock + p / 512, blk ))
+      return 0;
+    line[ n ++ ] = blk[ p % 512 ];
+  }
+  return lastSeq( line, n );
+}
+
+// Sequence number that follows the end of a file appended through SdFile
+//
+// return:
+//    0 if there is no line of a journal there
+
+uint32_t LogFile::fileSeq( SdFile * pFile )
+{
+  char line[ LOG_LINE_MAX ];
+  uint32_t size = pFile->fileSize();
+  uint32_t from = size > sizeof( line ) ? size - sizeof( line ) : 0;
+
+  if( size == 0 || ! pFile->seekSet( from ))
+    return 0;
+  int16_t n = pFile->read( line, size - from );
+  return n > 0 ? lastSeq( line, n ) : 0;
+}
+
+// Append some bytes to the log
+//
+// The block that holds the end of the log is read and written back. When
+//   a new block is started, the next one is cleared first, so that the end
+//   of the log can always be found.
+//
+// A RETR of the log can stream at the same time: it stops at the size it
+//   found when the file was opened, and bytes are only added past the end.
+//
+// return:
+//    false if the card is full or can't be written
+
+bool LogFile::write( const uint8_t * data, uint16_t len )
+{
+  IoScope io( IO_OP_LOG );
+  if( ! valid )
+    return false;
+  // Clusters were freed since the cursor was made (by an FTP client while
+  //   logging goes on): the log may be gone or overwritten, look again
+  if( cur.generation != sdl.generation() && ! begin( fileName ))
+    return false;
+  // The extent is full: its size is written, then the file grows past it
+  //   the usual way
+  if( cur.contiguous && len > room())
+  {
+    if( ! sync())
+      return false;
+    cur.contiguous = false;
+  }
+  if( ! cur.contiguous )
+    return appendFile( data, len );
+
+  uint8_t * blk = SdVolume::cacheClear();   // flush and borrow the cache of the volume
+  while( len > 0 )
+  {
+    uint32_t block = cur.bgnBlock + cur.position / 512;
+    uint16_t off = cur.position % 512;
+    uint16_t n = len < 512 - off ? len : 512 - off;
+    if( off == 0 )
+    {
+      memset( blk, 0, 512 );
+      if( block < cur.endBlock && ! SdBlockDev::write( block + 1, blk ))
+        return false;
+    }
+    else if( ! SdBlockDev::read( block, blk ))
+      return false;
+    memcpy( blk + off, data, n );
+    if( ! SdBlockDev::write( block, blk ))
+      return false;
+    data += n;
+    len -= n;
+    cur.position += n;
+  }
+  if( ++ cur.pending >= LOG_CHECKPOINT )
+    return sync();
+  return rtcSave( rtcSlot, & cur, sizeof( cur ));
+}
+
+// Append a line of text, ended by CR LF. In journal mode, its sequence
+//   number and CRC are added
+//
+// return:
+//    false if the card is full or can't be written, or the line
+//    is too long for a journal
+
+bool LogFile::println( const char * line )
+{
+  char buf[ LOG_LINE_MAX ];
+  size_t n = strlen( line );
+
+  if( ! journaled )
+    return printText( line );
+  if( n + 21 > sizeof( buf ))         // ", <seq>, <CRC>\r\n" and the 0 of sprintf()
+    return false;
+  memcpy( buf, line, n );
+  n += sprintf( buf + n, ", %lu, ", (unsigned long) seq );
+  n += sprintf( buf + n, "%04X\r\n", crc16( buf, n ));
+  if( ! write( (const uint8_t *) buf, n ))
+    return false;
+  seq ++;
+  return rtcSave( RTC_SLOT_JOURNAL, & seq, sizeof( seq ));
+}
+
+// Append a line as it is, ended by CR LF
+
+bool LogFile::printText( const char * line )
+{
+  char buf[ LOG_LINE_MAX ];
+  size_t n = strlen( line );
+
+  if( n + 2 > sizeof( buf ))
+    return write( (const uint8_t *) line, n ) &&
+           write( (const uint8_t *) "\r\n", 2 );
+  memcpy( buf, line, n );
+  buf[ n ] = '\r';
+  buf[ n + 1 ] = '\n';
+  return write( (const uint8_t *) buf, n + 2 );     // a single block write
+}
+
+// Write the size of the log in its directory entry
+
+bool LogFile::sync()
+{
+  IoScope io( IO_OP_LOG );
+  uint16_t date = 0, time = 0;
+
+  if( ! valid )
+    return false;
+  if( cur.contiguous && cur.pending > 0 )
+  {
+    if( pDateTime != NULL )
+      pDateTime( & date, & time );
+    if( ! sdl.setFileSize( cur.dirBlock, cur.dirIndex, cur.position, date, time ))
+      return false;
+  }
+  cur.pending = 0;
+  return rtcSave( rtcSlot, & cur, sizeof( cur ));
+}
+
+// Rename the log and start a new one
+//
+// The directory entry is renamed, the data stays where it is. The extent
+//   past the end of the snapshot is given back, then the new log is made
+//   as begin() does.
+//
+// parameters:
+//   name : new name of the log, in the root directory. If empty, it is set
+//          to the date and time, MMDDhhmm, with the extension of the log
+//          (13 chars)
+//
+// return:
+//    false if the log is empty, or the name is taken. Once the log is
+//    renamed, true even if the new one can't be made (see isOpen()): the
+//    card can't be written. With no run of clusters left for its extent,
+//    the new log is appended the usual way
+
+bool LogFile::snapshot( char * name )
+{
+  SdFile f;
+  uint16_t date, time;
+
+  if( ! valid || ( cur.generation != sdl.generation() && ! begin( fileName )))
+    return false;
+  if( cur.position == 0 || ! sync())
+    return false;
+  uint32_t extent = ( cur.endBlock - cur.bgnBlock + 1 ) * 512;
+  if( name[ 0 ] == 0 )
+  {
+    const char * ext = strchr( fileName, '.' );
+    if( pDateTime == NULL )
+      return false;
+    pDateTime( & date, & time );
+    snprintf( name, 13, "%02u%02u%02u%02u%s", ( date >> 5 ) & 15, date & 31,
+              time >> 11, ( time >> 5 ) & 63, ext != NULL ? ext : "" );
+  }
+  if( ! sdl.renameRoot( fileName, name ))
+    return false;
+  if( cur.contiguous && sdl.openRootFile( & f, name, O_WRITE ))
+  {
+    if( f.truncate( f.fileSize()))
+      sdl.sizeChanged( extent, f.fileSize());
+    f.close();
+  }
+  begin( fileName );
+  return true;
+}
+
+// Number of bytes that can still be appended
+
+uint32_t LogFile::room()
+{
+  if( cur.contiguous )
+    return ( cur.endBlock - cur.bgnBlock + 1 ) * 512 - cur.position;
+  return sdl.freeKB() >= 0x400000 ? 0xFFFFFFFF : sdl.freeKB() * 1024;
+}
+
+// Append to a file that was not preallocated
+
+bool LogFile::appendFile( const uint8_t * data, uint16_t len )
+{
+  SdFile f;
+
+  if( ! sdl.openRootFile( & f, fileName, O_WRITE | O_APPEND | O_CREAT ))
+    return false;
+  uint32_t oldSize = f.fileSize();
+  bool ok = f.write( data, len ) == len;
+  cur.position = f.fileSize();
+  ok = f.close() && ok;
+  sdl.sizeChanged( oldSize, cur.position );
+  rtcSave( rtcSlot, & cur, sizeof( cur ));
+  return ok;
+}
+
+uint32_t LogFile::nameHash( const char * name )
+{
+  uint32_t h = 5381;
+  while( * name )
+    h = h * 33 + toupper( * name ++ );
+  return h;
+}
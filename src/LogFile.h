@@ -0,0 +1,117 @@
+/*
+ * Preallocated contiguous log file with an append cursor kept across deep sleep
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                      CONTIGUOUS LOG FILE FOR DATALOGGER                    **
+ **                                                                            **
+ *******************************************************************************/
+
+// The log file is created once as a contiguous extent of LOG_PREALLOC_SIZE
+//   bytes, that is erased. Its first block and the current write position
+//   are kept in RTC memory (in the slot given to the constructor), so an
+//   append is a direct write of the block at the end of the log: the
+//   directory and the FAT are not read, whatever the size of the log.
+//
+// The size in the directory entry, seen by FTP clients, is updated every
+//   LOG_CHECKPOINT appends and by sync(). If the RTC memory is lost, the end
+//   of the log is found by scanning forward from that size up to the first
+//   byte that is not text.
+//
+// A log file that already exists and was not preallocated is appended the
+//   usual way, through SdFile. So is a new log when the card has no run of
+//   free clusters for its extent, and a log past the end of its extent:
+//   logging goes on while the card has room.
+//
+// snapshot() renames the log and starts a new one, that begins with the
+//   header given by header(): the file renamed does not grow anymore, and
+//   can be downloaded whole while logging goes on.
+//
+// In journal mode, println() ends each line with its sequence number and
+//   a CRC-16 of the line, as ", 1234, 5A3F". After a loss of power, the
+//   lines past the size of the directory entry (the last checkpoint) are
+//   kept up to the first one that has a wrong CRC or is out of sequence:
+//   a line torn while the card was written is cleared. Recovery reads at
+//   most LOG_CHECKPOINT lines, whatever the size of the log.
+
+#ifndef LOG_FILE_H
+#define LOG_FILE_H
+
+#include "Arduino.h"
+#include "utility/SdFat.h"
+#include "RtcMem.h"
+
+#define LOG_PREALLOC_SIZE ( 64UL * 1024 * 1024 )   // size of the extent
+#define LOG_CHECKPOINT    64     // appends between two updates of the directory
+#define LOG_LINE_MAX      128    // longest line of a journal, sequence and CRC included
+
+class LogFile
+{
+public:
+  LogFile( uint8_t slot = RTC_SLOT_LOG );   // of the RTC memory that keeps the cursor
+
+  bool     begin( const char * name, uint32_t prealloc = LOG_PREALLOC_SIZE );
+  bool     write( const uint8_t * data, uint16_t len );
+  bool     println( const char * line );
+  bool     sync();
+  bool     snapshot( char * name );
+  void     header( const char * text ) { pHeader = text; }
+  void     journal( bool on ) { journaled = on; }   // before begin(), one log only
+  void     dateTimeCallback( void (*dateTime)( uint16_t * date, uint16_t * time ))
+                { pDateTime = dateTime; }
+
+  uint32_t size() { return cur.position; }
+  uint32_t room();
+  bool     isContiguous() { return cur.contiguous; }
+  bool     isNew() { return created; }   // begin() started an empty log
+  bool     isOpen() { return valid; }    // false if begin() failed
+
+private:
+  bool     open( const char * name, uint32_t prealloc );
+  bool     recover();
+  bool     appendFile( const uint8_t * data, uint16_t len );
+  bool     printText( const char * line );
+  bool     trimJournal( uint32_t checkpoint );
+  uint32_t seqBefore( uint32_t pos );
+  uint32_t fileSeq( SdFile * pFile );
+  uint32_t nameHash( const char * name );
+
+  // Kept in RTC memory
+  struct Cursor
+  {
+    uint32_t bgnBlock;      // first block of the extent
+    uint32_t endBlock;      // last block of the extent
+    uint32_t position;      // size of the log
+    uint32_t dirBlock;      // block of the directory entry
+    uint8_t  dirIndex;      // index of the entry in this block
+    uint8_t  contiguous;    // false if appended through SdFile
+    uint16_t pending;       // appends since the directory entry was written
+    uint32_t generation;    // SdList::generation() when the cursor was made
+    uint32_t name;          // hash of the name of the file
+  } cur;
+
+  uint8_t rtcSlot;
+  bool valid;
+  bool created;
+  bool journaled;
+  uint32_t seq;             // of the next line in journal mode, kept in RTC memory
+  char fileName[ 13 ];
+  const char * pHeader;     // first line(s) of a new log
+  void (*pDateTime)( uint16_t * date, uint16_t * time );
+};
+
+#endif // LOG_FILE_H
@@ -0,0 +1,217 @@
+#include "MemStats.h"
+
+#ifdef ARDUINO
+extern "C" {
+#include "cont.h"
+}
+#else
+#include <new>
+#include <stdlib.h>
+#endif
+
+MemPoint MemStats::points[ MEM_POINTS ];
+uint8_t * MemStats::stackTop = NULL;
+
+#ifndef ARDUINO
+
+// Allocations of the host build. Each block starts with its size, in
+//   MEM_HEAD bytes to keep the alignment of malloc()
+
+#define MEM_HEAD 16
+
+static uint32_t nAllocs = 0;
+static uint32_t liveBytes = 0;
+static uintptr_t paintLow = 0;                // lowest word painted
+
+void * operator new( size_t n )
+{
+  uint8_t * p = (uint8_t *) malloc( n + MEM_HEAD );
+  if( p == NULL )
+    throw std::bad_alloc();
+  * (size_t *) p = n;
+  nAllocs ++;
+  liveBytes += n;
+  return p + MEM_HEAD;
+}
+
+void * operator new[]( size_t n )
+{
+  return operator new( n );
+}
+
+void operator delete( void * p ) noexcept
+{
+  if( p == NULL )
+    return;
+  uint8_t * h = (uint8_t *) p - MEM_HEAD;
+  liveBytes -= * (size_t *) h;
+  free( h );
+}
+
+void operator delete[]( void * p ) noexcept
+{
+  operator delete( p );
+}
+
+void operator delete( void * p, size_t ) noexcept
+{
+  operator delete( p );
+}
+
+void operator delete[]( void * p, size_t ) noexcept
+{
+  operator delete( p );
+}
+
+// Paint the words of the stack from low to high, free below the frame of
+//   begin(). The MEM_PAINT_GUARD bytes under high are left as they are:
+//   the frame of this function is there
+
+static void __attribute__(( noinline )) paintStack( uintptr_t low, uintptr_t high )
+{
+  for( uintptr_t a = low; a + 4 <= high - MEM_PAINT_GUARD; a += 4 )
+    * (volatile uint32_t *) a = MEM_PAINT;
+}
+
+#endif
+
+// Start the measures, from the stack depth of the caller
+
+void MemStats::begin()
+{
+  uint8_t here;
+  stackTop = & here;
+#ifndef ARDUINO
+  paintLow = ( (uintptr_t) stackTop - MEM_PAINT_SIZE ) & ~ (uintptr_t) 3;
+  paintStack( paintLow, (uintptr_t) stackTop );
+#endif
+  reset();
+}
+
+// Forget the samples taken. The peak of the stack is kept: the stack is
+//   painted only once
+
+void MemStats::reset()
+{
+  memset( points, 0, sizeof( points ));
+}
+
+// Take a sample at a point of measure
+
+void MemStats::sample( uint8_t point )
+{
+  uint8_t here;
+  MemPoint * p = & points[ point ];
+  uint32_t hFree = heapFree();
+  uint32_t hBlock = heapBlock();
+  uint8_t hFrag = heapFrag();
+  uint16_t depth = stackTop != NULL && stackTop > & here ? stackTop - & here : 0;
+
+#ifdef ARDUINO
+  bool lessFree = hFree < p->minFree;
+#else
+  bool lessFree = hFree > p->minFree;    // bytes allocated
+#endif
+  if( p->count == 0 || lessFree )
+    p->minFree = hFree;
+  if( p->count == 0 || hBlock < p->minBlock )
+    p->minBlock = hBlock;
+  if( hFrag > p->maxFrag )
+    p->maxFrag = hFrag;
+  if( depth > p->maxDepth )
+    p->maxDepth = depth;
+  p->count ++;
+}
+
+// Print the peaks, one line for the whole stack and the heap now, then
+//   one line for each point sampled
+//
+// parameters:
+//   prefix : start of each line, as "211-" for an FTP reply
+
+void MemStats::print( Print & out, const char * prefix )
+{
+  static const char * const names[ MEM_POINTS ] = { "service", "command", "reply", "sample" };
+
+  out.print( prefix ); out.print( "stack peak " ); out.print( stackPeak());
+  out.print( ", heap " ); out.print( heapFree());
+#ifdef ARDUINO
+  out.print( " free, block " ); out.print( heapBlock());
+  out.print( ", frag " ); out.print( heapFrag()); out.print( "%\r\n" );
+#else
+  out.print( " allocated, " ); out.print( allocs()); out.print( " allocations\r\n" );
+#endif
+  for( uint8_t i = 0; i < MEM_POINTS; i ++ )
+  {
+    MemPoint * p = & points[ i ];
+    if( p->count == 0 )
+      continue;
+    out.print( prefix ); out.print( names[ i ] );
+    out.print( ": " ); out.print( p->count );
+    out.print( " samples, depth " ); out.print( p->maxDepth );
+    out.print( ", heap " ); out.print( p->minFree );
+    out.print( ", block " ); out.print( p->minBlock );
+    out.print( ", frag " ); out.print( p->maxFrag ); out.print( "%\r\n" );
+  }
+}
+
+// Most bytes of stack used since boot
+
+uint32_t MemStats::stackPeak()
+{
+#ifdef ARDUINO
+  return CONT_STACKSIZE - cont_get_free_stack( g_pcont );
+#else
+  uintptr_t a = paintLow;
+  if( a == 0 )
+    return 0;
+  while( a + 4 <= (uintptr_t) stackTop - MEM_PAINT_GUARD && * (volatile uint32_t *) a == MEM_PAINT )
+    a += 4;
+  return (uintptr_t) stackTop - a;
+#endif
+}
+
+// Free bytes of the heap (host build: bytes allocated)
+
+uint32_t MemStats::heapFree()
+{
+#ifdef ARDUINO
+  return ESP.getFreeHeap();
+#else
+  return liveBytes;
+#endif
+}
+
+// Largest block that can be allocated
+
+uint32_t MemStats::heapBlock()
+{
+#ifdef ARDUINO
+  return ESP.getMaxFreeBlockSize();
+#else
+  return 0;
+#endif
+}
+
+// Fragmentation of the free heap: 0 if it is a single block, near 100 if
+//   it is made of many small ones
+
+uint8_t MemStats::heapFrag()
+{
+#ifdef ARDUINO
+  return ESP.getHeapFragmentation();
+#else
+  return 0;
+#endif
+}
+
+// Allocations made so far, counted on a host build only
+
+uint32_t MemStats::allocs()
+{
+#ifdef ARDUINO
+  return 0;
+#else
+  return nAllocs;
+#endif
+}
@@ -0,0 +1,82 @@
+/*
+ * Stack and heap usage of the datalogger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                         STACK AND HEAP USAGE                               **
+ **                                                                            **
+ *******************************************************************************/
+
+// The state of the heap and the depth of the stack are sampled at a few
+//   points of the FTP server and of the logger. For each point, the worst
+//   values seen are kept: least free heap, smallest largest free block,
+//   highest fragmentation and deepest stack. SITE MEM prints them, and
+//   each command recorded by SITE TRACE is followed by a sample.
+//
+// Stack: begin() paints the free stack with a pattern, the deepest point
+//   reached is where the pattern ends. On the ESP8266 the core paints the
+//   stack of loop() at boot and counts the free words itself.
+//
+// On a host build (ARDUINO not defined), new and delete are counted:
+//   allocs() tells how many allocations a command made, and the heap
+//   figures are the bytes allocated instead of the bytes free.
+
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include "Arduino.h"
+
+// Points of measure
+#define MEM_AT_SERVICE  0     // FtpServer::service(), at each call
+#define MEM_AT_COMMAND  1     // before a command is processed
+#define MEM_AT_REPLY    2     // after a command is processed
+#define MEM_AT_SAMPLE   3     // sample() of the sketch
+#define MEM_POINTS      4
+
+#define MEM_PAINT_SIZE  4096  // bytes of stack painted on a host build
+#define MEM_PAINT_GUARD 256   //   but those right under begin(), in use
+#define MEM_PAINT       0xA5C3E1F7UL
+
+struct MemPoint
+{
+  uint32_t count;             // samples taken
+  uint32_t minFree;           // least free heap (host: most bytes allocated)
+  uint32_t minBlock;          // smallest largest free block
+  uint16_t maxDepth;          // deepest stack, from where begin() was called
+  uint8_t  maxFrag;           // highest fragmentation, in %
+};
+
+class MemStats
+{
+public:
+  static void     begin();
+  static void     reset();
+  static void     sample( uint8_t point );
+  static void     print( Print & out, const char * prefix );
+
+  static uint32_t stackPeak();
+  static uint32_t heapFree();
+  static uint32_t heapBlock();
+  static uint8_t  heapFrag();
+  static uint32_t allocs();
+
+private:
+  static MemPoint points[ MEM_POINTS ];
+  static uint8_t * stackTop;  // stack pointer in begin()
+};
+
+#endif // MEM_STATS_H
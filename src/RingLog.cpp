@@ -0,0 +1,372 @@
+#include "RingLog.h"
+#include "SdList.h"
+#include "RtcMem.h"
+#include "SdBlockDev.h"
+
+extern SdList sdl;
+
+#define RING_MAGIC "RINGLOG1"
+
+// First block of the extent
+struct RingHeader
+{
+  char     magic[ 8 ];      // RING_MAGIC
+  uint32_t recordSize;      // RING_RECORD_SIZE
+  uint32_t capacity;        // records
+  uint32_t first;           // sequence of the oldest record
+  uint32_t next;            // sequence of the next record
+};
+
+// A line of the ring
+struct RingRecord
+{
+  uint32_t seq;             // 0 for a place never written
+  uint8_t  len;
+  char     text[ RING_TEXT_SIZE ];
+};
+
+RingLog::RingLog()
+{
+  memset( & cur, 0, sizeof( cur ));
+  valid = false;
+  created = false;
+  fileName[ 0 ] = 0;
+  pHeader = NULL;
+  pDateTime = NULL;
+}
+
+// Get ready to append to a ring of the root directory
+//
+// parameters:
+//   name : 8.3 name of the file
+//   prealloc : size of the extent if the file is created
+//
+// When the cursor in RTC memory is valid, nothing is read on the card.
+//
+// return:
+//    false if the file can't be created, or is not a ring
+
+bool RingLog::begin( const char * name, uint32_t prealloc )
+{
+  IoScope io( IO_OP_LOG );
+  valid = false;
+  created = false;
+  if( strlen( name ) >= sizeof( fileName ))
+    return false;
+  if( name != fileName )
+    strcpy( fileName, name );
+  if( rtcLoad( RTC_SLOT_RING, & cur, sizeof( cur )) &&
+      cur.name == nameHash( name ) && cur.generation == sdl.generation())
+  {
+    valid = true;
+    return true;
+  }
+  if( ! open( name, prealloc ))
+    return false;
+  valid = true;
+  return rtcSave( RTC_SLOT_RING, & cur, sizeof( cur ));
+}
+
+// Make the cursor from the header of the file, creating it if needed
+
+bool RingLog::open( const char * name, uint32_t prealloc )
+{
+  SdFile f;
+  uint32_t endBlock;
+
+  memset( & cur, 0, sizeof( cur ));
+  cur.name = nameHash( name );
+  cur.generation = sdl.generation();
+
+  if( sdl.openRootFile( & f, name, O_READ ))
+  {
+    bool contiguous = f.isFile() && f.contiguousRange( & cur.bgnBlock, & endBlock );
+    cur.dirBlock = f.dirBlock();
+    cur.dirIndex = f.dirIndex();
+    f.close();
+    uint8_t * blk = SdVolume::cacheClear();
+    RingHeader * h = (RingHeader *) blk;
+    if( ! contiguous || ! SdBlockDev::read( cur.bgnBlock, blk ) ||
+        memcmp( h->magic, RING_MAGIC, sizeof( h->magic )) != 0 ||
+        h->recordSize != RING_RECORD_SIZE ||
+        h->capacity == 0 || h->capacity > ( endBlock - cur.bgnBlock ) * RING_PER_BLOCK )
+      return false;                   // not a ring: left as it is
+    cur.capacity = h->capacity;
+    cur.first = h->first;
+    cur.next = h->next;
+    return recover();
+  }
+
+  if( ! sdl.createContiguous( & f, name, prealloc ))
+    return false;
+  cur.dirBlock = f.dirBlock();
+  cur.dirIndex = f.dirIndex();
+  bool contiguous = f.contiguousRange( & cur.bgnBlock, & endBlock );
+  f.close();
+  if( ! contiguous || endBlock <= cur.bgnBlock )
+    return false;
+  cur.capacity = ( endBlock - cur.bgnBlock ) * RING_PER_BLOCK;
+  cur.first = 1;
+  cur.next = 1;
+  created = true;
+
+  // The extent holds old data: clear the first block of records
+  uint8_t * blk = SdVolume::cacheClear();
+  memset( blk, 0, 512 );
+  return SdBlockDev::write( cur.bgnBlock + 1, blk ) && writeHeader();
+}
+
+// Find the records appended since the header was written
+
+bool RingLog::recover()
+{
+  uint8_t * blk = SdVolume::cacheClear();
+
+  for( uint32_t n = 0; n < cur.capacity; n ++ )
+  {
+    RingRecord * r = (RingRecord *) ( blk + (( cur.next - 1 ) % RING_PER_BLOCK ) * RING_RECORD_SIZE );
+    if(( n == 0 || ( cur.next - 1 ) % RING_PER_BLOCK == 0 ) &&
+        ! SdBlockDev::read( blockOf( cur.next ), blk ))
+      return false;
+    // A record of a later turn of the ring, if the header is that far behind
+    if( r->seq < cur.next || ( r->seq - cur.next ) % cur.capacity != 0 )
+      break;
+    cur.next = r->seq + 1;
+    cur.pending = 1;                  // the header is behind
+    if(( cur.next & 63 ) == 0 )
+      yield();
+  }
+  if( cur.next - cur.first > cur.capacity )
+    cur.first = cur.next - cur.capacity;
+  return true;
+}
+
+// Append a line, without its end. Bytes past RING_TEXT_SIZE are lost, and
+//   CR or LF in the line are changed to spaces
+//
+// The block of the record is read and written back: it holds other records.
+//   The first time a block is written, the next one is cleared before.
+//
+// return:
+//    false if the card can't be written
+
+bool RingLog::println( const char * line )
+{
+  IoScope io( IO_OP_LOG );
+  if( ! valid )
+    return false;
+  // Clusters were freed since the cursor was made (by an FTP client while
+  //   logging goes on): the ring may be gone, look again
+  if( cur.generation != sdl.generation() && ! begin( fileName ))
+    return false;
+
+  uint32_t slot = ( cur.next - 1 ) % cur.capacity;
+  uint32_t block = blockOf( cur.next );
+  uint8_t * blk = SdVolume::cacheClear();   // flush and borrow the cache of the volume
+
+  if( slot % RING_PER_BLOCK == 0 && cur.next + RING_PER_BLOCK <= cur.capacity )
+  {
+    memset( blk, 0, 512 );
+    if( ! SdBlockDev::write( block + 1, blk ))
+      return false;
+  }
+  if( ! SdBlockDev::read( block, blk ))
+    return false;
+
+  RingRecord * r = (RingRecord *) ( blk + ( slot % RING_PER_BLOCK ) * RING_RECORD_SIZE );
+  size_t n = strlen( line );
+  if( n > RING_TEXT_SIZE )
+    n = RING_TEXT_SIZE;
+  memset( r, 0, RING_RECORD_SIZE );
+  r->seq = cur.next;
+  r->len = n;
+  for( uint8_t i = 0; i < n; i ++ )
+    r->text[ i ] = line[ i ] == '\r' || line[ i ] == '\n' ? ' ' : line[ i ];
+  if( ! SdBlockDev::write( block, blk ))
+    return false;
+
+  cur.next ++;
+  if( cur.next - cur.first > cur.capacity )
+    cur.first ++;                     // the oldest record is gone
+  if( ++ cur.pending >= RING_CHECKPOINT )
+    return sync();
+  return rtcSave( RTC_SLOT_RING, & cur, sizeof( cur ));
+}
+
+// Write the sequences in the header, and the time in the directory entry
+
+bool RingLog::sync()
+{
+  IoScope io( IO_OP_LOG );
+  uint16_t date = 0, time = 0;
+
+  if( ! valid )
+    return false;
+  if( cur.pending > 0 )
+  {
+    if( ! writeHeader())
+      return false;
+    if( pDateTime != NULL )
+    {
+      pDateTime( & date, & time );
+      sdl.setFileSize( cur.dirBlock, cur.dirIndex,
+                       ( cur.capacity / RING_PER_BLOCK + 1 ) * 512, date, time );
+    }
+  }
+  cur.pending = 0;
+  return rtcSave( RTC_SLOT_RING, & cur, sizeof( cur ));
+}
+
+// Read a record
+//
+// parameters:
+//   seq  : its sequence number, from first() to next() - 1
+//   text : where to store the line, RING_TEXT_SIZE chars, not ended by 0
+//
+// return:
+//    length of the line, -1 if the record is not in the ring (overwritten
+//    if seq < first()) or the card can't be read
+
+int16_t RingLog::read( uint32_t seq, char * text )
+{
+  if( ! valid || seq < cur.first || seq >= cur.next )
+    return -1;
+
+  uint8_t * blk = SdVolume::cacheClear();
+  RingRecord * r = (RingRecord *) ( blk + (( seq - 1 ) % RING_PER_BLOCK ) * RING_RECORD_SIZE );
+  if( ! SdBlockDev::read( blockOf( seq ), blk ) || r->seq != seq || r->len > RING_TEXT_SIZE )
+    return -1;
+  memcpy( text, r->text, r->len );
+  return r->len;
+}
+
+bool RingLog::writeHeader()
+{
+  uint8_t * blk = SdVolume::cacheClear();
+  RingHeader * h = (RingHeader *) blk;
+
+  memset( blk, 0, 512 );
+  memcpy( h->magic, RING_MAGIC, sizeof( h->magic ));
+  h->recordSize = RING_RECORD_SIZE;
+  h->capacity = cur.capacity;
+  h->first = cur.first;
+  h->next = cur.next;
+  return SdBlockDev::write( cur.bgnBlock, blk );
+}
+
+// Block of a record
+
+uint32_t RingLog::blockOf( uint32_t seq )
+{
+  return cur.bgnBlock + 1 + (( seq - 1 ) % cur.capacity ) / RING_PER_BLOCK;
+}
+
+uint32_t RingLog::nameHash( const char * name )
+{
+  uint32_t h = 5381;
+  while( * name )
+    h = h * 33 + toupper( * name ++ );
+  return h;
+}
+
+//------------------------------------------------------------------------------
+
+RingStream::RingStream()
+{
+  ring = NULL;
+  seq = 0;
+  endSeq = 0;
+  skip = 0;
+  inHeader = false;
+}
+
+// Get ready to send the records of a ring
+//
+// parameters:
+//   from : sequence of the first record to send, 0 for the header line
+//          and all the records
+
+bool RingStream::begin( RingLog * pRing, uint32_t from )
+{
+  ring = pRing;
+  inHeader = from == 0 && pRing->headerText() != NULL;
+  seq = pRing->since( from );
+  endSeq = pRing->next();
+  skip = 0;
+  return true;
+}
+
+// Send the next buffer of lines
+//
+// return:
+//    number of bytes sent, 0 if the client can't take any now or at the end
+//    (see done()), -1 if the card can't be read
+
+int16_t RingStream::send( Print & out, uint8_t * buf, uint16_t bufSize )
+{
+  uint16_t n = 0;
+  size_t nw;
+
+  if( done())
+    return 0;
+  if( inHeader )
+  {
+    const char * text = ring->headerText();
+    uint16_t len = strlen( text ) + 2;
+    for( ; skip + n < len && n < bufSize; n ++ )
+      buf[ n ] = skip + n < len - 2 ? text[ skip + n ] : "\r\n"[ skip + n + 2 - len ];
+    nw = out.write( (const uint8_t *) buf, n );
+    skip += nw;
+    if( skip >= len )
+    {
+      inHeader = false;
+      skip = 0;
+    }
+    return nw;
+  }
+
+  // Lines from seq, the first one without the bytes already sent
+  if( seq < ring->first())                    // skip the records overwritten
+  {
+    seq = ring->first();
+    skip = 0;
+  }
+  uint32_t s = seq;
+  uint16_t sk = skip;
+  char line[ RING_TEXT_SIZE + 2 ];
+  while( s < endSeq && n < bufSize )
+  {
+    int16_t len = ring->read( s, line );
+    if( len < 0 )
+    {
+      if( s < ring->first())                  // overwritten while sent
+        break;
+      return -1;
+    }
+    line[ len ++ ] = '\r';
+    line[ len ++ ] = '\n';
+    uint16_t take = len - sk < bufSize - n ? len - sk : bufSize - n;
+    memcpy( buf + n, line + sk, take );
+    n += take;
+    sk = 0;
+    s ++;
+  }
+  if( n == 0 )
+  {
+    seq = s;
+    return 0;
+  }
+
+  // Move past the lines taken by the client: records have no LF inside
+  nw = out.write( (const uint8_t *) buf, n );
+  for( size_t i = 0; i < nw; i ++ )
+  {
+    skip ++;
+    if( buf[ i ] == '\n' )
+    {
+      seq ++;
+      skip = 0;
+    }
+  }
+  return nw;
+}
@@ -0,0 +1,135 @@
+/*
+ * Log of fixed size, the newest records overwrite the oldest
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                          RING LOG FOR DATALOGGER                           **
+ **                                                                            **
+ *******************************************************************************/
+
+// The ring is a file of the root directory made once as a contiguous extent
+//   of RING_PREALLOC_SIZE bytes: it never takes more of the card, and the
+//   logger can run for years without a client deleting files.
+//
+// The first block is the header: the sequence numbers of the oldest record
+//   and of the next one. Then come records of RING_RECORD_SIZE bytes, each
+//   a line of text with its sequence number. Record n is at a place given
+//   by n: an append writes a single block, and the records since n are
+//   found without reading the others. When the ring is full, a record
+//   takes the place of the oldest one.
+//
+// As for LogFile, the place of the ring and the sequences are kept in RTC
+//   memory, and the header is written every RING_CHECKPOINT appends and by
+//   sync(). If the RTC memory is lost, the records written after the header
+//   are found by their sequence numbers. Until the ring was filled once,
+//   the block after the one appended to is cleared first: old data of the
+//   card is never taken for a record.
+//
+// The file is not text: RETR of the ring is made by RingStream, that sends
+//   the header line given by header() then the records as lines, oldest
+//   first.
+
+#ifndef RING_LOG_H
+#define RING_LOG_H
+
+#include "Arduino.h"
+#include "utility/SdFat.h"
+
+#ifndef RING_PREALLOC_SIZE
+#define RING_PREALLOC_SIZE ( 16UL * 1024 * 1024 )   // size of the extent
+#endif
+#define RING_RECORD_SIZE   64     // bytes of a record, a divisor of 512
+#define RING_TEXT_SIZE     ( RING_RECORD_SIZE - 5 )  // longest line kept
+#define RING_PER_BLOCK     ( 512 / RING_RECORD_SIZE )
+#define RING_CHECKPOINT    64     // appends between two writes of the header
+
+class RingLog
+{
+public:
+  RingLog();
+
+  bool     begin( const char * name, uint32_t prealloc = RING_PREALLOC_SIZE );
+  bool     println( const char * line );
+  bool     sync();
+  int16_t  read( uint32_t seq, char * text );
+  void     header( const char * text ) { pHeader = text; }
+  void     dateTimeCallback( void (*dateTime)( uint16_t * date, uint16_t * time ))
+                { pDateTime = dateTime; }
+
+  uint32_t first() { return cur.first; }      // sequence of the oldest record
+  uint32_t next() { return cur.next; }        // sequence of the next record
+  uint32_t since( uint32_t seq ) { return seq < cur.first ? cur.first : seq; }
+  uint32_t capacity() { return cur.capacity; }
+  uint32_t size() { return ( cur.next - cur.first ) * RING_RECORD_SIZE; }
+  const char * name() { return fileName; }
+  const char * headerText() { return pHeader; }
+  bool     isNew() { return created; }        // begin() started an empty ring
+
+private:
+  bool     open( const char * name, uint32_t prealloc );
+  bool     recover();
+  bool     writeHeader();
+  uint32_t blockOf( uint32_t seq );
+  uint32_t nameHash( const char * name );
+
+  // Kept in RTC memory
+  struct Cursor
+  {
+    uint32_t bgnBlock;      // header, the records follow
+    uint32_t capacity;      // records
+    uint32_t first;         // sequence of the oldest record, from 1
+    uint32_t next;          // sequence of the next record
+    uint32_t dirBlock;      // block of the directory entry
+    uint8_t  dirIndex;      // index of the entry in this block
+    uint8_t  reserved;
+    uint16_t pending;       // appends since the header was written
+    uint32_t generation;    // SdList::generation() when the cursor was made
+    uint32_t name;          // hash of the name of the file
+  } cur;
+
+  bool valid;
+  bool created;
+  char fileName[ 13 ];
+  const char * pHeader;     // first line(s) sent by RETR
+  void (*pDateTime)( uint16_t * date, uint16_t * time );
+};
+
+// Send the header and records of a ring, one buffer at a time, as
+//   FileStream does for a file
+//
+// The records are those found when begin() is called. If the ring turns
+//   while they are sent, the records overwritten are skipped.
+
+class RingStream
+{
+public:
+  RingStream();
+
+  bool     begin( RingLog * pRing, uint32_t from );
+  int16_t  send( Print & out, uint8_t * buf, uint16_t bufSize );
+  bool     done() { return ring == NULL || ( ! inHeader && seq >= endSeq ); }
+  uint32_t records() { return ring == NULL ? 0 : endSeq - seq; }
+
+private:
+  RingLog * ring;
+  uint32_t seq;           // record being sent
+  uint32_t endSeq;        // record after the last one to send
+  uint16_t skip;          // bytes of it already sent
+  bool     inHeader;      // the header line is being sent
+};
+
+#endif // RING_LOG_H
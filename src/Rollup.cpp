@@ -0,0 +1,150 @@
+#include "Rollup.h"
+#include "SdList.h"
+#include "RtcMem.h"
+#include "SdBlockDev.h"
+
+extern SdList sdl;
+
+static const uint32_t periods[ ROLLUP_TIERS ] = { 60, 3600, 86400 };
+static const char * const files[ ROLLUP_TIERS ] = { "ROLLMIN.CSV", "ROLLHOUR.CSV", "ROLLDAY.CSV" };
+static const char * const names[ ROLLUP_TIERS ] = { "minute", "hour", "day" };
+static const char header[] =
+  "Start, Samples, Height min (cm), Height max (cm), Height mean (cm), "
+  "Temperature min (C), Temperature max (C), Temperature mean (C)";
+
+#define ROLLUP_NO_TEMP -100.0        // below: probe not read
+
+// Write time, in seconds since 2000-01-01, as "YYYY-MM-DD HH:MM" in str
+
+static void formatTime( char * str, uint32_t t )
+{
+  uint32_t days = t / 86400 + 10957;       // days since 1970-01-01
+  uint32_t secs = t % 86400;
+
+  // civil date from days (H. Hinnant)
+  uint32_t z = days + 719468;
+  uint32_t era = z / 146097;
+  uint32_t doe = z - era * 146097;
+  uint32_t yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+  uint32_t doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+  uint32_t mp = ( 5 * doy + 2 ) / 153;
+  uint32_t d = doy - ( 153 * mp + 2 ) / 5 + 1;
+  uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+  uint32_t y = yoe + era * 400 + ( m <= 2 );
+
+  sprintf( str, "%04u-%02u-%02u %02u:%02u", (unsigned) y, (unsigned) m, (unsigned) d,
+           (unsigned) ( secs / 3600 ), (unsigned) ( secs / 60 % 60 ));
+}
+
+Rollup::Rollup() : minutes( RTC_SLOT_ROLLMIN )
+{
+  memset( b, 0, sizeof( b ));
+  sink = NULL;
+}
+
+// Get the aggregates left in RTC memory by the previous wake
+
+void Rollup::begin()
+{
+  if( ! rtcLoad( RTC_SLOT_ROLLUP, b, sizeof( b )))
+    memset( b, 0, sizeof( b ));
+}
+
+// Add a sample to the buckets of all tiers
+
+void Rollup::add( uint32_t time, float heightCm, float tempC )
+{
+  int16_t h = (int16_t) constrain( heightCm * 10.0, -32768, 32767 );
+  int16_t t = (int16_t) constrain( tempC * 100.0, -32768, 32767 );
+  bool hasTemp = tempC > ROLLUP_NO_TEMP;
+
+  for( uint8_t i = 0; i < ROLLUP_TIERS; i ++ )
+  {
+    Bucket * p = & b[ i ];
+    uint32_t start = time - time % periods[ i ];
+    if( p->count > 0 && p->start != start )
+      close( i );
+    if( p->count == 0 )
+    {
+      memset( p, 0, sizeof( Bucket ));
+      p->start = start;
+      p->hMin = p->hMax = h;
+    }
+    if( h < p->hMin ) p->hMin = h;
+    if( h > p->hMax ) p->hMax = h;
+    p->hSum += h;
+    p->count ++;
+    if( hasTemp )
+    {
+      if( p->tcount == 0 || t < p->tMin ) p->tMin = t;
+      if( p->tcount == 0 || t > p->tMax ) p->tMax = t;
+      p->tSum += t;
+      p->tcount ++;
+    }
+  }
+  rtcSave( RTC_SLOT_ROLLUP, b, sizeof( b ));
+}
+
+// Append a finished bucket to the file of its tier
+
+void Rollup::close( uint8_t tier )
+{
+  Bucket * p = & b[ tier ];
+  char line[ 112 ];
+  char * s = line;
+  SdFile f;
+  IoScope io( IO_OP_LOG );
+
+  // the line is published with the name of its tier in front
+  s += sprintf( s, "%s, ", names[ tier ] );
+  char * row = s;
+  formatTime( s, p->start );
+  s += strlen( s );
+  s += sprintf( s, ", %u, %.1f, %.1f, %.1f", p->count,
+                p->hMin / 10.0, p->hMax / 10.0, p->hSum / 10.0 / p->count );
+  if( p->tcount > 0 )
+    s += sprintf( s, ", %.2f, %.2f, %.2f", p->tMin / 100.0, p->tMax / 100.0,
+                  p->tSum / 100.0 / p->tcount );
+  else
+    s += sprintf( s, ", , , " );
+
+  if( tier == 0 )
+  {
+    if( openMinutes())
+      minutes.println( row );
+  }
+  else if( sdl.openRootFile( & f, files[ tier ], O_WRITE | O_APPEND | O_CREAT ))
+  {
+    uint32_t oldSize = f.fileSize();
+    if( oldSize == 0 )
+    {
+      f.write( header );
+      f.write( "\r\n" );
+    }
+    f.write( row );
+    f.write( "\r\n" );
+    sdl.sizeChanged( oldSize, f.fileSize());
+    f.close();
+  }
+  if( sink != NULL )
+    sink->publish( (const uint8_t *) line, strlen( line ));
+  p->count = 0;
+}
+
+// Write the size of the minute file in its directory entry, for FTP clients
+
+bool Rollup::sync()
+{
+  return openMinutes() && minutes.sync();
+}
+
+// Get the cursor of the minute file, once a wake. A new file starts with
+//   the header
+
+bool Rollup::openMinutes()
+{
+  if( minutes.isOpen())
+    return true;
+  minutes.header( header );
+  return minutes.begin( files[ 0 ], ROLLUP_PREALLOC_SIZE );
+}
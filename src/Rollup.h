@@ -0,0 +1,78 @@
+/*
+ * Incremental per-minute, per-hour and per-day aggregates of the samples
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                        ROLLUP ENGINE FOR DATALOGGER                        **
+ **                                                                            **
+ *******************************************************************************/
+
+// For each tier, min, max and sum of water height and temperature of the
+//   current bucket are updated with each sample and kept in RTC memory.
+//
+// When a sample falls in a new bucket, the finished one is appended as a
+//   line of text to the file of its tier, at the root of the card:
+//     start, samples, height min, max, mean (cm), temperature min, max, mean (C)
+//   and published through the sink as text, if one is set (network up),
+//   with the name of the tier in front: "hour, 2018-06-01 10:00, 360, ..."
+//
+// A minute ends at almost every wake: its file is a LogFile, preallocated,
+//   whose cursor is kept in RTC memory. A line is a write of one block, the
+//   directory is written every LOG_CHECKPOINT lines and by sync(). The hour
+//   and day files, 25 lines a day, are appended through SdFile.
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include "Arduino.h"
+#include "Telemetry.h"
+#include "LogFile.h"
+
+#define ROLLUP_TIERS 3
+#define ROLLUP_PREALLOC_SIZE ( 16UL * 1024 * 1024 )   // extent of the minute file
+
+class Rollup
+{
+public:
+  Rollup();
+
+  void begin();
+  void add( uint32_t time, float heightCm, float tempC );
+  bool sync();
+  void setSink( TelemetrySink * pSink ) { sink = pSink; }
+
+private:
+  struct Bucket
+  {
+    uint32_t start;         // time of the beginning, in seconds since 2000
+    uint16_t count;         // samples of height
+    uint16_t tcount;        // samples of temperature
+    int16_t  hMin, hMax;    // height in mm
+    int32_t  hSum;
+    int16_t  tMin, tMax;    // temperature in 1/100 C
+    int32_t  tSum;
+  };
+
+  void close( uint8_t tier );
+  bool openMinutes();
+
+  Bucket b[ ROLLUP_TIERS ];   // kept in RTC memory
+  LogFile minutes;            // file of the first tier
+  TelemetrySink * sink;
+};
+
+#endif // ROLLUP_H
@@ -0,0 +1,54 @@
+#include "RtcMem.h"
+
+extern "C" {
+#include "user_interface.h"
+}
+
+// Check word of a slot: FNV-1a of its content and size
+
+static uint32_t rtcCheck( const void * data, uint16_t size )
+{
+  const uint8_t * p = (const uint8_t *) data;
+  uint32_t h = 2166136261UL ^ size;
+  while( size -- )
+  {
+    h ^= * p ++;
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+// Read a slot
+//
+// parameters:
+//   slot : first block of the slot
+//   data : where to store the content, size must be a multiple of 4
+//
+// return:
+//    false if the slot is not valid
+
+bool rtcLoad( uint8_t slot, void * data, uint16_t size )
+{
+  uint32_t check;
+  if( ! system_rtc_mem_read( slot, & check, sizeof( check )) ||
+      ! system_rtc_mem_read( slot + 1, data, size ))
+    return false;
+  return check == rtcCheck( data, size );
+}
+
+// Write a slot
+
+bool rtcSave( uint8_t slot, const void * data, uint16_t size )
+{
+  uint32_t check = rtcCheck( data, size );
+  return system_rtc_mem_write( slot + 1, data, size ) &&
+         system_rtc_mem_write( slot, & check, sizeof( check ));
+}
+
+// Make a slot not valid
+
+void rtcClear( uint8_t slot )
+{
+  uint32_t check = 0;
+  system_rtc_mem_write( slot, & check, sizeof( check ));
+}
@@ -0,0 +1,48 @@
+/*
+ * Slots of the RTC user memory, kept across deep sleep
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The RTC user memory of the ESP8266 is 512 bytes, addressed in blocks of
+//   4 bytes numbered from 64 to 191. Blocks 64 to 95 are left to the eboot
+//   command written by OTA updates.
+//
+// Each slot starts with a check word, so that a slot never written since
+//   power up (random content) is not mistaken for a valid one.
+//   The size of a slot is given in blocks, check word included.
+
+#ifndef RTC_MEM_H
+#define RTC_MEM_H
+
+#include "Arduino.h"
+
+#define RTC_SLOT_FREE     96   // free space of the card (SdList), 5 blocks
+#define RTC_SLOT_LOG     101   // append cursor of LogFile, 8 blocks
+#define RTC_SLOT_SENSORS 109   // ROM codes of the probes (SensorBus), 10 blocks
+#define RTC_SLOT_TELEM   119   // queue of samples to publish (Telemetry), 21 blocks
+#define RTC_SLOT_ROLLUP  140   // running aggregates (Rollup), 19 blocks
+#define RTC_SLOT_ROLLMIN 159   // append cursor of the minute file (Rollup), 8 blocks
+#define RTC_SLOT_PLACES  167   // places of files of the root (SdList), 8 blocks
+#define RTC_SLOT_RING    175   // sequences of the ring log (RingLog), 9 blocks
+#define RTC_SLOT_PACER   184   // last sample and interval (SamplePacer), 5 blocks
+#define RTC_SLOT_JOURNAL 189   // sequence number of the next line (LogFile), 2 blocks
+
+#define RTC_SLOT_END     192   // first block after the user memory
+
+bool rtcLoad( uint8_t slot, void * data, uint16_t size );
+bool rtcSave( uint8_t slot, const void * data, uint16_t size );
+void rtcClear( uint8_t slot );
+
+#endif // RTC_MEM_H
@@ -0,0 +1,49 @@
+#include "SamplePacer.h"
+#include "RtcMem.h"
+
+// Get the last sample left in RTC memory by the previous wake
+
+void SamplePacer::begin()
+{
+  if( ! rtcLoad( RTC_SLOT_PACER, & st, sizeof( st )))
+  {
+    memset( & st, 0, sizeof( st ));
+    st.interval = PACER_MIN_SECONDS;
+  }
+}
+
+// Take a sample into account, and set the sleep that follows it
+//
+// parameters:
+//   time : of the sample, in seconds since 2000
+//
+// return:
+//    seconds since the previous sample, 0 if it is not known
+
+uint32_t SamplePacer::update( uint32_t time, float heightCm, float tempC )
+{
+  uint32_t elapsed = st.time != 0 && time > st.time ? time - st.time : 0;
+  float next = PACER_MAX_SECONDS;
+
+  if( elapsed == 0 )
+    next = PACER_MIN_SECONDS;         // no rate yet: start fast
+  else
+  {
+    // seconds to change by a step, at the rate since the previous sample
+    float dh = fabs( heightCm - st.height );
+    float dt = fabs( tempC - st.temp );
+    if( dh > 0 && PACER_HEIGHT_STEP * elapsed / dh < next )
+      next = PACER_HEIGHT_STEP * elapsed / dh;
+    if( tempC > PACER_NO_TEMP && st.temp > PACER_NO_TEMP &&
+        dt > 0 && PACER_TEMP_STEP * elapsed / dt < next )
+      next = PACER_TEMP_STEP * elapsed / dt;
+    if( next > (float) st.interval * PACER_GROWTH )
+      next = (float) st.interval * PACER_GROWTH;
+  }
+  st.interval = constrain( (uint32_t) next, PACER_MIN_SECONDS, PACER_MAX_SECONDS );
+  st.time = time;
+  st.height = heightCm;
+  st.temp = tempC;
+  rtcSave( RTC_SLOT_PACER, & st, sizeof( st ));
+  return elapsed;
+}
@@ -0,0 +1,76 @@
+/*
+ * Interval between two samples, from the rate of change of the water
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                        ADAPTIVE SAMPLING INTERVAL                          **
+ **                                                                            **
+ *******************************************************************************/
+
+// The deep sleep after a sample lasts for the time the water takes to
+//   change by PACER_HEIGHT_STEP cm, or by PACER_TEMP_STEP C, at the rate
+//   seen since the previous sample: calm water is sampled seldom, a fast
+//   rise as often as PACER_MIN_SECONDS allows. The interval can drop at
+//   once, but grows by PACER_GROWTH at most from one sample to the next,
+//   so that the start of an event is not slept over.
+//
+// The last sample and the interval are kept in RTC memory. update() gives
+//   the seconds since the previous sample, written in the log with each
+//   line.
+//
+// The limits and steps can be set when building. A fixed interval is
+//   PACER_MIN_SECONDS = PACER_MAX_SECONDS.
+
+#ifndef SAMPLE_PACER_H
+#define SAMPLE_PACER_H
+
+#include "Arduino.h"
+
+#ifndef PACER_MIN_SECONDS
+#define PACER_MIN_SECONDS  10     // shortest sleep
+#endif
+#ifndef PACER_MAX_SECONDS
+#define PACER_MAX_SECONDS  120    // longest sleep
+#endif
+#ifndef PACER_HEIGHT_STEP
+#define PACER_HEIGHT_STEP  5.0    // cm of change between two samples
+#endif
+#ifndef PACER_TEMP_STEP
+#define PACER_TEMP_STEP    0.25   // C of change between two samples
+#endif
+#define PACER_GROWTH       2      // the interval at most doubles
+#define PACER_NO_TEMP      -100.0 // below: probe not read
+
+class SamplePacer
+{
+public:
+  void     begin();
+  uint32_t update( uint32_t time, float heightCm, float tempC );
+  uint32_t seconds() { return st.interval; }   // sleep after this sample
+
+private:
+  // Kept in RTC memory
+  struct State
+  {
+    uint32_t time;          // of the last sample, seconds since 2000. 0 if none
+    float    height;        //   its values
+    float    temp;
+    uint32_t interval;      // seconds to the next sample
+  } st;
+};
+
+#endif // SAMPLE_PACER_H
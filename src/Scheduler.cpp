@@ -0,0 +1,73 @@
+#include "Scheduler.h"
+
+Scheduler::Scheduler()
+{
+  nbTasks = 0;
+}
+
+// Add a task
+//
+// parameters:
+//   func : function of the task
+//   period : ms between two runs, 0 to run whenever nothing else is due
+//   priority : 0 is the most urgent
+//   delay : ms before the first run
+//
+// return:
+//    identifier of the task, -1 if the table is full
+
+int8_t Scheduler::add( SchedTask func, uint32_t period, uint8_t priority, uint32_t delay )
+{
+  if( nbTasks >= SCHED_MAX_TASKS )
+    return -1;
+  Task * t = & tasks[ nbTasks ];
+  t->func = func;
+  t->period = period;
+  t->priority = priority;
+  t->due = millis() + delay;
+  t->maxLate = 0;
+  return nbTasks ++;
+}
+
+void Scheduler::setPeriod( int8_t id, uint32_t period )
+{
+  if( id >= 0 && id < nbTasks )
+    tasks[ id ].period = period;
+}
+
+// Run the most urgent task that is due, if any
+
+void Scheduler::run()
+{
+  uint32_t now = millis();
+  Task * best = NULL;
+  uint32_t bestLate = 0;
+
+  for( uint8_t i = 0; i < nbTasks; i ++ )
+  {
+    Task * t = & tasks[ i ];
+    int32_t late = (int32_t) ( now - t->due );
+    if( late < 0 )
+      continue;
+    if( best == NULL || t->priority < best->priority ||
+        ( t->priority == best->priority && (uint32_t) late > bestLate ))
+    {
+      best = t;
+      bestLate = late;
+    }
+  }
+  if( best == NULL )
+  {
+    yield();
+    return;
+  }
+
+  if( bestLate > best->maxLate && best->period > 0 )
+    best->maxLate = bestLate;
+  best->func();
+  if( bestLate >= best->period )
+    best->due = millis() + best->period;    // too late: drop the missed runs
+  else
+    best->due += best->period;
+  yield();
+}
@@ -0,0 +1,67 @@
+/*
+ * Cooperative task scheduler for the datalogger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                   COOPERATIVE TASK SCHEDULER FOR DATALOGGER                **
+ **                                                                            **
+ *******************************************************************************/
+
+// Tasks are functions that do a short piece of work and return. Each has a
+//   period in milliseconds and a priority (0 is the most urgent).
+//
+// run() calls one task: among those that are due, the one with the lowest
+//   priority number, then the one that waited longest. A task of period 0
+//   is always due, so it only runs when no more urgent task is due: give it
+//   the highest priority number.
+//
+// A task that runs late keeps its cadence (the next time is counted from
+//   the time it was due), unless it is more than a period behind: missed
+//   runs are dropped, not caught up in a burst.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Arduino.h"
+
+#define SCHED_MAX_TASKS 6
+
+typedef void (*SchedTask)();
+
+class Scheduler
+{
+public:
+  Scheduler();
+
+  int8_t   add( SchedTask func, uint32_t period, uint8_t priority, uint32_t delay = 0 );
+  void     setPeriod( int8_t id, uint32_t period );
+  void     run();
+  uint32_t maxLate( int8_t id ) { return id >= 0 && id < nbTasks ? tasks[ id ].maxLate : 0; }
+
+private:
+  struct Task
+  {
+    SchedTask func;
+    uint32_t period;      // ms between two runs
+    uint32_t due;         // millis() of the next run
+    uint32_t maxLate;     // longest wait past the due time, in ms
+    uint8_t  priority;    // 0 is the most urgent
+  } tasks[ SCHED_MAX_TASKS ];
+  uint8_t nbTasks;
+};
+
+#endif // SCHEDULER_H
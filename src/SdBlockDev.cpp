@@ -0,0 +1,195 @@
+#include "SdBlockDev.h"
+
+IoCount SdBlockDev::ios[ IO_OPS ];
+SdVolume * SdBlockDev::pVol = NULL;
+uint8_t SdBlockDev::curOp = IO_OP_OTHER;
+uint8_t SdBlockDev::hint = IO_AUTO;
+
+// Set the volume whose regions are counted
+
+void SdBlockDev::begin( SdVolume * pVolume )
+{
+  pVol = pVolume;
+}
+
+#ifdef ARDUINO
+
+// Wrappers of the driver of the card, in place of Sd2Card::readBlock() and
+//   writeBlock() if the linker wraps them (see SdBlockDev.h). Both forms of
+//   uint32_t in the mangled names: only those the library has are wrapped,
+//   the others are weak and never called
+
+static bool driverWrapped = false;    // a wrapper was called: it counts all blocks
+
+extern "C"
+{
+uint8_t __real__ZN7Sd2Card9readBlockEjPh( Sd2Card * card, uint32_t block, uint8_t * dst ) __attribute__(( weak ));
+uint8_t __real__ZN7Sd2Card9readBlockEmPh( Sd2Card * card, uint32_t block, uint8_t * dst ) __attribute__(( weak ));
+uint8_t __real__ZN7Sd2Card10writeBlockEjPKh( Sd2Card * card, uint32_t block, const uint8_t * src ) __attribute__(( weak ));
+uint8_t __real__ZN7Sd2Card10writeBlockEmPKh( Sd2Card * card, uint32_t block, const uint8_t * src ) __attribute__(( weak ));
+
+static uint8_t wrappedRead( uint8_t ( * real )( Sd2Card *, uint32_t, uint8_t * ),
+                            Sd2Card * card, uint32_t block, uint8_t * dst )
+{
+  uint32_t t0 = micros();
+  uint8_t ok = real( card, block, dst );
+  driverWrapped = true;
+  SdBlockDev::count( block, false, micros() - t0 );
+  return ok;
+}
+
+static uint8_t wrappedWrite( uint8_t ( * real )( Sd2Card *, uint32_t, const uint8_t * ),
+                             Sd2Card * card, uint32_t block, const uint8_t * src )
+{
+  uint32_t t0 = micros();
+  uint8_t ok = real( card, block, src );
+  driverWrapped = true;
+  SdBlockDev::count( block, true, micros() - t0 );
+  return ok;
+}
+
+uint8_t __wrap__ZN7Sd2Card9readBlockEjPh( Sd2Card * card, uint32_t block, uint8_t * dst )
+{
+  return wrappedRead( __real__ZN7Sd2Card9readBlockEjPh, card, block, dst );
+}
+
+uint8_t __wrap__ZN7Sd2Card9readBlockEmPh( Sd2Card * card, uint32_t block, uint8_t * dst )
+{
+  return wrappedRead( __real__ZN7Sd2Card9readBlockEmPh, card, block, dst );
+}
+
+uint8_t __wrap__ZN7Sd2Card10writeBlockEjPKh( Sd2Card * card, uint32_t block, const uint8_t * src )
+{
+  return wrappedWrite( __real__ZN7Sd2Card10writeBlockEjPKh, card, block, src );
+}
+
+uint8_t __wrap__ZN7Sd2Card10writeBlockEmPKh( Sd2Card * card, uint32_t block, const uint8_t * src )
+{
+  return wrappedWrite( __real__ZN7Sd2Card10writeBlockEmPKh, card, block, src );
+}
+}
+
+#endif // ARDUINO
+
+// Read a block of the card. The driver counts it if it is wrapped, else
+//   it is counted here
+//
+// parameters:
+//   region : IO_DIR for a block of a directory that is not the root of
+//            a FAT16 volume, else IO_AUTO
+
+bool SdBlockDev::read( uint32_t block, uint8_t * dst, uint8_t region )
+{
+  hint = region;
+#ifdef ARDUINO
+  uint32_t t0 = micros();
+  bool ok = SdVolume::sdCard()->readBlock( block, dst );
+  if( ! driverWrapped )
+    count( block, false, micros() - t0 );
+#else
+  bool ok = SdVolume::sdCard()->readBlock( block, dst );   // the card counts
+#endif
+  hint = IO_AUTO;
+  return ok;
+}
+
+// Write a block of the card, see read()
+
+bool SdBlockDev::write( uint32_t block, const uint8_t * src, uint8_t region )
+{
+  hint = region;
+#ifdef ARDUINO
+  uint32_t t0 = micros();
+  bool ok = SdVolume::sdCard()->writeBlock( block, src );
+  if( ! driverWrapped )
+    count( block, true, micros() - t0 );
+#else
+  bool ok = SdVolume::sdCard()->writeBlock( block, src );   // the card counts
+#endif
+  hint = IO_AUTO;
+  return ok;
+}
+
+// Count a block read or written, for the operation under way
+
+void SdBlockDev::count( uint32_t block, bool isWrite, uint32_t us )
+{
+  IoCount * c = & ios[ curOp ];
+  uint8_t region = hint != IO_AUTO ? hint : regionOf( block );
+
+  if( isWrite )
+    c->writes[ region ] ++;
+  else
+    c->reads[ region ] ++;
+  c->micros += us;
+}
+
+// Start an operation. One started inside an operation of the same kind
+//   is a part of it, and is not counted again
+//
+// return:
+//    the operation that was under way, for leave()
+
+uint8_t SdBlockDev::enter( uint8_t op )
+{
+  uint8_t prev = curOp;
+  curOp = op < IO_OPS ? op : IO_OP_OTHER;
+  if( curOp != prev )
+    ios[ curOp ].ops ++;
+  return prev;
+}
+
+void SdBlockDev::reset()
+{
+  memset( ios, 0, sizeof( ios ));
+}
+
+uint8_t SdBlockDev::regionOf( uint32_t block )
+{
+  if( pVol == NULL )
+    return IO_DATA;
+  if( block < pVol->fatStartBlock() || pVol->fatStartBlock() == 0 )
+    return IO_BOOT;                   // the volume is being mounted
+  if( block < pVol->fatStartBlock() + pVol->fatCount() * pVol->blocksPerFat())
+    return IO_FAT;
+  if( block < pVol->dataStartBlock())
+    return IO_DIR;                    // root directory of FAT16
+  return IO_DATA;
+}
+
+// Print the counts, one line for each operation seen
+//
+// parameters:
+//   prefix  : start of each line, as "211-" for an FTP reply
+//   pCounts : IO_OPS counts to print, NULL for those of SdBlockDev
+
+void SdBlockDev::print( Print & out, const char * prefix, const IoCount * pCounts )
+{
+  static const char * const names[ IO_OPS ] =
+    { "other", "mount", "log", "cwd", "list", "retr", "stor", "file" };
+  static const char * const regions[ IO_REGIONS ] = { "boot", "FAT", "dir", "data" };
+
+  for( uint8_t i = 0; i < IO_OPS; i ++ )
+  {
+    const IoCount * c = & ( pCounts != NULL ? pCounts : ios )[ i ];
+    uint32_t blocks = 0;
+    for( uint8_t r = 0; r < IO_REGIONS; r ++ )
+      blocks += c->reads[ r ] + c->writes[ r ];
+    if( c->ops == 0 && blocks == 0 )
+      continue;
+    out.print( prefix ); out.print( names[ i ] );
+    out.print( ": " ); out.print( c->ops ); out.print( " ops" );
+    for( uint8_t r = 0; r < IO_REGIONS; r ++ )
+      if( c->reads[ r ] + c->writes[ r ] > 0 )
+      {
+        out.print( ", " ); out.print( regions[ r ] ); out.print( " " );
+        out.print( c->reads[ r ] ); out.print( "/" ); out.print( c->writes[ r ] );
+      }
+    out.print( ", " ); out.print( c->micros / 1000 ); out.print( " ms" );
+    if( c->ops > 0 )
+    {
+      out.print( ", " ); out.print( (float) blocks / c->ops, 1 ); out.print( " blocks/op" );
+    }
+    out.print( "\r\n" );
+  }
+}
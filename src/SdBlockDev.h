@@ -0,0 +1,124 @@
+/*
+ * Block I/O of the card, counted by operation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                          BLOCK I/O ACCOUNTING                              **
+ **                                                                            **
+ *******************************************************************************/
+
+// Each block read or written on the card is counted against the logical
+//   operation under way (a CWD, a LIST, a chunk of RETR or STOR, a line
+//   appended to the log...) and the region of the volume it falls in: FAT,
+//   directory or data. The time spent in the card is added up too. SITE IO
+//   prints the counts: blocks per operation is the cost of each one, and
+//   the writes per byte stored tell the wear of the card.
+//
+// An operation is the scope of an IoScope object. Scopes nest: the I/O
+//   goes to the innermost one, and a scope inside one of the same kind (a
+//   checkpoint of the log while a line is appended) is not counted again.
+//
+// The blocks read and written by SdList, LogFile and DirIndex go through
+//   read() and write(). The Arduino SD library calls its card directly:
+//   its own blocks (SdFile reads and writes, FAT updates) are counted by
+//   wrappers of Sd2Card::readBlock() and writeBlock(), that the linker puts
+//   in place of the driver's when asked to. Add to platform.local.txt, next
+//   to the platform.txt of the ESP8266 core:
+//
+//     compiler.c.elf.extra_flags=-Wl,--wrap=_ZN7Sd2Card9readBlockEjPh
+//       -Wl,--wrap=_ZN7Sd2Card9readBlockEmPh -Wl,--wrap=_ZN7Sd2Card10writeBlockEjPKh
+//       -Wl,--wrap=_ZN7Sd2Card10writeBlockEmPKh
+//
+//   (on one line; the block number is an unsigned int or unsigned long,
+//   depending on the toolchain: the name that doesn't exist is not
+//   wrapped). Without it the blocks of the library are not seen on the
+//   board. On a host build (ARDUINO not defined) the card calls count() for
+//   every block, so all of them are counted.
+//
+// Blocks of the root directory of FAT16 are found by their number, the
+//   blocks of other directories only when the caller says so: the library
+//   reads them as data.
+
+#ifndef SD_BLOCK_DEV_H
+#define SD_BLOCK_DEV_H
+
+#include "Arduino.h"
+#include "utility/SdFat.h"
+
+// Regions of the volume
+#define IO_BOOT     0         // boot sector and reserved blocks
+#define IO_FAT      1
+#define IO_DIR      2
+#define IO_DATA     3
+#define IO_REGIONS  4
+#define IO_AUTO     0xFF      // region found from the number of the block
+
+// Operations
+#define IO_OP_OTHER 0         // FTP commands not listed below
+#define IO_OP_MOUNT 1         // SdList::begin(), scan of the FAT
+#define IO_OP_LOG   2         // log: open, append, checkpoint. Rollups, telemetry spill
+#define IO_OP_CWD   3         // CWD, CDUP
+#define IO_OP_LIST  4         // LIST, NLST, MLSD, MLST
+#define IO_OP_RETR  5         // RETR, and each chunk sent (also SITE TAR, HTTP GET)
+#define IO_OP_STOR  6         // STOR, and each chunk received
+#define IO_OP_FILE  7         // DELE, RNFR, RNTO, MKD, RMD, SIZE, MDTM, HASH
+#define IO_OPS      8
+
+struct IoCount
+{
+  uint32_t ops;                       // operations counted
+  uint32_t reads[ IO_REGIONS ];       // blocks
+  uint32_t writes[ IO_REGIONS ];
+  uint32_t micros;                    // time spent in the card
+};
+
+class SdBlockDev
+{
+public:
+  static void    begin( SdVolume * pVolume );
+  static bool    read( uint32_t block, uint8_t * dst, uint8_t region = IO_AUTO );
+  static bool    write( uint32_t block, const uint8_t * src, uint8_t region = IO_AUTO );
+  static void    count( uint32_t block, bool isWrite, uint32_t us );
+
+  static uint8_t enter( uint8_t op );
+  static void    leave( uint8_t op ) { curOp = op; }
+  static void    reset();
+  static void    print( Print & out, const char * prefix, const IoCount * pCounts = NULL );
+  static const IoCount * counts() { return ios; }
+
+private:
+  static uint8_t regionOf( uint32_t block );
+
+  static IoCount  ios[ IO_OPS ];
+  static SdVolume * pVol;
+  static uint8_t  curOp;              // operation under way
+  static uint8_t  hint;               // region given to read() or write()
+};
+
+// I/O made during the life of the object is counted for op
+
+class IoScope
+{
+public:
+  IoScope( uint8_t op ) { prev = SdBlockDev::enter( op ); }
+  ~IoScope() { SdBlockDev::leave( prev ); }
+
+private:
+  uint8_t prev;
+};
+
+#endif // SD_BLOCK_DEV_H
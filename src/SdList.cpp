@@ -2,12 +2,107 @@
 #include "utility/SdFat.h"
 #include "utility/SdFatUtil.h"
 #include "SD.h"
+#include "RtcMem.h"
+#include "SdBlockDev.h"
+
+// Free space of the volume, kept in RTC memory across deep sleep
+struct FreeSlot
+{
+  uint32_t clusterCount;      // identify the volume
+  uint32_t fatStartBlock;
+  uint32_t freeClusters;
+  uint32_t generation;
+};
+
+// Places in the root directory of the files last opened with openRootFile(),
+//   kept in RTC memory so that a wake opens them without reading the directory
+#define ROOT_PLACES 4
+
+struct PlaceSlot
+{
+  uint32_t hash[ ROOT_PLACES ];    // hash of the name, 0 if unused
+  uint16_t index[ ROOT_PLACES ];   // index of the entry in the root directory
+  uint16_t next;                   // place to replace
+  uint16_t reserved;
+};
+
+// hash of a short name, case insensitive (FNV-1a)
+
+static uint32_t nameHash( const char * name )
+{
+	uint32_t h = 2166136261UL;
+	while( * name )
+	{
+		h = ( h ^ (uint8_t) toupper( * name ++ )) * 16777619UL;
+	}
+	return h == 0 ? 1 : h;
+}
+
+// name of a directory entry from a short name: 11 chars, upper case,
+//   padded with spaces
+//
+// return:
+//    false if the name is not a valid 8.3 name
+
+static bool entryName83( const char * str, uint8_t * name )
+{
+	uint8_t c, i = 0, last = 7;
+
+	memset( name, ' ', 11 );
+	while(( c = * str ++ ) != 0 )
+	{
+		if( c == '.' )
+		{
+			if( last == 10 )
+				return false;                                      // a single dot
+			last = 10;
+			i = 8;
+		}
+		else if( i > last || c <= ' ' || c > '~' || strchr( "|<>^+=?/[];,*\"\\", c ) != NULL )
+		{
+			return false;
+		}
+		else
+		{
+			name[ i ++ ] = toupper( c );
+		}
+	}
+	return name[ 0 ] != ' ';
+}
 
   //Sd2Card card;
  // SdVolume volume;
   //SdFile root;
 SdList::SdList()
 {
+	freeClust = 0;
+	gen = 0;
+}
+
+// mount the card and get its free space
+//
+// The free space counted at a previous wake is taken from the RTC memory,
+//   else the FAT is scanned once.
+
+bool SdList::begin( uint8_t csPin )
+{
+	FreeSlot fs;
+	IoScope io( IO_OP_MOUNT );
+
+	SdBlockDev::begin( & volume );
+	if( ! SDClass::begin( csPin ))
+	{
+		return false;
+	}
+	if( rtcLoad( RTC_SLOT_FREE, & fs, sizeof( fs )) &&
+	    fs.clusterCount == volume.clusterCount() &&
+	    fs.fatStartBlock == volume.fatStartBlock() )
+	{
+		freeClust = fs.freeClusters;
+		gen = fs.generation;
+		return true;
+	}
+	return scanFree();
 }
 
 bool SdList::chdir()
@@ -42,21 +137,605 @@ fail:
 
 bool SdList::openFile( SdFile * pFile, const char* name, uint8_t oflag )
 {
-	return pFile->open(root, name, oflag );                // file opened by its short name
+	return openIn( & root, pFile, name, oflag );            // file opened by its short name
 }
+
+// open a file of a directory, adding it to the index of the directory
+//   if it is created
 //
-//// return the capacity in Megabytes of the SD card
+// A file truncated gives back all its clusters, its extent if it was
+//   preallocated.
+
+bool SdList::openIn( SdFile * pDir, SdFile * pFile, const char* name, uint8_t oflag )
+{
+	if( ( oflag & ( O_TRUNC | O_EXCL )) == O_TRUNC &&
+	    pFile->open( pDir, name, oflag & ~ ( O_CREAT | O_TRUNC )))
+	{
+		int32_t clusters = fileClusters( pFile );
+		if( ! pFile->truncate( 0 ))
+		{
+			pFile->close();
+			return false;
+		}
+		allocated( - clusters );
+		return true;
+	}
+	if( ( oflag & ( O_CREAT | O_EXCL )) == O_CREAT &&
+	    pFile->open( pDir, name, oflag & ~ O_CREAT ))
+	{
+		return true;                                          // already there
+	}
+	if( ! pFile->open( pDir, name, oflag ))
+	{
+		return false;
+	}
+	if( oflag & O_CREAT )
+	{
+		DirIndex::insert( pDir, pFile );
+	}
+	return true;
+}
+
+// create a file of the root directory as a single extent of contiguous blocks
+
+bool SdList::createContiguous( SdFile * pFile, const char* name, uint32_t size )
+{
+	SdFile dir;
+	if( !dir.openRoot(volume) )
+	{
+		return false;
+	}
+	if( !pFile->createContiguous( & dir, name, size ) )
+	{
+		return false;
+	}
+	sizeChanged( 0, size );
+	DirIndex::insert( & dir, pFile );
+	return true;
+}
+
+// read the next entry of the current directory
+//
+// Facts are taken from the directory entry itself: the file is not opened.
+//
+// parameters:
+//   name  : where to store the 8.3 name of the entry (13 chars)
+//   pIsF  : true if the entry is a file, false if it is a directory
+//   pSize : size of the file
+//   pDate, pTime : date and time of last modification, in FAT format
+//
+// return:
+//    false at the end of the directory
+
+bool SdList::nextFile( char * name, bool * pIsF, uint32_t * pSize,
+                       uint16_t * pDate, uint16_t * pTime )
+{
+	return nextFile( & root, name, pIsF, pSize, pDate, pTime );
+}
+
+bool SdList::nextFile( SdFile * pDir, char * name, bool * pIsF, uint32_t * pSize,
+                       uint16_t * pDate, uint16_t * pTime )
+{
+	dir_t d;
+
+	if( pDir->readDir( & d ) <= 0 )
+	{
+		return false;
+	}
+	SdFile::dirName( d, name );
+	if( pIsF != NULL )
+		* pIsF = DIR_IS_FILE( & d );
+	if( pSize != NULL )
+		* pSize = d.fileSize;
+	if( pDate != NULL )
+		* pDate = d.lastWriteDate;
+	if( pTime != NULL )
+		* pTime = d.lastWriteTime;
+	return true;
+}
+
+// read the facts of an entry of the current directory
+
+bool SdList::fileInfo( const char * name, bool * pIsF, uint32_t * pSize,
+                       uint16_t * pDate, uint16_t * pTime )
+{
+	SdFile f;
+	dir_t d;
+
+	if( ! f.open(root, name, O_READ) )
+	{
+		return false;
+	}
+	bool ok = f.dirEntry( & d );
+	f.close();
+	if( ! ok )
+	{
+		return false;
+	}
+	if( pIsF != NULL )
+		* pIsF = DIR_IS_FILE( & d );
+	if( pSize != NULL )
+		* pSize = d.fileSize;
+	if( pDate != NULL )
+		* pDate = d.lastWriteDate;
+	if( pTime != NULL )
+		* pTime = d.lastWriteTime;
+	return true;
+}
+
+// open a file of the root directory of the volume, whatever the current directory
+
+// open a file of the root directory
 //
-//float SdList::capacity()
-//{
-//  Sd2Card * p_card = sd.card();
-//  return 0.000512 * p_card->cardSize();
-//}
+// An existing file is opened at the place it had the last time, if the
+//   entry found there still has its name. Else the directory is read, and
+//   the place of the file is kept for the next call (even across deep sleep).
+//   A file created is kept at the next call that finds it.
+
+bool SdList::openRootFile( SdFile * pFile, const char* name, uint8_t oflag )
+{
+	SdFile dir;
+	PlaceSlot ps;
+	uint32_t h = nameHash( name );
+	uint32_t pos;
+	int8_t i;
+
+	if( !dir.openRoot(volume) )
+	{
+		return false;
+	}
+	if( oflag & O_EXCL )
+	{
+		return openIn( & dir, pFile, name, oflag );
+	}
+	if( ! rtcLoad( RTC_SLOT_PLACES, & ps, sizeof( ps )))
+	{
+		memset( & ps, 0, sizeof( ps ));
+	}
+	for( i = ROOT_PLACES - 1; i >= 0 && ps.hash[ i ] != h; i -- )
+		;
+	if( i >= 0 && openAt( & dir, pFile, ps.index[ i ], name, oflag ))
+	{
+		return true;
+	}
+	if( ! pFile->open( & dir, name, oflag & ~ O_CREAT ))
+	{
+		if( ! ( oflag & O_CREAT ) || ! pFile->open( & dir, name, oflag ))
+		{
+			return false;
+		}
+		DirIndex::insert( & dir, pFile );
+		return true;
+	}
+	// the directory is left just after the entry found
+	pos = dir.curPosition() >> 5;
+	if( pos > 0 && (( pos - 1 ) & 0x0F ) == pFile->dirIndex() )
+	{
+		if( i < 0 )
+		{
+			i = ps.next;
+			ps.next = ( ps.next + 1 ) % ROOT_PLACES;
+		}
+		ps.hash[ i ] = h;
+		ps.index[ i ] = pos - 1;
+		rtcSave( RTC_SLOT_PLACES, & ps, sizeof( ps ));
+	}
+	return true;
+}
+
+// open a file of the root directory for reading, from a handle of its own
+
+bool SdList::readRootFile( SdFile * pFile, const char* name )
+{
+	SdFile dir;
+
+	if( !dir.openRoot(volume) )
+	{
+		return false;
+	}
+	return pFile->open( & dir, name, O_READ );
+}
+
+// open the entry at a given index of a directory, if it has the name expected
 //
-//// return the amount of free space in Megabytes in the SD card
+// The file is truncated only once its name is checked.
+
+bool SdList::openAt( SdFile * pDir, SdFile * pFile, uint16_t index, const char* name,
+                     uint8_t oflag )
+{
+	dir_t d;
+	char entryName[ 13 ];
+
+	if( ! pFile->open( pDir, index, oflag & ~ ( O_CREAT | O_TRUNC )))
+	{
+		return false;
+	}
+	if( ! pFile->isFile() || ! pFile->dirEntry( & d ))
+	{
+		pFile->close();
+		return false;
+	}
+	SdFile::dirName( d, entryName );
+	if( strcasecmp( entryName, name ) != 0 )
+	{
+		pFile->close();
+		return false;
+	}
+	if( oflag & O_TRUNC )
+	{
+		int32_t clusters = fileClusters( pFile );
+		if( ! pFile->truncate( 0 ))
+		{
+			pFile->close();
+			return false;
+		}
+		allocated( - clusters );
+	}
+	return true;
+}
+// remove a file and give back its clusters
 //
-//float SdList::free()
-//{
-//  SdVolume * p_vol = sd.vol();
-//  return 0.000512 * p_vol->freeClusterCount() * p_vol->blocksPerCluster();
-//}
+// A preallocated file holds more clusters than its size: they are counted
+//   from its extent.
+
+bool SdList::remove( const char* name )
+{
+	SdFile f;
+	int32_t clusters;
+	dir_t d;
+	char entryName[ 13 ];
+
+	if( ! f.open(root, name, O_READ) )
+	{
+		return false;
+	}
+	if( ! f.isFile() || ! f.dirEntry( & d ))
+	{
+		f.close();
+		return false;
+	}
+	SdFile::dirName( d, entryName );
+	clusters = fileClusters( & f );
+	f.close();
+	if( ! SDClass::remove( name ))
+	{
+		return false;
+	}
+	allocated( - clusters );
+	DirIndex::remove( & root, entryName );
+	return true;
+}
+
+// make a directory, that takes one cluster
+
+bool SdList::mkdir( const char* name )
+{
+	SdFile d;
+
+	if( ! SDClass::mkdir( name ))
+	{
+		return false;
+	}
+	allocated( 1 );
+	if( d.open( & root, name, O_READ ))
+	{
+		DirIndex::insert( & root, & d );
+		d.close();
+	}
+	return true;
+}
+
+// remove an empty directory, that gives back one cluster
+//
+// The index of the directory is removed first, as it would keep the
+//   directory from being empty.
+
+bool SdList::rmdir( const char* name )
+{
+	SdFile d;
+	dir_t e;
+	char entryName[ 13 ];
+
+	if( ! d.open( & root, name, O_READ ) )
+	{
+		return false;
+	}
+	if( ! d.isDir() || ! d.dirEntry( & e ))
+	{
+		d.close();
+		return false;
+	}
+	SdFile::dirName( e, entryName );
+	DirIndex::erase( & d );
+	d.close();
+	if( ! SDClass::rmdir( name ))
+	{
+		return false;
+	}
+	allocated( -1 );
+	DirIndex::remove( & root, entryName );
+	return true;
+}
+
+// rename an entry, or move a file from another directory to the current one
+//
+// Only directory entries are written, the data is not copied. A rename in
+//   the same directory is a single write of the block of the entry: files
+//   open on it, as a RETR in progress, go on. A file moved gets a new entry,
+//   with the facts of the old one, before the old one is removed: a power
+//   cut in between leaves two names for the data, never none. Directories
+//   are not moved, as their ".." entry would be wrong.
+//
+// parameters:
+//   pFromDir : directory of the entry, NULL for the current directory
+//   from : name of the entry
+//   to : new name, in the current directory (pToDir for moveEntry())
+//
+// return:
+//    false if from is not found, or to exists already
+
+bool SdList::rename( SdFile * pFromDir, const char* from, const char* to )
+{
+	return moveEntry( pFromDir != NULL ? pFromDir : & root, from, & root, to );
+}
+
+bool SdList::moveEntry( SdFile * pFromDir, const char* from, SdFile * pToDir, const char* to )
+{
+	SdFile f;
+	dir_t d;
+	uint8_t name[ 11 ];
+	char fromName[ 13 ];
+	uint32_t fromBlock;
+	uint8_t fromIndex;
+
+	bool sameDir = pFromDir->firstCluster() == pToDir->firstCluster();
+	if( ! entryName83( to, name ) || DirIndex::isIndexName( from ) || DirIndex::isIndexName( to ))
+	{
+		return false;
+	}
+	if( f.open( pToDir, to, O_READ ))
+	{
+		f.close();
+		return false;                                           // to exists already
+	}
+	if( ! f.open( pFromDir, from, O_READ ))
+	{
+		return false;
+	}
+	if( ! ( f.isFile() || ( f.isDir() && sameDir )) || ! f.dirEntry( & d ))
+	{
+		f.close();
+		return false;
+	}
+	SdFile::dirName( d, fromName );
+	fromBlock = f.dirBlock();
+	fromIndex = f.dirIndex();
+	f.close();
+
+	memcpy( d.name, name, 11 );
+	if( sameDir )
+	{
+		if( ! writeEntry( fromBlock, fromIndex, & d ))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// an empty file makes the new entry, that takes the facts of the old one
+		if( ! f.open( pToDir, to, O_CREAT | O_EXCL | O_WRITE ))
+		{
+			return false;
+		}
+		uint32_t toBlock = f.dirBlock();
+		uint8_t toIndex = f.dirIndex();
+		f.close();
+		if( ! writeEntry( toBlock, toIndex, & d ))
+		{
+			return false;
+		}
+		d.name[ 0 ] = DIR_NAME_DELETED;
+		if( ! writeEntry( fromBlock, fromIndex, & d ))
+		{
+			return false;
+		}
+	}
+	// the name is gone: places of it kept across deep sleep are checked again
+	gen ++;
+	allocated( 0 );
+	DirIndex::remove( pFromDir, fromName );
+	if( f.open( pToDir, to, O_READ ))
+	{
+		DirIndex::insert( pToDir, & f );
+		f.close();
+	}
+	return true;
+}
+
+// rename an entry of the root directory, whatever the current directory
+
+bool SdList::renameRoot( const char* from, const char* to )
+{
+	SdFile dir;
+
+	if( ! dir.openRoot( volume ))
+	{
+		return false;
+	}
+	return moveEntry( & dir, from, & dir, to );
+}
+
+// get ready to list the current directory in the order of the names
+//
+// The index of the directory is built if it has none and the directory has
+//   DIR_INDEX_MIN entries at least.
+//
+// return:
+//    false if the directory has no index: nextFile() lists it in the
+//    order of its entries
+
+bool SdList::listOpen( DirIndex * pList, const char * pattern, const char * after )
+{
+	if( pList->open( & root, pattern, after ))
+	{
+		return true;
+	}
+	if( DirIndex::worthBuilding( & root ) && DirIndex::build( & root ) &&
+	    pList->open( & root, pattern, after ))
+	{
+		return true;
+	}
+	root.rewind();
+	return false;
+}
+
+// write the size, and the time of last modification if date is not 0,
+//   in a directory entry
+//
+// Used for files written block by block, without SdFile.
+
+bool SdList::setFileSize( uint32_t dirBlock, uint8_t dirIndex, uint32_t size,
+                          uint16_t date, uint16_t time )
+{
+	uint8_t * blk = SdVolume::cacheClear();   // flush and borrow the cache of the volume
+	dir_t * d = ((dir_t *) blk) + dirIndex;
+
+	if( blk == NULL || dirIndex >= 512 / sizeof( dir_t ) || ! SdBlockDev::read( dirBlock, blk, IO_DIR ))
+	{
+		return false;
+	}
+	d->fileSize = size;
+	if( date != 0 )
+	{
+		d->lastWriteDate = date;
+		d->lastWriteTime = time;
+	}
+	return SdBlockDev::write( dirBlock, blk, IO_DIR );
+}
+
+// write a directory entry at its place
+//
+// The block is read and written back whole, through the cache of the
+//   volume: the change is made on the card by a single write.
+
+bool SdList::writeEntry( uint32_t dirBlock, uint8_t dirIndex, const dir_t * pEntry )
+{
+	uint8_t * blk = SdVolume::cacheClear();   // flush and borrow the cache of the volume
+
+	if( blk == NULL || dirIndex >= 512 / sizeof( dir_t ) || ! SdBlockDev::read( dirBlock, blk, IO_DIR ))
+	{
+		return false;
+	}
+	memcpy( ((dir_t *) blk) + dirIndex, pEntry, sizeof( dir_t ));
+	return SdBlockDev::write( dirBlock, blk, IO_DIR );
+}
+
+// return the capacity in Megabytes of the SD card
+
+float SdList::capacity()
+{
+	return 0.000512 * card.cardSize();
+}
+
+// return the amount of free space in Megabytes in the SD card
+
+float SdList::free()
+{
+	return 0.000512 * freeClust * volume.blocksPerCluster();
+}
+
+// return the amount of free space in kilobytes in the SD card
+
+uint32_t SdList::freeKB()
+{
+	return freeClust * volume.blocksPerCluster() / 2;
+}
+
+// count the free clusters of the volume by reading the whole FAT
+//
+// This is slow on big cards: it is done only when the RTC memory does not
+//   hold the count (power up, other card).
+
+bool SdList::scanFree()
+{
+	uint32_t n = 0;
+	uint32_t cluster = 0;                     // cluster of the first entry of a block
+	uint32_t last = volume.clusterCount() + 1;
+	uint8_t fat32 = volume.fatType() == 32;
+	uint16_t perBlock = fat32 ? 128 : 256;
+	uint8_t * blk = SdVolume::cacheClear();   // flush and borrow the cache of the volume
+
+	if( blk == NULL || volume.fatType() < 16 )
+	{
+		return false;
+	}
+	for( uint32_t b = 0; b < volume.blocksPerFat() && cluster <= last; b ++ )
+	{
+		if( ! SdBlockDev::read( volume.fatStartBlock() + b, blk ))
+		{
+			SdVolume::cacheClear();
+			return false;
+		}
+		for( uint16_t i = 0; i < perBlock; i ++, cluster ++ )
+		{
+			if( cluster < 2 || cluster > last )
+				continue;
+			if( fat32 ? ( ((uint32_t *) blk)[ i ] & 0x0FFFFFFF ) == 0 : ((uint16_t *) blk)[ i ] == 0 )
+				n ++;
+		}
+		if(( b & 63 ) == 0 )
+			yield();
+	}
+	SdVolume::cacheClear();                   // the cache holds a FAT block of ours
+	freeClust = n;
+	allocated( 0 );
+	return true;
+}
+
+// report a change of size of a file written without SdList
+
+void SdList::sizeChanged( uint32_t oldSize, uint32_t newSize )
+{
+	allocated( (int32_t) clustersOf( newSize ) - (int32_t) clustersOf( oldSize ));
+}
+
+// number of clusters taken by an open file: its extent if it is
+//   contiguous, as a preallocated file holds more clusters than its size
+
+int32_t SdList::fileClusters( SdFile * pFile )
+{
+	uint32_t bgn, end;
+
+	if( pFile->contiguousRange( & bgn, & end ) && end >= bgn )
+	{
+		return ( end - bgn + 1 ) / volume.blocksPerCluster();
+	}
+	return clustersOf( pFile->fileSize() );
+}
+
+// number of clusters taken by a file
+
+uint32_t SdList::clustersOf( uint32_t size )
+{
+	uint32_t clusterBytes = 512UL * volume.blocksPerCluster();
+	return ( size + clusterBytes - 1 ) / clusterBytes;
+}
+
+// update the count of free clusters and keep it in RTC memory
+
+void SdList::allocated( int32_t clusters )
+{
+	FreeSlot fs;
+
+	if( clusters > 0 && (uint32_t) clusters > freeClust )
+		freeClust = 0;
+	else
+		freeClust -= clusters;
+	if( clusters < 0 )
+		gen ++;
+	fs.clusterCount = volume.clusterCount();
+	fs.fatStartBlock = volume.fatStartBlock();
+	fs.freeClusters = freeClust;
+	fs.generation = gen;
+	rtcSave( RTC_SLOT_FREE, & fs, sizeof( fs ));
+}
@@ -2,23 +2,77 @@
 #define SD_LIST_H
 
 #include "SD.h"
+#include "DirIndex.h"
 
 class SdList : public SDClass
 {
 public:
   SdList();
 
+  bool begin( uint8_t csPin );
+
   bool tesset();
   bool chdir();
   bool chdir( const char* path );
 
-  bool rename(char const*, char const*);
+  // Rename an entry of the current directory, or move a file from another
+  //   directory to it, by a change of the directory entries only
+  bool rename( const char* from, const char* to ) { return rename( NULL, from, to ); }
+  bool rename( SdFile * pFromDir, const char* from, const char* to );
+  bool renameRoot( const char* from, const char* to );
 
-  bool nextFile( char * name, bool * pIsF = NULL, uint32_t * pSize = NULL );
+  bool nextFile( char * name, bool * pIsF = NULL, uint32_t * pSize = NULL,
+                 uint16_t * pDate = NULL, uint16_t * pTime = NULL );
+  bool nextFile( SdFile * pDir, char * name, bool * pIsF = NULL, uint32_t * pSize = NULL,
+                 uint16_t * pDate = NULL, uint16_t * pTime = NULL );
+  bool fileInfo( const char * name, bool * pIsF = NULL, uint32_t * pSize = NULL,
+                 uint16_t * pDate = NULL, uint16_t * pTime = NULL );
   bool openFile( SdFile * pFile, const char* name, uint8_t oflag );
+  bool openRootFile( SdFile * pFile, const char* name, uint8_t oflag );
+  // Open a file of the root directory for reading, leaving the current
+  //   directory and the places kept in RTC memory as they are
+  bool readRootFile( SdFile * pFile, const char* name );
+  bool createContiguous( SdFile * pFile, const char* name, uint32_t size );
+
+  bool remove( const char* name );
+  bool mkdir( const char* name );
+  bool rmdir( const char* name );
 
+  // Name-sorted listing of the current directory, see DirIndex.h. The index
+  //   is kept up to date by the functions above that create or remove entries
+  bool listOpen( DirIndex * pList, const char * pattern = NULL, const char * after = NULL );
+  bool reindex() { return DirIndex::build( & root ); }
+  // Handle of the current directory, that stays on it after a chdir()
+  bool openCwd( SdFile * pDir ) { * pDir = root; pDir->rewind(); return pDir->isOpen(); }
+
+  // Free space is counted once at mount, then updated by the changes of size
+  //   of the files made through SdList or reported with sizeChanged()
   float capacity();
   float free();
+  uint32_t freeKB();
+  uint32_t freeClusters() { return freeClust; }
+  bool scanFree();
+  void sizeChanged( uint32_t oldSize, uint32_t newSize );
+
+  // Incremented each time clusters are given back or an entry is removed
+  //   or renamed, so that positions on the card kept across deep sleep can
+  //   be checked
+  uint32_t generation() { return gen; }
+
+  bool setFileSize( uint32_t dirBlock, uint8_t dirIndex, uint32_t size,
+                    uint16_t date = 0, uint16_t time = 0 );
+
+private:
+  bool openIn( SdFile * pDir, SdFile * pFile, const char* name, uint8_t oflag );
+  bool openAt( SdFile * pDir, SdFile * pFile, uint16_t index, const char* name, uint8_t oflag );
+  bool moveEntry( SdFile * pFromDir, const char* from, SdFile * pToDir, const char* to );
+  bool writeEntry( uint32_t dirBlock, uint8_t dirIndex, const dir_t * pEntry );
+  uint32_t clustersOf( uint32_t size );
+  int32_t fileClusters( SdFile * pFile );
+  void allocated( int32_t clusters );
+
+  uint32_t freeClust;         // number of free clusters on the volume
+  uint32_t gen;               // see generation()
 };
 
 #endif // SD_LIST_H
@@ -0,0 +1,97 @@
+#include "SensorBus.h"
+#include "RtcMem.h"
+
+#define DS18B20_FAMILY 0x28
+
+SensorBus::SensorBus( OneWire * pOneWire ) : sensors( pOneWire )
+{
+  pWire = pOneWire;
+  probes.count = 0;
+}
+
+// Get the ROM codes of the probes, from RTC memory or by a search of the bus
+//
+// After a search, a first conversion is made and waited for.
+//
+// return:
+//    number of probes
+
+uint8_t SensorBus::begin()
+{
+  sensors.setWaitForConversion( false );
+  if( rtcLoad( RTC_SLOT_SENSORS, & probes, sizeof( probes )) &&
+      probes.count > 0 && probes.count <= SENSOR_MAX )
+    return probes.count;
+  if( search() > 0 )
+    convert();             // after power up the probes hold no result
+  return probes.count;
+}
+
+// Search the bus for DS18B20 probes, sorted by ROM code
+
+uint8_t SensorBus::search()
+{
+  uint8_t rom[ 8 ];
+
+  memset( & probes, 0, sizeof( probes ));
+  pWire->reset_search();
+  while( probes.count < SENSOR_MAX && pWire->search( rom ))
+  {
+    if( rom[ 0 ] != DS18B20_FAMILY || OneWire::crc8( rom, 7 ) != rom[ 7 ] )
+      continue;
+    // insert sorted
+    uint8_t i = probes.count;
+    while( i > 0 && memcmp( probes.rom[ i - 1 ], rom, 8 ) > 0 )
+    {
+      memcpy( probes.rom[ i ], probes.rom[ i - 1 ], 8 );
+      i --;
+    }
+    memcpy( probes.rom[ i ], rom, 8 );
+    probes.count ++;
+  }
+  if( probes.count > 0 )
+    rtcSave( RTC_SLOT_SENSORS, & probes, sizeof( probes ));
+  else
+    rtcClear( RTC_SLOT_SENSORS );
+  return probes.count;
+}
+
+// Start a conversion of all the probes at once, without waiting
+
+void SensorBus::start()
+{
+  sensors.requestTemperatures();
+}
+
+// Start a conversion of all the probes and wait for its end
+//
+// Needed after power up: the probes hold no result yet.
+
+void SensorBus::convert()
+{
+  start();
+  delay( sensors.millisToWaitForConversion( 12 ));
+}
+
+// Read the result of the last conversion of each probe
+//
+// parameters:
+//   temps : where to store count() temperatures, in Celsius.
+//           DEVICE_DISCONNECTED_C for a probe that does not answer
+//
+// return:
+//    number of probes read
+
+uint8_t SensorBus::read( float * temps )
+{
+  uint8_t n = 0;
+  for( uint8_t i = 0; i < probes.count; i ++ )
+  {
+    temps[ i ] = sensors.getTempC( probes.rom[ i ] );
+    if( temps[ i ] == DEVICE_DISCONNECTED_C )
+      rtcClear( RTC_SLOT_SENSORS );    // search again at next wake
+    else
+      n ++;
+  }
+  return n;
+}
@@ -0,0 +1,72 @@
+/*
+ * Bus of DS18B20 probes with ROM codes kept across deep sleep
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                       DS18B20 PROBES FOR DATALOGGER                        **
+ **                                                                            **
+ *******************************************************************************/
+
+// The probes of the bus are searched once, sorted by ROM code, and their
+//   codes are kept in RTC memory: later wakes do not search the bus again.
+//
+// A single conversion is started for all the probes (Skip ROM), then each
+//   probe is read by its ROM code (Match ROM). The probes keep their result
+//   while the ESP8266 sleeps, so the conversion can be started before deep
+//   sleep and read at the next wake, with no wait at all.
+//
+// If a probe does not answer, the bus is searched again at the next wake.
+//   The RTC memory does not hold results, so after power up begin() waits
+//   for a first conversion.
+
+#ifndef SENSOR_BUS_H
+#define SENSOR_BUS_H
+
+#include "Arduino.h"
+#include <OneWire.h>
+#include <DallasTemperature.h>
+
+#define SENSOR_MAX 4                // max number of probes on the bus
+
+class SensorBus
+{
+public:
+  SensorBus( OneWire * pOneWire );
+
+  uint8_t begin();
+  uint8_t count() { return probes.count; }
+  void    start();
+  void    convert();
+  uint8_t read( float * temps );
+  const uint8_t * address( uint8_t i ) { return probes.rom[ i ]; }
+
+private:
+  uint8_t search();
+
+  OneWire * pWire;
+  DallasTemperature sensors;
+
+  // Kept in RTC memory
+  struct Probes
+  {
+    uint8_t count;
+    uint8_t pad[ 3 ];
+    uint8_t rom[ SENSOR_MAX ][ 8 ];
+  } probes;
+};
+
+#endif // SENSOR_BUS_H
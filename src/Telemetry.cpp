@@ -0,0 +1,161 @@
+#include "Telemetry.h"
+#include "SdList.h"
+#include "RtcMem.h"
+#include "SdBlockDev.h"
+
+extern SdList sdl;
+
+Telemetry::Telemetry()
+{
+  memset( & q, 0, sizeof( q ));
+}
+
+// Get the queue left in RTC memory by the previous wake
+
+void Telemetry::begin()
+{
+  if( ! rtcLoad( RTC_SLOT_TELEM, & q, sizeof( q )) || q.count > TELEMETRY_RTC_SAMPLES )
+    memset( & q, 0, sizeof( q ));
+}
+
+// Queue a sample
+//
+// return:
+//    false if the queue is full and the card can't take it
+
+bool Telemetry::push( uint32_t time, float heightCm, float tempC )
+{
+  if( q.count == TELEMETRY_RTC_SAMPLES && ! spill())
+    return false;
+  TelemetrySample * p = & q.s[ q.count ++ ];
+  p->time = time;
+  p->height = (int16_t) constrain( heightCm * 10.0, -32768, 32767 );
+  p->temp = (int16_t) constrain( tempC * 100.0, -32768, 32767 );
+  return rtcSave( RTC_SLOT_TELEM, & q, sizeof( q ));
+}
+
+// Publish all the samples queued, oldest first
+//
+// return:
+//    number of samples published. Stops at the first batch not published.
+
+uint16_t Telemetry::flush( TelemetrySink * sink )
+{
+  uint8_t payload[ 4 + TELEMETRY_BATCH * sizeof( TelemetrySample ) ];
+  uint16_t n = 0;
+
+  if( pending() == 0 )
+    return 0;
+  if( q.spilled > 0 )
+  {
+    n = flushSpill( sink, payload );
+    if( q.spilled > 0 )
+      return n;
+  }
+  if( q.count > 0 )
+  {
+    memcpy( payload + 4, q.s, q.count * sizeof( TelemetrySample ));
+    if( send( sink, payload, q.count ))
+    {
+      n += q.count;
+      q.count = 0;
+      rtcSave( RTC_SLOT_TELEM, & q, sizeof( q ));
+    }
+  }
+  return n;
+}
+
+// Move the RTC queue to the end of the spill file
+//
+// The file starts with the number of bytes of samples already published.
+//
+// If the samples can't all be written, the file is cut back to its size
+//   before: the queue stays in RTC memory, and is spilled again by the
+//   next push(). Bytes left from a write that failed would be published
+//   twice.
+
+bool Telemetry::spill()
+{
+  SdFile f;
+  uint32_t sent = 0;
+  IoScope io( IO_OP_LOG );
+
+  if( ! sdl.openRootFile( & f, TELEMETRY_SPILL, O_RDWR | O_CREAT ))
+    return false;
+  uint32_t oldSize = f.fileSize();
+  uint32_t keep = oldSize;
+  bool ok = true;
+  if( oldSize < sizeof( sent ))
+  {
+    keep = 0;
+    ok = f.truncate( 0 ) && f.write( & sent, sizeof( sent )) == sizeof( sent );
+  }
+  ok = ok && f.seekEnd() &&
+       f.write( q.s, q.count * sizeof( TelemetrySample )) == q.count * sizeof( TelemetrySample ) &&
+       f.sync();
+  if( ! ok && f.fileSize() > keep )
+    f.truncate( keep );
+  sdl.sizeChanged( oldSize, f.fileSize());
+  ok = f.close() && ok;
+  if( ! ok )
+    return false;
+  q.spilled += q.count;
+  q.count = 0;
+  return rtcSave( RTC_SLOT_TELEM, & q, sizeof( q ));
+}
+
+// Publish the samples of the spill file, then empty it
+
+uint16_t Telemetry::flushSpill( TelemetrySink * sink, uint8_t * payload )
+{
+  SdFile f;
+  uint32_t sent;
+  uint16_t n = 0;
+  IoScope io( IO_OP_LOG );
+
+  if( ! sdl.openRootFile( & f, TELEMETRY_SPILL, O_RDWR ))
+  {
+    q.spilled = 0;             // lost with the file
+    return 0;
+  }
+  if( f.read( & sent, sizeof( sent )) != sizeof( sent ) ||
+      ! f.seekSet( sizeof( sent ) + sent ))
+    sent = f.fileSize();          // nothing to publish
+  while( sizeof( sent ) + sent < f.fileSize())
+  {
+    int16_t nb = f.read( payload + 4, TELEMETRY_BATCH * sizeof( TelemetrySample ));
+    uint8_t ns = nb > 0 ? nb / sizeof( TelemetrySample ) : 0;
+    if( ns == 0 || ! send( sink, payload, ns ))
+      break;
+    sent += ns * sizeof( TelemetrySample );
+    n += ns;
+    q.spilled = q.spilled > ns ? q.spilled - ns : 0;
+    // remember what was published, in case the next batch fails
+    if( ! f.seekSet( 0 ) || f.write( & sent, sizeof( sent )) != sizeof( sent ) ||
+        ! f.seekSet( sizeof( sent ) + sent ))
+      break;
+  }
+  if( sizeof( sent ) + sent >= f.fileSize())
+  {
+    // all published: keep only the header
+    uint32_t oldSize = f.fileSize();
+    sent = 0;
+    if( f.truncate( 0 ) && f.write( & sent, sizeof( sent )) == sizeof( sent ))
+      sdl.sizeChanged( oldSize, f.fileSize());
+    q.spilled = 0;
+  }
+  f.close();
+  rtcSave( RTC_SLOT_TELEM, & q, sizeof( q ));
+  return n;
+}
+
+// Publish n samples found at payload + 4
+
+bool Telemetry::send( TelemetrySink * sink, uint8_t * payload, uint8_t n )
+{
+  payload[ 0 ] = 'T';
+  payload[ 1 ] = TELEMETRY_VERSION;
+  payload[ 2 ] = n;
+  payload[ 3 ] = sizeof( TelemetrySample );
+  return sink->publish( payload, 4 + n * sizeof( TelemetrySample ));
+}
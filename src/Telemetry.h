@@ -0,0 +1,90 @@
+/*
+ * Queued, batched binary telemetry of the samples
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*******************************************************************************
+ **                                                                            **
+ **                      TELEMETRY QUEUE FOR DATALOGGER                        **
+ **                                                                            **
+ *******************************************************************************/
+
+// Each sample is queued as a record of 8 bytes in RTC memory, so the radio
+//   is not woken for each sample. When the RTC queue is full, it is moved
+//   to the end of a spill file on the card in a single write.
+//
+// When the network is up, flush() publishes the queue in batches of up to
+//   TELEMETRY_BATCH records, oldest first. A batch is:
+//     byte 0    : 'T'
+//     byte 1    : TELEMETRY_VERSION
+//     byte 2    : number of records
+//     byte 3    : size of a record
+//     then the records, little endian:
+//     uint32_t  : time, in seconds since 2000-01-01
+//     int16_t   : water height, in mm
+//     int16_t   : water temperature, in 1/100 C
+//
+// Batches go through a TelemetrySink, so that the transport (MQTT client,
+//   local broker stand-in, serial port) is chosen by the sketch.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "Arduino.h"
+
+#define TELEMETRY_VERSION     1
+#define TELEMETRY_RTC_SAMPLES 9             // samples queued in RTC memory
+#define TELEMETRY_BATCH       32            // max samples in one message
+#define TELEMETRY_SPILL       "TELEMQ.BIN"  // samples waiting on the card
+
+struct TelemetrySample
+{
+  uint32_t time;
+  int16_t  height;
+  int16_t  temp;
+};
+
+class TelemetrySink
+{
+public:
+  virtual bool publish( const uint8_t * payload, uint16_t len ) = 0;
+};
+
+class Telemetry
+{
+public:
+  Telemetry();
+
+  void     begin();
+  bool     push( uint32_t time, float heightCm, float tempC );
+  uint16_t flush( TelemetrySink * sink );
+  uint32_t pending() { return q.count + q.spilled; }
+
+private:
+  bool     spill();
+  uint16_t flushSpill( TelemetrySink * sink, uint8_t * payload );
+  bool     send( TelemetrySink * sink, uint8_t * payload, uint8_t n );
+
+  // Kept in RTC memory
+  struct Queue
+  {
+    uint16_t count;             // samples in s[]
+    uint16_t pad;
+    uint32_t spilled;           // samples in the spill file, not yet published
+    TelemetrySample s[ TELEMETRY_RTC_SAMPLES ];
+  } q;
+};
+
+#endif // TELEMETRY_H